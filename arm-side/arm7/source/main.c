@@ -37,6 +37,14 @@ static touchPosition touch;
 
 static uint8_t prev_backlights, new_backlights;
 
+/* The latest datamsg from the ARM9. In a global variable to avoid stack usage
+ * in fifo_datamsg_handler. */
+static union {
+	uint16_t command;
+	struct ipc_audio_start audio_start;
+	struct ipc_voice voice;
+} ipc_data;
+
 extern uint8_t arm7_loader;
 extern uint8_t arm7_loader_end;
 
@@ -72,6 +80,11 @@ void fifo_value_handler(uint32_t value, void* userdata)
 			new_backlights = (value & SET_BACKLIGHT_DATA_MASK) >> SET_BACKLIGHT_DATA_BIT;
 			break;
 
+		case IPC_STOP_AUDIO:
+			SCHANNEL_CR(0) = 0;
+			SCHANNEL_CR(1) = 0;
+			break;
+
 		case IPC_START_RESET:
 		{
 			reset_hardware();
@@ -121,6 +134,73 @@ void fifo_value_handler(uint32_t value, void* userdata)
 	}
 }
 
+static void start_audio(const struct ipc_audio_start* start)
+{
+	uint32_t format = start->is_16bit ? SOUND_FORMAT_16BIT : SOUND_FORMAT_8BIT;
+	unsigned int i, channels = start->is_stereo ? 2 : 1;
+
+	for (i = 0; i < channels; i++) {
+		SCHANNEL_CR(i) = 0;
+		SCHANNEL_SOURCE(i) = start->source[i];
+		SCHANNEL_TIMER(i) = start->timer;
+		SCHANNEL_REPEAT_POINT(i) = 0;
+		SCHANNEL_LENGTH(i) = start->length;
+	}
+
+	/* Start the channels back-to-back to keep them in step. */
+	if (start->is_stereo) {
+		SCHANNEL_CR(0) = SCHANNEL_ENABLE | SOUND_REPEAT | SOUND_VOL(0x7F) | SOUND_PAN(0) | format;
+		SCHANNEL_CR(1) = SCHANNEL_ENABLE | SOUND_REPEAT | SOUND_VOL(0x7F) | SOUND_PAN(0x7F) | format;
+	} else {
+		SCHANNEL_CR(0) = SCHANNEL_ENABLE | SOUND_REPEAT | SOUND_VOL(0x7F) | SOUND_PAN(0x40) | format;
+	}
+
+	fifoSendValue32(FIFO_USER_01, IPC_RPL_AUDIO_STARTED);
+}
+
+static void set_voice(const struct ipc_voice* voice)
+{
+	unsigned int channel = voice->channel;
+
+	if (voice->flags & IPC_VOICE_STOP) {
+		SCHANNEL_CR(channel) = 0;
+	} else if (voice->flags & IPC_VOICE_START) {
+		SCHANNEL_CR(channel) = 0;
+		SCHANNEL_SOURCE(channel) = voice->source;
+		SCHANNEL_TIMER(channel) = voice->timer;
+		SCHANNEL_REPEAT_POINT(channel) = voice->loop_start;
+		SCHANNEL_LENGTH(channel) = voice->length;
+		SCHANNEL_CR(channel) = SCHANNEL_ENABLE
+			| (voice->repeat ? SOUND_REPEAT : SOUND_ONE_SHOT)
+			| SOUND_VOL(voice->volume) | SOUND_PAN(voice->pan)
+			| ((uint32_t) voice->format << 29);
+	} else {
+		if (voice->flags & IPC_VOICE_SET_TIMER)
+			SCHANNEL_TIMER(channel) = voice->timer;
+		/* Volume and panning have their own bytes in SOUNDxCNT, so they can
+		 * be changed without restarting the channel. */
+		if (voice->flags & IPC_VOICE_SET_VOLUME) {
+			SCHANNEL_VOL(channel) = voice->volume;
+			SCHANNEL_PAN(channel) = voice->pan;
+		}
+	}
+}
+
+void fifo_datamsg_handler(int bytes, void* userdata)
+{
+	fifoGetDatamsg(FIFO_USER_01, sizeof(ipc_data), (uint8_t*) &ipc_data);
+
+	switch (ipc_data.command) {
+		case IPC_START_AUDIO:
+			start_audio(&ipc_data.audio_start);
+			break;
+
+		case IPC_SET_VOICE:
+			set_voice(&ipc_data.voice);
+			break;
+	}
+}
+
 /*
  * This handler sets the state of the Nintendo DS's backlights only once per
  * frame, if required. In addition to avoiding tearing on both screens, this
@@ -165,6 +245,7 @@ int main()
 	mmInstall(FIFO_MAXMOD);
 	installSystemFIFO();
 	fifoSetValue32Handler(FIFO_USER_01, fifo_value_handler, NULL);
+	fifoSetDatamsgHandler(FIFO_USER_01, fifo_datamsg_handler, NULL);
 
 	irqSet(IRQ_VBLANK, vblank_handler);
 	irqEnable(IRQ_VBLANK);
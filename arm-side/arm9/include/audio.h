@@ -37,6 +37,12 @@ extern bool audio_status_required;
  * >> to know how many samples fit in a certain number of bytes. */
 extern DTCM_BSS size_t audio_sample_size_shift;
 
+/* true if the samples in 'audio_buffer' are 16-bit; false if 8-bit. */
+extern DTCM_BSS bool audio_16bit;
+
+/* true if the samples in 'audio_buffer' have 2 channels; false if 1. */
+extern DTCM_BSS bool audio_stereo;
+
 /* The number of samples in 'audio_buffer'. This value is the size requested
  * on the wire plus 1, to allow the code to distinguish an empty ring buffer
  * from a full one. */
@@ -63,6 +69,10 @@ extern DTCM_BSS size_t audio_write_index;
  * from the head of the buffer. */
 extern DTCM_BSS uint16_t audio_consumed;
 
+/* true if audio is played on hardware sound channels by the ARM7 directly;
+ * false if it is streamed through maxmod. */
+extern DTCM_BSS bool audio_hw;
+
 /* Initialises the audio system. */
 extern void audio_init(void);
 
@@ -81,8 +91,16 @@ extern void audio_init(void);
  *   - true: Each sample is 2 values (16-bit or 8-bit) next to each other,
  *     first the one for the left channel, then the one for the right channel.
  *   - false: Each sample is 1 value (16-bit or 8-bit).
+ *   low_latency:
+ *   - true: Samples are copied into looping buffers played on hardware sound
+ *     channels by the ARM7, refilled every millisecond or so.
+ *   - false: Samples are streamed through maxmod.
  */
-extern void audio_start(uint16_t frequency, size_t buffer_size, bool is_16bit, bool is_stereo);
+extern void audio_start(uint16_t frequency, size_t buffer_size, bool is_16bit, bool is_stereo, bool low_latency);
+
+/* Called when the ARM7 has started playing audio on hardware sound channels,
+ * to start refilling their buffers in time with them. */
+extern void audio_hw_started(void);
 
 /* Stops a stream of PCM data. */
 extern void audio_stop(void);
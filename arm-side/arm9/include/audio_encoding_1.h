@@ -0,0 +1,34 @@
+/*
+ * This file is part of the DS communication library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIO_ENCODING_1_H
+#define AUDIO_ENCODING_1_H
+
+#include <stdint.h>
+
+/*
+ * Audio encoding 1 is IMA-ADPCM, used only for 16-bit audio. The ARM9 decodes
+ * it into 16-bit PCM in 'audio_buffer'.
+ *
+ * In:
+ *   header_1: The first header word, containing the meaningful byte count.
+ */
+void audio_encoding_1(uint32_t header_1);
+
+#endif /* !AUDIO_ENCODING_1_H */
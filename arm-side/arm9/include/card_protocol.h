@@ -85,9 +85,30 @@ struct __attribute__((packed, aligned (4))) card_command_hello {
 	uint8_t byte; /* = CARD_COMMAND_HELLO_BYTE */
 	uint8_t video_encodings_supported;
 	uint8_t audio_encodings_supported;
-	uint8_t reserved[5];
+	/* Number of Main Screen buffers the Nintendo DS can hold, from 3 to 4.
+	 * 0 if the Nintendo DS predates this field, in which case it holds 3. */
+	uint8_t main_buffers_supported;
+	/* Video features supported by the Nintendo DS beyond the video encodings,
+	 * as a combination of HELLO_VIDEO_* bits. 0 if the Nintendo DS predates
+	 * this field. */
+	uint8_t video_features_supported;
+	/* Audio features supported by the Nintendo DS beyond the audio encodings,
+	 * as a combination of HELLO_AUDIO_* bits. 0 if the Nintendo DS predates
+	 * this field. */
+	uint8_t audio_features_supported;
+	uint8_t reserved[2];
 };
 
+/* The Nintendo DS understands VIDEO_FIELD and VIDEO_LINE_DOUBLE. */
+#define HELLO_VIDEO_FIELDS (1 << 0)
+/* The Nintendo DS understands DATA_KIND_SPRITE and the sprite requests. */
+#define HELLO_VIDEO_SPRITES (1 << 1)
+/* The Nintendo DS understands DATA_KIND_TILES and the tile requests. */
+#define HELLO_VIDEO_TILES (1 << 2)
+
+/* The Nintendo DS understands DATA_KIND_SAMPLE and the voice requests. */
+#define HELLO_AUDIO_SAMPLES (1 << 0)
+
 struct __attribute__((packed, aligned (4))) card_command_input {
 	uint8_t byte; /* = CARD_COMMAND_INPUT_BYTE */
 	struct DS_InputState data;
@@ -154,6 +175,9 @@ struct __attribute__((packed, aligned (4))) card_reply_hello {
 #define DATA_KIND_AUDIO          (2 << DATA_KIND_BIT)
 #define DATA_KIND_REQUESTS       (3 << DATA_KIND_BIT)
 #define DATA_KIND_TEXT           (4 << DATA_KIND_BIT)
+#define DATA_KIND_SPRITE         (5 << DATA_KIND_BIT)
+#define DATA_KIND_TILES          (6 << DATA_KIND_BIT)
+#define DATA_KIND_SAMPLE         (7 << DATA_KIND_BIT)
 #define DATA_KIND_MIPS_ASSERT    (0xFD << DATA_KIND_BIT)
 #define DATA_KIND_MIPS_EXCEPTION (0xFE << DATA_KIND_BIT)
 /* Which encoding (compression, backwards compatibility mode, etc.) is being
@@ -190,8 +214,134 @@ struct __attribute__((packed, aligned (4))) card_reply_hello {
 /* Must the Main Screen buffer be flipped to the buffer in VIDEO_BUFFER_MASK
  * after this bit of video in order to ensure that the new data is shown? */
 #define VIDEO_END_FRAME    (1 << 12)
+/* If set, the pixels in this reply belong to a field: they are written only
+ * into even rows of the buffer, or odd rows if VIDEO_FIELD_ODD is also set,
+ * and VIDEO_PIXEL_OFFSET counts pixels in those rows only. Only valid with
+ * video encoding 0 on the Main Screen.
+ * If the reply has VIDEO_END_FRAME, and VIDEO_LINE_DOUBLE is not set, the
+ * Nintendo DS fills the rows of the other field from the last buffer that
+ * got a VIDEO_END_FRAME. */
+#define VIDEO_FIELD        (1 << 11)
+#define VIDEO_FIELD_ODD    (1 << 10)
 /* Used by certain video encodings that use palettes. */
 #define VIDEO_SET_PALETTE  (1 << 9)
+/* If set with VIDEO_FIELD, each row of the field is also written into the
+ * row of the other field next to it. */
+#define VIDEO_LINE_DOUBLE  (1 << 8)
+
+/* These definitions are for the second header word of sprite data. */
+
+/* At which pixel in the sprite's graphics does this reply start writing? */
+#define SPRITE_PIXEL_OFFSET_BIT  16
+#define SPRITE_PIXEL_OFFSET_MASK (0xFFFF << SPRITE_PIXEL_OFFSET_BIT)
+#define SPRITE_PIXEL_OFFSET(n)   ((uint32_t) (n) << SPRITE_PIXEL_OFFSET_BIT)
+/* Which sprite's graphics are being written? */
+#define SPRITE_INDEX_BIT         8
+#define SPRITE_INDEX_MASK        (0xFF << SPRITE_INDEX_BIT)
+#define SPRITE_INDEX(n)          ((uint32_t) (n) << SPRITE_INDEX_BIT)
+/* The shape and size of the sprite, as in bits 14-15 of the Nintendo DS's
+ * OAM attributes 0 and 1 respectively. */
+#define SPRITE_SHAPE_BIT         2
+#define SPRITE_SHAPE_MASK        (3 << SPRITE_SHAPE_BIT)
+#define SPRITE_SHAPE(n)          ((uint32_t) (n) << SPRITE_SHAPE_BIT)
+#define SPRITE_SIZE_BIT          0
+#define SPRITE_SIZE_MASK         (3 << SPRITE_SIZE_BIT)
+#define SPRITE_SIZE(n)           ((uint32_t) (n) << SPRITE_SIZE_BIT)
+
+/* Number of sprites that can be shown over the Sub Screen. Each sprite has
+ * room for 32x32 pixels of graphics. */
+#define SPRITE_COUNT 8
+
+/* These definitions are for the second header word of tile data. */
+
+/* At which byte in the target does this reply start writing? */
+#define TILE_OFFSET_BIT          16
+#define TILE_OFFSET_MASK         (0xFFFF << TILE_OFFSET_BIT)
+#define TILE_OFFSET(n)           ((uint32_t) (n) << TILE_OFFSET_BIT)
+/* Which of the tile graphics, the map or the palette is being written? */
+#define TILE_TARGET_MASK         3
+#define TILE_TARGET_GRAPHICS     0
+#define TILE_TARGET_MAP          1
+#define TILE_TARGET_PALETTE      2
+
+/* The sizes of the targets, in bytes. There are 1024 tiles of 8x8 pixels, at
+ * 4 or 8 bits per pixel, and up to 64x64 map entries of 16 bits. */
+#define TILE_GRAPHICS_BYTES      65536
+#define TILE_MAP_BYTES           8192
+#define TILE_PALETTE_BYTES       512
+
+/* These definitions are for the second header word of audio encoding 1. */
+
+/* How many samples does the IMA-ADPCM data in this reply decode to? */
+#define AUDIO_SAMPLE_COUNT_BIT   0
+#define AUDIO_SAMPLE_COUNT_MASK  (0x3FF << AUDIO_SAMPLE_COUNT_BIT)
+#define AUDIO_SAMPLE_COUNT(n)    ((uint32_t) (n) << AUDIO_SAMPLE_COUNT_BIT)
+
+/* These definitions are for the second header word of sample data. */
+
+/* At which byte in the sample does this reply start writing? */
+#define SAMPLE_OFFSET_BIT        8
+#define SAMPLE_OFFSET_MASK       (0xFFFFFF << SAMPLE_OFFSET_BIT)
+#define SAMPLE_OFFSET(n)         ((uint32_t) (n) << SAMPLE_OFFSET_BIT)
+/* Which sample is being written? */
+#define SAMPLE_INDEX_BIT         1
+#define SAMPLE_INDEX_MASK        (0x7F << SAMPLE_INDEX_BIT)
+#define SAMPLE_INDEX(n)          ((uint32_t) (n) << SAMPLE_INDEX_BIT)
+/* If set, this reply contains a card_sample_define instead of sample data,
+ * and SAMPLE_OFFSET is 0. */
+#define SAMPLE_DEFINE            (1 << 0)
+
+/* Number of samples that can be held by the Nintendo DS, and the total size
+ * of their data in bytes. */
+#define SAMPLE_COUNT 64
+#define SAMPLE_MEMORY_BYTES      1048576
+
+/* Formats of sample data, as played by the sound hardware. */
+#define SAMPLE_FORMAT_PCM8       0  /* signed 8-bit PCM */
+#define SAMPLE_FORMAT_PCM16      1  /* signed little-endian 16-bit PCM */
+#define SAMPLE_FORMAT_ADPCM      2  /* IMA-ADPCM, with a 4-byte header */
+
+/* Number of voices that can play samples at once, on hardware sound
+ * channels 8 to 15. */
+#define VOICE_COUNT 8
+
+/* Flags for card_voice. */
+#define VOICE_START              (1 << 0)  /* start 'sample' from its start */
+#define VOICE_STOP               (1 << 1)  /* stop the voice */
+#define VOICE_SET_FREQUENCY      (1 << 2)  /* apply 'frequency' */
+#define VOICE_SET_VOLUME         (1 << 3)  /* apply 'volume' and 'pan' */
+
+struct __attribute__((packed, aligned (4))) card_sample_define {
+	uint32_t length;       /* in bytes, a multiple of 4; 0 to free the sample */
+	uint32_t loop_start;   /* in bytes, a multiple of 4; >= length if none */
+	uint8_t format;        /* SAMPLE_FORMAT_* */
+	uint8_t reserved[3];
+};
+
+struct __attribute__((packed)) card_voice {
+	uint8_t flags;         /* VOICE_* */
+	uint8_t sample;        /* sample to play, with VOICE_START */
+	uint8_t volume;        /* 0 to 127, with VOICE_START or VOICE_SET_VOLUME */
+	uint8_t pan;           /* 0 (left) to 127 (right) */
+	uint32_t frequency;    /* in Hz, with VOICE_START or VOICE_SET_FREQUENCY */
+};
+
+struct __attribute__((packed)) card_sprite {
+	int16_t x;             /* position of the sprite's upper-left corner */
+	int16_t y;
+	uint8_t visible;       /* 1 if the sprite is shown */
+	uint8_t reserved;
+};
+
+/* Audio encoding 1 data starts with one of these per channel, left first,
+ * giving the IMA-ADPCM decoder state before the first sample of the reply.
+ * 4-bit codes follow, low nibble first; for stereo audio, the codes for the
+ * left and right channels alternate. */
+struct __attribute__((packed)) card_adpcm_state {
+	int16_t predictor;
+	uint8_t step_index;    /* 0 to 88 */
+	uint8_t reserved;
+};
 
 struct __attribute__((packed, aligned (4))) card_reply_mips_assert {
 	uint32_t line;
@@ -256,7 +406,18 @@ struct __attribute__((packed, aligned (4))) card_reply_requests {
 	uint8_t reset;         /* 1 to initiate a reset sequence */
 	uint8_t sleep;         /* 1 to make the Nintendo DS sleep */
 	uint8_t shutdown;      /* 1 to shut down the Nintendo DS */
-	uint8_t reserved[493];
+	uint8_t change_sprites; /* bit n set if sprites[n] is to be applied */
+	struct card_sprite sprites[SPRITE_COUNT];
+	uint8_t change_tile_mode; /* 1 if the DS should clear and display tiles */
+	uint8_t tile_map_size; /*    0 = 32x32 tiles, 1 = 64x32, 2 = 32x64, 3 = 64x64 */
+	uint8_t tile_8bpp;     /*    1 if tiles have 256 colors, 0 if 16 colors */
+	uint8_t change_tile_scroll; /* 1 if the DS should scroll the tile map */
+	uint16_t tile_scroll_x; /*   map pixel shown at the upper-left corner */
+	uint16_t tile_scroll_y;
+	uint8_t audio_low_latency; /* with start_audio, 1 to use hardware channels */
+	uint8_t change_voices; /* bit n set if voices[n] is to be applied */
+	struct card_voice voices[VOICE_COUNT];
+	uint8_t reserved[370];
 };
 
 union card_reply_4 {
@@ -0,0 +1,46 @@
+/*
+ * This file is part of the DS communication library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "card_protocol.h"
+
+/* Processes a reply containing a sample definition or sample data from the
+ * Supercard.
+ *
+ * In:
+ *   header_1: The first header word, containing the meaningful byte count.
+ *   header_2: The second header word, containing the sample and offset.
+ */
+extern void sample_data(uint32_t header_1, uint32_t header_2);
+
+/* Applies a change to a voice requested by the Supercard, by forwarding it to
+ * the ARM7, which owns the hardware sound channels.
+ *
+ * In:
+ *   voice: The voice to be changed, from 0 to VOICE_COUNT - 1.
+ *   data: The requested change.
+ */
+extern void set_voice(size_t voice, const struct card_voice* data);
+
+#endif /* !SAMPLES_H */
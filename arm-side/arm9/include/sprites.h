@@ -0,0 +1,53 @@
+/*
+ * This file is part of the DS communication library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPRITES_H
+#define SPRITES_H
+
+#include <stdint.h>
+
+#include "card_protocol.h"
+
+/* Maps VRAM bank I as Sub Screen sprite memory and hides all sprites. */
+extern void sprites_init(void);
+
+/* Processes a reply containing sprite graphics from the Supercard, writing
+ * them into sprite memory.
+ *
+ * In:
+ *   header_1: The first header word, containing the meaningful byte count.
+ *   header_2: The second header word, containing the sprite, pixel offset,
+ *     shape and size.
+ */
+extern void sprite_graphics(uint32_t header_1, uint32_t header_2);
+
+/* Sets the position and visibility of a sprite, to be applied at the next
+ * VBlank. Must be called with interrupts disabled.
+ *
+ * In:
+ *   sprite: 0 to SPRITE_COUNT - 1.
+ *   data: The new position and visibility of the sprite.
+ */
+extern void set_sprite(unsigned int sprite, const struct card_sprite* data);
+
+/* Called by the VBlank handler. Writes changes to sprites into OAM, if there
+ * are any. */
+extern void apply_pending_sprites(void);
+
+#endif /* !SPRITES_H */
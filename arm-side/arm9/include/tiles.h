@@ -0,0 +1,55 @@
+/*
+ * This file is part of the DS communication library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILES_H
+#define TILES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Sets up background 1 of the Sub Screen for tiles, clears the tile graphics
+ * and the map, and makes the Sub Screen display tiles.
+ *
+ * In:
+ *   map_size: 0 for a map of 32x32 tiles, 1 for 64x32, 2 for 32x64 or 3 for
+ *     64x64.
+ *   is_8bpp: true if tiles use 256 colors; false if they use 16 colors out
+ *     of one of 16 palettes.
+ */
+extern void set_tile_mode(uint8_t map_size, bool is_8bpp);
+
+/* Processes a reply containing tile graphics, map entries or palette entries
+ * from the Supercard. The Sub Screen must be displaying tiles.
+ *
+ * In:
+ *   header_1: The first header word, containing the meaningful byte count.
+ *   header_2: The second header word, containing the target and offset.
+ */
+extern void tile_data(uint32_t header_1, uint32_t header_2);
+
+/* Sets the map pixel to be shown at the upper-left corner of the Sub Screen
+ * from the next VBlank on. Must be called with interrupts disabled.
+ */
+extern void set_tile_scroll(uint16_t x, uint16_t y);
+
+/* Called by the VBlank handler. Applies a pending tile scroll, if there is
+ * one. */
+extern void apply_pending_tile_scroll(void);
+
+#endif /* !TILES_H */
@@ -24,14 +24,30 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-/* Main screen buffers. There are three, so page flipping can be used. */
-extern DTCM_BSS uint16_t* video_main[3];
+/* Number of Main Screen buffers that the Supercard may use. Buffers 0 to 2
+ * are in VRAM banks A, B and D; buffer 3 is in VRAM banks E, F and G. */
+#define MAIN_BUFFER_COUNT 4
+
+/* Main screen buffers. There are several, so page flipping can be used.
+ * The address of buffer 3 changes when it's displayed; see set_main_buffer. */
+extern DTCM_BSS uint16_t* video_main[MAIN_BUFFER_COUNT];
 
 /* Sub screen buffer. Page flipping cannot be used. */
 extern DTCM_BSS uint16_t* video_sub;
 
-/* true if the Sub Screen is graphics; false if it's text. */
-extern DTCM_BSS bool video_sub_graphics;
+enum sub_mode {
+	SUB_MODE_TEXT,
+	SUB_MODE_GRAPHICS,
+	SUB_MODE_TILES
+};
+
+/* What the Sub Screen is displaying. */
+extern DTCM_BSS enum sub_mode video_sub_mode;
+
+/* The palette used by tiles on the Sub Screen. It's copied to the Sub
+ * Screen's background palette whenever the Sub Screen displays tiles, since
+ * the text console uses that palette too. */
+extern uint16_t video_sub_palette[256];
 
 /* Index of the Main Screen buffer last set by set_main_buffer. */
 extern uint8_t video_main_current;
@@ -39,11 +55,11 @@ extern uint8_t video_main_current;
 /* Indexing this array yields the palette to be used to display a given Main
  * Screen buffer. Elements are meaningful only if set_main_buffer_palette is
  * first called for the buffer with a value of true. */
-uint16_t video_main_palette[3][256];
+uint16_t video_main_palette[MAIN_BUFFER_COUNT][256];
 
 /* Sets the currently-displayed Main Screen buffer.
  * In:
- *   buffer: 0 to 2.
+ *   buffer: 0 to MAIN_BUFFER_COUNT - 1.
  */
 extern void set_main_buffer(uint8_t buffer);
 
@@ -51,7 +67,7 @@ extern void set_main_buffer(uint8_t buffer);
  * is stored in video_main_palette[buffer] and is copied when flipping to the
  * buffer.
  * In:
- *   buffer: 0 to 2.
+ *   buffer: 0 to MAIN_BUFFER_COUNT - 1.
  *   value: true if the given buffer is to use a palette; false if it's to be
  *     a 16-bit background.
  */
@@ -68,6 +84,11 @@ extern void set_sub_graphics(void);
  * was already displaying text. */
 extern void set_sub_text(void);
 
+/* Sets the Sub Screen to be displaying tiles on background 1, which is set up
+ * by set_tile_mode. No operation if the screen was already displaying
+ * tiles. */
+extern void set_sub_tiles(void);
+
 /* Called by the VBlank handler. Applies a pending flip operation on the Main
  * Screen, if there is one, and requests notification to the Supercard. */
 extern void apply_pending_flip();
@@ -79,6 +100,21 @@ extern void apply_pending_flip();
  */
 extern void add_pending_flip(unsigned int buffer);
 
+/* Fills the rows of a Main Screen buffer that are not in the given field
+ * from the buffer that was last to receive a complete frame. If that buffer
+ * can't be used, the rows of the given field are doubled instead.
+ *
+ * Must be called before add_pending_flip is called for the same buffer, by
+ * the code that calls add_pending_flip. Interrupts may be enabled, because
+ * the buffer is not displayed yet.
+ *
+ * In:
+ *   buffer: The Main Screen buffer that has just received a field.
+ *   odd: true if the field that was received is made of the odd rows;
+ *     false if it's made of the even rows.
+ */
+extern void fill_other_field(uint8_t buffer, bool odd);
+
 /* Called by the VBlank handler. Applies a pending screen swap operation, if
  * there is one. */
 extern void apply_pending_swap();
@@ -34,4 +34,16 @@
  */
 void video_encoding_0(uint32_t header_1, uint16_t* dest, size_t max_pixels);
 
+/*
+ * Receives uncompressed video for one field of a Main Screen buffer, i.e.
+ * either its even rows or its odd rows.
+ *
+ * In:
+ *   header_1: The first header word, containing the meaningful byte count.
+ *   header_2: The second header word, containing the pixel offset within the
+ *     field and the VIDEO_FIELD_ODD and VIDEO_LINE_DOUBLE bits.
+ *   screen: Pointer to the first pixel of the Main Screen buffer.
+ */
+void video_encoding_0_field(uint32_t header_1, uint32_t header_2, uint16_t* screen);
+
 #endif /* !VIDEO_ENCODING_0_H */
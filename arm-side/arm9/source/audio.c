@@ -24,14 +24,25 @@
 
 #include "audio.h"
 #include "card_protocol.h"
+#include "common_ipc.h"
 #include "main.h"
 
+/* The timer that overflows once per sample played on hardware sound channels,
+ * and the timer that counts those overflows to request an interrupt once per
+ * half of their looping buffers. */
+#define AUDIO_HW_SAMPLE_TIMER 2
+#define AUDIO_HW_HALF_TIMER   3
+
 bool audio_started;
 
 bool audio_status_required;
 
 DTCM_BSS size_t audio_sample_size_shift;
 
+DTCM_BSS bool audio_16bit;
+
+DTCM_BSS bool audio_stereo;
+
 DTCM_BSS size_t audio_buffer_samples;
 
 DTCM_BSS uint8_t* audio_buffer;
@@ -42,6 +53,27 @@ DTCM_BSS size_t audio_write_index;
 
 DTCM_BSS uint16_t audio_consumed;
 
+DTCM_BSS bool audio_hw;
+
+/* The looping buffers played by hardware sound channels: two halves for the
+ * left or mono channel, then two halves for the right channel if stereo.
+ * While the hardware plays one half, the other is refilled. */
+static DTCM_BSS uint8_t* audio_hw_buffer;
+
+/* The number of samples in each half of each channel's buffer. */
+static DTCM_BSS size_t audio_hw_half_samples;
+
+/* The half of each channel's buffer to be refilled at the next interrupt. */
+static DTCM_BSS size_t audio_hw_next_half;
+
+/* The reload value of AUDIO_HW_SAMPLE_TIMER for the sampling rate. */
+static DTCM_BSS uint16_t audio_hw_timer_reload;
+
+/* The number of starts requested from the ARM7 that it has not yet replied
+ * to. The timers are only started after the reply to the last one, so that
+ * they run slightly behind the hardware sound channels. */
+static DTCM_BSS size_t audio_hw_pending_starts;
+
 void audio_init()
 {
 	mm_ds_system initdata;
@@ -100,7 +132,136 @@ static mm_word audio_update(mm_word length, mm_addr dest, mm_stream_formats form
 	return length;
 }
 
-void audio_start(uint16_t frequency, size_t buffer_size, bool is_16bit, bool is_stereo)
+/* Refills one half of each channel's hardware buffer with samples from
+ * 'audio_buffer', or silence after its last sample. */
+static void audio_hw_fill(size_t half)
+{
+	size_t channels = audio_stereo ? 2 : 1;
+	size_t half_bytes = audio_hw_half_samples << (audio_16bit ? 1 : 0);
+	size_t samples, i, c;
+
+	if (audio_write_index >= audio_read_index)
+		samples = audio_write_index - audio_read_index;
+	else
+		samples = audio_buffer_samples - (audio_read_index - audio_write_index);
+	if (samples > audio_hw_half_samples)
+		samples = audio_hw_half_samples;
+
+	for (c = 0; c < channels; c++) {
+		uint8_t* dest = &audio_hw_buffer[(2 * c + half) * half_bytes];
+		size_t index = audio_read_index;
+
+		if (audio_16bit) {
+			const int16_t* src = (const int16_t*) audio_buffer;
+			int16_t* dest_16 = (int16_t*) dest;
+
+			for (i = 0; i < samples; i++) {
+				dest_16[i] = src[index * channels + c];
+				index = add_wrap_fast(index, 1, audio_buffer_samples);
+			}
+			for (; i < audio_hw_half_samples; i++)
+				dest_16[i] = 0;
+		} else {
+			/* The hardware plays signed 8-bit PCM. */
+			for (i = 0; i < samples; i++) {
+				dest[i] = audio_buffer[index * channels + c] ^ 0x80;
+				index = add_wrap_fast(index, 1, audio_buffer_samples);
+			}
+			for (; i < audio_hw_half_samples; i++)
+				dest[i] = 0;
+		}
+
+		/* The ARM7 reads the buffer from main RAM, not from our cache. */
+		DC_FlushRange(dest, half_bytes);
+	}
+
+	if (samples > 0) {
+		audio_read_index = add_wrap_fast(audio_read_index, samples, audio_buffer_samples);
+		audio_consumed += samples;
+		add_pending_send(PENDING_SEND_AUDIO_CONSUMED);
+	}
+}
+
+/* Called when the hardware sound channels have just finished playing a half
+ * of their buffers, so that it can be refilled while they play the other. */
+static void audio_hw_timer_handler(void)
+{
+	audio_hw_fill(audio_hw_next_half);
+	audio_hw_next_half ^= 1;
+}
+
+void audio_hw_started()
+{
+	if (audio_hw_pending_starts > 0)
+		audio_hw_pending_starts--;
+
+	if (audio_hw_pending_starts == 0 && audio_hw && audio_started) {
+		TIMER_DATA(AUDIO_HW_SAMPLE_TIMER) = audio_hw_timer_reload;
+		TIMER_DATA(AUDIO_HW_HALF_TIMER) = 0x10000 - audio_hw_half_samples;
+		TIMER_CR(AUDIO_HW_HALF_TIMER) = TIMER_ENABLE | TIMER_CASCADE | TIMER_IRQ_REQ;
+		TIMER_CR(AUDIO_HW_SAMPLE_TIMER) = TIMER_ENABLE | TIMER_DIV_1;
+	}
+}
+
+static void audio_hw_start(uint16_t frequency, bool is_16bit, bool is_stereo)
+{
+	struct ipc_audio_start start;
+	size_t channel_bytes;
+	/* The sound hardware's clock runs at half the bus clock, which drives the
+	 * ARM9's timers. */
+	uint32_t period = 0x1000000 / frequency;
+
+	/* Refill every millisecond or so, in multiples of a word of 8-bit
+	 * samples, but not in too short bursts for the interrupt load. */
+	audio_hw_half_samples = ((frequency + 999) / 1000 + 3) & ~3;
+	if (audio_hw_half_samples < 16)
+		audio_hw_half_samples = 16;
+	audio_hw_next_half = 0;
+	audio_hw_timer_reload = 0x10000 - 2 * period;
+
+	channel_bytes = (2 * audio_hw_half_samples) << (is_16bit ? 1 : 0);
+	audio_hw_buffer = malloc(channel_bytes * (is_stereo ? 2 : 1));
+	memset(audio_hw_buffer, 0, channel_bytes * (is_stereo ? 2 : 1));
+	DC_FlushRange(audio_hw_buffer, channel_bytes * (is_stereo ? 2 : 1));
+
+	start.command = IPC_START_AUDIO;
+	start.reserved[0] = start.reserved[1] = 0;
+	start.source[0] = (uint32_t) audio_hw_buffer;
+	start.source[1] = (uint32_t) audio_hw_buffer + channel_bytes;
+	start.length = channel_bytes / 4;
+	start.timer = 0x10000 - period;
+	start.is_16bit = is_16bit ? 1 : 0;
+	start.is_stereo = is_stereo ? 1 : 0;
+
+	irqSet(IRQ_TIMER(AUDIO_HW_HALF_TIMER), audio_hw_timer_handler);
+	irqEnable(IRQ_TIMER(AUDIO_HW_HALF_TIMER));
+
+	audio_hw_pending_starts++;
+	REG_IME = IME_ENABLE;  /* must be enabled for FIFO communications */
+	fifoSendDatamsg(FIFO_USER_01, sizeof(start), (uint8_t*) &start);
+	REG_IME = IME_DISABLE;
+}
+
+static void audio_hw_stop(void)
+{
+	size_t buffer_bytes = ((2 * audio_hw_half_samples) << (audio_16bit ? 1 : 0)) * (audio_stereo ? 2 : 1);
+
+	TIMER_CR(AUDIO_HW_SAMPLE_TIMER) = 0;
+	TIMER_CR(AUDIO_HW_HALF_TIMER) = 0;
+	irqDisable(IRQ_TIMER(AUDIO_HW_HALF_TIMER));
+
+	REG_IME = IME_ENABLE;  /* must be enabled for FIFO communications */
+	fifoSendValue32(FIFO_USER_01, IPC_STOP_AUDIO);
+	REG_IME = IME_DISABLE;
+
+	/* The hardware may play on for a moment before the ARM7 stops it. */
+	memset(audio_hw_buffer, 0, buffer_bytes);
+	DC_FlushRange(audio_hw_buffer, buffer_bytes);
+	free(audio_hw_buffer);
+	audio_hw_buffer = NULL;
+}
+
+void audio_start(uint16_t frequency, size_t buffer_size, bool is_16bit, bool is_stereo, bool low_latency)
 {
 	mm_stream streamdata;
 
@@ -108,6 +269,26 @@ void audio_start(uint16_t frequency, size_t buffer_size, bool is_16bit, bool is_
 		audio_stop();
 	}
 
+	audio_sample_size_shift = (is_stereo ? 1 : 0) + (is_16bit ? 1 : 0);
+	audio_16bit = is_16bit;
+	audio_stereo = is_stereo;
+
+	audio_buffer_samples = buffer_size + 1;
+	audio_buffer = malloc(audio_buffer_samples << audio_sample_size_shift);
+	audio_read_index = audio_write_index = 0;
+
+	/* Under 512 Hz, a sample lasts longer than AUDIO_HW_SAMPLE_TIMER can
+	 * count. */
+	audio_hw = low_latency && frequency >= 512;
+	if (audio_hw) {
+		audio_hw_start(frequency, is_16bit, is_stereo);
+		audio_started = true;
+		if (audio_status_required) {
+			add_pending_send(PENDING_SEND_AUDIO_STATUS);
+		}
+		return;
+	}
+
 	streamdata.sampling_rate = frequency;
 	/* This buffer size calculation is based on the interrupt load that the
 	 * ARM9 and ARM7 can sustain, as well as the FIFO load that is required
@@ -126,12 +307,6 @@ void audio_start(uint16_t frequency, size_t buffer_size, bool is_16bit, bool is_
 	                  ? (is_16bit ? MM_STREAM_16BIT_STEREO : MM_STREAM_8BIT_STEREO)
 	                  : (is_16bit ? MM_STREAM_16BIT_MONO : MM_STREAM_8BIT_MONO);
 
-	audio_sample_size_shift = (is_stereo ? 1 : 0) + (is_16bit ? 1 : 0);
-
-	audio_buffer_samples = buffer_size + 1;
-	audio_buffer = malloc(audio_buffer_samples << audio_sample_size_shift);
-	audio_read_index = audio_write_index = 0;
-
 	REG_IME = IME_ENABLE;  /* must be enabled for maxmod communications */
 	mmStreamOpen(&streamdata);
 	REG_IME = IME_DISABLE;
@@ -144,9 +319,14 @@ void audio_start(uint16_t frequency, size_t buffer_size, bool is_16bit, bool is_
 
 void audio_stop()
 {
-	REG_IME = IME_ENABLE;  /* must be enabled for maxmod communications */
-	mmStreamClose();
-	REG_IME = IME_DISABLE;
+	if (audio_hw) {
+		audio_hw_stop();
+		audio_hw = false;
+	} else {
+		REG_IME = IME_ENABLE;  /* must be enabled for maxmod communications */
+		mmStreamClose();
+		REG_IME = IME_DISABLE;
+	}
 
 	remove_pending_send(PENDING_SEND_AUDIO_CONSUMED);
 	audio_consumed = 0;
@@ -0,0 +1,117 @@
+/*
+ * This file is part of the DS communication library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nds.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "audio.h"
+#include "audio_encoding_1.h"
+#include "card_protocol.h"
+
+static const int16_t adpcm_step_table[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t adpcm_index_table[8] = {
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+void audio_encoding_1(uint32_t header_1)
+{
+	size_t bytes = (header_1 & DATA_BYTE_COUNT_MASK) >> DATA_BYTE_COUNT_BIT;
+	union card_reply_512 reply_512;
+	size_t channels = audio_stereo ? 2 : 1, state_bytes, samples, used;
+	int predictor[2], step_index[2];
+	const uint8_t* codes;
+	int16_t* dest = (int16_t*) audio_buffer;
+	size_t i, c, n = 0, write;
+
+	REG_IME = IME_ENABLE;
+	uint32_t header_2 = card_read_word(false);
+	if (bytes > 504) {
+		fatal_link_error("Audio encoding 1 data is\nlarger than a reply\n\nSize received: %zu", bytes);
+	}
+	card_read_data((bytes + 3) & ~3, &reply_512, false);
+	card_ignore_reply();
+	REG_IME = IME_DISABLE;
+
+	if (!audio_16bit) {
+		fatal_link_error("Supercard attempted to use\naudio encoding 1 on 8-bit\naudio");
+	}
+
+	samples = (header_2 & AUDIO_SAMPLE_COUNT_MASK) >> AUDIO_SAMPLE_COUNT_BIT;
+	state_bytes = channels * sizeof(struct card_adpcm_state);
+	if (bytes < state_bytes + (samples * channels + 1) / 2) {
+		fatal_link_error("Audio encoding 1 data is too\nshort for its sample count\n\nSize received: %zu\nSamples: %zu", bytes, samples);
+	}
+
+	used = audio_write_index >= audio_read_index
+	     ? audio_write_index - audio_read_index
+	     : audio_buffer_samples - (audio_read_index - audio_write_index);
+	if (samples > audio_buffer_samples - 1 - used) {
+		fatal_link_error("Supercard sent enough audio to\ncause a buffer overrun that\nbehaves like an underrun");
+	}
+
+	for (c = 0; c < channels; c++) {
+		const struct card_adpcm_state* state = (const struct card_adpcm_state*) &reply_512.bytes[c * sizeof(struct card_adpcm_state)];
+		if (state->step_index > 88) {
+			fatal_link_error("Supercard sent an invalid\nIMA-ADPCM step index: %" PRIu8, state->step_index);
+		}
+		predictor[c] = state->predictor;
+		step_index[c] = state->step_index;
+	}
+	codes = &reply_512.bytes[state_bytes];
+
+	write = audio_write_index;
+	for (i = 0; i < samples; i++) {
+		for (c = 0; c < channels; c++, n++) {
+			unsigned int code = (codes[n >> 1] >> ((n & 1) * 4)) & 0xF;
+			int step = adpcm_step_table[step_index[c]];
+			int delta = step >> 3;
+
+			if (code & 4) delta += step;
+			if (code & 2) delta += step >> 1;
+			if (code & 1) delta += step >> 2;
+			predictor[c] += (code & 8) ? -delta : delta;
+			if (predictor[c] > INT16_MAX)
+				predictor[c] = INT16_MAX;
+			else if (predictor[c] < INT16_MIN)
+				predictor[c] = INT16_MIN;
+
+			step_index[c] += adpcm_index_table[code & 7];
+			if (step_index[c] < 0)
+				step_index[c] = 0;
+			else if (step_index[c] > 88)
+				step_index[c] = 88;
+
+			dest[write * channels + c] = predictor[c];
+		}
+		write = add_wrap_fast(write, 1, audio_buffer_samples);
+	}
+	audio_write_index = write;
+}
@@ -25,13 +25,17 @@
 
 #include "audio.h"
 #include "audio_encoding_0.h"
+#include "audio_encoding_1.h"
 #include "card_protocol.h"
 #include "common_ipc.h"
 #include "main.h"
 #include "mips_assert.h"
 #include "mips_except.h"
 #include "requests.h"
+#include "samples.h"
+#include "sprites.h"
 #include "text_encoding_0.h"
+#include "tiles.h"
 #include "video.h"
 #include "video_encoding_0.h"
 #include "video_encoding_1.h"
@@ -56,7 +60,7 @@
 #define ROMCTRL_USUAL_FLAGS 0xA0180010
 
 #define ARM_VIDEO_ENCODINGS 2
-#define ARM_AUDIO_ENCODINGS 1
+#define ARM_AUDIO_ENCODINGS 2
 
 #define VBLANK_LAG_MAX 5
 
@@ -293,6 +297,9 @@ void link_establishment_protocol()
 	command.hello.byte = CARD_COMMAND_HELLO_BYTE;
 	command.hello.video_encodings_supported = ARM_VIDEO_ENCODINGS;
 	command.hello.audio_encodings_supported = ARM_AUDIO_ENCODINGS;
+	command.hello.main_buffers_supported = MAIN_BUFFER_COUNT;
+	command.hello.video_features_supported = HELLO_VIDEO_FIELDS | HELLO_VIDEO_SPRITES | HELLO_VIDEO_TILES;
+	command.hello.audio_features_supported = HELLO_AUDIO_SAMPLES;
 	memset(command.hello.reserved, 0, sizeof(command.hello.reserved));
 
 	card_send_command(&command, 512);
@@ -353,8 +360,8 @@ void process_send_queue()
 			fatal_link_error("Supercard sent video data that\ndoes not start on an even pixel");
 		} else if (!is_main && buffer != 0) {
 			fatal_link_error("Supercard attempted to use\nmultiple buffering on the\nSub Screen");
-		} else if (is_main && buffer > 2) {
-			fatal_link_error("Supercard attempted to use\nquadruple buffering on the\nMain Screen");
+		} else if (is_main && buffer >= MAIN_BUFFER_COUNT) {
+			fatal_link_error("Supercard attempted to use\nMain Screen buffer %" PRIu8, buffer);
 		}
 
 		if (!is_main)
@@ -362,12 +369,26 @@ void process_send_queue()
 
 		max_pixels = SCREEN_WIDTH * SCREEN_HEIGHT - pixel_offset;
 
+		if (is_main && buffer == 3) {
+			/* Main Screen buffer 3 moves when the VBlank handler flips to it
+			 * or away from it. Keep interrupts disabled while its address is
+			 * used, so that the data lands in the right place. */
+			REG_IME = IME_DISABLE;
+		}
+
 		switch (encoding) {
 		case 0:
 			if (is_main)
 				set_main_buffer_palette(buffer, false);
-			dest = (is_main ? video_main[buffer] : video_sub) + pixel_offset;
-			video_encoding_0(header, dest, max_pixels);
+			if (header_2 & VIDEO_FIELD) {
+				if (!is_main) {
+					fatal_link_error("Supercard attempted to send\na field to the Sub Screen");
+				}
+				video_encoding_0_field(header, header_2, video_main[buffer]);
+			} else {
+				dest = (is_main ? video_main[buffer] : video_sub) + pixel_offset;
+				video_encoding_0(header, dest, max_pixels);
+			}
 			break;
 		case 1:
 			if (!is_main) {
@@ -385,8 +406,14 @@ void process_send_queue()
 			fatal_link_error("Supercard sent video data using\nunsupported encoding %" PRIu8, encoding);
 			break;
 		}
+		REG_IME = IME_ENABLE;
 
 		if (is_main && (header_2 & VIDEO_END_FRAME)) {
+			/* The buffer isn't queued for display yet, and only this code
+			 * changes which buffer was queued last, so interrupts may come
+			 * while the other field is filled in. */
+			if ((header_2 & (VIDEO_FIELD | VIDEO_LINE_DOUBLE)) == VIDEO_FIELD)
+				fill_other_field(buffer, (header_2 & VIDEO_FIELD_ODD) != 0);
 			REG_IME = IME_DISABLE;
 			add_pending_flip(buffer);
 			REG_IME = IME_ENABLE;
@@ -406,9 +433,53 @@ void process_send_queue()
 		}
 		break;
 
+	case DATA_KIND_SPRITE:
+	{
+		REG_IME = IME_ENABLE;
+		uint32_t header_2 = card_read_word(false);
+
+		switch (encoding) {
+		case 0:   sprite_graphics(header, header_2); break;
+		default:
+			fatal_link_error("Supercard sent sprite graphics\nusing unsupported encoding %" PRIu8, encoding);
+			break;
+		}
+		break;
+	}
+
+	case DATA_KIND_TILES:
+	{
+		REG_IME = IME_ENABLE;
+		uint32_t header_2 = card_read_word(false);
+		set_sub_tiles();
+
+		switch (encoding) {
+		case 0:   tile_data(header, header_2); break;
+		default:
+			fatal_link_error("Supercard sent tile data using\nunsupported encoding %" PRIu8, encoding);
+			break;
+		}
+		break;
+	}
+
+	case DATA_KIND_SAMPLE:
+	{
+		REG_IME = IME_ENABLE;
+		uint32_t header_2 = card_read_word(false);
+
+		switch (encoding) {
+		case 0:   sample_data(header, header_2); break;
+		default:
+			fatal_link_error("Supercard sent sample data using\nunsupported encoding %" PRIu8, encoding);
+			break;
+		}
+		break;
+	}
+
 	case DATA_KIND_AUDIO:
 		switch (encoding) {
 		case 0:   audio_encoding_0(header); break;
+		case 1:   audio_encoding_1(header); break;
 		default:
 			fatal_link_error("Supercard sent audio data using\nunsupported encoding %" PRIu8, encoding);
 			break;
@@ -25,7 +25,9 @@
 #include "card_protocol.h"
 #include "common_ipc.h"
 #include "main.h"
+#include "sprites.h"
 #include "structs.h"
+#include "tiles.h"
 #include "video.h"
 
 /* Bitmask of things we need to send to the Supercard.
@@ -100,6 +102,10 @@ void fifo_value_handler(uint32_t value, void* userdata)
 		input.touch_y = (value & RPL_INPUT_TOUCH_Y_MASK) >> RPL_INPUT_TOUCH_Y_BIT;
 		add_pending_send(PENDING_SEND_INPUT);
 		break;
+
+	case IPC_RPL_AUDIO_STARTED:
+		audio_hw_started();
+		break;
 	}
 
 	leaveCriticalSection(section);
@@ -120,6 +126,8 @@ void vblank_handler()
 	int previous_ime = enterCriticalSection();
 	apply_pending_flip();
 	apply_pending_swap();
+	apply_pending_sprites();
+	apply_pending_tile_scroll();
 
 	add_pending_send(PENDING_SEND_VBLANK);
 	leaveCriticalSection(previous_ime);
@@ -154,9 +162,10 @@ int main()
 	 * link state is as follows:
 	 *
 	 * - The video mode is graphical
-	 * - Main Screen buffers 0, 1 and 2, and Sub Screen buffer 0 are opaque
-	 *   black
+	 * - Main Screen buffers 0 to MAIN_BUFFER_COUNT - 1, and Sub Screen
+	 *   buffer 0 are opaque black
 	 * - Among the Main Screen buffers, number 0 is displayed
+	 * - No sprites are shown
 	 * - Audio is stopped
 	 * - Screens are not swapped (i.e. the Main Screen is on the bottom)
 	 * - Both screen backlights are on
@@ -26,6 +26,9 @@
 #include "main.h"
 #include "requests.h"
 #include "reset.h"
+#include "samples.h"
+#include "sprites.h"
+#include "tiles.h"
 #include "video.h"
 
 extern uint32_t arm9_reset_code[3];
@@ -44,12 +47,35 @@ void process_requests()
 	if (requests.start_audio) {
 		audio_start(requests.audio_freq, requests.buffer_size,
 			requests.is_16bit ? true : false,
-			requests.is_stereo ? true : false);
+			requests.is_stereo ? true : false,
+			requests.audio_low_latency ? true : false);
 	}
 	if (requests.change_swap) {
 		set_pending_swap(requests.swap_screens);
 	}
+	if (requests.change_sprites) {
+		unsigned int i;
+		for (i = 0; i < SPRITE_COUNT; i++) {
+			if (requests.change_sprites & (1 << i))
+				set_sprite(i, &requests.sprites[i]);
+		}
+	}
 	REG_IME = IME_ENABLE;
+	if (requests.change_voices) {
+		unsigned int i;
+		for (i = 0; i < VOICE_COUNT; i++) {
+			if (requests.change_voices & (1 << i))
+				set_voice(i, &requests.voices[i]);
+		}
+	}
+	if (requests.change_tile_mode) {
+		set_tile_mode(requests.tile_map_size, requests.tile_8bpp ? true : false);
+	}
+	if (requests.change_tile_scroll) {
+		REG_IME = IME_DISABLE;
+		set_tile_scroll(requests.tile_scroll_x, requests.tile_scroll_y);
+		REG_IME = IME_ENABLE;
+	}
 	if (requests.change_backlight) {
 		fifoSendValue32(FIFO_USER_01, IPC_SET_BACKLIGHT
 			| SET_BACKLIGHT_DATA(requests.screen_backlights));
@@ -0,0 +1,174 @@
+/*
+ * This file is part of the DS communication library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nds.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "card_protocol.h"
+#include "common_ipc.h"
+#include "samples.h"
+
+/* Voices play on the hardware sound channels from this one up, leaving the
+ * lower ones to streamed audio. */
+#define VOICE_CHANNEL_BASE 8
+
+/* The data of each sample in main RAM, or NULL if it is not defined. */
+static uint8_t* sample_buffers[SAMPLE_COUNT];
+
+/* The definition of each sample, as received from the Supercard. */
+static struct card_sample_define sample_defines[SAMPLE_COUNT];
+
+/* The sample each voice was last started with, or -1 if none, so that voices
+ * can be stopped before the sample they play is freed. */
+static int8_t voice_samples[VOICE_COUNT] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+
+static void stop_channel(size_t voice)
+{
+	struct ipc_voice ipc;
+
+	memset(&ipc, 0, sizeof(ipc));
+	ipc.command = IPC_SET_VOICE;
+	ipc.channel = VOICE_CHANNEL_BASE + voice;
+	ipc.flags = IPC_VOICE_STOP;
+	fifoSendDatamsg(FIFO_USER_01, sizeof(ipc), (uint8_t*) &ipc);
+	voice_samples[voice] = -1;
+}
+
+static void define_sample(size_t sample, const struct card_sample_define* define)
+{
+	size_t i;
+
+	if (define->length > SAMPLE_MEMORY_BYTES || (define->length & 3)) {
+		fatal_link_error("Supercard defined sample %zu\nwith invalid length %" PRIu32, sample, define->length);
+	} else if (define->loop_start < define->length
+	        && ((define->loop_start & 3) || define->loop_start / 4 > 0xFFFF)) {
+		fatal_link_error("Supercard defined sample %zu\nwith invalid loop start %" PRIu32, sample, define->loop_start);
+	} else if (define->format > SAMPLE_FORMAT_ADPCM) {
+		fatal_link_error("Supercard defined sample %zu\nwith unknown format %" PRIu8, sample, define->format);
+	}
+
+	for (i = 0; i < VOICE_COUNT; i++) {
+		if (voice_samples[i] == (int8_t) sample)
+			stop_channel(i);
+	}
+
+	free(sample_buffers[sample]);
+	sample_buffers[sample] = NULL;
+	sample_defines[sample] = *define;
+
+	if (define->length != 0) {
+		sample_buffers[sample] = malloc(define->length);
+		if (sample_buffers[sample] == NULL)
+			fatal_link_error("Not enough memory for sample\n%zu of %" PRIu32 " bytes", sample, define->length);
+	}
+}
+
+void sample_data(uint32_t header_1, uint32_t header_2)
+{
+	size_t bytes = (header_1 & DATA_BYTE_COUNT_MASK) >> DATA_BYTE_COUNT_BIT;
+	size_t offset = (header_2 & SAMPLE_OFFSET_MASK) >> SAMPLE_OFFSET_BIT;
+	size_t sample = (header_2 & SAMPLE_INDEX_MASK) >> SAMPLE_INDEX_BIT;
+
+	if (sample >= SAMPLE_COUNT) {
+		fatal_link_error("Supercard sent data for\nunknown sample %zu", sample);
+	}
+
+	if (header_2 & SAMPLE_DEFINE) {
+		struct card_sample_define define;
+
+		if (bytes != sizeof(define)) {
+			fatal_link_error("Sample definition is not %zu\nbytes\n\nSize received: %zu", sizeof(define), bytes);
+		}
+
+		card_read_data(sizeof(define), &define, false);
+		card_ignore_reply();
+		define_sample(sample, &define);
+		return;
+	}
+
+	if (bytes > 504) {
+		fatal_link_error("Sample data is larger than 504\nbytes\n\nSize received: %zu", bytes);
+	} else if ((bytes | offset) & 3) {
+		fatal_link_error("Supercard sent sample data that\nis not aligned to 4 bytes");
+	} else if (offset + bytes > sample_defines[sample].length) {
+		fatal_link_error("Supercard sent sample data that\nexceeds sample %zu by %zu bytes", sample, offset + bytes - sample_defines[sample].length);
+	}
+
+	card_read_data(bytes, &sample_buffers[sample][offset], false);
+	card_ignore_reply();
+
+	/* The ARM7 reads samples from main RAM, not from our cache. */
+	DC_FlushRange(&sample_buffers[sample][offset], bytes);
+}
+
+void set_voice(size_t voice, const struct card_voice* data)
+{
+	struct ipc_voice ipc;
+
+	memset(&ipc, 0, sizeof(ipc));
+	ipc.command = IPC_SET_VOICE;
+	ipc.channel = VOICE_CHANNEL_BASE + voice;
+
+	if (data->flags & VOICE_STOP) {
+		stop_channel(voice);
+		return;
+	}
+
+	if (data->flags & (VOICE_START | VOICE_SET_FREQUENCY)) {
+		if (data->frequency < 256 || data->frequency > 0x1000000) {
+			fatal_link_error("Supercard requested voice %zu\nat invalid frequency %" PRIu32, voice, data->frequency);
+		}
+		ipc.timer = 0x10000 - 0x1000000 / data->frequency;
+		ipc.flags |= IPC_VOICE_SET_TIMER;
+	}
+
+	if (data->flags & (VOICE_START | VOICE_SET_VOLUME)) {
+		ipc.volume = data->volume > 127 ? 127 : data->volume;
+		ipc.pan = data->pan > 127 ? 127 : data->pan;
+		ipc.flags |= IPC_VOICE_SET_VOLUME;
+	}
+
+	if (data->flags & VOICE_START) {
+		const struct card_sample_define* define;
+
+		if (data->sample >= SAMPLE_COUNT || sample_buffers[data->sample] == NULL) {
+			fatal_link_error("Supercard requested voice %zu\nto play undefined sample %" PRIu8, voice, data->sample);
+		}
+
+		define = &sample_defines[data->sample];
+		ipc.flags |= IPC_VOICE_START;
+		ipc.source = (uint32_t) sample_buffers[data->sample];
+		ipc.format = define->format;
+		if (define->loop_start < define->length) {
+			ipc.loop_start = define->loop_start / 4;
+			ipc.length = (define->length - define->loop_start) / 4;
+			ipc.repeat = 1;
+		} else {
+			ipc.loop_start = 0;
+			ipc.length = define->length / 4;
+			ipc.repeat = 0;
+		}
+		voice_samples[voice] = data->sample;
+	}
+
+	fifoSendDatamsg(FIFO_USER_01, sizeof(ipc), (uint8_t*) &ipc);
+}
@@ -0,0 +1,130 @@
+/*
+ * This file is part of the DS communication library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nds.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "card_protocol.h"
+#include "sprites.h"
+
+/* Number of bytes of sprite memory given to each sprite, which is enough for
+ * 32x32 pixels. */
+#define SPRITE_BYTES 2048
+
+/* With 1D bitmap sprite mapping, the tile number in OAM attribute 2 counts
+ * units of this many bytes. */
+#define SPRITE_BOUNDARY 128
+
+struct sprite_state {
+	int16_t x;
+	int16_t y;
+	/* Shape and size codes, as in bits 14-15 of OAM attributes 0 and 1. */
+	uint8_t shape;
+	uint8_t size;
+	bool visible;
+};
+
+/* The state of each sprite as last sent by the Supercard. It's written into
+ * OAM at the next VBlank after it changes. */
+static struct sprite_state sprites[SPRITE_COUNT];
+
+/* true if 'sprites' has changed since it was last written into OAM. */
+static bool pending_sprites;
+
+void sprites_init()
+{
+	size_t i;
+
+	vramSetBankI(VRAM_I_SUB_SPRITE);
+	dmaFillWords(0, SPRITE_GFX_SUB, SPRITE_COUNT * SPRITE_BYTES);
+
+	/* vramDefault cleared OAM to zeroes, which would show 128 8x8 sprites
+	 * as soon as sprites are enabled. */
+	for (i = 0; i < 128; i++) {
+		OAM_SUB[i * 4] = ATTR0_DISABLED;
+	}
+}
+
+void sprite_graphics(uint32_t header_1, uint32_t header_2)
+{
+	size_t bytes = (header_1 & DATA_BYTE_COUNT_MASK) >> DATA_BYTE_COUNT_BIT;
+	size_t offset = (header_2 & SPRITE_PIXEL_OFFSET_MASK) >> SPRITE_PIXEL_OFFSET_BIT;
+	unsigned int sprite = (header_2 & SPRITE_INDEX_MASK) >> SPRITE_INDEX_BIT;
+	uint8_t shape = (header_2 & SPRITE_SHAPE_MASK) >> SPRITE_SHAPE_BIT;
+	uint8_t size = (header_2 & SPRITE_SIZE_MASK) >> SPRITE_SIZE_BIT;
+
+	if (sprite >= SPRITE_COUNT) {
+		fatal_link_error("Supercard sent graphics for\nsprite %u", sprite);
+	} else if ((bytes & 3) || (offset & 1)) {
+		fatal_link_error("Supercard sent sprite graphics\nthat are not aligned to 4 bytes");
+	} else if (shape == 3 || size == 3) {
+		fatal_link_error("Supercard sent graphics for a\nsprite larger than 32x32");
+	} else if (offset * sizeof(uint16_t) + bytes > SPRITE_BYTES) {
+		fatal_link_error("Supercard sent sprite graphics\nthat exceed 32x32 pixels");
+	}
+
+	/* Sprite memory is written while the old graphics may be displayed.
+	 * Applications hide the sprite first if they care about that. */
+	card_read_data(bytes, (uint8_t*) SPRITE_GFX_SUB + sprite * SPRITE_BYTES + offset * sizeof(uint16_t), false);
+	card_ignore_reply();
+
+	REG_IME = IME_DISABLE;
+	if (sprites[sprite].shape != shape || sprites[sprite].size != size) {
+		sprites[sprite].shape = shape;
+		sprites[sprite].size = size;
+		pending_sprites = true;
+	}
+	REG_IME = IME_ENABLE;
+}
+
+void set_sprite(unsigned int sprite, const struct card_sprite* data)
+{
+	sprites[sprite].x = data->x;
+	sprites[sprite].y = data->y;
+	sprites[sprite].visible = data->visible != 0;
+	pending_sprites = true;
+}
+
+void apply_pending_sprites()
+{
+	if (pending_sprites) {
+		size_t i;
+		for (i = 0; i < SPRITE_COUNT; i++) {
+			const struct sprite_state* sprite = &sprites[i];
+
+			/* OAM coordinates wrap around, so sprites that are completely
+			 * off the screen must be disabled rather than positioned. No
+			 * sprite is larger than 32 pixels on either side, and any
+			 * coordinate from -32 on is represented properly. */
+			if (!sprite->visible
+			 || sprite->x <= -32 || sprite->x >= SCREEN_WIDTH
+			 || sprite->y <= -32 || sprite->y >= SCREEN_HEIGHT) {
+				OAM_SUB[i * 4] = ATTR0_DISABLED;
+			} else {
+				OAM_SUB[i * 4] = OBJ_Y(sprite->y) | ATTR0_BMP | (sprite->shape << 14);
+				OAM_SUB[i * 4 + 1] = OBJ_X(sprite->x) | (sprite->size << 14);
+				OAM_SUB[i * 4 + 2] = ATTR2_ALPHA(15) | ATTR2_PRIORITY(0)
+				                   | (i * SPRITE_BYTES / SPRITE_BOUNDARY);
+			}
+		}
+		pending_sprites = false;
+	}
+}
@@ -0,0 +1,127 @@
+/*
+ * This file is part of the DS communication library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nds.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "card_protocol.h"
+#include "tiles.h"
+#include "video.h"
+
+/* The map is at the start of VRAM bank C, at map base 0, and tile graphics
+ * follow at tile base 1 (16 KiB). Like Sub graphics, these are only valid
+ * while bank C is mapped as Sub background memory. */
+#define TILE_MAP_BASE     0
+#define TILE_GRAPHICS_BASE 1
+
+/* true if a tile scroll is pending. */
+static bool pending_tile_scroll;
+
+/* The new tile scroll to be set in the next VBlank. */
+static uint16_t new_tile_scroll_x, new_tile_scroll_y;
+
+void set_tile_mode(uint8_t map_size, bool is_8bpp)
+{
+	static const uint16_t map_sizes[4] = { BG_32x32, BG_64x32, BG_32x64, BG_64x64 };
+
+	set_sub_tiles();
+
+	REG_BG1CNT_SUB = map_sizes[map_size & 3] | (is_8bpp ? BG_COLOR_256 : BG_COLOR_16)
+	               | BG_MAP_BASE(TILE_MAP_BASE) | BG_TILE_BASE(TILE_GRAPHICS_BASE)
+	               | BG_PRIORITY_1;
+
+	/* With every map entry pointing to tile 0, and every pixel of tile 0
+	 * being color 0, the screen shows only the backdrop color. */
+	dmaFillWords(0, BG_MAP_RAM_SUB(TILE_MAP_BASE), TILE_MAP_BYTES);
+	dmaFillWords(0, BG_TILE_RAM_SUB(TILE_GRAPHICS_BASE), TILE_GRAPHICS_BYTES);
+
+	REG_IME = IME_DISABLE;
+	set_tile_scroll(0, 0);
+	REG_IME = IME_ENABLE;
+}
+
+void tile_data(uint32_t header_1, uint32_t header_2)
+{
+	size_t bytes = (header_1 & DATA_BYTE_COUNT_MASK) >> DATA_BYTE_COUNT_BIT;
+	size_t offset = (header_2 & TILE_OFFSET_MASK) >> TILE_OFFSET_BIT;
+	uint16_t data[252];
+	volatile uint16_t* dest;
+	size_t limit, i;
+
+	switch (header_2 & TILE_TARGET_MASK) {
+	case TILE_TARGET_GRAPHICS:
+		dest = BG_TILE_RAM_SUB(TILE_GRAPHICS_BASE);
+		limit = TILE_GRAPHICS_BYTES;
+		break;
+	case TILE_TARGET_MAP:
+		dest = BG_MAP_RAM_SUB(TILE_MAP_BASE);
+		limit = TILE_MAP_BYTES;
+		break;
+	case TILE_TARGET_PALETTE:
+		dest = video_sub_palette;
+		limit = TILE_PALETTE_BYTES;
+		break;
+	default:
+		fatal_link_error("Supercard sent tile data for\nunknown target %" PRIu32, header_2 & TILE_TARGET_MASK);
+		break;
+	}
+
+	if (bytes > sizeof(data)) {
+		fatal_link_error("Tile data is larger than %zu\nbytes\n\nSize received: %zu", sizeof(data), bytes);
+	} else if ((bytes | offset) & 1) {
+		fatal_link_error("Supercard sent tile data that\nis not aligned to 2 bytes");
+	} else if (offset + bytes > limit) {
+		fatal_link_error("Supercard sent tile data that\nexceeds its target by %zu bytes", offset + bytes - limit);
+	}
+
+	/* VRAM can't be written a byte at a time, but it can be written 16 bits
+	 * at a time, and map entries are 16 bits wide. So the data is read into
+	 * memory first, then copied to any 16-bit boundary. */
+	card_read_data((bytes + 3) & ~3, data, false);
+	card_ignore_reply();
+
+	dest += offset / sizeof(uint16_t);
+	for (i = 0; i < bytes / sizeof(uint16_t); i++)
+		dest[i] = data[i];
+
+	/* Outside tile mode, the palette is the console's. set_sub_tiles loads
+	 * the tile palette when tile mode comes back. */
+	if ((header_2 & TILE_TARGET_MASK) == TILE_TARGET_PALETTE && video_sub_mode == SUB_MODE_TILES) {
+		for (i = 0; i < bytes / sizeof(uint16_t); i++)
+			BG_PALETTE_SUB[offset / sizeof(uint16_t) + i] = data[i];
+	}
+}
+
+void set_tile_scroll(uint16_t x, uint16_t y)
+{
+	new_tile_scroll_x = x;
+	new_tile_scroll_y = y;
+	pending_tile_scroll = true;
+}
+
+void apply_pending_tile_scroll()
+{
+	if (pending_tile_scroll) {
+		pending_tile_scroll = false;
+		REG_BG1HOFS_SUB = new_tile_scroll_x;
+		REG_BG1VOFS_SUB = new_tile_scroll_y;
+	}
+}
@@ -22,22 +22,29 @@
 #include <stdint.h>
 
 #include "main.h"
+#include "sprites.h"
 #include "video.h"
 
-DTCM_BSS uint16_t* video_main[3];
+DTCM_BSS uint16_t* video_main[MAIN_BUFFER_COUNT];
 
 DTCM_BSS uint16_t* video_sub;
 
-DTCM_BSS bool video_sub_graphics;
+DTCM_BSS enum sub_mode video_sub_mode;
+
+uint16_t video_sub_palette[256];
+
+/* The Sub Screen's background palette as set up by consoleInit. It's copied
+ * back when the Sub Screen goes from displaying tiles to displaying text. */
+static uint16_t sub_text_palette[256];
 
 uint8_t video_main_current;
 
 /* For each element in this array:
  * true if the given Main Screen buffer is using a palette; false if it's a
  * 16-bit bitmap background. */
-static DTCM_BSS bool video_main_use_palette[3];
+static DTCM_BSS bool video_main_use_palette[MAIN_BUFFER_COUNT];
 
-uint16_t video_main_palette[3][256];
+uint16_t video_main_palette[MAIN_BUFFER_COUNT][256];
 
 /* Contains the index of the Main Screen buffer for which data was last sent
  * by the Supercard. Tracked separately from video_main_current to allow for
@@ -52,7 +59,7 @@ static size_t pending_flip_count;
 /* For each element in this array:
  * The index of the Main Screen buffer to be flipped to at a following
  * VBlank. */
-static uint8_t flip_target_buffer[3];
+static uint8_t flip_target_buffer[MAIN_BUFFER_COUNT];
 
 /* true if a screen swap change request is pending. */
 static bool pending_swap;
@@ -93,6 +100,17 @@ static void copy_palette(uint8_t buffer)
 		BG_PALETTE[i] = video_main_palette[buffer][i];
 }
 
+/* Maps VRAM banks E, F and G, which hold Main Screen buffer 3, to the LCD,
+ * where they are contiguous and can be written to while the buffer is not
+ * displayed. */
+static void hide_buffer_3(void)
+{
+	vramSetBankE(VRAM_E_LCD);
+	vramSetBankF(VRAM_F_LCD);
+	vramSetBankG(VRAM_G_LCD);
+	video_main[3] = VRAM_E;
+}
+
 void set_main_buffer(uint8_t buffer)
 {
 	/* MAIN can have three backgrounds, because it can manage up to 512 KiB
@@ -100,7 +118,13 @@ void set_main_buffer(uint8_t buffer)
 	 * To display buffers that use palettes, since REG_DISPCNT cannot be used
 	 * in bitmap modes to add 64 KiB offsets to the VRAM base, we remap banks
 	 * to 0x06000000, making sure that two banks are never mapped there at the
-	 * same time. */
+	 * same time.
+	 * Buffer 3 is in banks E, F and G, which the framebuffer modes cannot
+	 * display. Those banks are mapped to 0x06000000 only while the buffer is
+	 * displayed, as a 16-bit or 8-bit bitmap on background 2. */
+	if (video_main_current == 3 && buffer != 3)
+		hide_buffer_3();
+
 	switch (buffer) {
 	case 0:
 	default:
@@ -110,6 +134,7 @@ void set_main_buffer(uint8_t buffer)
 			if (video_main_use_palette[2])
 				vramSetBankD(VRAM_D_MAIN_BG_0x06060000);
 			vramSetBankA(VRAM_A_MAIN_BG_0x06000000);
+			REG_BG2CNT = BG_BMP8_256x256 | BG_MAP_BASE(0) | BG_PRIORITY_1;
 			videoSetMode(MODE_5_2D | DISPLAY_BG2_ACTIVE | DISPLAY_SCREEN_BASE(0));
 			copy_palette(0);
 		} else
@@ -122,6 +147,7 @@ void set_main_buffer(uint8_t buffer)
 			if (video_main_use_palette[2])
 				vramSetBankD(VRAM_D_MAIN_BG_0x06060000);
 			vramSetBankB(VRAM_B_MAIN_BG_0x06000000);
+			REG_BG2CNT = BG_BMP8_256x256 | BG_MAP_BASE(0) | BG_PRIORITY_1;
 			videoSetMode(MODE_5_2D | DISPLAY_BG2_ACTIVE | DISPLAY_SCREEN_BASE(0));
 			copy_palette(1);
 		} else
@@ -134,11 +160,32 @@ void set_main_buffer(uint8_t buffer)
 			if (video_main_use_palette[1])
 				vramSetBankB(VRAM_B_MAIN_BG_0x06040000);
 			vramSetBankD(VRAM_B_MAIN_BG_0x06000000);
+			REG_BG2CNT = BG_BMP8_256x256 | BG_MAP_BASE(0) | BG_PRIORITY_1;
 			videoSetMode(MODE_5_2D | DISPLAY_BG2_ACTIVE | DISPLAY_SCREEN_BASE(0));
 			copy_palette(2);
 		} else
 			videoSetMode(MODE_FB3);
 		break;
+	case 3:
+		if (video_main_use_palette[0])
+			vramSetBankA(VRAM_B_MAIN_BG_0x06020000);
+		if (video_main_use_palette[1])
+			vramSetBankB(VRAM_B_MAIN_BG_0x06040000);
+		if (video_main_use_palette[2])
+			vramSetBankD(VRAM_D_MAIN_BG_0x06060000);
+		vramSetBankE(VRAM_E_MAIN_BG);
+		if (video_main_use_palette[3]) {
+			/* An 8-bit bitmap fits in bank E alone. */
+			REG_BG2CNT = BG_BMP8_256x256 | BG_MAP_BASE(0) | BG_PRIORITY_1;
+			copy_palette(3);
+		} else {
+			vramSetBankF(VRAM_F_MAIN_BG_0x06010000);
+			vramSetBankG(VRAM_G_MAIN_BG_0x06014000);
+			REG_BG2CNT = BG_BMP16_256x256 | BG_MAP_BASE(0) | BG_PRIORITY_1;
+		}
+		videoSetMode(MODE_5_2D | DISPLAY_BG2_ACTIVE | DISPLAY_SCREEN_BASE(0));
+		video_main[3] = (uint16_t*) 0x06000000;
+		break;
 	}
 	video_main_current = buffer;
 }
@@ -174,6 +221,10 @@ void set_main_buffer_palette(uint8_t buffer, bool value)
 			video_main[2] = VRAM_D;
 		}
 		break;
+	case 3:
+		/* Banks E, F and G stay wherever set_main_buffer has put them. Only
+		 * the way their contents get displayed changes. */
+		break;
 	}
 	video_main_use_palette[buffer] = value;
 }
@@ -201,6 +252,24 @@ void add_pending_flip(unsigned int buffer)
 	}
 }
 
+void fill_other_field(uint8_t buffer, bool odd)
+{
+	uint16_t* dest = video_main[buffer];
+	size_t y;
+
+	if (video_main_last != buffer && !video_main_use_palette[video_main_last]) {
+		/* Weave the previous frame's rows with the new field's. */
+		const uint16_t* src = video_main[video_main_last];
+		for (y = odd ? 0 : 1; y < SCREEN_HEIGHT; y += 2)
+			dmaCopyWords(3, src + y * SCREEN_WIDTH, dest + y * SCREEN_WIDTH, SCREEN_WIDTH * sizeof(uint16_t));
+	} else {
+		/* Copy each row of the new field onto its neighbour in the other
+		 * field. */
+		for (y = odd ? 0 : 1; y < SCREEN_HEIGHT; y += 2)
+			dmaCopyWords(3, dest + (y ^ 1) * SCREEN_WIDTH, dest + y * SCREEN_WIDTH, SCREEN_WIDTH * sizeof(uint16_t));
+	}
+}
+
 void apply_pending_swap()
 {
 	if (pending_swap) {
@@ -223,14 +292,19 @@ void set_pending_swap(bool swap)
 
 void video_init()
 {
-	/* Set up VRAM banks A, B and D for Main Screen buffers FB0, FB1 and FB3
-	 * and clear them to black. */
+	size_t i;
+
+	/* Set up VRAM banks A, B and D for Main Screen buffers FB0, FB1 and FB3,
+	 * as well as banks E, F and G for Main Screen buffer 3, and clear them to
+	 * black. */
 	set_main_buffer_palette(0, false);
 	dmaFillWords(0x80008000, video_main[0], SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(u16));
 	set_main_buffer_palette(1, false);
 	dmaFillWords(0x80008000, video_main[1], SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(u16));
 	set_main_buffer_palette(2, false);
 	dmaFillWords(0x80008000, video_main[2], SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(u16));
+	hide_buffer_3();
+	dmaFillWords(0x80008000, video_main[3], SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(u16));
 
 	/* Start displaying the first one straight away. */
 	set_main_buffer(0);
@@ -271,32 +345,63 @@ void video_init()
 	consoleInit(&sub_text, /* layer */ 0, BgType_Text4bpp, BgSize_T_256x256,
 		/* map base */ 0 /* * 2 KiB */, /* tile base */ 1 /* * 16 KiB */,
 		/* main: */ false, /* load graphics */ true);
+	for (i = 0; i < 256; i++)
+		sub_text_palette[i] = BG_PALETTE_SUB[i];
 
 	vramSetBankH(VRAM_H_LCD);
 
+	sprites_init();
+
 	set_sub_graphics();
 }
 
 void set_sub_graphics()
 {
-	if (!video_sub_graphics) {
-		/* While bank C is used for Sub graphics, unmap bank H. Unmap it first
-		 * so that banks C and H aren't mapped to the same place at once. */
-		vramSetBankH(VRAM_H_LCD);
-		vramSetBankC(VRAM_C_SUB_BG_0x06200000);
-		videoSetModeSub(MODE_5_2D | DISPLAY_BG2_ACTIVE);
-		video_sub_graphics = true;
+	if (video_sub_mode != SUB_MODE_GRAPHICS) {
+		if (video_sub_mode == SUB_MODE_TEXT) {
+			/* While bank C is used for Sub graphics, unmap bank H. Unmap it
+			 * first so that banks C and H aren't mapped to the same place at
+			 * once. */
+			vramSetBankH(VRAM_H_LCD);
+			vramSetBankC(VRAM_C_SUB_BG_0x06200000);
+		}
+		videoSetModeSub(MODE_5_2D | DISPLAY_BG2_ACTIVE | DISPLAY_SPR_ACTIVE | DISPLAY_SPR_1D_BMP);
+		video_sub_mode = SUB_MODE_GRAPHICS;
 	}
 }
 
 void set_sub_text()
 {
-	if (video_sub_graphics) {
+	size_t i;
+
+	if (video_sub_mode != SUB_MODE_TEXT) {
 		/* While bank H is used for Sub text, unmap bank C. Unmap it first
 		 * so that banks C and H aren't mapped to the same place at once. */
 		vramSetBankC(VRAM_C_LCD);
 		vramSetBankH(VRAM_H_SUB_BG);
+		/* The tile palette may have been loaded since the last time text
+		 * was shown, even if graphics were shown in between, because
+		 * graphics don't use the palette. */
+		for (i = 0; i < 256; i++)
+			BG_PALETTE_SUB[i] = sub_text_palette[i];
 		videoSetModeSub(MODE_0_2D | DISPLAY_BG0_ACTIVE);
-		video_sub_graphics = false;
+		video_sub_mode = SUB_MODE_TEXT;
+	}
+}
+
+void set_sub_tiles()
+{
+	size_t i;
+
+	if (video_sub_mode != SUB_MODE_TILES) {
+		if (video_sub_mode == SUB_MODE_TEXT) {
+			/* Tiles are in bank C, like Sub graphics. */
+			vramSetBankH(VRAM_H_LCD);
+			vramSetBankC(VRAM_C_SUB_BG_0x06200000);
+		}
+		for (i = 0; i < 256; i++)
+			BG_PALETTE_SUB[i] = video_sub_palette[i];
+		videoSetModeSub(MODE_0_2D | DISPLAY_BG1_ACTIVE | DISPLAY_SPR_ACTIVE | DISPLAY_SPR_1D_BMP);
+		video_sub_mode = SUB_MODE_TILES;
 	}
 }
@@ -18,6 +18,7 @@
 */
 
 #include <nds.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <inttypes.h>
 
@@ -43,3 +44,47 @@ void video_encoding_0(uint32_t header_1, uint16_t* dest, size_t max_pixels)
 
 	card_ignore_reply();
 }
+
+void video_encoding_0_field(uint32_t header_1, uint32_t header_2, uint16_t* screen)
+{
+	size_t bytes = (header_1 & DATA_BYTE_COUNT_MASK) >> DATA_BYTE_COUNT_BIT;
+	size_t offset = (header_2 & VIDEO_PIXEL_OFFSET_MASK) >> VIDEO_PIXEL_OFFSET_BIT;
+	size_t pixels = bytes / sizeof(uint16_t);
+	unsigned int odd = (header_2 & VIDEO_FIELD_ODD) ? 1 : 0;
+	bool line_double = (header_2 & VIDEO_LINE_DOUBLE) != 0;
+
+	if (bytes & 3) {
+		fatal_link_error("Video encoding 0 data is not\na multiple of 4 bytes\n\nSize received: %zu", bytes);
+	}
+	if (offset + pixels > SCREEN_WIDTH * SCREEN_HEIGHT / 2) {
+		fatal_link_error("Video encoding 0 field data is\nnot fully inside the screen");
+	}
+
+	/* The field's rows are not contiguous in VRAM, so the data is read one
+	 * row (or part of one) at a time. Since the pixel offset is even, so is
+	 * every part, which keeps card_read_data's 32-bit writes aligned. */
+	while (pixels > 0) {
+		size_t x = offset % SCREEN_WIDTH;
+		size_t y = (offset / SCREEN_WIDTH) * 2 + odd;
+		size_t run = SCREEN_WIDTH - x;
+		uint16_t* dest = screen + y * SCREEN_WIDTH + x;
+
+		if (run > pixels)
+			run = pixels;
+
+		card_read_data(run * sizeof(uint16_t), dest, false);
+
+		if (line_double) {
+			uint32_t* src_words = (uint32_t*) dest;
+			uint32_t* dest_words = (uint32_t*) (screen + (y ^ 1) * SCREEN_WIDTH + x);
+			size_t i;
+			for (i = 0; i < run / 2; i++)
+				dest_words[i] = src_words[i];
+		}
+
+		offset += run;
+		pixels -= run;
+	}
+
+	card_ignore_reply();
+}
@@ -1,6 +1,8 @@
 #ifndef COMMON_IPC_H
 #define COMMON_IPC_H
 
+#include <stdint.h>
+
 #define IPC_GET_INPUT           0x0001
 
 #define IPC_RPL_INPUT_BUTTONS   0x0001
@@ -23,6 +25,49 @@
 #define     SET_BACKLIGHT_DATA_MASK  (0x3 << SET_BACKLIGHT_DATA_BIT)
 #define     SET_BACKLIGHT_DATA(n)    ((uint32_t) (n) << SET_BACKLIGHT_DATA_BIT)
 
+#define IPC_STOP_AUDIO          0x0004
+
+/* Sent as datamsgs. */
+#define IPC_START_AUDIO         0x0005
+#define IPC_SET_VOICE           0x0006
+
+#define IPC_RPL_AUDIO_STARTED   0x0003
+
 #define IPC_START_RESET         0xFFFF
 
+/* Sent as a datamsg by the ARM9 to make the ARM7 play audio from looping
+ * buffers in main RAM on hardware sound channels 0 (left or mono) and 1
+ * (right). Replied to with IPC_RPL_AUDIO_STARTED once the channels play. */
+struct ipc_audio_start {
+	uint16_t command;    /* = IPC_START_AUDIO */
+	uint16_t timer;      /* SOUND_FREQ value for the sampling rate */
+	uint8_t is_16bit;    /* 1 if signed 16-bit PCM, 0 if signed 8-bit */
+	uint8_t is_stereo;   /* 1 to play on 2 channels, 0 on 1 */
+	uint8_t reserved[2];
+	uint32_t source[2];  /* address of each channel's buffer; [1] unused if mono */
+	uint32_t length;     /* length of each channel's buffer, in words */
+};
+
+/* Flags for ipc_voice. */
+#define IPC_VOICE_START         (1 << 0)
+#define IPC_VOICE_STOP          (1 << 1)
+#define IPC_VOICE_SET_TIMER     (1 << 2)
+#define IPC_VOICE_SET_VOLUME    (1 << 3)
+
+/* Sent as a datamsg by the ARM9 to make the ARM7 start, stop or change a
+ * sample playing on a hardware sound channel. */
+struct ipc_voice {
+	uint16_t command;    /* = IPC_SET_VOICE */
+	uint8_t channel;     /* hardware sound channel */
+	uint8_t flags;       /* IPC_VOICE_* */
+	uint32_t source;     /* with IPC_VOICE_START: address of the sample */
+	uint32_t length;     /*   words from the loop start to the end */
+	uint16_t loop_start; /*   words before the loop start */
+	uint8_t format;      /*   as in bits 29-30 of SOUNDxCNT */
+	uint8_t repeat;      /*   1 to loop, 0 to stop at the end */
+	uint16_t timer;      /* with START or SET_TIMER: SOUND_FREQ value */
+	uint8_t volume;      /* with START or SET_VOLUME: 0 to 127 */
+	uint8_t pan;         /*   0 (left) to 127 (right) */
+};
+
 #endif /* !COMMON_IPC_H */
@@ -41,6 +41,18 @@
 #define BGR555_G(bgr555) (((bgr555) >> 5) & 0x1F)
 #define BGR555_B(bgr555) (((bgr555) >> 10) & 0x1F)
 
+#define RGB565(r, g, b) (((r) << 11) | ((g) << 5) | ((b)))
+
+#define RGB565_R(rgb565) (((rgb565) >> 11) & 0x1F)
+#define RGB565_G(rgb565) (((rgb565) >> 5) & 0x3F)
+#define RGB565_B(rgb565) ((rgb565) & 0x1F)
+
+#define XRGB8888(r, g, b) (((uint32_t) (r) << 16) | ((g) << 8) | ((b)))
+
+#define XRGB8888_R(xrgb8888) (((xrgb8888) >> 16) & 0xFF)
+#define XRGB8888_G(xrgb8888) (((xrgb8888) >> 8) & 0xFF)
+#define XRGB8888_B(xrgb8888) ((xrgb8888) & 0xFF)
+
 /* This enum describes the screens to be affected by a command, designating
  * them by engine name to properly deal with swapping.
  * Constraints: DS_ENGINE_MAIN and DS_ENGINE_SUB must have values with only
@@ -76,15 +88,77 @@ enum DS_Screen {
 #endif
 
 /* This enum describes the pixel formats supported by the Supercard DSTwo.
- * One may be chosen for the two engines independently from each other. */
+ * One may be chosen for the two engines independently from each other.
+ * All pixel formats are 16 bits wide, except for XRGB8888, which is 32 bits
+ * wide and leaves the upper 8 bits unused. */
 #if !defined __ASSEMBLY__
 enum DS2_PixelFormat {
 	DS2_PIXEL_FORMAT_BGR555,
-	DS2_PIXEL_FORMAT_RGB555
+	DS2_PIXEL_FORMAT_RGB555,
+	DS2_PIXEL_FORMAT_RGB565,
+	DS2_PIXEL_FORMAT_XRGB8888
+};
+#else
+#  define DS2_PIXEL_FORMAT_BGR555   0
+#  define DS2_PIXEL_FORMAT_RGB555   1
+#  define DS2_PIXEL_FORMAT_RGB565   2
+#  define DS2_PIXEL_FORMAT_XRGB8888 3
+#endif
+
+/* This enum describes how flips of the Main Screen are sent to the Nintendo
+ * DS. In both field modes, each flip sends only every other row, starting at
+ * row 0 on one flip and at row 1 on the next. */
+#if !defined __ASSEMBLY__
+enum DS2_FieldMode {
+	/* Every row is sent. */
+	DS2_FIELDS_OFF,
+	/* The rows that are not sent keep the contents of the previous frame. */
+	DS2_FIELDS_INTERLACED,
+	/* The rows that are sent are doubled onto the rows that are not sent. */
+	DS2_FIELDS_LINE_DOUBLED
+};
+#else
+#  define DS2_FIELDS_OFF          0
+#  define DS2_FIELDS_INTERLACED   1
+#  define DS2_FIELDS_LINE_DOUBLED 2
+#endif
+
+/* This enum describes how the mixer computes the values of a voice between
+ * the samples of its source, when the voice is played at a rate other than
+ * the output rate. */
+#if !defined __ASSEMBLY__
+enum DS2_Interpolation {
+	/* The value of the nearest earlier sample is used. Fastest. */
+	DS2_INTERPOLATION_NONE,
+	/* A straight line is drawn between two samples. */
+	DS2_INTERPOLATION_LINEAR,
+	/* A curve is drawn through four samples. Slowest, but dulls high
+	 * frequencies the least. */
+	DS2_INTERPOLATION_CUBIC
 };
 #else
-#  define DS2_PIXEL_FORMAT_BGR555 0
-#  define DS2_PIXEL_FORMAT_RGB555 1
+#  define DS2_INTERPOLATION_NONE   0
+#  define DS2_INTERPOLATION_LINEAR 1
+#  define DS2_INTERPOLATION_CUBIC  2
+#endif
+
+/* This enum describes the format of a sample loaded on the Nintendo DS with
+ * DS2_LoadSample. These are the formats of its sound hardware. */
+#if !defined __ASSEMBLY__
+enum DS2_SampleFormat {
+	/* Signed 8-bit PCM. */
+	DS2_SAMPLE_PCM8,
+	/* Signed little-endian 16-bit PCM. */
+	DS2_SAMPLE_PCM16,
+	/* IMA-ADPCM, starting with a 4-byte header holding the initial 16-bit
+	 * value and the initial step index, followed by 4-bit codes, low nibble
+	 * first. */
+	DS2_SAMPLE_ADPCM
+};
+#else
+#  define DS2_SAMPLE_PCM8  0
+#  define DS2_SAMPLE_PCM16 1
+#  define DS2_SAMPLE_ADPCM 2
 #endif
 
 #define DS_SCREEN_COUNT 2
@@ -153,12 +227,12 @@ extern void DS2_UseVideoCompression(bool compress);
  *   engine: The Nintendo DS engine to fill the current screen of.
  *   color: The color to fill the region with. If the pixel format used for
  *     screens of the given engine is BGR555, this value should be made by
- *     the BGR555 macro. Similarly for RGB555.
+ *     the BGR555 macro. Similarly for RGB555, RGB565 and XRGB8888.
  * Returns:
  *   0 on success.
  *   EINVAL if 'engine' is neither DS_ENGINE_MAIN nor DS_ENGINE_SUB.
  */
-extern int DS2_FillScreen(enum DS_Engine engine, uint16_t color);
+extern int DS2_FillScreen(enum DS_Engine engine, uint32_t color);
 
 /* Causes the current buffer of the given engine to be sent to the Nintendo DS
  * and displayed as soon as it's received. This may cause screen tearing.
@@ -226,9 +300,11 @@ extern int DS2_UpdateScreenPart(enum DS_Engine engine, size_t start_y, size_t en
  * write into.
  *
  * The part of the screen that does not get updated will keep its contents
- * from 3 flips ago or the last update that affected the current buffer.
- * To preserve a border at the top and bottom of the screen, please ensure
- * that you update or flip the screen 3 times before doing partial updates.
+ * from as many flips ago as there are Main Screen buffers (3 by default; see
+ * DS2_SetMainBufferCount), or the last update that affected the current
+ * buffer. To preserve a border at the top and bottom of the screen, please
+ * ensure that you update or flip the screen once per Main Screen buffer
+ * before doing partial updates.
  *
  * If any part of the buffer used before the flip is still being sent to the
  * Nintendo DS, or the DS did not yet switch to another buffer so that sends
@@ -243,6 +319,34 @@ extern int DS2_UpdateScreenPart(enum DS_Engine engine, size_t start_y, size_t en
  */
 extern int DS2_FlipMainScreenPart(size_t start_y, size_t end_y);
 
+/* Returns the number of Main Screen buffers that DS2_FlipMainScreen and
+ * DS2_FlipMainScreenPart cycle through. The default is 3.
+ */
+extern size_t DS2_GetMainBufferCount(void);
+
+/* Sets the number of Main Screen buffers that DS2_FlipMainScreen and
+ * DS2_FlipMainScreenPart cycle through.
+ *
+ * With 2 buffers, the Supercard may be stalled more often waiting for the
+ * Nintendo DS to flip away from the buffer it wants to write into, but a
+ * frame is displayed sooner after it's flipped. With 4 buffers, rendering
+ * that varies in duration from frame to frame is smoothed out further, at
+ * the cost of one more frame of latency when the Supercard is ahead.
+ *
+ * Any frames that are queued to be sent to the Nintendo DS are sent before
+ * the number of buffers changes. Afterwards, DS2_GetMainScreen may return a
+ * different address, and the contents of the new current buffer are those
+ * it had the last time it was used.
+ *
+ * In:
+ *   count: The new number of Main Screen buffers, from 2 to 4.
+ * Returns:
+ *   0 on success.
+ *   EINVAL: count is out of range.
+ *   ENOTSUP: the Nintendo DS cannot hold this many buffers.
+ */
+extern int DS2_SetMainBufferCount(size_t count);
+
 /*
  * Waits until the Supercard is done sending data from the current screen of
  * the given Nintendo DS engine(s).
@@ -257,7 +361,8 @@ extern int DS2_AwaitScreenUpdate(enum DS_Engine engine);
 
 /* Returns the address of the current Main Screen buffer. Following the
  * returned address, there are DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT pixels, each
- * 16 bits wide.
+ * 16 bits wide, or 32 bits wide if the Main Screen uses the XRGB8888 pixel
+ * format, in which case the address should be converted to uint32_t*.
  *
  * Because the Main Screen may be multiple buffered, the returned address is
  * subject to change after calls to DS2_FlipMainScreen.
@@ -266,7 +371,8 @@ extern uint16_t* DS2_GetMainScreen(void);
 
 /* Returns the address of the Sub Screen buffer. Following the returned
  * address, there are DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT pixels, each 16 bits
- * wide.
+ * wide, or 32 bits wide if the Sub Screen uses the XRGB8888 pixel format, in
+ * which case the address should be converted to uint32_t*.
  *
  * Because the Sub Screen is single-buffered, the returned address is
  * guaranteed not to change during the course of program execution.
@@ -275,7 +381,8 @@ extern uint16_t* DS2_GetSubScreen(void);
 
 /* Returns the address of the current buffer of the given DS engine. Following
  * the returned address, if the value of 'engine' is valid, there are
- * DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT pixels, each 16 bits wide.
+ * DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT pixels, each 16 bits wide, or 32 bits
+ * wide if the engine uses the XRGB8888 pixel format.
  *
  * In:
  *   engine: The engine to get the address of the current buffer for.
@@ -297,6 +404,15 @@ extern uint16_t* DS2_GetScreen(enum DS_Engine engine);
 extern enum DS2_PixelFormat DS2_GetPixelFormat(enum DS_Engine engine);
 
 /* Sets the pixel format in use on the given Nintendo DS engine.
+ *
+ * BGR555 and RGB555 screens are converted by the Supercard's FPGA as they
+ * are sent. RGB565 and XRGB8888 screens are converted by the CPU as they are
+ * sent, and are never sent with video compression (see
+ * DS2_UseVideoCompression). Screens that are queued to be sent when the pixel
+ * format changes are sent using the pixel format they were queued with.
+ *
+ * Changing the pixel format does not convert the pixels already in the
+ * buffers of the engine.
  *
  * In:
  *   engine: The Nintendo DS engine to set the pixel format for. If this is
@@ -364,6 +480,281 @@ extern int DS2_SetScreenBacklights(enum DS_Screen screens);
  */
 extern void DS2_AwaitVBlank(void);
 
+/* Returns the number of vertical blanking periods that the Nintendo DS has
+ * reported since the link with it was established. This is the value that
+ * DS2_PresentAt and DS2_GetFrameVBlank use.
+ */
+extern uint32_t DS2_GetVBlankCount(void);
+
+/* Requests that the next frame flipped with DS2_FlipMainScreen or
+ * DS2_FlipMainScreenPart be displayed at the given VBlank, rather than at
+ * the first VBlank after it's received by the Nintendo DS.
+ *
+ * The end of the frame is held back on the Supercard until the VBlank before
+ * the requested one. Anything queued to be sent to the Nintendo DS after the
+ * frame, including updates to the Sub Screen, is held back with it.
+ *
+ * If the requested VBlank has already passed, or the frame takes too long to
+ * send, it's displayed as soon as possible, as if this function had not been
+ * called. DS2_GetFrameVBlank tells when it was actually displayed.
+ *
+ * In:
+ *   vblank: The value of DS2_GetVBlankCount at which the next flipped frame
+ *     is to be displayed.
+ */
+extern void DS2_PresentAt(uint32_t vblank);
+
+/* Returns the number of frames flipped so far with DS2_FlipMainScreen and
+ * DS2_FlipMainScreenPart. Right after a flip, this is the number of the frame
+ * that was just flipped, which can be passed to DS2_GetFrameVBlank.
+ */
+extern uint32_t DS2_GetFlipCount(void);
+
+/* Gets the VBlank at which the Nintendo DS started displaying a flipped
+ * frame. The last 16 flipped frames are remembered.
+ *
+ * In:
+ *   frame: The number of the frame, as returned by DS2_GetFlipCount just
+ *     after flipping it.
+ * Out:
+ *   vblank: If 0 is returned, updated to contain the value of
+ *     DS2_GetVBlankCount at which the frame was first displayed.
+ * Returns:
+ *   0 on success.
+ *   EINVAL: The frame has not been flipped yet, or 'frame' is 0.
+ *   EAGAIN: The frame has not been displayed yet.
+ *   ENOENT: The frame was never displayed, because a later frame replaced it
+ *   before the Nintendo DS could flip to it, or it was displayed too long
+ *   ago to be remembered.
+ */
+extern int DS2_GetFrameVBlank(uint32_t frame, uint32_t* vblank);
+
+/* Returns the field mode set by DS2_SetFieldMode. The default is
+ * DS2_FIELDS_OFF.
+ */
+extern enum DS2_FieldMode DS2_GetFieldMode(void);
+
+/* Sets the way the next flips of the Main Screen are sent to the Nintendo DS.
+ *
+ * In the field modes, DS2_FlipMainScreen and DS2_FlipMainScreenPart send only
+ * half of the rows of the screen, alternating between even and odd rows on
+ * each flip. This halves the time taken to send a frame, so that moving
+ * images can keep up with the Nintendo DS's refresh rate, at the cost of
+ * vertical resolution. The mode may be changed before any flip.
+ *
+ * Fields are never sent with video compression (see DS2_UseVideoCompression).
+ *
+ * In:
+ *   mode: The new field mode.
+ * Returns:
+ *   0 on success.
+ *   EINVAL: mode is not valid.
+ *   ENOTSUP: the Nintendo DS cannot receive fields.
+ */
+extern int DS2_SetFieldMode(enum DS2_FieldMode mode);
+
+/* Bits of DS2_FrameTrace.flags telling which of its times are valid. */
+#define DS2_TRACE_INPUT     0x01
+#define DS2_TRACE_SENT      0x02
+#define DS2_TRACE_DISPLAYED 0x04
+
+/* A trace record for a flipped frame, made while frame tracing is enabled.
+ * Times are in units of clock() (CLOCKS_PER_SEC per second); VBlanks are in
+ * units of DS2_GetVBlankCount. */
+struct DS2_FrameTrace {
+	/* The number of the frame, as returned by DS2_GetFlipCount. */
+	uint32_t frame;
+	/* A combination of DS2_TRACE_* bits. */
+	uint32_t flags;
+	/* Valid if flags & DS2_TRACE_INPUT: when the first change in buttons
+	 * since the previous flip arrived from the Nintendo DS. */
+	uint32_t input_time;
+	uint32_t input_vblank;
+	/* When the frame was flipped by the application. */
+	uint32_t queued_time;
+	uint32_t queued_vblank;
+	/* Valid if flags & DS2_TRACE_SENT: when the last packet of the frame was
+	 * sent to the Nintendo DS. */
+	uint32_t sent_time;
+	uint32_t sent_vblank;
+	/* Valid if flags & DS2_TRACE_DISPLAYED: when the Nintendo DS reported
+	 * having flipped to the frame. */
+	uint32_t displayed_time;
+	uint32_t displayed_vblank;
+};
+
+/* Enables or disables frame tracing, which records when input arrives and
+ * when each flipped frame goes through the video path, so that the latency
+ * from input to display can be measured. Tracing is disabled by default.
+ *
+ * Enabling tracing after it was disabled forgets all previous records.
+ */
+extern void DS2_SetFrameTracing(bool enable);
+
+/* Gets the trace record of a flipped frame. The records of the last 64
+ * frames flipped while tracing was enabled are kept.
+ *
+ * In:
+ *   frame: The number of the frame, as returned by DS2_GetFlipCount just
+ *     after flipping it.
+ * Out:
+ *   trace: If 0 is returned, updated to contain the trace record. Its times
+ *     may still be incomplete if the frame is being sent or displayed.
+ * Returns:
+ *   0 on success.
+ *   EINVAL: The frame has not been flipped yet, or 'frame' is 0.
+ *   ENOENT: The frame was flipped while tracing was disabled, or too long
+ *   ago to be remembered.
+ */
+extern int DS2_GetFrameTrace(uint32_t frame, struct DS2_FrameTrace* trace);
+
+/* The number of sprites that can be shown over the Sub Screen. */
+#define DS2_SPRITE_COUNT 8
+
+/* Sprite pixels are BGR 555 and must have this bit set to be opaque. Pixels
+ * without it are transparent. */
+#define DS2_SPRITE_OPAQUE 0x8000
+
+/* Sends graphics for one of the sprites that can be shown over the Sub
+ * Screen, such as a mouse cursor, without resending any part of the screen.
+ * Sprites are shown only while the Sub Screen displays graphics, not text.
+ *
+ * The graphics are written over the sprite's old graphics as they arrive. If
+ * the sprite is visible, it may show a mix of both for a frame.
+ *
+ * In:
+ *   sprite: The sprite to be modified, from 0 to DS2_SPRITE_COUNT - 1.
+ *   pixels: width * height pixels, row by row, in BGR 555 format with
+ *     DS2_SPRITE_OPAQUE set on opaque pixels. They are copied before this
+ *     function returns.
+ *   width, height: The size of the sprite: 8, 16 or 32 pixels on each side.
+ * Returns:
+ *   0 on success.
+ *   EINVAL: sprite, width or height is not valid, or pixels is NULL.
+ *   ENOTSUP: the Nintendo DS cannot show sprites.
+ */
+extern int DS2_SetSpriteGraphics(size_t sprite, const uint16_t* pixels, size_t width, size_t height);
+
+/* Shows a sprite over the Sub Screen, with its upper-left corner at the given
+ * coordinates, from the next VBlank on. Coordinates may be negative or
+ * outside of the screen for a sprite that is partly or completely hidden.
+ *
+ * Moving sprites costs a few bytes, and many moves may be sent at once, so
+ * this may be called for each sprite at every frame.
+ *
+ * In:
+ *   sprite: The sprite to be shown, from 0 to DS2_SPRITE_COUNT - 1.
+ *   x, y: The coordinates of the upper-left corner of the sprite.
+ * Returns:
+ *   0 on success.
+ *   EINVAL: sprite is not valid.
+ *   ENOTSUP: the Nintendo DS cannot show sprites.
+ */
+extern int DS2_MoveSprite(size_t sprite, int x, int y);
+
+/* Hides a sprite from the next VBlank on. All sprites are initially hidden.
+ *
+ * In:
+ *   sprite: The sprite to be hidden, from 0 to DS2_SPRITE_COUNT - 1.
+ * Returns:
+ *   0 on success.
+ *   EINVAL: sprite is not valid.
+ *   ENOTSUP: the Nintendo DS cannot show sprites.
+ */
+extern int DS2_HideSprite(size_t sprite);
+
+/* The number of tiles that can be used on the Sub Screen. */
+#define DS2_TILE_COUNT 1024
+
+/* Tile map entries are built from these. DS2_TILE_PALETTE is only used with
+ * tiles of 4 bits per pixel, where it selects colors 16 * n to 16 * n + 15 of
+ * the tile palette. */
+#define DS2_TILE(n)         ((n) & 0x3FF)
+#define DS2_TILE_FLIP_X     0x0400
+#define DS2_TILE_FLIP_Y     0x0800
+#define DS2_TILE_PALETTE(n) (((n) & 0xF) << 12)
+
+/* Makes the Sub Screen display a map of 8x8 tiles, clearing all tiles to
+ * color 0 (transparent, showing color 0 of the palette as the background).
+ *
+ * In tile mode, tile graphics and the palette are sent once, and then only
+ * map entries and scrolling change from frame to frame. This takes a few
+ * hundred bytes per frame instead of the whole screen.
+ *
+ * The Sub Screen displays tiles until video is sent to it, at which point the
+ * screen must be sent in full, or until text is written to the console. Any
+ * tile data sent later makes it display the tiles again.
+ *
+ * In:
+ *   bits_per_pixel: 4 for tiles of 16 colors, selected from one of 16
+ *     palettes in each map entry; 8 for tiles of 256 colors.
+ *   map_width, map_height: The size of the map, in tiles: 32 or 64 each. The
+ *     map wraps around at its edges when scrolled.
+ * Returns:
+ *   0 on success.
+ *   EINVAL: An argument is not valid.
+ *   ENOTSUP: the Nintendo DS cannot display tiles.
+ */
+extern int DS2_SetTileMode(unsigned int bits_per_pixel, size_t map_width, size_t map_height);
+
+/* Sends graphics for tiles in the Nintendo DS's format. Each tile is 8x8
+ * pixels, row by row. At 4 bits per pixel, a tile takes 32 bytes, and the
+ * lower 4 bits of each byte are the pixel on the left; at 8 bits per pixel, a
+ * tile takes 64 bytes. Color 0 is transparent.
+ *
+ * In:
+ *   first_tile: The first tile to be written.
+ *   data: The graphics of 'count' tiles.
+ *   count: The number of tiles to be written.
+ * Returns:
+ *   0 on success.
+ *   EINVAL: The tiles are not all below DS2_TILE_COUNT, data is NULL, or
+ *   DS2_SetTileMode has not been called.
+ *   ENOTSUP: the Nintendo DS cannot display tiles.
+ */
+extern int DS2_SetTileGraphics(size_t first_tile, const void* data, size_t count);
+
+/* Sends colors for the palette of tiles, in BGR 555 format.
+ *
+ * In:
+ *   first_color: The first color to be written, from 0 to 255.
+ *   colors: 'count' colors.
+ *   count: The number of colors to be written.
+ * Returns:
+ *   0 on success.
+ *   EINVAL: The colors are not all below 256, colors is NULL, or
+ *   DS2_SetTileMode has not been called.
+ *   ENOTSUP: the Nintendo DS cannot display tiles.
+ */
+extern int DS2_SetTilePalette(size_t first_color, const uint16_t* colors, size_t count);
+
+/* Sends a rectangle of tile map entries, made with the DS2_TILE macros.
+ * Entries that are contiguous in the Nintendo DS's memory are sent together,
+ * so updating whole rows of the map is the cheapest.
+ *
+ * In:
+ *   x, y: The coordinates of the upper-left entry to be written, in tiles.
+ *   width, height: The size of the rectangle, in tiles.
+ *   entries: width * height entries, row by row.
+ * Returns:
+ *   0 on success.
+ *   EINVAL: The rectangle is not inside the map, entries is NULL, or
+ *   DS2_SetTileMode has not been called.
+ *   ENOTSUP: the Nintendo DS cannot display tiles.
+ */
+extern int DS2_SetTileMap(size_t x, size_t y, size_t width, size_t height, const uint16_t* entries);
+
+/* Sets the pixel of the map that is shown at the upper-left corner of the
+ * Sub Screen, from the next VBlank on. Coordinates wrap around at the edges
+ * of the map.
+ *
+ * Returns:
+ *   0 on success.
+ *   EINVAL: DS2_SetTileMode has not been called.
+ *   ENOTSUP: the Nintendo DS cannot display tiles.
+ */
+extern int DS2_SetTileScroll(unsigned int x, unsigned int y);
+
 /* Starts an audio stream with the specified parameters.
  *
  * May be called if audio is already started, in which case the prior audio
@@ -392,6 +783,288 @@ extern void DS2_AwaitVBlank(void);
  */
 extern int DS2_StartAudio(uint16_t frequency, uint16_t buffer_size, bool is_16bit, bool is_stereo);
 
+/* Requests the use or avoidance of compression when sending 16-bit audio to
+ * the Nintendo DS.
+ *
+ * Applies from the next packet of audio on, and persists across calls to
+ * DS2_StartAudio.
+ *
+ * In:
+ *   compress:
+ *   - true to request IMA-ADPCM compression, which sends about a quarter as
+ *     much data for the same audio, leaving more bandwidth for video, at the
+ *     cost of some audio quality. Has no effect on 8-bit audio or if the
+ *     Nintendo DS cannot decode it.
+ *   - false to request sending audio exactly as submitted. This is the
+ *     default.
+ */
+extern void DS2_UseAudioCompression(bool compress);
+
+/* Requests that the Nintendo DS play audio on its hardware sound channels
+ * directly instead of streaming it through its sound library.
+ *
+ * Applies from the next call to DS2_StartAudio on.
+ *
+ * In:
+ *   low_latency:
+ *   - true to play audio with about 1 millisecond of buffering on the
+ *     Nintendo DS, besides the audio buffer, instead of about 4. This suits
+ *     applications that must react to input with sound, such as rhythm games,
+ *     but a Nintendo DS that is busy with video for longer than that may play
+ *     short bursts of silence. Sampling rates under 512 Hz are streamed
+ *     anyway.
+ *   - false to stream audio. This is the default.
+ */
+extern void DS2_UseLowLatencyAudio(bool low_latency);
+
+/* Requests that DS2_SubmitAudio change the rate of the audio submitted to it
+ * by up to 0.5% so as to keep the audio buffer near a target fullness.
+ *
+ * Audio submitted at a rate driven by something other than the Nintendo DS's
+ * audio clock, such as an emulated system's clock or its frame rate, slowly
+ * overruns or underruns the audio buffer. With rate control, the buffer can
+ * stay much smaller without doing either. The pitch change is not audible.
+ *
+ * Persists across calls to DS2_StartAudio. Has no effect on samples written
+ * directly with DS2_AcquireAudioBuffer and DS2_CommitAudio.
+ *
+ * In:
+ *   target: The number of samples to keep in the audio buffer, or 0 to
+ *     disable rate control and submit audio exactly as given. This is the
+ *     default.
+ */
+extern void DS2_SetAudioRateControl(size_t target);
+
+/* Gets the number of samples the Nintendo DS has played since audio was last
+ * started, and when the last of them were reported as played.
+ *
+ * The number of samples played, compared to the number submitted, tells how
+ * far behind the submitted audio is heard; the VBlank count allows video to
+ * be synchronised with it, by comparing it with DS2_GetVBlankCount.
+ *
+ * Out:
+ *   samples: The number of samples played since audio was last started.
+ *   vblank: The VBlank count, as returned by DS2_GetVBlankCount, when the
+ *     Nintendo DS last reported samples as played.
+ * Returns:
+ *   0 on success.
+ *   EFAULT if audio is not started. In that case, 'samples' and 'vblank' are
+ *   not updated.
+ */
+extern int DS2_GetAudioPosition(uint32_t* samples, uint32_t* vblank);
+
+/* A function that writes audio samples for DS2_SetAudioCallback.
+ *
+ * In:
+ *   buffer: Where to write the samples, in the format of the audio stream.
+ *   n: The number of samples to write. All of them must be written.
+ *   data: The value given to DS2_SetAudioCallback.
+ */
+typedef void (*DS2_AudioCallback) (void* buffer, size_t n, void* data);
+
+/* Sets a function to be called to fill the audio buffer whenever the number
+ * of samples in it falls to a low-water mark, instead of submitting audio
+ * from the main loop of the application.
+ *
+ * The function is never called inside an interrupt handler. It is called,
+ * with interrupts enabled, when the application is waiting for an interrupt
+ * inside a block of code started by DS2_StartAwait, for example in
+ * DS2_AwaitVBlank, DS2_AwaitScreenUpdate, the input waits, while waiting for
+ * more room in the audio buffer, or in an idle loop. It is not called while
+ * the library waits in the middle of its own work, such as queuing a screen
+ * update or console text, or reading or writing the microSD card. Because
+ * it can be called in the middle of the application's waits, it must not use
+ * data that the application could be in the middle of modifying.
+ *
+ * When called, the function may be called more than once in a row, until
+ * the audio buffer is full. If audio is started or already started when the
+ * function is set, it is first called to fill the buffer.
+ *
+ * In:
+ *   callback: The function to call, or NULL to stop calling one.
+ *   data: A value passed along to the function.
+ *   low_water: The number of samples at or under which the audio buffer
+ *     must fall for the function to be called. Higher values mean fewer
+ *     underruns if the application waits rarely.
+ */
+extern void DS2_SetAudioCallback(DS2_AudioCallback callback, void* data, size_t low_water);
+
+/* The number of voices that the mixer can play at once. */
+#define DS2_MIXER_VOICES 16
+
+/* Passed to DS2_PlayVoice as the loop start for a voice that does not loop. */
+#define DS2_VOICE_NO_LOOP ((size_t) -1)
+
+/* Starts playing a sound on a voice of the mixer, replacing any sound that
+ * was playing on it. The volume, panning and interpolation of the voice are
+ * kept.
+ *
+ * Voices are mixed by DS2_MixVoices.
+ *
+ * In:
+ *   voice: The voice to use, from 0 to DS2_MIXER_VOICES - 1.
+ *   data: The samples of the sound, which are mono. They are read as the
+ *     voice plays, so they must remain valid until it stops.
+ *   length: The number of samples in the sound.
+ *   is_16bit:
+ *   - true: Samples are 16-bit signed PCM.
+ *   - false: Samples are 8-bit unsigned PCM.
+ *   frequency: The rate at which to play the sound, in Hertz. It is
+ *     resampled to the rate given to DS2_StartAudio.
+ *   loop_start: The sample to go back to after the last one, or
+ *     DS2_VOICE_NO_LOOP to stop the voice after the last one.
+ * Returns:
+ *   0 on success.
+ *   EINVAL if voice is out of range, data is NULL, length or frequency is 0,
+ *   or loop_start is not a sample of the sound.
+ */
+extern int DS2_PlayVoice(size_t voice, const void* data, size_t length, bool is_16bit, uint32_t frequency, size_t loop_start);
+
+/* Stops a voice of the mixer.
+ *
+ * Returns:
+ *   0 on success.
+ *   EINVAL if voice is out of range.
+ */
+extern int DS2_StopVoice(size_t voice);
+
+/* Returns true if a voice of the mixer is playing a sound. Voices that do
+ * not loop stop by themselves after their last sample has been mixed. */
+extern bool DS2_IsVoicePlaying(size_t voice);
+
+/* Changes the rate at which a voice plays its sound, in Hertz, from the next
+ * sample mixed on.
+ *
+ * Returns:
+ *   0 on success.
+ *   EINVAL if voice is out of range or frequency is 0.
+ */
+extern int DS2_SetVoiceFrequency(size_t voice, uint32_t frequency);
+
+/* Changes the volume and panning of a voice, from the next sample mixed on.
+ *
+ * In:
+ *   voice: The voice to change.
+ *   volume: From 0 (silent) to 127 (as loud as the sound itself).
+ *   pan: From 0 (left only) to 127 (right only), with 64 in the center. For
+ *     mono audio output, panning is ignored.
+ * Returns:
+ *   0 on success.
+ *   EINVAL if voice, volume or pan is out of range.
+ */
+extern int DS2_SetVoiceVolume(size_t voice, uint8_t volume, uint8_t pan);
+
+/* Changes the interpolation used to resample a voice. The default is
+ * DS2_INTERPOLATION_LINEAR.
+ *
+ * Returns:
+ *   0 on success.
+ *   EINVAL if voice or interpolation is out of range.
+ */
+extern int DS2_SetVoiceInterpolation(size_t voice, enum DS2_Interpolation interpolation);
+
+/* Mixes the playing voices of the mixer into samples in the format of the
+ * audio stream started by DS2_StartAudio, saturating on overflow.
+ *
+ * This is a DS2_AudioCallback, so it may be given to DS2_SetAudioCallback to
+ * have the mixer render straight into the audio buffer as it empties, or be
+ * called on the area returned by DS2_AcquireAudioBuffer.
+ *
+ * Mixing uses only integer arithmetic.
+ *
+ * In:
+ *   buffer: Where to write the samples.
+ *   n: The number of samples to write.
+ *   data: Unused.
+ */
+extern void DS2_MixVoices(void* buffer, size_t n, void* data);
+
+/* The number of samples that can be loaded on the Nintendo DS at once, and
+ * the total number of bytes they can take. */
+#define DS2_SAMPLE_COUNT 64
+#define DS2_SAMPLE_MEMORY 1048576
+
+/* The number of voices that can play samples loaded on the Nintendo DS at
+ * once. */
+#define DS2_REMOTE_VOICES 8
+
+/* Loads a sample into the memory of the Nintendo DS, replacing any sample
+ * loaded in the same slot and stopping any remote voice that plays it.
+ *
+ * Loaded samples are played by the sound hardware of the Nintendo DS on
+ * remote voices, which are started, stopped and changed by small requests,
+ * so that sound effects and music made of samples take almost none of the
+ * link between the Supercard DSTwo and the Nintendo DS. They are mixed with
+ * the audio stream, if any, by the sound hardware.
+ *
+ * Waits until the sample is sent.
+ *
+ * In:
+ *   sample: The slot to load the sample into, from 0 to
+ *     DS2_SAMPLE_COUNT - 1.
+ *   data: The data of the sample, in the given format.
+ *   length: The number of bytes in the sample, which must be a multiple of 4.
+ *     0 frees the slot.
+ *   format: The format of the sample.
+ *   loop_start: The byte to go back to after the last one, which must be a
+ *     multiple of 4 under 262144, or DS2_VOICE_NO_LOOP to stop the voice
+ *     after the last one.
+ * Returns:
+ *   0 on success.
+ *   EINVAL if sample or format is out of range, data is NULL while length is
+ *   not 0, or length or loop_start is not valid.
+ *   ENOMEM if the loaded samples would take more than DS2_SAMPLE_MEMORY bytes.
+ *   ENOTSUP if the Nintendo DS does not support loading samples.
+ */
+extern int DS2_LoadSample(size_t sample, const void* data, size_t length, enum DS2_SampleFormat format, size_t loop_start);
+
+/* Starts playing a loaded sample on a remote voice, from its start,
+ * replacing any sample that was playing on it.
+ *
+ * In:
+ *   voice: The voice to use, from 0 to DS2_REMOTE_VOICES - 1.
+ *   sample: The sample to play, loaded by DS2_LoadSample.
+ *   frequency: The rate at which to play the sample, in Hertz, from 256 to
+ *     16777216.
+ *   volume: The volume of the voice, from 0 to 127.
+ *   pan: The panning of the voice, from 0 (left) to 127 (right); 64 is the
+ *     center.
+ * Returns:
+ *   0 on success.
+ *   EINVAL if any parameter is out of range.
+ *   ENOENT if the sample is not loaded.
+ *   ENOTSUP if the Nintendo DS does not support loading samples.
+ */
+extern int DS2_PlayRemoteVoice(size_t voice, size_t sample, uint32_t frequency, uint8_t volume, uint8_t pan);
+
+/* Stops a remote voice.
+ *
+ * Returns:
+ *   0 on success.
+ *   EINVAL if voice is out of range.
+ *   ENOTSUP if the Nintendo DS does not support loading samples.
+ */
+extern int DS2_StopRemoteVoice(size_t voice);
+
+/* Changes the rate at which a remote voice plays its sample, which changes
+ * its pitch, without restarting it.
+ *
+ * Returns:
+ *   0 on success.
+ *   EINVAL if voice or frequency is out of range.
+ *   ENOTSUP if the Nintendo DS does not support loading samples.
+ */
+extern int DS2_SetRemoteVoiceFrequency(size_t voice, uint32_t frequency);
+
+/* Changes the volume and panning of a remote voice without restarting it.
+ *
+ * Returns:
+ *   0 on success.
+ *   EINVAL if any parameter is out of range.
+ *   ENOTSUP if the Nintendo DS does not support loading samples.
+ */
+extern int DS2_SetRemoteVoiceVolume(size_t voice, uint8_t volume, uint8_t pan);
+
 /* Returns the number of audio samples that may be submitted using
  * DS2_SubmitAudio without first waiting for the Nintendo DS to consume the
  * oldest samples.
@@ -420,6 +1093,40 @@ extern size_t DS2_GetFreeAudioSamples();
  */
 extern int DS2_SubmitAudio(const void* data, size_t n);
 
+/* Gets a part of the audio buffer into which samples may be written directly,
+ * for example by a mixer, instead of being written elsewhere then submitted
+ * with DS2_SubmitAudio. Does not wait for the Nintendo DS to consume samples.
+ *
+ * The part returned is contiguous, so it may be shorter than the return value
+ * of DS2_GetFreeAudioSamples when the free space wraps around the end of the
+ * buffer. After committing it, acquire again to get the rest.
+ *
+ * Out:
+ *   data: Updated to point to where the next sample is to be written.
+ *   n: Updated to the number of samples that may be written there. May be 0
+ *     if the buffer is full.
+ * Returns:
+ *   0 on success.
+ *   EFAULT if audio is not started. In that case, n is updated to 0.
+ */
+extern int DS2_AcquireAudioBuffer(void** data, size_t* n);
+
+/* Submits samples that were written to the area returned by the last call to
+ * DS2_AcquireAudioBuffer, starting at its beginning.
+ *
+ * The area must not be written to after committing it, nor after audio is
+ * stopped or restarted.
+ *
+ * In:
+ *   n: The number of samples that were written.
+ * Returns:
+ *   0 on success.
+ *   EFAULT if audio is not started.
+ *   EINVAL if n is greater than the number of samples that may be written
+ *   at that point.
+ */
+extern int DS2_CommitAudio(size_t n);
+
 /* Stops the last started audio stream.
  *
  * Any samples that were going to be sent are cancelled; as of receiving the
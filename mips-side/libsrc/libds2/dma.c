@@ -27,7 +27,7 @@
 static bool dmac_started;
 
 static bool dma_ch_in_use[MAX_DMA_NUM];
-static bool dma_ch_transfer_size_shift[MAX_DMA_NUM] __attribute__((section(".noinit")));
+static uint8_t dma_ch_transfer_size_shift[MAX_DMA_NUM] __attribute__((section(".noinit")));
 static bool dma_ch_triggers_irq[MAX_DMA_NUM] __attribute__((section(".noinit")));
 
 #define PHYSADDR(addr) ((uintptr_t) (addr) & 0x1FFFFFFF)
@@ -79,7 +79,7 @@ int dma_request(void (*irq_handler) (unsigned int), unsigned int arg,
 		dma_ch_triggers_irq[i] = false;
 	}
 
-	return 0;
+	return i;
 }
 
 void dma_free(int ch)
@@ -26,6 +26,7 @@
 #include "../intc.h"
 #include "audio.h"
 #include "audio_encoding_0.h"
+#include "audio_encoding_1.h"
 #include "globals.h"
 
 size_t DS2_GetFreeAudioSamples(void)
@@ -42,7 +43,12 @@ size_t DS2_GetFreeAudioSamples(void)
 
 void _audio_dequeue(void)
 {
-	size_t result = _audio_encoding_0(_ds2_ds.snd_send, _ds2_ds.snd_write);
+	size_t result;
+
+	if (_ds2_ds.snd_compress && _ds2_ds.snd_16bit && _ds2_ds.snd_encodings_supported >= 2)
+		result = _audio_encoding_1(_ds2_ds.snd_send, _ds2_ds.snd_write);
+	else
+		result = _audio_encoding_0(_ds2_ds.snd_send, _ds2_ds.snd_write);
 
 	_ds2_ds.snd_send = _add_wrap_fast(_ds2_ds.snd_send, result, _ds2_ds.snd_samples);
 
@@ -50,16 +56,180 @@ void _audio_dequeue(void)
 		_add_pending_send(PENDING_SEND_AUDIO);
 }
 
+/* Called outside of interrupt handlers, via _deferred_call. Fills the audio
+ * buffer with samples from the audio callback. */
+static void run_audio_callback(void)
+{
+	DS2_AudioCallback callback = _ds2_ds.snd_callback;
+
+	if (callback == NULL || _ds2_ds.snd_status != AUDIO_STATUS_STARTED)
+		return;
+
+	_ds2_ds.snd_callback_running = true;
+	while (true) {
+		void* data;
+		size_t n;
+
+		if (DS2_AcquireAudioBuffer(&data, &n) != 0 || n == 0)
+			break;
+		callback(data, n, _ds2_ds.snd_callback_data);
+		DS2_CommitAudio(n);
+	}
+	_ds2_ds.snd_callback_running = false;
+}
+
+void _audio_schedule_callback(void)
+{
+	if (_ds2_ds.snd_callback != NULL && !_ds2_ds.snd_callback_running
+	 && _ds2_ds.snd_status == AUDIO_STATUS_STARTED
+	 && _ds2_ds.snd_samples - 1 - DS2_GetFreeAudioSamples() <= _ds2_ds.snd_low_water)
+		_deferred_call = run_audio_callback;
+}
+
 void _audio_consumed(size_t samples)
 {
 	_ds2_ds.snd_read = _add_wrap_fast(_ds2_ds.snd_read, samples, _ds2_ds.snd_samples);
+	_ds2_ds.snd_played += samples;
+	_ds2_ds.snd_played_vblank = _ds2_ds.vblank_count;
+	_audio_schedule_callback();
 }
 
-int DS2_SubmitAudio(const void* data, size_t n)
+void DS2_SetAudioCallback(DS2_AudioCallback callback, void* data, size_t low_water)
+{
+	uint32_t section = DS2_EnterCriticalSection();
+	_ds2_ds.snd_callback = callback;
+	_ds2_ds.snd_callback_data = data;
+	_ds2_ds.snd_low_water = low_water;
+	if (callback == NULL) {
+		if (_deferred_call == run_audio_callback)
+			_deferred_call = NULL;
+	} else {
+		_audio_schedule_callback();
+	}
+	DS2_LeaveCriticalSection(section);
+}
+
+void DS2_UseAudioCompression(bool compress)
+{
+	_ds2_ds.snd_compress = compress;
+}
+
+void DS2_UseLowLatencyAudio(bool low_latency)
+{
+	_ds2_ds.snd_low_latency = low_latency;
+}
+
+int DS2_GetAudioPosition(uint32_t* samples, uint32_t* vblank)
 {
 	uint32_t section;
 
-	/* Wait until the audio is fully started before submitting samples. */
+	if (_ds2_ds.snd_status != AUDIO_STATUS_STARTED)
+		return EFAULT;
+
+	section = DS2_EnterCriticalSection();
+	*samples = _ds2_ds.snd_played;
+	*vblank = _ds2_ds.snd_played_vblank;
+	DS2_LeaveCriticalSection(section);
+	return 0;
+}
+
+void DS2_SetAudioRateControl(size_t target)
+{
+	/* Start again from the next sample submitted, because the last one that
+	 * was submitted was not recorded while rate control was disabled. */
+	if (_ds2_ds.snd_rate_target == 0)
+		_ds2_ds.snd_rate_pos = 0x10000;
+	_ds2_ds.snd_rate_target = target;
+}
+
+/* The largest change to the rate at which submitted samples are consumed,
+ * in 16.16 fixed point. 327 / 65536 is just under 0.5%. */
+#define RATE_CONTROL_MAX 327
+
+/* Gets the number of submitted samples that the rate control resampler
+ * should advance by for each sample it writes, in 16.16 fixed point. Samples
+ * are consumed faster than they are written, shrinking the audio that is
+ * submitted, if the buffer is fuller than its target, and vice versa. */
+static uint32_t rate_control_step(void)
+{
+	int32_t target = _ds2_ds.snd_rate_target;
+	int32_t error = (int32_t) (_ds2_ds.snd_samples - 1 - DS2_GetFreeAudioSamples()) - target;
+
+	if (error > target)
+		error = target;
+	else if (error < -target)
+		error = -target;
+
+	return 0x10000 + error * RATE_CONTROL_MAX / target;
+}
+
+static int32_t get_sample(const void* data, size_t index)
+{
+	if (_ds2_ds.snd_16bit)
+		return ((const int16_t*) data)[index];
+	else
+		return (int32_t) ((const uint8_t*) data)[index] - 128;
+}
+
+static void put_sample(void* data, size_t index, int32_t value)
+{
+	if (_ds2_ds.snd_16bit)
+		((int16_t*) data)[index] = value;
+	else
+		((uint8_t*) data)[index] = value + 128;
+}
+
+/* Resamples the samples at 'src' into at most 'dest_n' samples at 'dest',
+ * advancing by 'step' (16.16 fixed point) samples of 'src' for each sample
+ * written, with linear interpolation.
+ *
+ * In:
+ *   src_n: The number of samples at 'src'.
+ * Out:
+ *   src_n: The number of samples at 'src' that were used up.
+ * Returns:
+ *   The number of samples written to 'dest'.
+ */
+static size_t resample(void* dest, size_t dest_n, const void* src, size_t* src_n, uint32_t step)
+{
+	size_t channels = _ds2_ds.snd_stereo ? 2 : 1, written = 0, used, c;
+	uint32_t pos = _ds2_ds.snd_rate_pos;
+
+	while (written < dest_n && (pos >> 16) < *src_n) {
+		size_t next = pos >> 16;
+		/* In 1.15 fixed point so that the product below fits in 32 bits. */
+		int32_t frac = (pos & 0xFFFF) >> 1;
+
+		for (c = 0; c < channels; c++) {
+			int32_t a = next == 0 ? _ds2_ds.snd_rate_last[c] : get_sample(src, (next - 1) * channels + c);
+			int32_t b = get_sample(src, next * channels + c);
+			put_sample(dest, written * channels + c, a + (((b - a) * frac) >> 15));
+		}
+		written++;
+		pos += step;
+	}
+
+	used = pos >> 16;
+	if (used > *src_n)
+		used = *src_n;
+	if (used > 0) {
+		for (c = 0; c < channels; c++)
+			_ds2_ds.snd_rate_last[c] = get_sample(src, (used - 1) * channels + c);
+		pos -= used << 16;
+	}
+
+	_ds2_ds.snd_rate_pos = pos;
+	*src_n = used;
+	return written;
+}
+
+/* Waits until audio is fully started, then gets the contiguous part of the
+ * free space in the audio buffer that starts at 'snd_write'. */
+static int free_audio_run(size_t* snd_write, size_t* n)
+{
+	uint32_t section;
+	size_t snd_read;
+
 	DS2_StartAwait();
 	while (_ds2_ds.snd_status == AUDIO_STATUS_STARTING)
 		DS2_AwaitInterrupt();
@@ -67,41 +237,99 @@ int DS2_SubmitAudio(const void* data, size_t n)
 
 	if (_ds2_ds.snd_status != AUDIO_STATUS_STARTED)
 		return EFAULT;
+
+	section = DS2_EnterCriticalSection();
+	snd_read = _ds2_ds.snd_read;
+	*snd_write = _ds2_ds.snd_write;
+	DS2_LeaveCriticalSection(section);
+
+	if (*snd_write >= snd_read) {
+		*n = _ds2_ds.snd_samples - *snd_write;
+		if (snd_read == 0)
+			(*n)--; /* Ensure there's a 1-sample gap */
+	} else {
+		*n = snd_read - *snd_write - 1;
+	}
+	return 0;
+}
+
+int DS2_AcquireAudioBuffer(void** data, size_t* n)
+{
+	size_t snd_write;
+	int result = free_audio_run(&snd_write, n);
+
+	if (result != 0) {
+		*n = 0;
+		return result;
+	}
+
+	*data = &_ds2_ds.snd_buffer[snd_write << _ds2_ds.snd_size_shift];
+	return 0;
+}
+
+int DS2_CommitAudio(size_t n)
+{
+	uint32_t section;
+	size_t snd_write, free_samples;
+	int result = free_audio_run(&snd_write, &free_samples);
+
+	if (result != 0)
+		return result;
+	if (n > free_samples)
+		return EINVAL;
 	if (n == 0)
 		return 0;
 
 	section = DS2_EnterCriticalSection();
+	_ds2_ds.snd_write = _add_wrap_fast(snd_write, n, _ds2_ds.snd_samples);
+	_add_pending_send(PENDING_SEND_AUDIO);
+	DS2_LeaveCriticalSection(section);
+	return 0;
+}
+
+int DS2_SubmitAudio(const void* data, size_t n)
+{
+	/* Wait until the audio is fully started before submitting samples. */
+	DS2_StartAwait();
+	while (_ds2_ds.snd_status == AUDIO_STATUS_STARTING)
+		DS2_AwaitInterrupt();
+	DS2_StopAwait();
+
+	if (_ds2_ds.snd_status != AUDIO_STATUS_STARTED)
+		return EFAULT;
+
 	while (n > 0) {
-		size_t snd_read = _ds2_ds.snd_read, snd_write = _ds2_ds.snd_write;
+		void* dest;
 		size_t transfer_samples;
+		int result = DS2_AcquireAudioBuffer(&dest, &transfer_samples);
 
-		if (snd_write >= snd_read) {
-			transfer_samples = _ds2_ds.snd_samples - snd_write;
-			if (snd_read == 0)
-				transfer_samples--; /* Ensure there's a 1-sample gap */
-		} else {
-			transfer_samples = snd_read - snd_write - 1;
-		}
-		if (transfer_samples > n)
-			transfer_samples = n;
+		if (result != 0)
+			return result;
 
 		if (transfer_samples > 0) {
-			memcpy(&_ds2_ds.snd_buffer[snd_write << _ds2_ds.snd_size_shift],
-			       data,
-			       transfer_samples << _ds2_ds.snd_size_shift);
-			n -= transfer_samples;
-			data = (void*) ((uint8_t*) data + (transfer_samples << _ds2_ds.snd_size_shift));
-			_ds2_ds.snd_write = _add_wrap_fast(_ds2_ds.snd_write, transfer_samples, _ds2_ds.snd_samples);
-			_add_pending_send(PENDING_SEND_AUDIO);
+			size_t used;
+
+			/* The Nintendo DS only reads samples before 'snd_write', so
+			 * these can be copied with interrupts enabled. */
+			if (_ds2_ds.snd_rate_target != 0) {
+				used = n;
+				transfer_samples = resample(dest, transfer_samples, data, &used, rate_control_step());
+			} else {
+				if (transfer_samples > n)
+					transfer_samples = n;
+				used = transfer_samples;
+				memcpy(dest, data, transfer_samples << _ds2_ds.snd_size_shift);
+			}
+			n -= used;
+			data = (const uint8_t*) data + (used << _ds2_ds.snd_size_shift);
+			DS2_CommitAudio(transfer_samples);
 		} else {
-			DS2_LeaveCriticalSection(section);
 			DS2_StartAwait();
-			while (_ds2_ds.snd_read == snd_read)
+			while (_ds2_ds.snd_status == AUDIO_STATUS_STARTED
+			    && DS2_GetFreeAudioSamples() == 0)
 				DS2_AwaitInterrupt();
 			DS2_StopAwait();
-			section = DS2_EnterCriticalSection();
 		}
 	}
-	DS2_LeaveCriticalSection(section);
 	return 0;
 }
@@ -28,6 +28,11 @@ extern void _audio_dequeue(void);
 
 extern void _audio_consumed(size_t samples);
 
+/* Arranges for the audio callback to be called outside of interrupt
+ * handlers if it is set and the audio buffer is at or under its low-water
+ * mark. Must be called from an interrupt handler or a critical section. */
+extern void _audio_schedule_callback(void);
+
 static inline size_t _add_wrap_fast(size_t index, size_t increment, size_t buffer_size)
 {
 	index += increment;
@@ -18,43 +18,74 @@
 */
 
 #include <stddef.h>
-#include <string.h>
+#include <stdint.h>
 
 #include "card_protocol.h"
 #include "globals.h"
 
-size_t _audio_encoding_0(size_t snd_send, size_t snd_write)
+/* Sends 'bytes' bytes of the audio buffer, starting at byte 'start' and
+ * wrapping around after byte 'size' - 1, straight from the buffer.
+ * Returns the number of bytes written to the reply, which is 'bytes' rounded
+ * up to a multiple of 2. */
+static size_t send_ring(size_t start, size_t bytes, size_t size)
 {
-	size_t max_samples = 508 >> _ds2_ds.snd_size_shift, samples;
+	const uint8_t* ring = _ds2_ds.snd_buffer;
+	size_t halfwords = 0;
 
-	if (snd_send < snd_write) {
-		samples = snd_write - snd_send;
-		if (samples > max_samples)
-			samples = max_samples;
+	if (((start | size) & 1) == 0) {
+		size_t bytes_a = size - start, bytes_b;
+		if (bytes_a > bytes)
+			bytes_a = bytes;
+		bytes_b = bytes - bytes_a;
 
-		memcpy(&_ds2_ds.temp,
-		       &_ds2_ds.snd_buffer[snd_send << _ds2_ds.snd_size_shift],
-		       samples << _ds2_ds.snd_size_shift);
+		/* In both cases, an odd last byte is sent with the byte after it,
+		 * which is still within the buffer. The byte count tells the
+		 * Nintendo DS to ignore it. */
+		if (bytes_b == 0) {
+			/* The bytes don't wrap, so bytes_a may be odd. */
+			halfwords = (bytes_a + 1) / 2;
+			_send_reply_2((const uint16_t*) &ring[start], halfwords);
+		} else {
+			/* The bytes wrap, so bytes_a reaches the end of the buffer and
+			 * is even. */
+			_send_reply_2((const uint16_t*) &ring[start], bytes_a / 2);
+			_send_reply_2((const uint16_t*) ring, (bytes_b + 1) / 2);
+			halfwords = bytes_a / 2 + (bytes_b + 1) / 2;
+		}
 	} else {
-		size_t samples_a, samples_b;
-		samples = _ds2_ds.snd_samples - (snd_send - snd_write);
-		if (samples > max_samples)
-			samples = max_samples;
-		samples_a = _ds2_ds.snd_samples - snd_send;
-		if (samples_a > max_samples)
-			samples_a = max_samples;
-		samples_b = samples - samples_a;
-
-		memcpy(&_ds2_ds.temp,
-		       &_ds2_ds.snd_buffer[snd_send << _ds2_ds.snd_size_shift],
-		       samples_a << _ds2_ds.snd_size_shift);
-		memcpy(&_ds2_ds.temp.bytes[samples_a << _ds2_ds.snd_size_shift],
-		       _ds2_ds.snd_buffer,
-		       samples_b << _ds2_ds.snd_size_shift);
+		/* Only 8-bit mono audio can be misaligned. Pair bytes up. */
+		size_t i;
+		for (i = 0; i < bytes; i += 2) {
+			uint16_t halfword = ring[start];
+			start = (start + 1 == size) ? 0 : start + 1;
+			if (i + 1 < bytes) {
+				halfword |= (uint16_t) ring[start] << 8;
+				start = (start + 1 == size) ? 0 : start + 1;
+			}
+			_send_reply_2(&halfword, 1);
+			halfwords++;
+		}
 	}
 
-	_send_reply_4(DATA_KIND_AUDIO | DATA_ENCODING(0) | DATA_BYTE_COUNT(samples << _ds2_ds.snd_size_shift));
-	_send_reply(&_ds2_ds.temp, 508);
+	return halfwords * 2;
+}
+
+size_t _audio_encoding_0(size_t snd_send, size_t snd_write)
+{
+	size_t max_samples = 508 >> _ds2_ds.snd_size_shift, samples, bytes;
+
+	if (snd_send < snd_write)
+		samples = snd_write - snd_send;
+	else
+		samples = _ds2_ds.snd_samples - (snd_send - snd_write);
+	if (samples > max_samples)
+		samples = max_samples;
+	bytes = samples << _ds2_ds.snd_size_shift;
+
+	_send_reply_4(DATA_KIND_AUDIO | DATA_ENCODING(0) | DATA_BYTE_COUNT(bytes));
+	bytes = send_ring(snd_send << _ds2_ds.snd_size_shift, bytes,
+	                  _ds2_ds.snd_samples << _ds2_ds.snd_size_shift);
+	_send_reply_zero(508 - bytes);
 
 	return samples;
 }
@@ -0,0 +1,127 @@
+/*
+ * This file is part of the DS communication library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "audio.h"
+#include "card_protocol.h"
+#include "globals.h"
+
+static const int16_t adpcm_step_table[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t adpcm_index_table[8] = {
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+/* Encodes one value, updating the state as the decoder on the Nintendo DS
+ * will when it decodes the returned 4-bit code. */
+static uint_fast8_t adpcm_encode(struct card_adpcm_state* state, int_fast32_t value)
+{
+	int_fast32_t predictor = state->predictor;
+	int_fast32_t step = adpcm_step_table[state->step_index];
+	int_fast32_t diff = value - predictor, delta = step >> 3;
+	uint_fast8_t code = 0;
+	int_fast32_t step_index;
+
+	if (diff < 0) {
+		code = 8;
+		diff = -diff;
+	}
+	if (diff >= step) {
+		code |= 4;
+		diff -= step;
+		delta += step;
+	}
+	step >>= 1;
+	if (diff >= step) {
+		code |= 2;
+		diff -= step;
+		delta += step;
+	}
+	step >>= 1;
+	if (diff >= step) {
+		code |= 1;
+		delta += step;
+	}
+
+	predictor += (code & 8) ? -delta : delta;
+	if (predictor > INT16_MAX)
+		predictor = INT16_MAX;
+	else if (predictor < INT16_MIN)
+		predictor = INT16_MIN;
+	state->predictor = predictor;
+
+	step_index = state->step_index + adpcm_index_table[code & 7];
+	if (step_index < 0)
+		step_index = 0;
+	else if (step_index > 88)
+		step_index = 88;
+	state->step_index = step_index;
+
+	return code;
+}
+
+size_t _audio_encoding_1(size_t snd_send, size_t snd_write)
+{
+	size_t channels = _ds2_ds.snd_stereo ? 2 : 1;
+	size_t state_bytes = channels * sizeof(struct card_adpcm_state);
+	/* Each value takes a nibble after the decoder states. */
+	size_t max_samples = (504 - state_bytes) * 2 / channels, samples;
+	const int16_t* src = (const int16_t*) _ds2_ds.snd_buffer;
+	uint8_t* codes = &_ds2_ds.temp.bytes[state_bytes];
+	size_t i, c, n = 0;
+
+	if (snd_send < snd_write)
+		samples = snd_write - snd_send;
+	else
+		samples = _ds2_ds.snd_samples - (snd_send - snd_write);
+	if (samples > max_samples)
+		samples = max_samples;
+
+	memcpy(_ds2_ds.temp.bytes, _ds2_ds.snd_adpcm, state_bytes);
+
+	for (i = 0; i < samples; i++) {
+		for (c = 0; c < channels; c++, n++) {
+			uint_fast8_t code = adpcm_encode(&_ds2_ds.snd_adpcm[c], src[snd_send * channels + c]);
+			if (n & 1)
+				codes[n >> 1] |= code << 4;
+			else
+				codes[n >> 1] = code;
+		}
+		snd_send = _add_wrap_fast(snd_send, 1, _ds2_ds.snd_samples);
+	}
+
+	_send_reply_4(DATA_KIND_AUDIO | DATA_ENCODING(1) | DATA_BYTE_COUNT(state_bytes + (n + 1) / 2));
+	_send_reply_4(AUDIO_SAMPLE_COUNT(samples));
+	_send_reply(&_ds2_ds.temp, 504);
+
+	return samples;
+}
@@ -27,12 +27,16 @@
 #include "main.h"
 #include "globals.h"
 #include "requests.h"
+#include "samples.h"
+#include "sprites.h"
 #include "text.h"
+#include "tiles.h"
+#include "trace.h"
 #include "video.h"
 #include "../dma.h"
 
 #define MIPS_VIDEO_ENCODINGS 2
-#define MIPS_AUDIO_ENCODINGS 1
+#define MIPS_AUDIO_ENCODINGS 2
 
 void _add_pending_send(uint32_t mask)
 {
@@ -89,9 +93,22 @@ void _send_reply(const void* reply, size_t reply_len)
 		_send_reply_4(*reply_word++);
 }
 
-void _send_video_reply(const void* reply, size_t reply_len, enum DS_Engine engine)
+void _send_reply_2(const uint16_t* reply, size_t count)
+{
+	size_t i;
+	for (i = 0; i < count; i++)
+		REG_CPLD_FIFO_WRITE_NDSRDATA = *reply++;
+}
+
+void _send_reply_zero(size_t reply_len)
+{
+	size_t i;
+	for (i = 0; i < reply_len / 2; i++)
+		REG_CPLD_FIFO_WRITE_NDSRDATA = 0;
+}
+
+void _send_video_reply(const void* reply, size_t reply_len, enum DS2_PixelFormat format)
 {
-	enum DS2_PixelFormat format = _ds2_ds.vid_formats[engine - 1];
 	REG_CPLD_CTR = CPLD_CTR_FPGA_MODE | CPLD_CTR_FIX_VIDEO_EN
 	             | (format == DS2_PIXEL_FORMAT_RGB555 ? CPLD_CTR_FIX_VIDEO_RGB_EN : 0);
 
@@ -126,6 +143,16 @@ void _link_establishment_protocol(const union card_command* command)
 		if (command->hello.video_encodings_supported < _ds2_ds.vid_encodings_supported)
 			_ds2_ds.vid_encodings_supported = command->hello.video_encodings_supported;
 
+		/* A Nintendo DS side that predates the field holds 3 buffers. */
+		_ds2_ds.vid_main_buffers_supported = command->hello.main_buffers_supported;
+		if (_ds2_ds.vid_main_buffers_supported == 0)
+			_ds2_ds.vid_main_buffers_supported = MAIN_BUFFER_DEFAULT;
+		else if (_ds2_ds.vid_main_buffers_supported > MAIN_BUFFER_MAX)
+			_ds2_ds.vid_main_buffers_supported = MAIN_BUFFER_MAX;
+
+		_ds2_ds.vid_features_supported = command->hello.video_features_supported;
+		_ds2_ds.snd_features_supported = command->hello.audio_features_supported;
+
 		_ds2_ds.snd_encodings_supported = MIPS_AUDIO_ENCODINGS;
 		if (command->hello.audio_encodings_supported < _ds2_ds.snd_encodings_supported)
 			_ds2_ds.snd_encodings_supported = command->hello.audio_encodings_supported;
@@ -186,6 +213,7 @@ void _main_protocol(const union card_command* command)
 			const struct card_command_input* command_input = &command->input;
 
 			_send_reply_4(0);
+			_trace_input(&command_input->data);
 			_merge_input(&command_input->data);
 			break;
 		}
@@ -193,6 +221,10 @@ void _main_protocol(const union card_command* command)
 		case CARD_COMMAND_VBLANK_BYTE:
 			_send_reply_4(0);
 			_ds2_ds.vblank_count++;
+			if (_ds2_ds.vid_held) {
+				_ds2_ds.vid_held = false;
+				_video_dequeue();
+			}
 			break;
 
 		case CARD_COMMAND_VIDEO_DISPLAYED_BYTE:
@@ -219,6 +251,7 @@ void _main_protocol(const union card_command* command)
 
 			_send_reply_4(0);
 			_ds2_ds.snd_status = command_audio_status->status ? AUDIO_STATUS_STARTED : AUDIO_STATUS_STOPPED;
+			_audio_schedule_callback();
 			break;
 		}
 
@@ -231,17 +264,21 @@ void _main_protocol(const union card_command* command)
 				case PENDING_SEND_ASSERT:    _send_assert();    break;
 				case PENDING_SEND_REQUESTS:  _send_requests();  break;
 				case PENDING_SEND_AUDIO:     _audio_dequeue();  break;
+				case PENDING_SEND_SAMPLE:    _sample_dequeue(); break;
+				case PENDING_SEND_TILES:     _tile_dequeue();   break;
+				case PENDING_SEND_SPRITE:    _sprite_dequeue(); break;
 				case PENDING_SEND_TEXT:      _text_dequeue();   break;
 				case PENDING_SEND_VIDEO:
 					/* Send the prepared packet */
 					_send_reply_4(_ds2_ds.vid_header_1);
 					_send_reply_4(_ds2_ds.vid_header_2);
 					if (_ds2_ds.vid_fixup) {
-						_send_video_reply(_ds2_ds.vid_next_ptr, 504,
-							(_ds2_ds.vid_header_2 & VIDEO_ENGINE_MASK) >> VIDEO_ENGINE_BIT);
+						_send_video_reply(_ds2_ds.vid_next_ptr, 504, _ds2_ds.vid_fixup_format);
 					} else {
 						_send_reply(_ds2_ds.vid_next_ptr, 504);
 					}
+					if (_ds2_ds.vid_next_frame != 0)
+						_trace_sent(_ds2_ds.vid_next_frame);
 
 					/* Prepare the next one, if any */
 					_video_dequeue();
@@ -27,10 +27,27 @@
 
 #include "card_protocol.h"
 
-#define MAIN_BUFFER_COUNT 3
+/* Bounds on the number of Main Screen buffers. The application chooses the
+ * number it uses at runtime with DS2_SetMainBufferCount; the default is
+ * triple buffering, which every Nintendo DS side supports. */
+#define MAIN_BUFFER_MIN     2
+#define MAIN_BUFFER_DEFAULT 3
+#define MAIN_BUFFER_MAX     4
+
+/* The number of flipped frames whose display times are remembered for
+ * DS2_GetFrameVBlank. Must be a power of 2. */
+#define DISPLAYED_FRAME_COUNT 16
+
+/* The number of flipped frames whose trace records are kept while frame
+ * tracing is enabled. Must be a power of 2. */
+#define TRACE_FRAME_COUNT 64
+
+/* The size in bytes of the buffer for text waiting to be sent to the
+ * Nintendo DS. Must be a power of 2. */
+#define TEXT_RING_SIZE 4096
 
 struct _video_entry {
-	uint16_t* src;
+	const void* src;
 	volatile uint8_t* busy;
 	uint16_t pixel_offset;
 	uint16_t pixel_count;
@@ -38,6 +55,25 @@ struct _video_entry {
 	bool use_palette;
 	bool palette_sent;
 	enum DS_Engine engine;
+	/* The pixel format of the engine when the entry was queued. */
+	enum DS2_PixelFormat format;
+	/* true if the last packet of this entry must be held until the VBlank
+	 * before present_at, so that the frame is displayed at present_at. */
+	bool has_present_at;
+	uint32_t present_at;
+	/* The number of the frame if this entry is a flip, or 0. */
+	uint32_t frame;
+	/* VIDEO_FIELD, VIDEO_FIELD_ODD and VIDEO_LINE_DOUBLE bits if this entry
+	 * sends a field, or 0. For fields, 'src' is the start of the screen, and
+	 * 'pixel_offset' and 'pixel_count' count pixels in the field's rows. */
+	uint32_t field_flags;
+};
+
+struct _displayed_frame {
+	/* The number of a flipped frame, starting at 1 (see vid_flip_count). */
+	uint32_t frame;
+	/* The value of vblank_count when the frame was first displayed. */
+	uint32_t vblank;
 };
 
 enum _audio_status {
@@ -136,16 +172,134 @@ struct __attribute__((aligned(32))) _ds2_ds {
 	 * getting interrupted. */
 	volatile size_t snd_write;
 
-	/* Text waiting to be sent to the Nintendo DS.
+	/* The function set by DS2_SetAudioCallback, or NULL, and its data. */
+	DS2_AudioCallback snd_callback;
+	void* snd_callback_data;
+
+	/* The number of samples at or under which the audio buffer must fall for
+	 * snd_callback to be called. */
+	size_t snd_low_water;
+
+	/* true while snd_callback is being called, so that it is not scheduled
+	 * again from inside itself. */
+	volatile bool snd_callback_running;
+
+	/* true if audio encoding 1 (IMA-ADPCM) may be used on 16-bit audio. */
+	bool snd_compress;
+
+	/* true if the Nintendo DS is to be asked to play audio on its hardware
+	 * sound channels directly, from the next call to DS2_StartAudio on. */
+	bool snd_low_latency;
+
+	/* The state of the IMA-ADPCM encoder for each channel, left first. Only
+	 * used while audio is sent with audio encoding 1. */
+	struct card_adpcm_state snd_adpcm[2];
+
+	/* The number of samples reported as played by the Nintendo DS since audio
+	 * was last started, and the value of vblank_count when the last of them
+	 * was reported.
+	 * Must be accessed in a critical section or with interrupts disabled. */
+	uint32_t snd_played;
+	uint32_t snd_played_vblank;
+
+	/* The buffer fullness, in samples, that DS2_SubmitAudio resamples audio to
+	 * stay near, or 0 if rate control is disabled. */
+	size_t snd_rate_target;
+
+	/* The position of the next sample to be written by the rate control
+	 * resampler, in 16.16 fixed point, counted from the last sample received
+	 * by DS2_SubmitAudio (0) to the first sample of the next call (1). */
+	uint32_t snd_rate_pos;
+
+	/* The last sample received by DS2_SubmitAudio for each channel, signed
+	 * even for 8-bit audio. Only used while rate control is enabled. */
+	int16_t snd_rate_last[2];
+
+	/* Text waiting to be sent to the Nintendo DS. It is a ring buffer defined
+	 * by txt_read and txt_write, so that many small writes can be accepted
+	 * while the Nintendo DS is busy and then sent in full packets. */
+	char txt_ring[TEXT_RING_SIZE];
+
+	/* Index of the first byte of txt_ring that has not been sent yet.
+	 * volatile because it's modified by _text_dequeue as part of the card
+	 * command interrupt handler, and it's then tested in a loop to see if more
+	 * text can be submitted. */
+	volatile size_t txt_read;
+
+	/* Index of the first byte of txt_ring that may be written. An empty buffer
+	 * has txt_read == txt_write; a full one has a 1-byte gap instead.
+	 * volatile because it's read by _text_dequeue as part of the card command
+	 * interrupt handler. */
+	volatile size_t txt_write;
+
+	/* The packet of text being sent to the Nintendo DS, gathered from
+	 * txt_ring by _text_dequeue.
 	 * Aligned to 32 bytes so as to affect one fewer cache line than if it were
 	 * not. */
 	char txt_data[508] __attribute__((aligned (32)));
 
-	/* The number of meaningful bytes at the start of _text_data.
-	 * volatile because it's modified by _text_dequeue as part of the card command
-	 * interrupt handler, and it's then tested in a loop to see if more text can
-	 * be submitted. */
-	volatile size_t txt_size;
+	/* Sprite graphics waiting to be sent to the Nintendo DS, up to 252
+	 * pixels of one sprite.
+	 * Aligned to 32 bytes so as to affect one fewer cache line than if it were
+	 * not. */
+	uint16_t spr_data[252] __attribute__((aligned (32)));
+
+	/* The second header word to be sent before spr_data, containing the
+	 * sprite, pixel offset, shape and size. */
+	uint32_t spr_header_2;
+
+	/* The number of meaningful bytes at the start of spr_data, or 0 if it's
+	 * free.
+	 * volatile because it's modified by _sprite_dequeue as part of the card
+	 * command interrupt handler, and it's then tested in a loop to see if more
+	 * graphics can be submitted. */
+	volatile size_t spr_size;
+
+	/* Tile graphics, map entries or palette entries waiting to be sent to the
+	 * Nintendo DS, up to 504 bytes.
+	 * Aligned to 32 bytes so as to affect one fewer cache line than if it were
+	 * not. */
+	uint16_t tile_data[252] __attribute__((aligned (32)));
+
+	/* The second header word to be sent before tile_data, containing the
+	 * target and byte offset. */
+	uint32_t tile_header_2;
+
+	/* The number of meaningful bytes at the start of tile_data, or 0 if it's
+	 * free.
+	 * volatile because it's modified by _tile_dequeue as part of the card
+	 * command interrupt handler, and it's then tested in a loop to see if more
+	 * tile data can be submitted. */
+	volatile size_t tile_size;
+
+	/* The number of bits per pixel of tiles set by DS2_SetTileMode, or 0 if
+	 * it hasn't been called yet. */
+	uint8_t tile_bpp;
+
+	/* The size of the tile map set by DS2_SetTileMode, in tiles. */
+	uint8_t tile_map_width;
+	uint8_t tile_map_height;
+
+	/* Sample definitions or sample data waiting to be sent to the Nintendo
+	 * DS, up to 504 bytes.
+	 * Aligned to 32 bytes so as to affect one fewer cache line than if it were
+	 * not. */
+	uint32_t smp_data[126] __attribute__((aligned (32)));
+
+	/* The second header word to be sent before smp_data, containing the
+	 * sample and byte offset. */
+	uint32_t smp_header_2;
+
+	/* The number of meaningful bytes at the start of smp_data, or 0 if it's
+	 * free.
+	 * volatile because it's modified by _sample_dequeue as part of the card
+	 * command interrupt handler, and it's then tested in a loop to see if more
+	 * sample data can be submitted. */
+	volatile size_t smp_size;
+
+	/* The length in bytes of each sample loaded on the Nintendo DS, or 0 if
+	 * it's not loaded. */
+	uint32_t smp_length[SAMPLE_COUNT];
 
 	/* true if compression may be used on video data; false if BGR 555 pixels
 	 * without compression are the only allowed format. */
@@ -154,6 +308,10 @@ struct __attribute__((aligned(32))) _ds2_ds {
 	/* Pixel formats for each engine. Indexed by 'enum DS2_Engine' - 1. */
 	enum DS2_PixelFormat vid_formats[2];
 
+	/* The number of Main Screen buffers that are cycled through by flips,
+	 * between MAIN_BUFFER_MIN and vid_main_buffers_supported. */
+	uint8_t vid_main_count;
+
 	/* Contains the number of the Main Screen buffer being written into by the
 	 * Supercard. */
 	uint8_t vid_main_current;
@@ -164,6 +322,10 @@ struct __attribute__((aligned(32))) _ds2_ds {
 	 * and it's then tested in a loop to see if more data can be submitted. */
 	volatile uint8_t vid_main_displayed;
 
+	/* Contains the number of the Main Screen buffer that received the last
+	 * flip. The Nintendo DS ends up displaying it once the flip is sent. */
+	uint8_t vid_main_flipped;
+
 	/* true if the Main Screen is on the top and the Sub Screen is on the bottom.
 	 * false if the Main Screen is on the bottom and the Sub Screen is on the top.
 	 */
@@ -183,7 +345,7 @@ struct __attribute__((aligned(32))) _ds2_ds {
 	 * a palette frame; false if it was a 16-bit frame. A palette frame can't
 	 * be updated partially, because the partial update's palette entries may
 	 * not apply to the pixels that are to be left alone. */
-	bool vid_main_was_palette[MAIN_BUFFER_COUNT];
+	bool vid_main_was_palette[MAIN_BUFFER_MAX];
 
 	/* Contains an entry for each Main Screen buffer stating whether it's being
 	 * sent.
@@ -191,7 +353,7 @@ struct __attribute__((aligned(32))) _ds2_ds {
 	 * and it's then tested in a loop to see if more data can be submitted.
 	 * Reading all elements at once must be done in a critical section or with
 	 * interrupts disabled to prevent reads from getting interrupted. */
-	volatile uint8_t vid_main_busy[MAIN_BUFFER_COUNT];
+	volatile uint8_t vid_main_busy[MAIN_BUFFER_MAX];
 
 	/* 1 if the Sub Screen buffer is being transferred to the Nintendo DS,
 	 * or 0 if it is free to use.
@@ -199,10 +361,44 @@ struct __attribute__((aligned(32))) _ds2_ds {
 	 * and it's then tested in a loop to see if more data can be submitted. */
 	volatile uint8_t vid_sub_busy;
 
-	struct _video_entry vid_queue[MAIN_BUFFER_COUNT + 1];
+	struct _video_entry vid_queue[MAIN_BUFFER_MAX + 1];
 
 	size_t vid_queue_count;
 
+	/* true if the last packet of the entry at the head of vid_queue is held
+	 * back until a later VBlank, as requested by DS2_PresentAt. */
+	bool vid_held;
+
+	/* true if DS2_PresentAt was called since the last flip, in which case
+	 * vid_present_at is the VBlank to display the next flipped frame at. */
+	bool vid_has_present_at;
+	uint32_t vid_present_at;
+
+	/* The number of flips requested so far, which is also the number of the
+	 * last flipped frame. */
+	uint32_t vid_flip_count;
+
+	/* The field mode set by DS2_SetFieldMode. */
+	enum DS2_FieldMode vid_field_mode;
+
+	/* true if the next field to be flipped is made of the odd rows. */
+	bool vid_field_odd;
+
+	/* The number of the frame whose last packet is at vid_next_ptr, or 0 if
+	 * that packet doesn't end a flipped frame. */
+	uint32_t vid_next_frame;
+
+	/* For each Main Screen buffer, the number of the last frame flipped from
+	 * it, or 0 if it has never been flipped. */
+	uint32_t vid_main_frame[MAIN_BUFFER_MAX];
+
+	/* The number of the last frame displayed by the Nintendo DS, or 0. */
+	uint32_t vid_last_displayed_frame;
+
+	/* The VBlanks at which the last flipped frames were displayed, indexed by
+	 * frame number modulo DISPLAYED_FRAME_COUNT. */
+	struct _displayed_frame vid_displayed_frames[DISPLAYED_FRAME_COUNT];
+
 	/* A pointer to the video data to be sent by the interrupt handler during
 	 * the next time it runs. It may be a pointer to 252 pixels from a screen
 	 * buffer, if the 252 pixels are to be sent directly and they aren't last
@@ -227,12 +423,34 @@ struct __attribute__((aligned(32))) _ds2_ds {
 	 * data; false if software has done this or is sending raw data. */
 	bool vid_fixup;
 
+	/* The pixel format of the video data to be fixed up, if vid_fixup is
+	 * true. This comes from the queued update, because the application may
+	 * have changed the engine's pixel format since. */
+	enum DS2_PixelFormat vid_fixup_format;
+
 	/* Number of vertical blanking interrupts (VBlank) encountered by the Nintendo
 	 * DS. Overflows every 414.252 days.
 	 * volatile because it can be modified by the card command interrupt handler,
 	 * and it's then tested for inequality in a loop to await the next VBlank. */
 	volatile uint32_t vblank_count;
 
+	/* true if frame tracing was enabled by DS2_SetFrameTracing. */
+	bool trace_enabled;
+
+	/* true if input has changed since the last flip. If so, trace_input_time
+	 * and trace_input_vblank tell when the first change arrived. */
+	bool trace_input_pending;
+	uint32_t trace_input_time;
+	uint32_t trace_input_vblank;
+
+	/* The buttons held in the last input received while tracing, used to
+	 * detect changes. */
+	uint16_t trace_buttons;
+
+	/* Trace records of the last flipped frames, indexed by frame number
+	 * modulo TRACE_FRAME_COUNT. */
+	struct DS2_FrameTrace trace_frames[TRACE_FRAME_COUNT];
+
 	/* Status of the link between the DS and the Supercard.
 	 * volatile because it can be modified by the card command interrupt handler. */
 	volatile enum _mips_side_link_status link_status;
@@ -248,8 +466,17 @@ struct __attribute__((aligned(32))) _ds2_ds {
 
 	uint8_t vid_encodings_supported;
 
+	/* The number of Main Screen buffers that the Nintendo DS can hold. */
+	uint8_t vid_main_buffers_supported;
+
+	/* HELLO_VIDEO_* bits for the video features the Nintendo DS supports. */
+	uint8_t vid_features_supported;
+
 	uint8_t snd_encodings_supported;
 
+	/* HELLO_AUDIO_* bits for the audio features the Nintendo DS supports. */
+	uint8_t snd_features_supported;
+
 	struct card_reply_mips_assert assert_failure __attribute__((aligned (32)));
 
 	struct card_reply_requests requests __attribute__((aligned (32)));
@@ -264,6 +491,11 @@ struct __attribute__((aligned(32))) _ds2_ds {
 	 * not. */
 	union card_reply_512 vid_next_data __attribute__((aligned (32)));
 
+	/* Contains the pixels of a field gathered from every other row of a
+	 * screen, to be sent with video encoding 0 as if they were contiguous.
+	 * Has room for 252 pixels of 32 bits. */
+	uint32_t vid_field_data[252] __attribute__((aligned (32)));
+
 	/* Used when the code needs global memory to send a reply that is constructed
 	 * on-the-fly, because stack memory is undefined after a function exits.
 	 * Aligned to 32 bytes so as to affect one fewer cache line than if it were
@@ -288,6 +520,15 @@ extern struct _ds2_ds _ds2_ds __attribute__((section(".noinit")));
 /* Some audio can be submitted to the Nintendo DS. */
 #define PENDING_SEND_AUDIO     0x00000008
 
+/* Some sample data can be submitted to the Nintendo DS. */
+#define PENDING_SEND_SAMPLE    0x04000000
+
+/* Some tile data can be submitted to the Nintendo DS. */
+#define PENDING_SEND_TILES     0x08000000
+
+/* Some sprite graphics can be submitted to the Nintendo DS. */
+#define PENDING_SEND_SPRITE    0x10000000
+
 /* Some text can be submitted to the Nintendo DS. */
 #define PENDING_SEND_TEXT      0x20000000
 
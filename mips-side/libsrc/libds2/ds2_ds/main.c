@@ -23,6 +23,7 @@
 
 #include "main.h"
 #include "globals.h"
+#include "mixer.h"
 #include "../dma.h"
 #include "../intc.h"
 #include "../jz4740.h"
@@ -104,23 +105,51 @@ static void init_variables(void)
 	size_t i;
 
 	_ds2_ds.snd_status = AUDIO_STATUS_STOPPED;
+	_ds2_ds.snd_compress = false;
+	_ds2_ds.snd_low_latency = false;
+	_ds2_ds.snd_callback = NULL;
+	_ds2_ds.snd_callback_running = false;
+	_ds2_ds.snd_rate_target = 0;
+	_mixer_init();
 
-	_ds2_ds.txt_size = 0;
+	_ds2_ds.txt_read = 0;
+	_ds2_ds.txt_write = 0;
+
+	_ds2_ds.spr_size = 0;
+
+	_ds2_ds.tile_size = 0;
+	_ds2_ds.smp_size = 0;
+	memset(_ds2_ds.smp_length, 0, sizeof(_ds2_ds.smp_length));
+	_ds2_ds.tile_bpp = 0;
 
 	_ds2_ds.vid_compress = false;
 	_ds2_ds.vid_formats[0] = DS2_PIXEL_FORMAT_BGR555;
 	_ds2_ds.vid_formats[1] = DS2_PIXEL_FORMAT_BGR555;
+	_ds2_ds.vid_main_count = MAIN_BUFFER_DEFAULT;
 	_ds2_ds.vid_main_displayed = 0;
 	_ds2_ds.vid_main_current = 0;
+	_ds2_ds.vid_main_flipped = 0;
 	_ds2_ds.vid_swap = false;
 	_ds2_ds.vid_backlights = DS_SCREEN_BOTH;
 	_ds2_ds.vid_last_was_flip = false;
-	for (i = 0; i < MAIN_BUFFER_COUNT; i++) {
+	for (i = 0; i < MAIN_BUFFER_MAX; i++) {
 		_ds2_ds.vid_main_busy[i] = 0;
 		_ds2_ds.vid_main_was_palette[i] = false;
+		_ds2_ds.vid_main_frame[i] = 0;
 	}
 	_ds2_ds.vid_sub_busy = 0;
 	_ds2_ds.vid_queue_count = 0;
+	_ds2_ds.vid_held = false;
+	_ds2_ds.vid_has_present_at = false;
+	_ds2_ds.vid_flip_count = 0;
+	_ds2_ds.vid_next_frame = 0;
+	_ds2_ds.vid_field_mode = DS2_FIELDS_OFF;
+	_ds2_ds.vid_field_odd = false;
+	_ds2_ds.trace_enabled = false;
+	_ds2_ds.vid_last_displayed_frame = 0;
+	for (i = 0; i < DISPLAYED_FRAME_COUNT; i++) {
+		_ds2_ds.vid_displayed_frames[i].frame = 0;
+	}
 	_ds2_ds.vblank_count = 0;
 
 	_ds2_ds.link_status = LINK_STATUS_NONE;
@@ -161,8 +190,7 @@ int _ds2_ds_init(void)
 	 * done, and that our version of the link state is as follows:
 	 *
 	 * - The DS's video mode is assumed to be graphical
-	 * - Main Screen buffers 0, 1 and 2, and Sub Screen buffer 0 are opaque
-	 *   black
+	 * - All Main Screen buffers, and Sub Screen buffer 0, are opaque black
 	 * - Among the Main Screen buffers, number 0 is displayed
 	 * - None of the buffers are being transferred
 	 * - Audio is stopped
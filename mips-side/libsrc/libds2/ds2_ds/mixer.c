@@ -0,0 +1,314 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ds2/ds.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "globals.h"
+#include "mixer.h"
+
+/* The number of output samples mixed at a time, bounded by the size of the
+ * accumulator on the stack. */
+#define MIX_CHUNK 128
+
+/* The fixed-point position of a voice in its source is split into a whole
+ * sample index and a 32-bit fraction, and so is its step per output
+ * sample. */
+struct voice {
+	const void* data;
+	uint32_t length;
+	uint32_t loop_start;
+	bool looping;
+	bool is_16bit;
+	bool playing;
+	enum DS2_Interpolation interpolation;
+	uint32_t frequency;
+	/* The output rate that 'step_int' and 'step_frac' were computed for. */
+	uint32_t step_rate;
+	uint32_t step_int;
+	uint32_t step_frac;
+	uint32_t pos;
+	uint32_t frac;
+	uint8_t volume;
+	uint8_t pan;
+	/* Gains for each output channel, where 8192 is unity. */
+	int32_t gain_left;
+	int32_t gain_right;
+};
+
+static struct voice voices[DS2_MIXER_VOICES];
+
+static void set_gains(struct voice* v)
+{
+	/* Panning only lowers the channel away from the side panned to, so that
+	 * a centered voice is as loud on each side as a mono one. */
+	uint32_t left = 127 - v->pan, right = v->pan;
+	if (left > 64) left = 64;
+	if (right > 64) right = 64;
+	v->gain_left = v->volume * left;
+	v->gain_right = v->volume * right;
+}
+
+static void set_step(struct voice* v, uint32_t rate)
+{
+	uint64_t step = ((uint64_t) v->frequency << 32) / rate;
+	v->step_int = step >> 32;
+	v->step_frac = (uint32_t) step;
+	v->step_rate = rate;
+}
+
+void _mixer_init(void)
+{
+	size_t i;
+
+	for (i = 0; i < DS2_MIXER_VOICES; i++) {
+		voices[i].playing = false;
+		voices[i].interpolation = DS2_INTERPOLATION_LINEAR;
+		voices[i].volume = 127;
+		voices[i].pan = 64;
+		voices[i].step_rate = 0;
+		set_gains(&voices[i]);
+	}
+}
+
+int DS2_PlayVoice(size_t voice, const void* data, size_t length, bool is_16bit, uint32_t frequency, size_t loop_start)
+{
+	struct voice* v;
+
+	if (voice >= DS2_MIXER_VOICES || data == NULL || length == 0 || length > UINT32_MAX
+	 || frequency == 0 || (loop_start != DS2_VOICE_NO_LOOP && loop_start >= length))
+		return EINVAL;
+
+	v = &voices[voice];
+	v->playing = false;
+	v->data = data;
+	v->length = length;
+	v->looping = loop_start != DS2_VOICE_NO_LOOP;
+	v->loop_start = v->looping ? loop_start : 0;
+	v->is_16bit = is_16bit;
+	v->frequency = frequency;
+	v->step_rate = 0;
+	v->pos = 0;
+	v->frac = 0;
+	v->playing = true;
+	return 0;
+}
+
+int DS2_StopVoice(size_t voice)
+{
+	if (voice >= DS2_MIXER_VOICES)
+		return EINVAL;
+
+	voices[voice].playing = false;
+	return 0;
+}
+
+bool DS2_IsVoicePlaying(size_t voice)
+{
+	return voice < DS2_MIXER_VOICES && voices[voice].playing;
+}
+
+int DS2_SetVoiceFrequency(size_t voice, uint32_t frequency)
+{
+	if (voice >= DS2_MIXER_VOICES || frequency == 0)
+		return EINVAL;
+
+	voices[voice].frequency = frequency;
+	voices[voice].step_rate = 0;
+	return 0;
+}
+
+int DS2_SetVoiceVolume(size_t voice, uint8_t volume, uint8_t pan)
+{
+	if (voice >= DS2_MIXER_VOICES || volume > 127 || pan > 127)
+		return EINVAL;
+
+	voices[voice].volume = volume;
+	voices[voice].pan = pan;
+	set_gains(&voices[voice]);
+	return 0;
+}
+
+int DS2_SetVoiceInterpolation(size_t voice, enum DS2_Interpolation interpolation)
+{
+	if (voice >= DS2_MIXER_VOICES
+	 || (interpolation != DS2_INTERPOLATION_NONE
+	  && interpolation != DS2_INTERPOLATION_LINEAR
+	  && interpolation != DS2_INTERPOLATION_CUBIC))
+		return EINVAL;
+
+	voices[voice].interpolation = interpolation;
+	return 0;
+}
+
+/* Gets a source value of a voice as 16-bit signed, following the loop past
+ * the end and repeating the first value before the start. Past the end of a
+ * voice that does not loop, the value is 0. */
+static int32_t voice_value(const struct voice* v, int32_t index)
+{
+	if (index < 0)
+		index = 0;
+	else if ((uint32_t) index >= v->length) {
+		if (!v->looping)
+			return 0;
+		index = v->loop_start + ((uint32_t) index - v->length) % (v->length - v->loop_start);
+	}
+
+	if (v->is_16bit)
+		return ((const int16_t*) v->data)[index];
+	else
+		return ((int32_t) ((const uint8_t*) v->data)[index] - 128) << 8;
+}
+
+static int32_t interpolate(const struct voice* v, uint32_t pos, uint32_t frac)
+{
+	int32_t p0, p1, p2, p3;
+
+	switch (v->interpolation) {
+	case DS2_INTERPOLATION_NONE:
+		/* mix_voice has already brought pos within the voice. */
+		if (v->is_16bit)
+			return ((const int16_t*) v->data)[pos];
+		else
+			return ((int32_t) ((const uint8_t*) v->data)[pos] - 128) << 8;
+
+	case DS2_INTERPOLATION_LINEAR:
+	{
+		/* t is in 15-bit fixed point, so that the difference of two 16-bit
+		 * values times t fits in 32 bits. */
+		int32_t t = frac >> 17;
+		if (pos + 1 < v->length) {
+			if (v->is_16bit) {
+				p1 = ((const int16_t*) v->data)[pos];
+				p2 = ((const int16_t*) v->data)[pos + 1];
+			} else {
+				p1 = ((int32_t) ((const uint8_t*) v->data)[pos] - 128) << 8;
+				p2 = ((int32_t) ((const uint8_t*) v->data)[pos + 1] - 128) << 8;
+			}
+		} else {
+			p1 = voice_value(v, pos);
+			p2 = voice_value(v, pos + 1);
+		}
+		return p1 + (((p2 - p1) * t) >> 15);
+	}
+
+	default: /* DS2_INTERPOLATION_CUBIC */
+	{
+		/* Catmull-Rom spline through 4 values, with t in 11-bit fixed point
+		 * so that no intermediate product overflows 32 bits. */
+		int32_t t = frac >> 21, x;
+		p0 = voice_value(v, (int32_t) pos - 1);
+		p1 = voice_value(v, pos);
+		p2 = voice_value(v, pos + 1);
+		p3 = voice_value(v, pos + 2);
+		x = (3 * (p1 - p2) + p3 - p0) * t >> 11;
+		x = (2 * p0 - 5 * p1 + 4 * p2 - p3 + x) * t >> 11;
+		x = (p2 - p0 + x) * t >> 11;
+		return p1 + (x >> 1);
+	}
+	}
+}
+
+/* Adds 'n' output samples of a voice to the accumulator. Returns false if the
+ * voice reached its end. */
+static bool mix_voice(struct voice* v, int32_t* acc, size_t n, bool stereo)
+{
+	uint32_t pos = v->pos, frac = v->frac;
+	int32_t gain_left = v->gain_left, gain_right = v->gain_right;
+	size_t i;
+	bool playing = true;
+
+	if (!stereo)
+		gain_left = v->volume * 64;
+
+	for (i = 0; i < n; i++) {
+		int32_t value;
+		uint32_t new_frac;
+
+		if (pos >= v->length) {
+			if (!v->looping) {
+				playing = false;
+				break;
+			}
+			pos = v->loop_start + (pos - v->length) % (v->length - v->loop_start);
+		}
+
+		value = interpolate(v, pos, frac);
+		if (stereo) {
+			acc[2 * i] += (value * gain_left) >> 13;
+			acc[2 * i + 1] += (value * gain_right) >> 13;
+		} else {
+			acc[i] += (value * gain_left) >> 13;
+		}
+
+		new_frac = frac + v->step_frac;
+		pos += v->step_int + (new_frac < frac);
+		frac = new_frac;
+	}
+
+	v->pos = pos;
+	v->frac = frac;
+	return playing;
+}
+
+void DS2_MixVoices(void* buffer, size_t n, void* data)
+{
+	int32_t acc[MIX_CHUNK * 2];
+	bool stereo = _ds2_ds.snd_stereo, is_16bit = _ds2_ds.snd_16bit;
+	size_t channels = stereo ? 2 : 1;
+	uint32_t rate = _ds2_ds.snd_freq;
+	size_t v;
+
+	(void) data;
+
+	while (n > 0) {
+		size_t count = n > MIX_CHUNK ? MIX_CHUNK : n, i;
+
+		for (i = 0; i < count * channels; i++)
+			acc[i] = 0;
+
+		for (v = 0; v < DS2_MIXER_VOICES; v++) {
+			struct voice* voice = &voices[v];
+			if (!voice->playing)
+				continue;
+			if (voice->step_rate != rate)
+				set_step(voice, rate);
+			if (!mix_voice(voice, acc, count, stereo))
+				voice->playing = false;
+		}
+
+		for (i = 0; i < count * channels; i++) {
+			int32_t value = acc[i];
+			if (value > INT16_MAX)
+				value = INT16_MAX;
+			else if (value < INT16_MIN)
+				value = INT16_MIN;
+			if (is_16bit)
+				((int16_t*) buffer)[i] = value;
+			else
+				((uint8_t*) buffer)[i] = (value >> 8) + 128;
+		}
+
+		buffer = (uint8_t*) buffer + ((count * channels) << (is_16bit ? 1 : 0));
+		n -= count;
+	}
+}
@@ -0,0 +1,27 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __DS2_DS_MIXER_H__
+#define __DS2_DS_MIXER_H__
+
+/* Sets all voices of the mixer to be stopped, at full volume, centered and
+ * with linear interpolation. */
+extern void _mixer_init(void);
+
+#endif /* !__DS2_DS_MIXER_H__ */
@@ -87,6 +87,7 @@ int DS2_StartAudio(uint16_t frequency, uint16_t buffer_size, bool is_16bit, bool
 		_ds2_ds.requests.is_16bit = is_16bit ? 1 : 0;
 		_ds2_ds.requests.is_stereo = is_stereo ? 1 : 0;
 		_ds2_ds.requests.buffer_size = buffer_size;
+		_ds2_ds.requests.audio_low_latency = _ds2_ds.snd_low_latency ? 1 : 0;
 
 		_ds2_ds.snd_size_shift = _ds2_ds.requests.is_16bit + _ds2_ds.requests.is_stereo;
 
@@ -104,6 +105,10 @@ int DS2_StartAudio(uint16_t frequency, uint16_t buffer_size, bool is_16bit, bool
 		_ds2_ds.snd_16bit = _ds2_ds.requests.is_16bit;
 		_ds2_ds.snd_stereo = _ds2_ds.requests.is_stereo;
 		_ds2_ds.snd_read = _ds2_ds.snd_send = _ds2_ds.snd_write = 0;
+		memset(_ds2_ds.snd_adpcm, 0, sizeof(_ds2_ds.snd_adpcm));
+		_ds2_ds.snd_played = 0;
+		_ds2_ds.snd_played_vblank = _ds2_ds.vblank_count;
+		_ds2_ds.snd_rate_pos = 0x10000;
 		_ds2_ds.snd_status = AUDIO_STATUS_STARTING;
 
 		_add_pending_send(PENDING_SEND_REQUESTS);
@@ -0,0 +1,212 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <ds2/ds.h>
+#include <ds2/pm.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../intc.h"
+#include "card_protocol.h"
+#include "globals.h"
+#include "samples.h"
+
+void _sample_dequeue(void)
+{
+	_send_reply_4(DATA_KIND_SAMPLE | DATA_ENCODING(0) | DATA_BYTE_COUNT(_ds2_ds.smp_size));
+	_send_reply_4(_ds2_ds.smp_header_2);
+	_send_reply(_ds2_ds.smp_data, 504);
+	_ds2_ds.smp_size = 0;
+}
+
+/* Waits until the interrupt handler has sent all sample data. */
+static void await_sample_data(void)
+{
+	DS2_StartAwait();
+	while (_ds2_ds.smp_size != 0)
+		DS2_AwaitInterrupt();
+	DS2_StopAwait();
+}
+
+/* Queues one packet of sample data or a sample definition. */
+static void send_sample_packet(uint32_t header_2, const void* data, size_t bytes)
+{
+	await_sample_data();
+	memcpy(_ds2_ds.smp_data, data, bytes);
+	_ds2_ds.smp_header_2 = header_2;
+	_ds2_ds.smp_size = bytes;
+
+	uint32_t section = DS2_EnterCriticalSection();
+	_add_pending_send(PENDING_SEND_SAMPLE);
+	DS2_LeaveCriticalSection(section);
+}
+
+int DS2_LoadSample(size_t sample, const void* data, size_t length, enum DS2_SampleFormat format, size_t loop_start)
+{
+	struct card_sample_define define;
+	const uint8_t* src = data;
+	size_t offset, total = 0, i;
+
+	if (!(_ds2_ds.snd_features_supported & HELLO_AUDIO_SAMPLES))
+		return ENOTSUP;
+	if (sample >= DS2_SAMPLE_COUNT || (data == NULL && length != 0)
+	 || (length & 3) || format > DS2_SAMPLE_ADPCM
+	 || (loop_start != DS2_VOICE_NO_LOOP
+	  && (loop_start >= length || (loop_start & 3) || loop_start / 4 > 0xFFFF)))
+		return EINVAL;
+
+	for (i = 0; i < DS2_SAMPLE_COUNT; i++) {
+		if (i != sample)
+			total += _ds2_ds.smp_length[i];
+	}
+	if (length > DS2_SAMPLE_MEMORY - total)
+		return ENOMEM;
+
+	define.length = length;
+	define.loop_start = loop_start == DS2_VOICE_NO_LOOP ? length : loop_start;
+	define.format = format;
+	memset(define.reserved, 0, sizeof(define.reserved));
+	send_sample_packet(SAMPLE_INDEX(sample) | SAMPLE_DEFINE, &define, sizeof(define));
+	_ds2_ds.smp_length[sample] = length;
+
+	for (offset = 0; offset < length; offset += 504) {
+		size_t count = length - offset >= 504 ? 504 : length - offset;
+
+		send_sample_packet(SAMPLE_INDEX(sample) | SAMPLE_OFFSET(offset), &src[offset], count);
+	}
+
+	/* Requests have a higher priority than sample data. Make sure that the
+	 * sample is all sent before returning, so that a voice started right
+	 * afterwards does not play the sample before it is complete. */
+	await_sample_data();
+	return 0;
+}
+
+/* Checks the parameters common to the remote voice functions. */
+static int check_remote_voice(size_t voice)
+{
+	if (!(_ds2_ds.snd_features_supported & HELLO_AUDIO_SAMPLES))
+		return ENOTSUP;
+	if (voice >= DS2_REMOTE_VOICES)
+		return EINVAL;
+	return 0;
+}
+
+int DS2_PlayRemoteVoice(size_t voice, size_t sample, uint32_t frequency, uint8_t volume, uint8_t pan)
+{
+	int result = check_remote_voice(voice);
+
+	if (result != 0)
+		return result;
+	if (sample >= DS2_SAMPLE_COUNT || frequency < 256 || frequency > 0x1000000
+	 || volume > 127 || pan > 127)
+		return EINVAL;
+	if (_ds2_ds.smp_length[sample] == 0)
+		return ENOENT;
+
+	{
+		uint32_t section = DS2_EnterCriticalSection();
+		struct card_voice* request = &_ds2_ds.requests.voices[voice];
+
+		_ds2_ds.requests.change_voices |= 1 << voice;
+		/* Starting a voice overrides any earlier change to it that is still
+		 * waiting to be sent. */
+		request->flags = VOICE_START;
+		request->sample = sample;
+		request->volume = volume;
+		request->pan = pan;
+		request->frequency = frequency;
+
+		_add_pending_send(PENDING_SEND_REQUESTS);
+		DS2_LeaveCriticalSection(section);
+	}
+	return 0;
+}
+
+int DS2_StopRemoteVoice(size_t voice)
+{
+	int result = check_remote_voice(voice);
+
+	if (result != 0)
+		return result;
+
+	{
+		uint32_t section = DS2_EnterCriticalSection();
+
+		_ds2_ds.requests.change_voices |= 1 << voice;
+		_ds2_ds.requests.voices[voice].flags = VOICE_STOP;
+
+		_add_pending_send(PENDING_SEND_REQUESTS);
+		DS2_LeaveCriticalSection(section);
+	}
+	return 0;
+}
+
+int DS2_SetRemoteVoiceFrequency(size_t voice, uint32_t frequency)
+{
+	int result = check_remote_voice(voice);
+
+	if (result != 0)
+		return result;
+	if (frequency < 256 || frequency > 0x1000000)
+		return EINVAL;
+
+	{
+		uint32_t section = DS2_EnterCriticalSection();
+		struct card_voice* request = &_ds2_ds.requests.voices[voice];
+
+		/* A voice that is about to be stopped stays stopped. */
+		if (!(request->flags & VOICE_STOP)) {
+			_ds2_ds.requests.change_voices |= 1 << voice;
+			request->flags |= VOICE_SET_FREQUENCY;
+			request->frequency = frequency;
+			_add_pending_send(PENDING_SEND_REQUESTS);
+		}
+		DS2_LeaveCriticalSection(section);
+	}
+	return 0;
+}
+
+int DS2_SetRemoteVoiceVolume(size_t voice, uint8_t volume, uint8_t pan)
+{
+	int result = check_remote_voice(voice);
+
+	if (result != 0)
+		return result;
+	if (volume > 127 || pan > 127)
+		return EINVAL;
+
+	{
+		uint32_t section = DS2_EnterCriticalSection();
+		struct card_voice* request = &_ds2_ds.requests.voices[voice];
+
+		/* A voice that is about to be stopped stays stopped. */
+		if (!(request->flags & VOICE_STOP)) {
+			_ds2_ds.requests.change_voices |= 1 << voice;
+			request->flags |= VOICE_SET_VOLUME;
+			request->volume = volume;
+			request->pan = pan;
+			_add_pending_send(PENDING_SEND_REQUESTS);
+		}
+		DS2_LeaveCriticalSection(section);
+	}
+	return 0;
+}
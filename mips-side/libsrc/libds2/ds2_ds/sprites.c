@@ -0,0 +1,140 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <ds2/ds.h>
+#include <ds2/pm.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../intc.h"
+#include "card_protocol.h"
+#include "globals.h"
+#include "sprites.h"
+
+/* Gets the SPRITE_SHAPE and SPRITE_SIZE bits for a sprite of the given
+ * dimensions, or UINT32_MAX if the Nintendo DS has no such sprite size. */
+static uint32_t sprite_shape_size(size_t width, size_t height)
+{
+	unsigned int width_code, height_code;
+
+	switch (width) {
+		case 8:  width_code = 0; break;
+		case 16: width_code = 1; break;
+		case 32: width_code = 2; break;
+		default: return UINT32_MAX;
+	}
+	switch (height) {
+		case 8:  height_code = 0; break;
+		case 16: height_code = 1; break;
+		case 32: height_code = 2; break;
+		default: return UINT32_MAX;
+	}
+
+	if (width_code == height_code)  /* Square */
+		return SPRITE_SHAPE(0) | SPRITE_SIZE(width_code);
+	else if (width_code > height_code)  /* Wide */
+		return SPRITE_SHAPE(1) | SPRITE_SIZE(width_code + height_code - 1);
+	else  /* Tall */
+		return SPRITE_SHAPE(2) | SPRITE_SIZE(width_code + height_code - 1);
+}
+
+void _sprite_dequeue(void)
+{
+	_send_reply_4(DATA_KIND_SPRITE | DATA_ENCODING(0) | DATA_BYTE_COUNT(_ds2_ds.spr_size));
+	_send_reply_4(_ds2_ds.spr_header_2);
+	_send_reply(_ds2_ds.spr_data, 504);
+	_ds2_ds.spr_size = 0;
+}
+
+int DS2_SetSpriteGraphics(size_t sprite, const uint16_t* pixels, size_t width, size_t height)
+{
+	uint32_t shape_size = sprite_shape_size(width, height);
+	size_t pixel_count = width * height, offset;
+
+	if (sprite >= DS2_SPRITE_COUNT || pixels == NULL || shape_size == UINT32_MAX)
+		return EINVAL;
+	if (!(_ds2_ds.vid_features_supported & HELLO_VIDEO_SPRITES))
+		return ENOTSUP;
+
+	for (offset = 0; offset < pixel_count; offset += 252) {
+		size_t count = pixel_count - offset >= 252 ? 252 : pixel_count - offset;
+		uint32_t section;
+
+		DS2_StartAwait();
+		while (_ds2_ds.spr_size != 0)
+			DS2_AwaitInterrupt();
+		DS2_StopAwait();
+
+		memcpy(_ds2_ds.spr_data, pixels + offset, count * sizeof(uint16_t));
+		_ds2_ds.spr_header_2 = SPRITE_PIXEL_OFFSET(offset) | SPRITE_INDEX(sprite) | shape_size;
+		_ds2_ds.spr_size = count * sizeof(uint16_t);
+
+		section = DS2_EnterCriticalSection();
+		_add_pending_send(PENDING_SEND_SPRITE);
+		DS2_LeaveCriticalSection(section);
+	}
+
+	/* Requests have a higher priority than sprite graphics. Make sure that
+	 * the graphics are all sent before returning, so that a sprite moved
+	 * right afterwards is not shown with some of its old graphics. */
+	DS2_StartAwait();
+	while (_ds2_ds.spr_size != 0)
+		DS2_AwaitInterrupt();
+	DS2_StopAwait();
+	return 0;
+}
+
+static int set_sprite(size_t sprite, int x, int y, bool visible)
+{
+	if (sprite >= DS2_SPRITE_COUNT)
+		return EINVAL;
+	if (!(_ds2_ds.vid_features_supported & HELLO_VIDEO_SPRITES))
+		return ENOTSUP;
+
+	/* Anything beyond these coordinates is off the screen anyway. */
+	if (x < -DS_SCREEN_WIDTH) x = -DS_SCREEN_WIDTH;
+	else if (x > DS_SCREEN_WIDTH) x = DS_SCREEN_WIDTH;
+	if (y < -DS_SCREEN_HEIGHT) y = -DS_SCREEN_HEIGHT;
+	else if (y > DS_SCREEN_HEIGHT) y = DS_SCREEN_HEIGHT;
+
+	{
+		uint32_t section = DS2_EnterCriticalSection();
+
+		_ds2_ds.requests.change_sprites |= 1 << sprite;
+		_ds2_ds.requests.sprites[sprite].x = x;
+		_ds2_ds.requests.sprites[sprite].y = y;
+		_ds2_ds.requests.sprites[sprite].visible = visible ? 1 : 0;
+
+		_add_pending_send(PENDING_SEND_REQUESTS);
+		DS2_LeaveCriticalSection(section);
+	}
+	return 0;
+}
+
+int DS2_MoveSprite(size_t sprite, int x, int y)
+{
+	return set_sprite(sprite, x, y, true);
+}
+
+int DS2_HideSprite(size_t sprite)
+{
+	return set_sprite(sprite, 0, 0, false);
+}
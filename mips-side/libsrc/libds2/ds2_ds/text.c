@@ -28,8 +28,23 @@
 
 void _text_dequeue(void)
 {
-	_text_encoding_0(_ds2_ds.txt_data, _ds2_ds.txt_size);
-	_ds2_ds.txt_size = 0;
+	size_t read = _ds2_ds.txt_read, write = _ds2_ds.txt_write;
+	size_t length = (write - read) & (TEXT_RING_SIZE - 1), first;
+
+	if (length > sizeof(_ds2_ds.txt_data))
+		length = sizeof(_ds2_ds.txt_data);
+	first = TEXT_RING_SIZE - read;
+	if (first > length)
+		first = length;
+
+	memcpy(_ds2_ds.txt_data, &_ds2_ds.txt_ring[read], first);
+	memcpy(&_ds2_ds.txt_data[first], _ds2_ds.txt_ring, length - first);
+	_text_encoding_0(_ds2_ds.txt_data, length);
+
+	read = (read + length) & (TEXT_RING_SIZE - 1);
+	_ds2_ds.txt_read = read;
+	if (read != write)
+		_add_pending_send(PENDING_SEND_TEXT);
 }
 
 void _text_enqueue(const char* text, size_t length)
@@ -37,19 +52,32 @@ void _text_enqueue(const char* text, size_t length)
 	if (text == NULL)
 		return;
 
+	/* 'write' is kept across the wait, so text written by a deferred call
+	 * during the wait would be overwritten. */
+	_block_deferred_calls();
 	while (length > 0) {
+		size_t write = _ds2_ds.txt_write, free_bytes;
+
 		DS2_StartAwait();
-		while (_ds2_ds.txt_size != 0)
+		while ((free_bytes = (_ds2_ds.txt_read - write - 1) & (TEXT_RING_SIZE - 1)) == 0)
 			DS2_AwaitInterrupt();
 		DS2_StopAwait();
-		size_t entry_length = length >= 508 ? 508 : length;
-		memcpy(_ds2_ds.txt_data, text, entry_length);
-		_ds2_ds.txt_size = entry_length;
+
+		/* Copy as much as fits before the end of the ring buffer. The rest,
+		 * if any, goes to the start of it on the next iteration. */
+		size_t entry_length = TEXT_RING_SIZE - write;
+		if (entry_length > free_bytes)
+			entry_length = free_bytes;
+		if (entry_length > length)
+			entry_length = length;
+		memcpy(&_ds2_ds.txt_ring[write], text, entry_length);
 		text += entry_length;
 		length -= entry_length;
 
 		uint32_t section = DS2_EnterCriticalSection();
+		_ds2_ds.txt_write = (write + entry_length) & (TEXT_RING_SIZE - 1);
 		_add_pending_send(PENDING_SEND_TEXT);
 		DS2_LeaveCriticalSection(section);
 	}
+	_unblock_deferred_calls();
 }
@@ -0,0 +1,191 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <ds2/ds.h>
+#include <ds2/pm.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../intc.h"
+#include "card_protocol.h"
+#include "globals.h"
+#include "tiles.h"
+
+void _tile_dequeue(void)
+{
+	_send_reply_4(DATA_KIND_TILES | DATA_ENCODING(0) | DATA_BYTE_COUNT(_ds2_ds.tile_size));
+	_send_reply_4(_ds2_ds.tile_header_2);
+	_send_reply(_ds2_ds.tile_data, 504);
+	_ds2_ds.tile_size = 0;
+}
+
+/* Waits until the interrupt handler has sent all tile data. */
+static void await_tile_data(void)
+{
+	DS2_StartAwait();
+	while (_ds2_ds.tile_size != 0)
+		DS2_AwaitInterrupt();
+	DS2_StopAwait();
+}
+
+/* Queues bytes to be written at the given offset in one of the tile targets,
+ * splitting them into as many packets as needed. */
+static void send_tile_data(uint32_t target, size_t offset, const void* data, size_t bytes)
+{
+	const uint8_t* src = data;
+
+	while (bytes > 0) {
+		size_t count = bytes >= 504 ? 504 : bytes;
+
+		await_tile_data();
+		memcpy(_ds2_ds.tile_data, src, count);
+		_ds2_ds.tile_header_2 = TILE_OFFSET(offset) | target;
+		_ds2_ds.tile_size = count;
+
+		uint32_t section = DS2_EnterCriticalSection();
+		_add_pending_send(PENDING_SEND_TILES);
+		DS2_LeaveCriticalSection(section);
+
+		src += count;
+		offset += count;
+		bytes -= count;
+	}
+}
+
+int DS2_SetTileMode(unsigned int bits_per_pixel, size_t map_width, size_t map_height)
+{
+	if ((bits_per_pixel != 4 && bits_per_pixel != 8)
+	 || (map_width != 32 && map_width != 64)
+	 || (map_height != 32 && map_height != 64))
+		return EINVAL;
+	if (!(_ds2_ds.vid_features_supported & HELLO_VIDEO_TILES))
+		return ENOTSUP;
+
+	{
+		uint32_t section = DS2_EnterCriticalSection();
+
+		_ds2_ds.tile_bpp = bits_per_pixel;
+		_ds2_ds.tile_map_width = map_width;
+		_ds2_ds.tile_map_height = map_height;
+
+		_ds2_ds.requests.change_tile_mode = 1;
+		_ds2_ds.requests.tile_map_size = (map_width == 64 ? 1 : 0) | (map_height == 64 ? 2 : 0);
+		_ds2_ds.requests.tile_8bpp = bits_per_pixel == 8 ? 1 : 0;
+		/* Setting the mode resets the scroll, after any earlier scroll in the
+		 * same requests would have been applied. */
+		_ds2_ds.requests.change_tile_scroll = 0;
+
+		_add_pending_send(PENDING_SEND_REQUESTS);
+		DS2_LeaveCriticalSection(section);
+	}
+	return 0;
+}
+
+int DS2_SetTileGraphics(size_t first_tile, const void* data, size_t count)
+{
+	size_t tile_bytes = 8 * _ds2_ds.tile_bpp;
+
+	if (!(_ds2_ds.vid_features_supported & HELLO_VIDEO_TILES))
+		return ENOTSUP;
+	if (_ds2_ds.tile_bpp == 0 || data == NULL
+	 || first_tile > DS2_TILE_COUNT || count > DS2_TILE_COUNT - first_tile)
+		return EINVAL;
+
+	send_tile_data(TILE_TARGET_GRAPHICS, first_tile * tile_bytes, data, count * tile_bytes);
+	await_tile_data();
+	return 0;
+}
+
+int DS2_SetTilePalette(size_t first_color, const uint16_t* colors, size_t count)
+{
+	if (!(_ds2_ds.vid_features_supported & HELLO_VIDEO_TILES))
+		return ENOTSUP;
+	if (_ds2_ds.tile_bpp == 0 || colors == NULL
+	 || first_color > 256 || count > 256 - first_color)
+		return EINVAL;
+
+	send_tile_data(TILE_TARGET_PALETTE, first_color * sizeof(uint16_t), colors, count * sizeof(uint16_t));
+	await_tile_data();
+	return 0;
+}
+
+int DS2_SetTileMap(size_t x, size_t y, size_t width, size_t height, const uint16_t* entries)
+{
+	/* Entries that are next to each other in the map's memory are gathered
+	 * here, so that a rectangle spanning whole rows of a 32-tile-wide block
+	 * goes out in full packets. */
+	uint16_t run[252];
+	size_t run_offset = 0, run_count = 0, row, col;
+
+	if (!(_ds2_ds.vid_features_supported & HELLO_VIDEO_TILES))
+		return ENOTSUP;
+	if (_ds2_ds.tile_bpp == 0 || entries == NULL
+	 || x > _ds2_ds.tile_map_width || width > _ds2_ds.tile_map_width - x
+	 || y > _ds2_ds.tile_map_height || height > _ds2_ds.tile_map_height - y)
+		return EINVAL;
+
+	for (row = 0; row < height; row++) {
+		for (col = 0; col < width; col++) {
+			size_t map_x = x + col, map_y = y + row;
+			/* The map is made of blocks of 32x32 entries, stored row by row
+			 * in each block, with the blocks themselves stored row by row. */
+			size_t offset = (((map_y / 32) * (_ds2_ds.tile_map_width / 32) + map_x / 32) * 1024
+			              + (map_y % 32) * 32 + map_x % 32) * sizeof(uint16_t);
+
+			if (run_count == sizeof(run) / sizeof(run[0])
+			 || (run_count > 0 && offset != run_offset + run_count * sizeof(uint16_t))) {
+				send_tile_data(TILE_TARGET_MAP, run_offset, run, run_count * sizeof(uint16_t));
+				run_count = 0;
+			}
+			if (run_count == 0)
+				run_offset = offset;
+			run[run_count++] = entries[row * width + col];
+		}
+	}
+	if (run_count > 0)
+		send_tile_data(TILE_TARGET_MAP, run_offset, run, run_count * sizeof(uint16_t));
+
+	/* Requests have a higher priority than tile data. Make sure that the map
+	 * is all sent before returning, so that a scroll made right afterwards
+	 * does not show the old map entries. */
+	await_tile_data();
+	return 0;
+}
+
+int DS2_SetTileScroll(unsigned int x, unsigned int y)
+{
+	if (!(_ds2_ds.vid_features_supported & HELLO_VIDEO_TILES))
+		return ENOTSUP;
+	if (_ds2_ds.tile_bpp == 0)
+		return EINVAL;
+
+	{
+		uint32_t section = DS2_EnterCriticalSection();
+
+		_ds2_ds.requests.change_tile_scroll = 1;
+		_ds2_ds.requests.tile_scroll_x = x & 511;
+		_ds2_ds.requests.tile_scroll_y = y & 511;
+
+		_add_pending_send(PENDING_SEND_REQUESTS);
+		DS2_LeaveCriticalSection(section);
+	}
+	return 0;
+}
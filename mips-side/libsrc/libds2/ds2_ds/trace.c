@@ -0,0 +1,129 @@
+/*
+ * This file is part of the DS communication library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ds2/ds.h>
+#include <ds2/pm.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "../intc.h"
+#include "globals.h"
+#include "trace.h"
+
+/* Returns the trace record that holds the given frame, if any. */
+static struct DS2_FrameTrace* trace_record(uint32_t frame)
+{
+	struct DS2_FrameTrace* record = &_ds2_ds.trace_frames[frame & (TRACE_FRAME_COUNT - 1)];
+	return record->frame == frame ? record : NULL;
+}
+
+void _trace_input(const struct DS_InputState* new_state)
+{
+	if (!_ds2_ds.trace_enabled)
+		return;
+
+	/* Only the first change since the last flip is kept, so that a frame's
+	 * record shows the longest wait for any input it may reflect. */
+	if (new_state->buttons != _ds2_ds.trace_buttons && !_ds2_ds.trace_input_pending) {
+		_ds2_ds.trace_input_time = clock();
+		_ds2_ds.trace_input_vblank = _ds2_ds.vblank_count;
+		_ds2_ds.trace_input_pending = true;
+	}
+	_ds2_ds.trace_buttons = new_state->buttons;
+}
+
+void _trace_queued(uint32_t frame)
+{
+	struct DS2_FrameTrace* record = &_ds2_ds.trace_frames[frame & (TRACE_FRAME_COUNT - 1)];
+
+	if (!_ds2_ds.trace_enabled)
+		return;
+
+	memset(record, 0, sizeof(*record));
+	record->frame = frame;
+	record->queued_time = clock();
+	record->queued_vblank = _ds2_ds.vblank_count;
+
+	if (_ds2_ds.trace_input_pending) {
+		record->flags |= DS2_TRACE_INPUT;
+		record->input_time = _ds2_ds.trace_input_time;
+		record->input_vblank = _ds2_ds.trace_input_vblank;
+		_ds2_ds.trace_input_pending = false;
+	}
+}
+
+void _trace_sent(uint32_t frame)
+{
+	struct DS2_FrameTrace* record;
+
+	if (!_ds2_ds.trace_enabled || (record = trace_record(frame)) == NULL)
+		return;
+
+	record->flags |= DS2_TRACE_SENT;
+	record->sent_time = clock();
+	record->sent_vblank = _ds2_ds.vblank_count;
+}
+
+void _trace_displayed(uint32_t frame)
+{
+	struct DS2_FrameTrace* record;
+
+	if (!_ds2_ds.trace_enabled || (record = trace_record(frame)) == NULL)
+		return;
+
+	record->flags |= DS2_TRACE_DISPLAYED;
+	record->displayed_time = clock();
+	record->displayed_vblank = _ds2_ds.vblank_count;
+}
+
+void DS2_SetFrameTracing(bool enable)
+{
+	uint32_t section = DS2_EnterCriticalSection();
+
+	if (enable && !_ds2_ds.trace_enabled) {
+		memset(_ds2_ds.trace_frames, 0, sizeof(_ds2_ds.trace_frames));
+		_ds2_ds.trace_buttons = _ds2_ds.in_state.buttons;
+		_ds2_ds.trace_input_pending = false;
+	}
+	_ds2_ds.trace_enabled = enable;
+
+	DS2_LeaveCriticalSection(section);
+}
+
+int DS2_GetFrameTrace(uint32_t frame, struct DS2_FrameTrace* trace)
+{
+	const struct DS2_FrameTrace* record;
+	uint32_t section;
+	int result = 0;
+
+	if (frame == 0 || frame > _ds2_ds.vid_flip_count)
+		return EINVAL;
+
+	section = DS2_EnterCriticalSection();
+	if ((record = trace_record(frame)) != NULL)
+		*trace = *record;
+	else
+		result = ENOENT;
+	DS2_LeaveCriticalSection(section);
+
+	return result;
+}
@@ -0,0 +1,43 @@
+/*
+ * This file is part of the DS communication library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __DS2_DS_TRACE_H__
+#define __DS2_DS_TRACE_H__
+
+#include <ds2/ds.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Notes the arrival of new input from the Nintendo DS, if tracing is enabled
+ * and the buttons changed. Must be called from an interrupt handler. */
+extern void _trace_input(const struct DS_InputState* new_state);
+
+/* Starts the trace record for a newly flipped frame, if tracing is enabled.
+ * Must be called in a critical section. */
+extern void _trace_queued(uint32_t frame);
+
+/* Notes that the last packet of a flipped frame was sent to the Nintendo DS,
+ * if tracing is enabled. Must be called from an interrupt handler. */
+extern void _trace_sent(uint32_t frame);
+
+/* Notes that a flipped frame was displayed by the Nintendo DS, if tracing is
+ * enabled. Must be called from an interrupt handler. */
+extern void _trace_displayed(uint32_t frame);
+
+#endif /* !__DS2_DS_TRACE_H__ */
@@ -22,28 +22,34 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "../intc.h"
 #include "video.h"
 #include "globals.h"
+#include "trace.h"
 #include "video_encoding_0.h"
 #include "video_encoding_1.h"
 
-uint16_t _video_main[MAIN_BUFFER_COUNT][DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT] __attribute__((aligned (32)));
+uint32_t _video_main[MAIN_BUFFER_MAX][DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT] __attribute__((aligned (32)));
 
-uint16_t _video_main_palettes[MAIN_BUFFER_COUNT][256] __attribute__((aligned (32)));
+uint16_t _video_main_palettes[MAIN_BUFFER_MAX][256] __attribute__((aligned (32)));
 
-uint8_t _video_main_rev_palettes[MAIN_BUFFER_COUNT][0x8000] __attribute__((aligned (32)));
+uint8_t _video_main_rev_palettes[MAIN_BUFFER_MAX][REV_PALETTE_SIZE] __attribute__((aligned (32)));
 
-uint16_t _video_sub[DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT] __attribute__((aligned (32)));
+uint32_t _video_sub[DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT] __attribute__((aligned (32)));
 
 extern size_t _make_palette(uint_fast8_t buffer);
 
+extern void _video_fill(void* dst, uint32_t word, size_t lines);
+
 static int video_enqueue(enum DS_Engine engine, size_t start_y, size_t end_y, bool flip)
 {
 	volatile uint8_t* busy;
-	uint16_t* src;
+	const uint8_t* src;
+	enum DS2_PixelFormat format;
 	size_t palette_count = 0;
+	uint32_t field_flags = 0;
 
 	if (start_y == end_y)
 		return 0;
@@ -53,6 +59,10 @@ static int video_enqueue(enum DS_Engine engine, size_t start_y, size_t end_y, bo
 		return EINVAL;
 	}
 
+	/* The waits below use the current buffer, which a deferred call that
+	 * updates the screen would move. */
+	_block_deferred_calls();
+
 	if (engine == DS_ENGINE_MAIN) {
 		busy = &_ds2_ds.vid_main_busy[_ds2_ds.vid_main_current];
 		/* Wait for any transfer of this very screen to the Nintendo DS to end. */
@@ -60,7 +70,7 @@ static int video_enqueue(enum DS_Engine engine, size_t start_y, size_t end_y, bo
 		while (*busy != 0)
 			DS2_AwaitInterrupt();
 		DS2_StopAwait();
-		src = _video_main[_ds2_ds.vid_main_current];
+		src = (const uint8_t*) _video_main[_ds2_ds.vid_main_current];
 
 		/* If we're using multiple buffering and the Nintendo DS is still
 		 * displaying the screen we're about to send, wait until the DS flips
@@ -81,7 +91,7 @@ static int video_enqueue(enum DS_Engine engine, size_t start_y, size_t end_y, bo
 		 * updating a hidden buffer for the next 2 VBlanks. */
 		else if (!flip && _ds2_ds.vid_last_was_flip) {
 			DS2_StartAwait();
-			while ((_ds2_ds.vid_main_displayed + 1) % MAIN_BUFFER_COUNT != _ds2_ds.vid_main_current)
+			while ((_ds2_ds.vid_main_displayed + 1) % _ds2_ds.vid_main_count != _ds2_ds.vid_main_current)
 				DS2_AwaitInterrupt();
 			DS2_StopAwait();
 		}
@@ -92,12 +102,26 @@ static int video_enqueue(enum DS_Engine engine, size_t start_y, size_t end_y, bo
 		while (*busy != 0)
 			DS2_AwaitInterrupt();
 		DS2_StopAwait();
-		src = _video_sub;
+		src = (const uint8_t*) _video_sub;
+	}
+
+	format = _ds2_ds.vid_formats[engine - 1];
+
+	if (engine == DS_ENGINE_MAIN && flip && _ds2_ds.vid_field_mode != DS2_FIELDS_OFF) {
+		field_flags = VIDEO_FIELD
+		            | (_ds2_ds.vid_field_odd ? VIDEO_FIELD_ODD : 0)
+		            | (_ds2_ds.vid_field_mode == DS2_FIELDS_LINE_DOUBLED ? VIDEO_LINE_DOUBLE : 0);
 	}
 
+	/* _make_palette only understands 15-bit colors. Fields are only sent
+	 * with video encoding 0. */
 	if (_ds2_ds.vid_compress && _ds2_ds.vid_encodings_supported >= 2
+	 && field_flags == 0
+	 && (format == DS2_PIXEL_FORMAT_BGR555 || format == DS2_PIXEL_FORMAT_RGB555)
 	 && engine == DS_ENGINE_MAIN && flip && _ds2_ds.vid_last_was_flip) {
 		palette_count = _make_palette(_ds2_ds.vid_main_current);
+		if (palette_count != 0)
+			_make_rev_palette(_ds2_ds.vid_main_current, palette_count);
 	}
 
 	if (_ds2_ds.vid_main_was_palette[_ds2_ds.vid_main_current] || palette_count != 0) {
@@ -110,12 +134,35 @@ static int video_enqueue(enum DS_Engine engine, size_t start_y, size_t end_y, bo
 
 	_ds2_ds.vid_main_was_palette[_ds2_ds.vid_main_current] = palette_count != 0;
 
+	if (field_flags != 0) {
+		/* Convert the rows to send into rows of the field, which are every
+		 * other row of the screen starting at row 0 or 1. */
+		unsigned int odd = _ds2_ds.vid_field_odd ? 1 : 0;
+		size_t field_start_y = (start_y + 1 - odd) / 2,
+		       field_end_y = (end_y + 1 - odd) / 2;
+		if (field_start_y != field_end_y) {
+			start_y = field_start_y;
+			end_y = field_end_y;
+		} else {
+			/* The field has no rows in the range. Flip the rows as usual. */
+			field_flags = 0;
+		}
+	}
+
 	{
 		uint32_t section = DS2_EnterCriticalSection();
 		struct _video_entry* tail = &_ds2_ds.vid_queue[_ds2_ds.vid_queue_count];
 
-		tail->src = src + DS_SCREEN_WIDTH * start_y;
+		/* For fields, pixels are found using the pixel offset, so the source
+		 * is the start of the screen. */
+		tail->src = (field_flags != 0) ? src
+		          : src + DS_SCREEN_WIDTH * start_y * _video_pixel_size(format);
+		tail->field_flags = field_flags;
 		tail->engine = engine;
+		tail->format = format;
+		tail->has_present_at = flip && _ds2_ds.vid_has_present_at;
+		tail->present_at = _ds2_ds.vid_present_at;
+		tail->frame = flip ? _ds2_ds.vid_flip_count + 1 : 0;
 		tail->buffer = (engine == DS_ENGINE_MAIN) ? _ds2_ds.vid_main_current : 0;
 		tail->pixel_offset = DS_SCREEN_WIDTH * start_y;
 		tail->pixel_count = DS_SCREEN_WIDTH * (end_y - start_y);
@@ -131,8 +178,15 @@ static int video_enqueue(enum DS_Engine engine, size_t start_y, size_t end_y, bo
 		_ds2_ds.vid_queue_count++;
 		*busy = 1;
 
-		if (flip)
-			_ds2_ds.vid_main_current = (_ds2_ds.vid_main_current + 1) % MAIN_BUFFER_COUNT;
+		if (flip) {
+			_ds2_ds.vid_main_frame[_ds2_ds.vid_main_current] = ++_ds2_ds.vid_flip_count;
+			_trace_queued(_ds2_ds.vid_flip_count);
+			if (field_flags != 0)
+				_ds2_ds.vid_field_odd = !_ds2_ds.vid_field_odd;
+			_ds2_ds.vid_has_present_at = false;
+			_ds2_ds.vid_main_flipped = _ds2_ds.vid_main_current;
+			_ds2_ds.vid_main_current = (_ds2_ds.vid_main_current + 1) % _ds2_ds.vid_main_count;
+		}
 		if (engine == DS_ENGINE_MAIN)
 			_ds2_ds.vid_last_was_flip = flip;
 
@@ -144,37 +198,84 @@ static int video_enqueue(enum DS_Engine engine, size_t start_y, size_t end_y, bo
 		DS2_LeaveCriticalSection(section);
 	}
 
+	_unblock_deferred_calls();
 	return 0;
 }
 
+/* Gathers the next pixels of a field into vid_field_data and prepares them
+ * with video encoding 0. */
+static size_t video_encode_field(const struct _video_entry* entry)
+{
+	size_t pixel_size = _video_pixel_size(entry->format);
+	uint8_t* dst = (uint8_t*) _ds2_ds.vid_field_data;
+	size_t offset = entry->pixel_offset, count = 0, result;
+	unsigned int odd = (entry->field_flags & VIDEO_FIELD_ODD) ? 1 : 0;
+
+	while (count < 252 && count < entry->pixel_count) {
+		size_t x = offset % DS_SCREEN_WIDTH;
+		size_t y = (offset / DS_SCREEN_WIDTH) * 2 + odd;
+		size_t run = DS_SCREEN_WIDTH - x;
+
+		if (run > 252 - count)
+			run = 252 - count;
+		if (run > entry->pixel_count - count)
+			run = entry->pixel_count - count;
+
+		memcpy(dst + count * pixel_size,
+		       (const uint8_t*) entry->src + (y * DS_SCREEN_WIDTH + x) * pixel_size,
+		       run * pixel_size);
+		count += run;
+		offset += run;
+	}
+
+	result = _video_encoding_0(_ds2_ds.vid_field_data, entry->format, entry->engine, entry->buffer, entry->pixel_offset, entry->pixel_count);
+	_ds2_ds.vid_header_2 |= entry->field_flags;
+	return result;
+}
+
 void _video_dequeue(void)
 {
 	struct _video_entry* head = &_ds2_ds.vid_queue[0];
-	size_t result;
+	size_t result, i;
 
 	if (_ds2_ds.vid_queue_count == 0)
 		return;
 
+	/* If the frame is to be displayed at a given VBlank, and the next packet
+	 * ends it, hold the packet until the VBlank before that. The Nintendo DS
+	 * then flips to the frame at the target VBlank. */
+	if (head->has_present_at
+	 && (!head->use_palette || head->palette_sent)
+	 && head->pixel_count <= (head->use_palette ? 504 : 252)
+	 && (int32_t) (_ds2_ds.vblank_count - (head->present_at - 1)) < 0) {
+		_ds2_ds.vid_held = true;
+		return;
+	}
+
 	_add_pending_send(PENDING_SEND_VIDEO);
 
 	if (head->use_palette) {
 		if (!head->palette_sent) {
-			_send_palette(head->buffer);
+			_send_palette(head->buffer, head->format);
 			head->palette_sent = true;
 			result = 0;
 		} else {
 			result = _video_encoding_1(head->src, head->buffer, head->pixel_offset, head->pixel_count);
 		}
+	} else if (head->field_flags != 0) {
+		result = video_encode_field(head);
 	} else {
-		result = _video_encoding_0(head->src, head->engine, head->buffer, head->pixel_offset, head->pixel_count);
+		result = _video_encoding_0(head->src, head->format, head->engine, head->buffer, head->pixel_offset, head->pixel_count);
 	}
 
-	head->src += result;
+	if (head->field_flags == 0)
+		head->src = (const uint8_t*) head->src + result * _video_pixel_size(head->format);
 	head->pixel_offset += result;
 	head->pixel_count -= result;
+	_ds2_ds.vid_next_frame = 0;
 
 	if (head->pixel_count == 0) {
-		size_t i;
+		_ds2_ds.vid_next_frame = head->frame;
 		*head->busy = 0;
 		for (i = 1; i < _ds2_ds.vid_queue_count; i++) {
 			_ds2_ds.vid_queue[i - 1] = _ds2_ds.vid_queue[i];
@@ -185,7 +286,17 @@ void _video_dequeue(void)
 
 void _video_displayed(uint_fast8_t index)
 {
+	uint32_t frame = _ds2_ds.vid_main_frame[index];
+
 	_ds2_ds.vid_main_displayed = index;
+
+	if (frame != 0 && frame != _ds2_ds.vid_last_displayed_frame) {
+		struct _displayed_frame* entry = &_ds2_ds.vid_displayed_frames[frame & (DISPLAYED_FRAME_COUNT - 1)];
+		entry->frame = frame;
+		entry->vblank = _ds2_ds.vblank_count;
+		_ds2_ds.vid_last_displayed_frame = frame;
+		_trace_displayed(frame);
+	}
 }
 
 void DS2_UseVideoCompression(bool compress)
@@ -213,6 +324,58 @@ int DS2_FlipMainScreenPart(size_t start_y, size_t end_y)
 	return video_enqueue(DS_ENGINE_MAIN, start_y, end_y, true);
 }
 
+size_t DS2_GetMainBufferCount(void)
+{
+	return _ds2_ds.vid_main_count;
+}
+
+int DS2_SetMainBufferCount(size_t count)
+{
+	size_t i;
+
+	if (count < MAIN_BUFFER_MIN || count > MAIN_BUFFER_MAX)
+		return EINVAL;
+	if (count > _ds2_ds.vid_main_buffers_supported)
+		return ENOTSUP;
+	if (count == _ds2_ds.vid_main_count)
+		return 0;
+
+	/* Let every queued frame reach the Nintendo DS, so that no transfer
+	 * refers to a buffer that is about to leave the cycle. Then wait for the
+	 * last flip to be displayed, because the buffer chosen below must not be
+	 * the one the Nintendo DS is about to flip to. A deferred call must not
+	 * queue more frames meanwhile. */
+	_block_deferred_calls();
+	DS2_StartAwait();
+	while (_ds2_ds.vid_queue_count != 0)
+		DS2_AwaitInterrupt();
+	for (i = 0; i < MAIN_BUFFER_MAX; i++) {
+		while (_ds2_ds.vid_main_busy[i] != 0)
+			DS2_AwaitInterrupt();
+	}
+	while (_ds2_ds.vid_main_displayed != _ds2_ds.vid_main_flipped)
+		DS2_AwaitInterrupt();
+	DS2_StopAwait();
+
+	{
+		uint32_t section = DS2_EnterCriticalSection();
+
+		_ds2_ds.vid_main_count = count;
+		/* Write into the buffer that follows the displayed one. The
+		 * displayed buffer may be outside the new cycle, in which case the
+		 * next flip moves the Nintendo DS back into it. */
+		_ds2_ds.vid_main_current = (_ds2_ds.vid_main_displayed + 1) % count;
+		/* The waits in video_enqueue assume the previous flips followed the
+		 * current cycle, which is not true anymore. */
+		_ds2_ds.vid_last_was_flip = false;
+
+		DS2_LeaveCriticalSection(section);
+	}
+
+	_unblock_deferred_calls();
+	return 0;
+}
+
 int DS2_AwaitScreenUpdate(enum DS_Engine engine)
 {
 	if (engine & ~DS_ENGINE_BOTH)
@@ -235,22 +398,41 @@ int DS2_AwaitScreenUpdate(enum DS_Engine engine)
 	return 0;
 }
 
+int DS2_FillScreen(enum DS_Engine engine, uint32_t color)
+{
+	void* dst;
+	size_t pixel_size;
+
+	if (engine != DS_ENGINE_MAIN && engine != DS_ENGINE_SUB)
+		return EINVAL;
+
+	dst = DS2_GetScreen(engine);
+	pixel_size = _video_pixel_size(_ds2_ds.vid_formats[engine - 1]);
+	if (pixel_size == 2) {
+		color &= UINT32_C(0xFFFF);
+		color |= color << 16;
+	}
+
+	_video_fill(dst, color, DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT * pixel_size / 32);
+	return 0;
+}
+
 uint16_t* DS2_GetMainScreen(void)
 {
-	return _video_main[_ds2_ds.vid_main_current];
+	return (uint16_t*) _video_main[_ds2_ds.vid_main_current];
 }
 
 uint16_t* DS2_GetSubScreen(void)
 {
-	return _video_sub;
+	return (uint16_t*) _video_sub;
 }
 
 uint16_t* DS2_GetScreen(enum DS_Engine engine)
 {
 	return engine == DS_ENGINE_MAIN
-		? _video_main[_ds2_ds.vid_main_current]
+		? (uint16_t*) _video_main[_ds2_ds.vid_main_current]
 		: engine == DS_ENGINE_SUB
-			? _video_sub
+			? (uint16_t*) _video_sub
 			: NULL;
 }
 
@@ -261,7 +443,8 @@ enum DS2_PixelFormat DS2_GetPixelFormat(enum DS_Engine engine)
 
 int DS2_SetPixelFormat(enum DS_Engine engine, enum DS2_PixelFormat format)
 {
-	if ((format != DS2_PIXEL_FORMAT_BGR555 && format != DS2_PIXEL_FORMAT_RGB555)
+	if ((format != DS2_PIXEL_FORMAT_BGR555 && format != DS2_PIXEL_FORMAT_RGB555
+	  && format != DS2_PIXEL_FORMAT_RGB565 && format != DS2_PIXEL_FORMAT_XRGB8888)
 	 || ((engine & ~DS_ENGINE_BOTH) != 0)) {
 		return EINVAL;
 	}
@@ -283,6 +466,65 @@ enum DS_Screen DS2_GetScreenBacklights(void)
 	return _ds2_ds.vid_backlights;
 }
 
+uint32_t DS2_GetVBlankCount(void)
+{
+	return _ds2_ds.vblank_count;
+}
+
+void DS2_PresentAt(uint32_t vblank)
+{
+	_ds2_ds.vid_present_at = vblank;
+	_ds2_ds.vid_has_present_at = true;
+}
+
+uint32_t DS2_GetFlipCount(void)
+{
+	return _ds2_ds.vid_flip_count;
+}
+
+int DS2_GetFrameVBlank(uint32_t frame, uint32_t* vblank)
+{
+	const struct _displayed_frame* entry = &_ds2_ds.vid_displayed_frames[frame & (DISPLAYED_FRAME_COUNT - 1)];
+	uint32_t section;
+	int result;
+
+	if (frame == 0 || frame > _ds2_ds.vid_flip_count)
+		return EINVAL;
+
+	section = DS2_EnterCriticalSection();
+	if (entry->frame == frame) {
+		*vblank = entry->vblank;
+		result = 0;
+	} else if (frame > _ds2_ds.vid_last_displayed_frame) {
+		result = EAGAIN;
+	} else {
+		/* Either the frame was replaced before the Nintendo DS flipped to
+		 * it, or it was displayed too long ago to be remembered. */
+		result = ENOENT;
+	}
+	DS2_LeaveCriticalSection(section);
+
+	return result;
+}
+
+enum DS2_FieldMode DS2_GetFieldMode(void)
+{
+	return _ds2_ds.vid_field_mode;
+}
+
+int DS2_SetFieldMode(enum DS2_FieldMode mode)
+{
+	if (mode != DS2_FIELDS_OFF && mode != DS2_FIELDS_INTERLACED
+	 && mode != DS2_FIELDS_LINE_DOUBLED)
+		return EINVAL;
+	if (mode != DS2_FIELDS_OFF
+	 && !(_ds2_ds.vid_features_supported & HELLO_VIDEO_FIELDS))
+		return ENOTSUP;
+
+	_ds2_ds.vid_field_mode = mode;
+	return 0;
+}
+
 void DS2_AwaitVBlank(void)
 {
 	uint32_t saved_count = _ds2_ds.vblank_count;
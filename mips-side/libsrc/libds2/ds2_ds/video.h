@@ -22,6 +22,7 @@
 
 #include <ds2/ds.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "globals.h"
@@ -30,30 +31,46 @@
  *
  * The Main Screen supports page flipping with many buffers. This buffer is
  * selected by the first array index, video_main[n].
- * The second array index, video_main[][n], has the screen pixels laid out
- * so that a row of pixels is contiguous in memory. */
-extern uint16_t _video_main[MAIN_BUFFER_COUNT][DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT];
+ * The second array index, video_main[][n], has room for the screen pixels in
+ * the largest pixel format, XRGB8888. Pixels are laid out so that a row of
+ * pixels is contiguous in memory. In 16-bit pixel formats, only the first half
+ * of each buffer is used. */
+extern uint32_t _video_main[MAIN_BUFFER_MAX][DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT];
 
 /* For each Main Screen buffer, this array contains the palette that was last
  * computed for the buffer, if it contained 252 unique colors or fewer. */
-extern uint16_t _video_main_palettes[MAIN_BUFFER_COUNT][256];
+extern uint16_t _video_main_palettes[MAIN_BUFFER_MAX][256];
+
+/* The number of entries in a reverse palette: one per 15-bit color. */
+#define REV_PALETTE_SIZE 0x8000
 
 /* For each Main Screen buffer, this array maps pixels (of the pixel format
  * used by the Main Screen; see _ds2_ds.vid_formats) to the palette entries
  * that correspond to them.
  *
  * The upper bit of a pixel must be cleared before looking it up. If colors
- * don't appear in the buffer, their palette entries are left undefined. */
-extern uint8_t _video_main_rev_palettes[MAIN_BUFFER_COUNT][0x8000];
+ * don't appear in the buffer, their palette entries are left undefined.
+ *
+ * A frame only touches one 32-byte line of the table per color, so the
+ * table does not thrash the data cache even though it is larger than it,
+ * and a lookup is a single load. */
+extern uint8_t _video_main_rev_palettes[MAIN_BUFFER_MAX][REV_PALETTE_SIZE];
 
 /* The buffer for the Sub Screen to be sent to the Nintendo DS.
  *
  * The Sub Screen doesn't support page flipping, so video_sub[n] has the
- * screen pixels laid out so that a row of pixels is contiguous in memory. */
-extern uint16_t _video_sub[DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT];
+ * screen pixels laid out so that a row of pixels is contiguous in memory.
+ * Like the Main Screen buffers, it has room for 32-bit pixels. */
+extern uint32_t _video_sub[DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT];
 
 extern void _video_dequeue(void);
 
+/* Returns the size, in bytes, of a pixel in the given pixel format. */
+static inline size_t _video_pixel_size(enum DS2_PixelFormat format)
+{
+	return format == DS2_PIXEL_FORMAT_XRGB8888 ? 4 : 2;
+}
+
 extern void _video_displayed(uint_fast8_t index);
 
 /* Converts the given pixel, in the pixel format used on the given Nintendo DS
@@ -67,7 +84,7 @@ extern void _video_displayed(uint_fast8_t index);
  * Returns:
  *   The converted pixel value.
  */
-static inline uint16_t _video_convert_bgr555(uint16_t pixel, enum DS_Engine engine)
+static inline uint16_t _video_convert_bgr555(uint32_t pixel, enum DS_Engine engine)
 {
 	enum DS2_PixelFormat format = _ds2_ds.vid_formats[engine - 1];
 	switch (format) {
@@ -80,6 +97,18 @@ static inline uint16_t _video_convert_bgr555(uint16_t pixel, enum DS_Engine engi
 			     | ((pixel & UINT16_C(0x001F)) << 10)
 			     |  (pixel & UINT16_C(0x03E0));
 
+		case DS2_PIXEL_FORMAT_RGB565:
+			return UINT16_C(0x8000)
+			     | ((pixel & UINT16_C(0xF800)) >> 11)
+			     | ((pixel & UINT16_C(0x001F)) << 10)
+			     | ((pixel & UINT16_C(0x07C0)) >> 1);
+
+		case DS2_PIXEL_FORMAT_XRGB8888:
+			return UINT16_C(0x8000)
+			     | ((pixel & UINT32_C(0xF80000)) >> 19)
+			     | ((pixel & UINT32_C(0x0000F8)) << 7)
+			     | ((pixel & UINT32_C(0x00F800)) >> 6);
+
 		default:
 			return 0;
 	}
@@ -23,8 +23,36 @@
 
 #include "card_protocol.h"
 #include "globals.h"
+#include "video_encoding_0.h"
 
-size_t _video_encoding_0(const uint16_t* src, enum DS_Engine engine, uint_fast8_t buffer, uint_fast16_t pixel_offset, size_t pixel_count)
+/* Converts pairs of RGB 565 pixels to BGR 555 with the upper bit set. */
+static void convert_rgb565(uint32_t* dst, const uint32_t* src, size_t pixel_count)
+{
+	size_t i;
+
+	for (i = 0; i < pixel_count / 2; i++) {
+		uint32_t pair = src[i];
+		dst[i] = UINT32_C(0x80008000)
+		       | ((pair >> 11) & UINT32_C(0x001F001F))
+		       | ((pair << 10) & UINT32_C(0x7C007C00))
+		       | ((pair >> 1) & UINT32_C(0x03E003E0));
+	}
+}
+
+/* Converts pairs of XRGB 8888 pixels to BGR 555 with the upper bit set. */
+static void convert_xrgb8888(uint32_t* dst, const uint32_t* src, size_t pixel_count)
+{
+	size_t i;
+
+	for (i = 0; i < pixel_count / 2; i++) {
+		uint32_t a = src[i * 2], b = src[i * 2 + 1];
+		a = ((a >> 19) & 0x001F) | ((a << 7) & 0x7C00) | ((a >> 6) & 0x03E0);
+		b = ((b >> 19) & 0x001F) | ((b << 7) & 0x7C00) | ((b >> 6) & 0x03E0);
+		dst[i] = UINT32_C(0x80008000) | a | (b << 16);
+	}
+}
+
+size_t _video_encoding_0(const void* src, enum DS2_PixelFormat format, enum DS_Engine engine, uint_fast8_t buffer, uint_fast16_t pixel_offset, size_t pixel_count)
 {
 	bool end = pixel_count <= 252;
 	if (!end)
@@ -36,16 +64,37 @@ size_t _video_encoding_0(const uint16_t* src, enum DS_Engine engine, uint_fast8_
 	                  | (engine == DS_ENGINE_MAIN ? VIDEO_ENGINE_MAIN : VIDEO_ENGINE_SUB)
 	                  | (end ? VIDEO_END_FRAME : 0);
 
-	if (!end) {
-		_ds2_ds.vid_next_ptr = src;
-	} else {
-		/* There may not be 504 valid bytes after the final pixels of the
-		 * screen; the ones that follow may be past the end of RAM, so we
-		 * move them to vid_next_data. */
-		memcpy(&_ds2_ds.vid_next_data, src, pixel_count * sizeof(uint16_t));
+	switch (format) {
+	case DS2_PIXEL_FORMAT_BGR555:
+	case DS2_PIXEL_FORMAT_RGB555:
+	default:
+		if (!end) {
+			_ds2_ds.vid_next_ptr = src;
+		} else {
+			/* There may not be 504 valid bytes after the final pixels of the
+			 * screen; the ones that follow may be past the end of RAM, so we
+			 * move them to vid_next_data. */
+			memcpy(&_ds2_ds.vid_next_data, src, pixel_count * sizeof(uint16_t));
+			_ds2_ds.vid_next_ptr = &_ds2_ds.vid_next_data;
+		}
+		_ds2_ds.vid_fixup = true;
+		_ds2_ds.vid_fixup_format = format;
+		break;
+
+	/* The FPGA can't convert these formats, so the pixels are converted while
+	 * they are read, straight into the reply, which is then sent as is. */
+	case DS2_PIXEL_FORMAT_RGB565:
+		convert_rgb565(_ds2_ds.vid_next_data.words, src, pixel_count);
+		_ds2_ds.vid_next_ptr = &_ds2_ds.vid_next_data;
+		_ds2_ds.vid_fixup = false;
+		break;
+
+	case DS2_PIXEL_FORMAT_XRGB8888:
+		convert_xrgb8888(_ds2_ds.vid_next_data.words, src, pixel_count);
 		_ds2_ds.vid_next_ptr = &_ds2_ds.vid_next_data;
+		_ds2_ds.vid_fixup = false;
+		break;
 	}
-	_ds2_ds.vid_fixup = true;
 
 	return pixel_count;
 }
@@ -26,14 +26,19 @@
 
 /*
  * Video encoding 0 is simply uncompressed video sent to the Nintendo DS as
- * RGB 555 with the upper bit set on each 16-bit quantity.
+ * BGR 555 with the upper bit set on each 16-bit quantity.
+ *
+ * Pixels in BGR 555 and RGB 555 are sent straight from the screen buffer, and
+ * the FPGA converts them. Pixels in other formats are converted by the CPU
+ * into the reply as they are read.
  *
  * In:
  *   src: A pointer to the first pixel to be sent. This is guaranteed to be
  *     aligned to 4 bytes.
+ *   format: The pixel format of the pixels at 'src'.
  *   engine: The Nintendo DS engine to which the pixels are destined.
- *     This is used to get the proper pixel format (BGR 555 or RGB 555) and
- *     sent in the header.
+ *     This is used to get the proper FPGA conversion for BGR 555 and RGB 555
+ *     and sent in the header.
  *   buffer: If engine == DS_ENGINE_MAIN, the buffer number to which the
  *     pixels are destined. Sent in the header.
  *   pixel_offset: The pixel offset within the screen (or screen buffer) to
@@ -44,6 +49,6 @@
  * Returns:
  *   The number of pixels sent in the reply.
  */
-extern size_t _video_encoding_0(const uint16_t* src, enum DS_Engine engine, uint_fast8_t buffer, uint_fast16_t pixel_offset, size_t pixel_count);
+extern size_t _video_encoding_0(const void* src, enum DS2_PixelFormat format, enum DS_Engine engine, uint_fast8_t buffer, uint_fast16_t pixel_offset, size_t pixel_count);
 
 #endif /* !__DS2_DS_VIDEO_ENCODING_0_H__ */
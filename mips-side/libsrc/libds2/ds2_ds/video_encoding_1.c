@@ -24,11 +24,37 @@
 #include "card_protocol.h"
 #include "globals.h"
 #include "video.h"
+#include "video_encoding_1.h"
+
+void _make_rev_palette(uint_fast8_t buffer, size_t count)
+{
+	const uint16_t* palette = _video_main_palettes[buffer];
+	uint8_t* rev_palette = _video_main_rev_palettes[buffer];
+	size_t i;
+
+	/* Entries for the colors that are not in the palette are left as they
+	 * were. */
+	for (i = 0; i < count; i++)
+		rev_palette[palette[i]] = i;
+}
+
+/* Returns the palette entries for the two pixels in the given word, in the
+ * low 16 bits of the return value, in memory order. The upper bit of each
+ * pixel must be cleared. */
+static inline uint32_t rev_palette_lookup_pair(const uint8_t* rev_palette, uint32_t pair)
+{
+	uint_fast16_t low = pair & UINT32_C(0xFFFF), high = pair >> 16;
+
+	return (uint32_t) rev_palette[low] | ((uint32_t) rev_palette[high] << 8);
+}
 
 size_t _video_encoding_1(const uint16_t* src, uint_fast8_t buffer, uint_fast16_t pixel_offset, size_t pixel_count)
 {
 	bool end = pixel_count <= 504;
 	const uint8_t* rev_palette = _video_main_rev_palettes[buffer];
+	/* Two pixels are read at once. A lookup is one load, so it costs less
+	 * than checking for runs of the same color. */
+	const uint32_t* src_pairs = (const uint32_t*) src;
 	size_t i;
 	if (!end)
 		pixel_count = 504;
@@ -39,11 +65,11 @@ size_t _video_encoding_1(const uint16_t* src, uint_fast8_t buffer, uint_fast16_t
 	                     | VIDEO_ENGINE_MAIN
 	                     | (end ? VIDEO_END_FRAME : 0);
 
-	for (i = 0; i < pixel_count; i += 4) {
-		_ds2_ds.vid_next_data.words[i / 4] = rev_palette[src[i] & UINT16_C(0x7FFF)]
-			| (rev_palette[src[i + 1] & UINT16_C(0x7FFF)] << 8)
-			| (rev_palette[src[i + 2] & UINT16_C(0x7FFF)] << 16)
-			| (rev_palette[src[i + 3] & UINT16_C(0x7FFF)] << 24);
+	for (i = 0; i < pixel_count / 2; i += 2) {
+		uint32_t indices_a = rev_palette_lookup_pair(rev_palette, src_pairs[i] & UINT32_C(0x7FFF7FFF)),
+		         indices_b = rev_palette_lookup_pair(rev_palette, src_pairs[i + 1] & UINT32_C(0x7FFF7FFF));
+
+		_ds2_ds.vid_next_data.words[i / 2] = indices_a | (indices_b << 16);
 	}
 
 	_ds2_ds.vid_next_ptr = &_ds2_ds.vid_next_data;
@@ -52,7 +78,7 @@ size_t _video_encoding_1(const uint16_t* src, uint_fast8_t buffer, uint_fast16_t
 	return pixel_count;
 }
 
-void _send_palette(uint_fast8_t buffer)
+void _send_palette(uint_fast8_t buffer, enum DS2_PixelFormat format)
 {
 	_ds2_ds.vid_header_1 = DATA_KIND_VIDEO | DATA_ENCODING(1);
 	_ds2_ds.vid_header_2 = VIDEO_SET_PALETTE | VIDEO_BUFFER(buffer)
@@ -62,4 +88,5 @@ void _send_palette(uint_fast8_t buffer)
 	 * the Main Engine. Fixing up the palette to BGR 555 with the high bit set
 	 * will allow the Nintendo DS to get the right colors. */
 	_ds2_ds.vid_fixup = true;
+	_ds2_ds.vid_fixup_format = format;
 }
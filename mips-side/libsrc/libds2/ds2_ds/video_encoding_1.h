@@ -56,6 +56,18 @@
  */
 extern size_t _video_encoding_1(const uint16_t* src, uint_fast8_t buffer, uint_fast16_t pixel_offset, size_t pixel_count);
 
+/*
+ * Creates the reverse palette for the given buffer, mapping each color in
+ * _video_main_palettes[buffer] to its palette entry.
+ *
+ * In:
+ *   buffer: The buffer to make the reverse palette for.
+ *   count: The number of entries in the palette of the buffer, 1..252.
+ * Out:
+ *   _video_main_rev_palettes[buffer]: Updated.
+ */
+extern void _make_rev_palette(uint_fast8_t buffer, size_t count);
+
 /*
  * Sends the given palette to the Nintendo DS for the next frame.
  *
@@ -63,7 +75,9 @@ extern size_t _video_encoding_1(const uint16_t* src, uint_fast8_t buffer, uint_f
  *
  * In:
  *   buffer: The buffer to set the palette for. Sent in the header.
+ *   format: The pixel format the palette was made in, which is that of the
+ *     frame it belongs to.
  */
-extern void _send_palette(uint_fast8_t buffer);
+extern void _send_palette(uint_fast8_t buffer, enum DS2_PixelFormat format);
 
 #endif /* !__DS2_DS_VIDEO_ENCODING_1_H__ */
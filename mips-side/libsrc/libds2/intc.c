@@ -18,6 +18,7 @@
 */
 
 #include <mipsregs.h>
+#include <stddef.h>
 #include "bsp.h"
 #include "jz4740.h"
 #include "intc.h"
@@ -87,6 +88,9 @@ static void irq_ack(unsigned int irq)
 	}
 }
 
+void (* volatile _deferred_call)(void);
+volatile uint32_t _deferred_calls_blocked;
+
 static uint32_t ipl;  /* Interrupt Pending List */
 
 static int intc_irq(void)
@@ -134,6 +138,8 @@ void _intc_init(void)
 {
 	unsigned int i;
 	ipl = 0;
+	_deferred_call = NULL;
+	_deferred_calls_blocked = 0;
 	for (i = 0; i < IRQ_MAX; i++) {
 		irq_disable(i);
 		irq_table[i].handler = default_handler;
@@ -35,6 +35,31 @@ extern int irq_request(unsigned int irq, void (*handler) (unsigned int), unsigne
 // Removes the handler for the given IRQ number.
 extern void irq_free(unsigned int irq);
 
+// A function that an interrupt handler wants called outside of interrupt
+// handlers, or NULL. It is called, with interrupts enabled, the next time an
+// interrupt ends while the application is waiting in a block of code started
+// by DS2_StartAwait and deferred calls are not blocked, then set back to
+// NULL. Only one call can be pending.
+extern void (* volatile _deferred_call)(void);
+
+// The number of times deferred calls have been blocked and not yet
+// unblocked. While this is not 0, a pending deferred call waits.
+extern volatile uint32_t _deferred_calls_blocked;
+
+// Blocks deferred calls. Library code that waits for interrupts while its
+// state is half updated, or that must not be entered again by the deferred
+// call, blocks them around the wait. Deferred calls themselves run blocked.
+static inline void _block_deferred_calls(void)
+{
+	_deferred_calls_blocked++;
+}
+
+// Undoes one call to _block_deferred_calls.
+static inline void _unblock_deferred_calls(void)
+{
+	_deferred_calls_blocked--;
+}
+
 // Sets the master interrupt enable flag.
 extern void sti(void);
 
@@ -215,34 +215,66 @@ struct pr_chunk {
 	struct pr_chunk *min_star;
 	struct pr_chunk *max_star;
 	struct pr_chunk *next;
+	struct pr_chunk *same; /* next chunk using the same parameter */
+	int pooled; /* non-zero if taken from a struct pr_pool */
 };
 
 struct pr_chunk_x {
-	struct pr_chunk **chunks;
+	struct pr_chunk *first;
+	struct pr_chunk *last;
 	int num;
 };
 
-static int dopr(char* restrict buffer, size_t maxlen, const char* restrict format, 
+/*
+ * Storage on the stack of dopr() for the chunks and parameters of
+ * ordinary format strings, so that formatting one does not go through
+ * malloc. Longer format strings take the rest from the heap.
+ */
+#define PR_POOL_CHUNKS 24
+#define PR_POOL_PARAMS 12
+
+struct pr_pool {
+	struct pr_chunk chunks[PR_POOL_CHUNKS];
+	int used;
+	struct pr_chunk_x params[PR_POOL_PARAMS];
+};
+
+/*
+ * Destination of the characters produced by dopr().
+ * Without a stream, characters past maxlen are counted but dropped, as
+ * snprintf requires. With a stream, the buffer is written to it whenever
+ * it fills up, and once more at the end.
+ */
+struct pr_out {
+	char *buffer;
+	size_t maxlen;
+	size_t currlen; /* characters produced so far */
+	size_t flushed; /* characters already written to the stream */
+	FILE *stream;
+};
+
+static int dopr(struct pr_out* restrict out, const char* restrict format,
 		   va_list args_in);
-static void fmtstr(char* restrict buffer, size_t* restrict currlen, size_t maxlen,
+static void fmtstr(struct pr_out* restrict out,
 		    char* restrict value, int flags, int min, int max);
-static void fmtint(char* restrict buffer, size_t* restrict currlen, size_t maxlen,
+static void fmtint(struct pr_out* restrict out,
 		    LLONG value, int base, int min, int max, int flags);
-static void fmtfp(char* restrict buffer, size_t* restrict currlen, size_t maxlen,
+static void fmtfp(struct pr_out* restrict out,
 		   LDOUBLE fvalue, int min, int max, int flags);
-static void dopr_outch(char* restrict buffer, size_t* restrict currlen, size_t maxlen, char c);
-static struct pr_chunk *new_chunk(void);
-static int add_cnk_list_entry(struct pr_chunk_x **list,
+static void dopr_outch(struct pr_out* restrict out, char c);
+static void dopr_outstr(struct pr_out* restrict out, const char* restrict s, size_t len);
+static void dopr_flush(struct pr_out* restrict out);
+static struct pr_chunk *new_chunk(struct pr_pool *pool);
+static int add_cnk_list_entry(struct pr_chunk_x **list, struct pr_pool *pool,
 				int max_num, struct pr_chunk *chunk);
 
-static int dopr(char* restrict buffer, size_t maxlen, const char* restrict format, va_list args_in)
+static int dopr(struct pr_out* restrict out, const char* restrict format, va_list args_in)
 {
 	char ch;
 	int state;
 	int pflag;
 	int pnum;
 	int pfirst;
-	size_t currlen;
 	va_list args;
 	const char *base;
 	struct pr_chunk *chunks = NULL;
@@ -250,9 +282,12 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 	struct pr_chunk_x *clist = NULL;
 	int max_pos;
 	int ret = -1;
+	struct pr_pool pool;
 
 	VA_COPY(args, args_in);
 
+	pool.used = 0;
+
 	state = DP_S_DEFAULT;
 	pfirst = 1;
 	pflag = 0;
@@ -271,10 +306,10 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 		case DP_S_DEFAULT:
 			
 			if (cnk) {
-				cnk->next = new_chunk();
+				cnk->next = new_chunk(&pool);
 				cnk = cnk->next;
 			} else {
-				cnk = new_chunk();
+				cnk = new_chunk(&pool);
 			}
 			if (!cnk) goto done;
 			if (!chunks) chunks = cnk;
@@ -340,7 +375,7 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 				ch = *format++;
 			} else if (ch == '*') {
 				if (pfirst) pfirst = 0;
-				cnk->min_star = new_chunk();
+				cnk->min_star = new_chunk(&pool);
 				if (!cnk->min_star) /* out of memory :-( */
 					goto done;
 				cnk->min_star->type = CNK_INT;
@@ -360,7 +395,7 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 				} else {
 					cnk->min_star->num = ++pnum;
 				}
-				max_pos = add_cnk_list_entry(&clist, max_pos, cnk->min_star);
+				max_pos = add_cnk_list_entry(&clist, &pool, max_pos, cnk->min_star);
 				if (max_pos == 0) /* out of memory :-( */
 					goto done;
 				ch = *format++;
@@ -395,7 +430,7 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 				cnk->max = -1;
 				ch = *format++;
 			} else if (ch == '*') {
-				cnk->max_star = new_chunk();
+				cnk->max_star = new_chunk(&pool);
 				if (!cnk->max_star) /* out of memory :-( */
 					goto done;
 				cnk->max_star->type = CNK_INT;
@@ -415,7 +450,7 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 				} else {
 					cnk->max_star->num = ++pnum;
 				}
-				max_pos = add_cnk_list_entry(&clist, max_pos, cnk->max_star);
+				max_pos = add_cnk_list_entry(&clist, &pool, max_pos, cnk->max_star);
 				if (max_pos == 0) /* out of memory :-( */
 					goto done;
 
@@ -458,7 +493,7 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 			break;
 		case DP_S_CONV:
 			if (cnk->num == 0) cnk->num = ++pnum;
-			max_pos = add_cnk_list_entry(&clist, max_pos, cnk);
+			max_pos = add_cnk_list_entry(&clist, &pool, max_pos, cnk);
 			if (max_pos == 0) /* out of memory :-( */
 				goto done;
 			
@@ -527,7 +562,7 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 
 	/* retrieve the format arguments */
 	for (pnum = 0; pnum < max_pos; pnum++) {
-		int i;
+		struct pr_chunk *c;
 
 		if (clist[pnum].num == 0) {
 			/* ignoring a parameter should not be permitted
@@ -542,8 +577,8 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 			va_arg (args, int);
 			continue;
 		}
-		for (i = 1; i < clist[pnum].num; i++) {
-			if (clist[pnum].chunks[0]->type != clist[pnum].chunks[i]->type) {
+		for (c = clist[pnum].first->same; c; c = c->same) {
+			if (clist[pnum].first->type != c->type) {
 				/* nooo noo no!
 				 * all the references to a parameter
 				 * must be of the same type
@@ -551,7 +586,7 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 				goto done;
 			}
 		}
-		cnk = clist[pnum].chunks[0];
+		cnk = clist[pnum].first;
 		switch (cnk->type) {
 		case CNK_INT:
 			if (cnk->cflags == DP_C_SHORT) 
@@ -565,8 +600,8 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 			else
 				cnk->value = va_arg (args, int);
 
-			for (i = 1; i < clist[pnum].num; i++) {
-				clist[pnum].chunks[i]->value = cnk->value;
+			for (c = cnk->same; c; c = c->same) {
+				c->value = cnk->value;
 			}
 			break;
 
@@ -584,8 +619,8 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 			else
 				cnk->value = (unsigned int)va_arg (args, unsigned int);
 
-			for (i = 1; i < clist[pnum].num; i++) {
-				clist[pnum].chunks[i]->value = cnk->value;
+			for (c = cnk->same; c; c = c->same) {
+				c->value = cnk->value;
 			}
 			break;
 
@@ -595,16 +630,16 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 			else
 				cnk->fvalue = va_arg (args, double);
 
-			for (i = 1; i < clist[pnum].num; i++) {
-				clist[pnum].chunks[i]->fvalue = cnk->fvalue;
+			for (c = cnk->same; c; c = c->same) {
+				c->fvalue = cnk->fvalue;
 			}
 			break;
 
 		case CNK_CHAR:
 			cnk->value = va_arg (args, int);
 
-			for (i = 1; i < clist[pnum].num; i++) {
-				clist[pnum].chunks[i]->value = cnk->value;
+			for (c = cnk->same; c; c = c->same) {
+				c->value = cnk->value;
 			}
 			break;
 
@@ -612,15 +647,15 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 			cnk->strvalue = va_arg (args, char *);
 			if (!cnk->strvalue) cnk->strvalue = "(NULL)";
 
-			for (i = 1; i < clist[pnum].num; i++) {
-				clist[pnum].chunks[i]->strvalue = cnk->strvalue;
+			for (c = cnk->same; c; c = c->same) {
+				c->strvalue = cnk->strvalue;
 			}
 			break;
 
 		case CNK_PTR:
 			cnk->strvalue = va_arg (args, void *);
-			for (i = 1; i < clist[pnum].num; i++) {
-				clist[pnum].chunks[i]->strvalue = cnk->strvalue;
+			for (c = cnk->same; c; c = c->same) {
+				c->strvalue = cnk->strvalue;
 			}
 			break;
 
@@ -638,8 +673,8 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 			else
 				cnk->pnum = va_arg (args, int *);
 
-			for (i = 1; i < clist[pnum].num; i++) {
-				clist[pnum].chunks[i]->pnum = cnk->pnum;
+			for (c = cnk->same; c; c = c->same) {
+				c->pnum = cnk->pnum;
 			}
 			break;
 
@@ -652,10 +687,9 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 		}
 	}
 	/* print out the actual string from chunks */
-	currlen = 0;
 	cnk = chunks;
 	while (cnk) {
-		int len, min, max;
+		int min, max;
 
 		if (cnk->min_star) min = cnk->min_star->value;
 		else min = cnk->min;
@@ -665,65 +699,58 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 		switch (cnk->type) {
 
 		case CNK_FMT_STR:
-			if (maxlen != 0 && maxlen > currlen) {
-				if (maxlen > (currlen + cnk->len)) len = cnk->len;
-				else len = maxlen - currlen;
-
-				memcpy(&(buffer[currlen]), &(base[cnk->start]), len);
-			}
-			currlen += cnk->len;
-				
+			dopr_outstr (out, &(base[cnk->start]), cnk->len);
 			break;
 
 		case CNK_INT:
 		case CNK_UINT:
-			fmtint (buffer, &currlen, maxlen, cnk->value, 10, min, max, cnk->flags);
+			fmtint (out, cnk->value, 10, min, max, cnk->flags);
 			break;
 
 		case CNK_OCTAL:
-			fmtint (buffer, &currlen, maxlen, cnk->value, 8, min, max, cnk->flags);
+			fmtint (out, cnk->value, 8, min, max, cnk->flags);
 			break;
 
 		case CNK_HEX:
-			fmtint (buffer, &currlen, maxlen, cnk->value, 16, min, max, cnk->flags);
+			fmtint (out, cnk->value, 16, min, max, cnk->flags);
 			break;
 
 		case CNK_FLOAT:
-			fmtfp (buffer, &currlen, maxlen, cnk->fvalue, min, max, cnk->flags);
+			fmtfp (out, cnk->fvalue, min, max, cnk->flags);
 			break;
 
 		case CNK_CHAR:
-			dopr_outch (buffer, &currlen, maxlen, cnk->value);
+			dopr_outch (out, cnk->value);
 			break;
 
 		case CNK_STRING:
 			if (max == -1) {
 				max = strlen(cnk->strvalue);
 			}
-			fmtstr (buffer, &currlen, maxlen, cnk->strvalue, cnk->flags, min, max);
+			fmtstr (out, cnk->strvalue, cnk->flags, min, max);
 			break;
 
 		case CNK_PTR:
-			fmtint (buffer, &currlen, maxlen, (long)(cnk->strvalue), 16, min, max, cnk->flags);
+			fmtint (out, (long)(cnk->strvalue), 16, min, max, cnk->flags);
 			break;
 
 		case CNK_NUM:
 			if (cnk->cflags == DP_C_CHAR)
-				*((char *)(cnk->pnum)) = (char)currlen;
+				*((char *)(cnk->pnum)) = (char)out->currlen;
 			else if (cnk->cflags == DP_C_SHORT)
-				*((short int *)(cnk->pnum)) = (short int)currlen;
+				*((short int *)(cnk->pnum)) = (short int)out->currlen;
 			else if (cnk->cflags == DP_C_LONG)
-				*((long int *)(cnk->pnum)) = (long int)currlen;
+				*((long int *)(cnk->pnum)) = (long int)out->currlen;
 			else if (cnk->cflags == DP_C_LLONG)
-				*((LLONG *)(cnk->pnum)) = (LLONG)currlen;
+				*((LLONG *)(cnk->pnum)) = (LLONG)out->currlen;
 			else if (cnk->cflags == DP_C_SIZET)
-				*((ssize_t *)(cnk->pnum)) = (ssize_t)currlen;
+				*((ssize_t *)(cnk->pnum)) = (ssize_t)out->currlen;
 			else
-				*((int *)(cnk->pnum)) = (int)currlen;
+				*((int *)(cnk->pnum)) = (int)out->currlen;
 			break;
 
 		case CNK_PRCNT:
-			dopr_outch (buffer, &currlen, maxlen, '%');
+			dopr_outch (out, '%');
 			break;
 
 		default:
@@ -732,32 +759,33 @@ static int dopr(char* restrict buffer, size_t maxlen, const char* restrict forma
 		}
 		cnk = cnk->next;
 	}
-	if (maxlen != 0) {
-		if (currlen < maxlen - 1) 
-			buffer[currlen] = '\0';
-		else if (maxlen > 0) 
-			buffer[maxlen - 1] = '\0';
+	if (out->stream) {
+		dopr_flush(out);
+	} else if (out->maxlen != 0) {
+		if (out->currlen < out->maxlen - 1) 
+			out->buffer[out->currlen] = '\0';
+		else if (out->maxlen > 0) 
+			out->buffer[out->maxlen - 1] = '\0';
 	}
-	ret = currlen;
+	ret = out->currlen;
 
 done:
 	va_end(args);
 
 	while (chunks) {
 		cnk = chunks->next;
-		free(chunks);
+		if (chunks->min_star && !chunks->min_star->pooled) free(chunks->min_star);
+		if (chunks->max_star && !chunks->max_star->pooled) free(chunks->max_star);
+		if (!chunks->pooled) free(chunks);
 		chunks = cnk;
 	}
-	if (clist) {
-		for (pnum = 0; pnum < max_pos; pnum++) {
-			if (clist[pnum].chunks) free(clist[pnum].chunks);
-		}
+	if (clist && clist != pool.params) {
 		free(clist);
 	}
 	return ret;
 }
 
-static void fmtstr(char* restrict buffer, size_t* restrict currlen, size_t maxlen,
+static void fmtstr(struct pr_out* restrict out,
 		    char* restrict value, int flags, int min, int max)
 {
 	int padlen, strln;     /* amount to pad */
@@ -778,22 +806,22 @@ static void fmtstr(char* restrict buffer, size_t* restrict currlen, size_t maxle
 		padlen = -padlen; /* Left Justify */
 	
 	while (padlen > 0) {
-		dopr_outch (buffer, currlen, maxlen, ' ');
+		dopr_outch (out, ' ');
 		--padlen;
 	}
 	while (*value && (cnt < max)) {
-		dopr_outch (buffer, currlen, maxlen, *value++);
+		dopr_outch (out, *value++);
 		++cnt;
 	}
 	while (padlen < 0) {
-		dopr_outch (buffer, currlen, maxlen, ' ');
+		dopr_outch (out, ' ');
 		++padlen;
 	}
 }
 
 /* Have to handle DP_F_NUM (ie 0x and 0 alternates) */
 
-static void fmtint(char* restrict buffer, size_t* restrict currlen, size_t maxlen,
+static void fmtint(struct pr_out* restrict out,
 		    LLONG value, int base, int min, int max, int flags)
 {
 	int signvalue = 0;
@@ -850,29 +878,29 @@ static void fmtint(char* restrict buffer, size_t* restrict currlen, size_t maxle
 
 	/* Spaces */
 	while (spadlen > 0) {
-		dopr_outch (buffer, currlen, maxlen, ' ');
+		dopr_outch (out, ' ');
 		--spadlen;
 	}
 
 	/* Sign */
 	if (signvalue) 
-		dopr_outch (buffer, currlen, maxlen, signvalue);
+		dopr_outch (out, signvalue);
 
 	/* Zeros */
 	if (zpadlen > 0) {
 		while (zpadlen > 0) {
-			dopr_outch (buffer, currlen, maxlen, '0');
+			dopr_outch (out, '0');
 			--zpadlen;
 		}
 	}
 
 	/* Digits */
 	while (place > 0) 
-		dopr_outch (buffer, currlen, maxlen, convert[--place]);
+		dopr_outch (out, convert[--place]);
   
 	/* Left Justified spaces */
 	while (spadlen < 0) {
-		dopr_outch (buffer, currlen, maxlen, ' ');
+		dopr_outch (out, ' ');
 		++spadlen;
 	}
 }
@@ -946,7 +974,7 @@ static double my_modf(double x0, double *iptr)
 }
 
 
-static void fmtfp (char* restrict buffer, size_t* restrict currlen, size_t maxlen,
+static void fmtfp (struct pr_out* restrict out,
 		   LDOUBLE fvalue, int min, int max, int flags)
 {
 	int signvalue = 0;
@@ -1053,24 +1081,24 @@ static void fmtfp (char* restrict buffer, size_t* restrict currlen, size_t maxle
 	
 	if ((flags & DP_F_ZERO) && (padlen > 0)) {
 		if (signvalue) {
-			dopr_outch (buffer, currlen, maxlen, signvalue);
+			dopr_outch (out, signvalue);
 			--padlen;
 			signvalue = 0;
 		}
 		while (padlen > 0) {
-			dopr_outch (buffer, currlen, maxlen, '0');
+			dopr_outch (out, '0');
 			--padlen;
 		}
 	}
 	while (padlen > 0) {
-		dopr_outch (buffer, currlen, maxlen, ' ');
+		dopr_outch (out, ' ');
 		--padlen;
 	}
 	if (signvalue) 
-		dopr_outch (buffer, currlen, maxlen, signvalue);
+		dopr_outch (out, signvalue);
 	
 	while (iplace > 0) 
-		dopr_outch (buffer, currlen, maxlen, iconvert[--iplace]);
+		dopr_outch (out, iconvert[--iplace]);
 
 #ifdef DEBUG_SNPRINTF
 	printf("fmtfp: fplace=%d zpadlen=%d\n", fplace, zpadlen);
@@ -1081,36 +1109,81 @@ static void fmtfp (char* restrict buffer, size_t* restrict currlen, size_t maxle
 	 * char to print out.
 	 */
 	if (max > 0) {
-		dopr_outch (buffer, currlen, maxlen, '.');
+		dopr_outch (out, '.');
 		
 		while (zpadlen > 0) {
-			dopr_outch (buffer, currlen, maxlen, '0');
+			dopr_outch (out, '0');
 			--zpadlen;
 		}
 
 		while (fplace > 0) 
-			dopr_outch (buffer, currlen, maxlen, fconvert[--fplace]);
+			dopr_outch (out, fconvert[--fplace]);
 	}
 
 	while (padlen < 0) {
-		dopr_outch (buffer, currlen, maxlen, ' ');
+		dopr_outch (out, ' ');
 		++padlen;
 	}
 }
 
-static void dopr_outch(char* restrict buffer, size_t* restrict currlen, size_t maxlen, char c)
+static void dopr_outch(struct pr_out* restrict out, char c)
 {
-	if (*currlen < maxlen) {
-		buffer[(*currlen)] = c;
+	size_t used = out->currlen - out->flushed;
+
+	if (out->stream && used == out->maxlen) {
+		dopr_flush(out);
+		used = 0;
+	}
+	if (used < out->maxlen) {
+		out->buffer[used] = c;
 	}
-	(*currlen)++;
+	out->currlen++;
 }
 
-static struct pr_chunk *new_chunk(void) {
-	struct pr_chunk *new_c = (struct pr_chunk *)malloc(sizeof(struct pr_chunk));
+static void dopr_outstr(struct pr_out* restrict out, const char* restrict s, size_t len)
+{
+	while (len > 0) {
+		size_t used = out->currlen - out->flushed, n;
 
-	if (!new_c)
-		return NULL;
+		if (out->stream && used == out->maxlen) {
+			dopr_flush(out);
+			used = 0;
+		}
+		if (used >= out->maxlen) {
+			out->currlen += len;
+			break;
+		}
+		n = out->maxlen - used;
+		if (n > len) n = len;
+		memcpy(&(out->buffer[used]), s, n);
+		out->currlen += n;
+		s += n;
+		len -= n;
+	}
+}
+
+static void dopr_flush(struct pr_out* restrict out)
+{
+	size_t used = out->currlen - out->flushed;
+
+	if (used > 0) {
+		fwrite(out->buffer, 1, used, out->stream);
+	}
+	out->flushed = out->currlen;
+}
+
+static struct pr_chunk *new_chunk(struct pr_pool *pool) {
+	struct pr_chunk *new_c;
+
+	if (pool->used < PR_POOL_CHUNKS) {
+		new_c = &pool->chunks[pool->used++];
+		new_c->pooled = 1;
+	} else {
+		new_c = (struct pr_chunk *)malloc(sizeof(struct pr_chunk));
+		if (!new_c)
+			return NULL;
+		new_c->pooled = 0;
+	}
 
 	new_c->type = 0;
 	new_c->num = 0;
@@ -1127,36 +1200,39 @@ static struct pr_chunk *new_chunk(void) {
 	new_c->strvalue = NULL;
 	new_c->pnum = NULL;
 	new_c->next = NULL;
+	new_c->same = NULL;
 
 	return new_c;
 }
 
-static int add_cnk_list_entry(struct pr_chunk_x **list,
+static int add_cnk_list_entry(struct pr_chunk_x **list, struct pr_pool *pool,
 				int max_num, struct pr_chunk *chunk) {
 	struct pr_chunk_x *l;
-	struct pr_chunk **c;
 	int max;
-	int cnum;
-	int i, pos;
+	int i;
 
 	if (chunk->num > max_num) {
 		max = chunk->num;
 	
-		if (*list == NULL) {
+		if (*list == NULL && max <= PR_POOL_PARAMS) {
+			l = pool->params;
+		} else if (*list == NULL) {
+			l = (struct pr_chunk_x *)malloc(sizeof(struct pr_chunk_x) * max);
+		} else if (*list == pool->params && max <= PR_POOL_PARAMS) {
+			l = *list;
+		} else if (*list == pool->params) {
 			l = (struct pr_chunk_x *)malloc(sizeof(struct pr_chunk_x) * max);
-			pos = 0;
+			if (l != NULL)
+				memcpy(l, *list, sizeof(struct pr_chunk_x) * max_num);
 		} else {
 			l = (struct pr_chunk_x *)realloc(*list, sizeof(struct pr_chunk_x) * max);
-			pos = max_num;
 		}
 		if (l == NULL) {
-			for (i = 0; i < max; i++) {
-				if ((*list)[i].chunks) free((*list)[i].chunks);
-			}
 			return 0;
 		}
-		for (i = pos; i < max; i++) {
-			l[i].chunks = NULL;
+		for (i = max_num; i < max; i++) {
+			l[i].first = NULL;
+			l[i].last = NULL;
 			l[i].num = 0;
 		}
 	} else {
@@ -1165,21 +1241,10 @@ static int add_cnk_list_entry(struct pr_chunk_x **list,
 	}
 
 	i = chunk->num - 1;
-	cnum = l[i].num + 1;
-	if (l[i].chunks == NULL) {
-		c = (struct pr_chunk **)malloc(sizeof(struct pr_chunk *) * cnum); 
-	} else {
-		c = (struct pr_chunk **)realloc(l[i].chunks, sizeof(struct pr_chunk *) * cnum);
-	}
-	if (c == NULL) {
-		for (i = 0; i < max; i++) {
-			if (l[i].chunks) free(l[i].chunks);
-		}
-		return 0;
-	}
-	c[l[i].num] = chunk;
-	l[i].chunks = c;
-	l[i].num = cnum;
+	if (l[i].last) l[i].last->same = chunk;
+	else l[i].first = chunk;
+	l[i].last = chunk;
+	l[i].num++;
 
 	*list = l;
 	return max;
@@ -1187,17 +1252,33 @@ static int add_cnk_list_entry(struct pr_chunk_x **list,
 
  int vsnprintf (char* restrict str, size_t count, const char* restrict fmt, va_list args)
 {
-	return dopr(str, count, fmt, args);
+	struct pr_out out;
+
+	out.buffer = str;
+	out.maxlen = count;
+	out.currlen = 0;
+	out.flushed = 0;
+	out.stream = NULL;
+	return dopr(&out, fmt, args);
 }
 
+/*
+ * Formats straight into the stream, a small buffer at a time, so that
+ * printing neither allocates memory nor limits the length of the output.
+ * For stdout and stderr, the stream merges the pieces into its text
+ * buffer for the Nintendo DS.
+ */
 int vfprintf(FILE* restrict stream, const char* restrict format, va_list ap)
 {
-    /* moved to section .noinit to avoid zero-initialisation - Neb */
-    static char buf[4096] __attribute__((section(".noinit")));
-    int size;
-
-    size = vsnprintf(buf, sizeof(buf), format, ap);
-    return fwrite(buf, size, 1, stream);
+	char buf[128];
+	struct pr_out out;
+
+	out.buffer = buf;
+	out.maxlen = sizeof(buf);
+	out.currlen = 0;
+	out.flushed = 0;
+	out.stream = stream;
+	return dopr(&out, format, ap);
 }
 
 #endif
@@ -1251,18 +1332,11 @@ int printf(const char* restrict fmt, ...)
 {
 	va_list ap;
 	int ret;
-	char *s;
 
-	s = NULL;
 	va_start(ap, fmt);
-	ret = vasprintf(&s, fmt, ap);
+	ret = vfprintf(stdout, fmt, ap);
 	va_end(ap);
 
-	if (s) {
-		fwrite(s, 1, strlen(s), stdout);
-	}
-	free(s);
-
 	return ret;
 }
 #endif
@@ -1276,18 +1350,11 @@ int fprintf(FILE* restrict stream, const char* restrict fmt, ...)
 {
 	va_list ap;
 	int ret;
-	char *s;
 
-	s = NULL;
 	va_start(ap, fmt);
-	ret = vasprintf(&s, fmt, ap);
+	ret = vfprintf(stream, fmt, ap);
 	va_end(ap);
 
-	if (s) {
-		fwrite(s, 1, strlen(s), stream);
-	}
-	free(s);
-
 	return ret;
 }
 #endif
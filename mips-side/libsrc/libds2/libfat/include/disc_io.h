@@ -35,6 +35,7 @@
 
 #define FEATURE_MEDIUM_CANREAD		0x00000001
 #define FEATURE_MEDIUM_CANWRITE		0x00000002
+#define FEATURE_MEDIUM_ASYNC		0x00000004
 #define FEATURE_SLOT_GBA			0x00000010
 #define FEATURE_SLOT_NDS			0x00000020
 
@@ -47,6 +48,10 @@ typedef bool (* FN_MEDIUM_READSECTORS)(sec_t sector, sec_t numSectors, void* buf
 typedef bool (* FN_MEDIUM_WRITESECTORS)(sec_t sector, sec_t numSectors, const void* buffer) ;
 typedef bool (* FN_MEDIUM_CLEARSTATUS)(void) ;
 typedef bool (* FN_MEDIUM_SHUTDOWN)(void) ;
+typedef bool (* FN_MEDIUM_STARTREADSECTORS)(sec_t sector, sec_t numSectors, void* buffer) ;
+typedef bool (* FN_MEDIUM_STARTWRITESECTORS)(sec_t sector, sec_t numSectors, const void* buffer) ;
+typedef bool (* FN_MEDIUM_ISBUSY)(void) ;
+typedef bool (* FN_MEDIUM_WAITTRANSFER)(void) ;
 
 struct DISC_INTERFACE_STRUCT {
 	unsigned long			ioType ;
@@ -57,6 +62,11 @@ struct DISC_INTERFACE_STRUCT {
 	FN_MEDIUM_WRITESECTORS	writeSectors ;
 	FN_MEDIUM_CLEARSTATUS	clearStatus ;
 	FN_MEDIUM_SHUTDOWN		shutdown ;
+	// Only with FEATURE_MEDIUM_ASYNC
+	FN_MEDIUM_STARTREADSECTORS	startReadSectors ;
+	FN_MEDIUM_STARTWRITESECTORS	startWriteSectors ;
+	FN_MEDIUM_ISBUSY		isBusy ;
+	FN_MEDIUM_WAITTRANSFER	waitTransfer ;
 } ;
 
 typedef struct DISC_INTERFACE_STRUCT DISC_INTERFACE ;
@@ -37,6 +37,7 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <disc_io.h>
 
 /*
@@ -64,7 +65,9 @@ Mount the device pointed to by interface, and set up a devoptab entry for it as
 You can then access the filesystem using "name:/".
 If startSector = 0, it will mount the active partition of the first valid partition on
 the disc. Otherwise it will try to mount the partition starting at startSector.
-cacheSize specifies the number of pages to allocate for the cache.
+cacheSize specifies the number of pages to allocate for the cache. Pages are
+found in constant time, so thousands of pages may be used if memory allows.
+SectorsPerPage specifies the number of sectors in each page.
 This will not startup the disc, so you need to call interface->startup(); first.
 */
 extern bool fatMount (const char* name, const DISC_INTERFACE* interface, sec_t startSector, uint32_t cacheSize, uint32_t SectorsPerPage);
@@ -80,6 +83,41 @@ Get Volume Label
 */
 extern void fatGetVolumeLabel (const char* name, char *label);
 
+/*
+Start reading up to len bytes from the file fd at its current position into
+buffer, returning before the data has arrived if the disc can move it in the
+background, so that the program can do other work meanwhile.
+Returns the number of bytes started, which may be fewer than len, and moves
+the file position past them; 0 at the end of the file; or -1 with errno set.
+Whole sectors in clusters that follow each other on the disc move in the
+background, and only into a buffer aligned to 32 bytes. Other bytes are read
+before returning, up to the next sector boundary.
+The buffer must not be accessed until fatTransferBusy returns false or
+fatWaitTransfer returns. Only one transfer moves at a time; starting another
+waits for the previous one.
+*/
+extern ssize_t fatStartRead (int fd, void* buffer, size_t len);
+
+/*
+Start writing up to len bytes from buffer to the file fd at its current
+position, like fatStartRead. Only clusters that the file already has are
+written in the background, so extend the file with ftruncate first to write
+past its end in the background.
+The buffer must not be modified until the transfer is done.
+*/
+extern ssize_t fatStartWrite (int fd, const void* buffer, size_t len);
+
+/*
+Return true while data started by fatStartRead or fatStartWrite is moving
+*/
+extern bool fatTransferBusy (void);
+
+/*
+Wait for data started by fatStartRead or fatStartWrite to finish moving.
+Returns 0 on success, or -1 with errno set to EIO if the transfer failed.
+*/
+extern int fatWaitTransfer (void);
+
 // File attributes
 #define ATTR_ARCHIVE	0x20			// Archive
 #define ATTR_DIRECTORY	0x10			// Directory
@@ -36,6 +36,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <limits.h>
+#include <stdlib.h>
 
 #include "common.h"
 #include "cache.h"
@@ -47,9 +48,94 @@
 
 #define CACHE_FREE UINT_MAX
 
+// Ends the hash chains and the LRU list
+#define CACHE_NONE UINT_MAX
+
+/*
+Gets the hash bucket of the page starting at the given sector, which is a
+multiple of sectorsPerPage. Fibonacci hashing spreads consecutive pages over
+all buckets.
+*/
+static inline unsigned int _FAT_cache_bucket (CACHE* cache, sec_t sector) {
+	return ((uint32_t)(sector / cache->sectorsPerPage) * UINT32_C(2654435761)) >> cache->hashShift;
+}
+
+static void _FAT_cache_hashInsert (CACHE* cache, unsigned int i) {
+	unsigned int bucket = _FAT_cache_bucket (cache, cache->cacheEntries[i].sector);
+	cache->cacheEntries[i].hashNext = cache->hashBuckets[bucket];
+	cache->hashBuckets[bucket] = i;
+}
+
+static void _FAT_cache_hashRemove (CACHE* cache, unsigned int i) {
+	unsigned int* link = &cache->hashBuckets[_FAT_cache_bucket (cache, cache->cacheEntries[i].sector)];
+	while (*link != i) {
+		link = &cache->cacheEntries[*link].hashNext;
+	}
+	*link = cache->cacheEntries[i].hashNext;
+}
+
+static void _FAT_cache_lruRemove (CACHE* cache, unsigned int i) {
+	CACHE_ENTRY* entry = &cache->cacheEntries[i];
+	if (entry->lruPrev != CACHE_NONE) {
+		cache->cacheEntries[entry->lruPrev].lruNext = entry->lruNext;
+	} else {
+		cache->lruHead = entry->lruNext;
+	}
+	if (entry->lruNext != CACHE_NONE) {
+		cache->cacheEntries[entry->lruNext].lruPrev = entry->lruPrev;
+	} else {
+		cache->lruTail = entry->lruPrev;
+	}
+}
+
+static void _FAT_cache_lruPushFront (CACHE* cache, unsigned int i) {
+	CACHE_ENTRY* entry = &cache->cacheEntries[i];
+	entry->lruPrev = CACHE_NONE;
+	entry->lruNext = cache->lruHead;
+	if (cache->lruHead != CACHE_NONE) {
+		cache->cacheEntries[cache->lruHead].lruPrev = i;
+	} else {
+		cache->lruTail = i;
+	}
+	cache->lruHead = i;
+}
+
+static void _FAT_cache_lruPushBack (CACHE* cache, unsigned int i) {
+	CACHE_ENTRY* entry = &cache->cacheEntries[i];
+	entry->lruNext = CACHE_NONE;
+	entry->lruPrev = cache->lruTail;
+	if (cache->lruTail != CACHE_NONE) {
+		cache->cacheEntries[cache->lruTail].lruNext = i;
+	} else {
+		cache->lruHead = i;
+	}
+	cache->lruTail = i;
+}
+
+/*
+Empties the hash table and puts all entries in the LRU list in order, all
+entries having to be free
+*/
+static void _FAT_cache_resetIndex (CACHE* cache) {
+	unsigned int i;
+	unsigned int numberOfBuckets = 1u << (32 - cache->hashShift);
+
+	for (i = 0; i < numberOfBuckets; i++) {
+		cache->hashBuckets[i] = CACHE_NONE;
+	}
+	for (i = 0; i < cache->numberOfPages; i++) {
+		cache->cacheEntries[i].hashNext = CACHE_NONE;
+		cache->cacheEntries[i].lruPrev = (i == 0) ? CACHE_NONE : i - 1;
+		cache->cacheEntries[i].lruNext = (i == cache->numberOfPages - 1) ? CACHE_NONE : i + 1;
+	}
+	cache->lruHead = 0;
+	cache->lruTail = cache->numberOfPages - 1;
+}
+
 CACHE* _FAT_cache_constructor (unsigned int numberOfPages, unsigned int sectorsPerPage, const DISC_INTERFACE* discInterface, sec_t endOfPartition, unsigned int bytesPerSector) {
 	CACHE* cache;
 	unsigned int i;
+	unsigned int numberOfBuckets;
 	CACHE_ENTRY* cacheEntries;
 
 	if (numberOfPages < 2) {
@@ -78,15 +164,47 @@ CACHE* _FAT_cache_constructor (unsigned int numberOfPages, unsigned int sectorsP
 		return NULL;
 	}
 
+	// Use at least as many hash buckets as pages, in a power of 2
+	cache->hashShift = 31;
+	numberOfBuckets = 2;
+	while (numberOfBuckets < numberOfPages && cache->hashShift > 16) {
+		cache->hashShift--;
+		numberOfBuckets <<= 1;
+	}
+
+	cache->hashBuckets = (unsigned int*) _FAT_mem_allocate (sizeof(unsigned int) * numberOfBuckets);
+	if (cache->hashBuckets == NULL) {
+		_FAT_mem_free (cacheEntries);
+		_FAT_mem_free (cache);
+		return NULL;
+	}
+
+	// Read ahead by at most half of the cache, so that a read ahead doesn't
+	// evict its own pages
+	cache->readAheadSectors = (numberOfPages / 2) * sectorsPerPage;
+	if (cache->readAheadSectors > READ_AHEAD_MAX_SECTORS) {
+		cache->readAheadSectors = READ_AHEAD_MAX_SECTORS;
+	}
+	if (cache->readAheadSectors > sectorsPerPage) {
+		cache->readAheadBuffer = (uint8_t*) _FAT_mem_align (cache->readAheadSectors * bytesPerSector);
+		if (cache->readAheadBuffer == NULL) {
+			cache->readAheadSectors = sectorsPerPage;
+		}
+	} else {
+		cache->readAheadSectors = sectorsPerPage;
+		cache->readAheadBuffer = NULL;
+	}
+
 	for (i = 0; i < numberOfPages; i++) {
 		cacheEntries[i].sector = CACHE_FREE;
 		cacheEntries[i].count = 0;
-		cacheEntries[i].last_access = 0;
 		cacheEntries[i].dirty = false;
 		cacheEntries[i].cache = (uint8_t*) _FAT_mem_align ( sectorsPerPage * bytesPerSector );
 	}
 
 	cache->cacheEntries = cacheEntries;
+	cache->prefetchCount = 0;
+	_FAT_cache_resetIndex (cache);
 
 	return cache;
 }
@@ -100,59 +218,269 @@ void _FAT_cache_destructor (CACHE* cache) {
 	for (i = 0; i < cache->numberOfPages; i++) {
 		_FAT_mem_free (cache->cacheEntries[i].cache);
 	}
+	_FAT_mem_free (cache->readAheadBuffer);
+	_FAT_mem_free (cache->hashBuckets);
 	_FAT_mem_free (cache->cacheEntries);
 	_FAT_mem_free (cache);
 }
 
+/*
+Finds the entry holding the page starting at the given sector, or CACHE_NONE
+*/
+static unsigned int _FAT_cache_findPage(CACHE *cache,sec_t sector)
+{
+	unsigned int i;
+	CACHE_ENTRY* cacheEntries = cache->cacheEntries;
 
-static uint32_t accessCounter = 0;
+	for(i=cache->hashBuckets[_FAT_cache_bucket(cache,sector)];i!=CACHE_NONE;i=cacheEntries[i].hashNext) {
+		if(cacheEntries[i].sector==sector) break;
+	}
+	return i;
+}
 
-static uint32_t accessTime(){
-	accessCounter++;
-	return accessCounter;
+/*
+Writes back a dirty entry together with the dirty pages next to it on the
+disc, as one multi-sector transfer through the staging buffer of at most
+readAheadSectors sectors, so that the card programs them in one command.
+While a prefetch holds the staging buffer, the entry is written alone.
+All of the pages written are clean afterwards
+*/
+static bool _FAT_cache_writeBack(CACHE *cache,unsigned int i)
+{
+	CACHE_ENTRY* cacheEntries = cache->cacheEntries;
+	unsigned int sectorsPerPage = cache->sectorsPerPage;
+	sec_t first = cacheEntries[i].sector;
+	sec_t end = first + cacheEntries[i].count;
+	sec_t page;
+	unsigned int j;
+
+	if(cache->readAheadBuffer!=NULL && cache->prefetchCount==0) {
+		// Take in dirty pages before the entry, then after it
+		while(first >= sectorsPerPage && end - first + sectorsPerPage <= cache->readAheadSectors) {
+			j = _FAT_cache_findPage(cache,first - sectorsPerPage);
+			if(j==CACHE_NONE || !cacheEntries[j].dirty) break;
+			first -= sectorsPerPage;
+		}
+		while(end % sectorsPerPage == 0 && end - first + sectorsPerPage <= cache->readAheadSectors) {
+			j = _FAT_cache_findPage(cache,end);
+			if(j==CACHE_NONE || !cacheEntries[j].dirty) break;
+			end += cacheEntries[j].count;
+		}
+	}
+
+	if(end - first == cacheEntries[i].count) {
+		if(!_FAT_disc_writeSectors(cache->disc,first,end - first,cacheEntries[i].cache)) return false;
+		cacheEntries[i].dirty = false;
+		return true;
+	}
+
+	for(page = first; page < end; page += sectorsPerPage) {
+		j = _FAT_cache_findPage(cache,page);
+		memcpy(cache->readAheadBuffer + (page - first)*cache->bytesPerSector,cacheEntries[j].cache,cacheEntries[j].count*cache->bytesPerSector);
+	}
+	if(!_FAT_disc_writeSectors(cache->disc,first,end - first,cache->readAheadBuffer)) return false;
+	for(page = first; page < end; page += sectorsPerPage) {
+		cacheEntries[_FAT_cache_findPage(cache,page)].dirty = false;
+	}
+	return true;
 }
 
+/*
+Frees the least recently used entry, writing it back first if it is dirty.
+Returns the entry, or CACHE_NONE if it could not be written back
+*/
+static unsigned int _FAT_cache_evict(CACHE *cache)
+{
+	unsigned int i = cache->lruTail;
+	CACHE_ENTRY* cacheEntries = cache->cacheEntries;
+
+	if(cacheEntries[i].dirty==true) {
+		if(!_FAT_cache_writeBack(cache,i)) return CACHE_NONE;
+	}
+
+	if(cacheEntries[i].sector!=CACHE_FREE) {
+		_FAT_cache_hashRemove(cache,i);
+		cacheEntries[i].sector = CACHE_FREE;
+		cacheEntries[i].count = 0;
+	}
+	return i;
+}
 
+/*
+Makes a freed entry hold the page starting at the given sector, whose data
+has been put into it, as the most recently used
+*/
+static void _FAT_cache_install(CACHE *cache,unsigned int i,sec_t sector,unsigned int count)
+{
+	cache->cacheEntries[i].sector = sector;
+	cache->cacheEntries[i].count = count;
+	_FAT_cache_hashInsert(cache,i);
+	_FAT_cache_lruRemove(cache,i);
+	_FAT_cache_lruPushFront(cache,i);
+}
+
+/*
+Gets the number of sectors in the page starting at the given sector
+*/
+static inline unsigned int _FAT_cache_pageCount(CACHE *cache,sec_t sector)
+{
+	sec_t next_page = sector + cache->sectorsPerPage;
+	if(next_page > cache->endOfPartition)	next_page = cache->endOfPartition;
+	return next_page - sector;
+}
+
+/*
+Waits for the pages being read in the background, if any, and puts them into
+the cache. A failed prefetch is not an error; the pages are read again when
+they are needed
+*/
+static void _FAT_cache_finishPrefetch(CACHE *cache)
+{
+	sec_t offset;
+
+	if(cache->prefetchCount==0) return;
+
+	if(_FAT_disc_waitTransfer(cache->disc)) {
+		for(offset = 0; offset < cache->prefetchCount; offset += cache->sectorsPerPage) {
+			unsigned int count = _FAT_cache_pageCount(cache,cache->prefetchSector + offset);
+			unsigned int i = _FAT_cache_evict(cache);
+			if(i==CACHE_NONE) break;
+
+			memcpy(cache->cacheEntries[i].cache,cache->readAheadBuffer + offset*cache->bytesPerSector,count*cache->bytesPerSector);
+			_FAT_cache_install(cache,i,cache->prefetchSector + offset,count);
+		}
+	}
+	cache->prefetchCount = 0;
+}
+
+/*
+Finds the page containing a sector in constant time through the hash table,
+or swaps it in, replacing the least recently used page
+*/
 static CACHE_ENTRY* _FAT_cache_getPage(CACHE *cache,sec_t sector)
 {
 	unsigned int i;
 	CACHE_ENTRY* cacheEntries = cache->cacheEntries;
-	unsigned int numberOfPages = cache->numberOfPages;
 	unsigned int sectorsPerPage = cache->sectorsPerPage;
 
-	bool foundFree = false;
-	unsigned int oldUsed = 0;
-	unsigned int oldAccess = UINT_MAX;
+	sector = (sector/sectorsPerPage)*sectorsPerPage; // align base sector to page size
+
+	i = _FAT_cache_findPage(cache,sector);
+	if(i==CACHE_NONE && cache->prefetchCount > 0) {
+		// The page may be on its way from the disc, and the disc is about to
+		// be used anyway
+		_FAT_cache_finishPrefetch(cache);
+		i = _FAT_cache_findPage(cache,sector);
+	}
+	if(i!=CACHE_NONE) {
+		if(cache->lruHead!=i) {
+			_FAT_cache_lruRemove(cache,i);
+			_FAT_cache_lruPushFront(cache,i);
+		}
+		return &(cacheEntries[i]);
+	}
+
+	i = _FAT_cache_evict(cache);
+	if(i==CACHE_NONE) return NULL;
+
+	if(!_FAT_disc_readSectors(cache->disc,sector,_FAT_cache_pageCount(cache,sector),cacheEntries[i].cache)) return NULL;
+
+	_FAT_cache_install(cache,i,sector,_FAT_cache_pageCount(cache,sector));
+
+	return &(cacheEntries[i]);
+}
+
+bool _FAT_cache_prefetch(CACHE *cache,sec_t sector,sec_t numSectors)
+{
+	unsigned int sectorsPerPage = cache->sectorsPerPage;
+	sec_t page = (sector/sectorsPerPage)*sectorsPerPage;
+	sec_t end = sector + numSectors;
+
+	_FAT_cache_finishPrefetch(cache);
+
+	if(end > cache->endOfPartition) end = cache->endOfPartition;
 
-	for(i=0;i<numberOfPages;i++) {
-		if(sector>=cacheEntries[i].sector && sector<(cacheEntries[i].sector + cacheEntries[i].count)) {
-			cacheEntries[i].last_access = accessTime();
-			return &(cacheEntries[i]);
+	while(page < end) {
+		sec_t runEnd = page;
+		sec_t runCount, offset;
+
+		// Gather consecutive pages that are not in the cache
+		while(runEnd < end && runEnd - page + sectorsPerPage <= cache->readAheadSectors
+		   && _FAT_cache_findPage(cache,runEnd)==CACHE_NONE) {
+			runEnd += sectorsPerPage;
 		}
 
-		if(foundFree==false && (cacheEntries[i].sector==CACHE_FREE || cacheEntries[i].last_access<oldAccess)) {
-			if(cacheEntries[i].sector==CACHE_FREE) foundFree = true;
-			oldUsed = i;
-			oldAccess = cacheEntries[i].last_access;
+		if(runEnd == page) {
+			page += sectorsPerPage;
+			continue;
 		}
-	}
 
-	if(foundFree==false && cacheEntries[oldUsed].dirty==true) {
-		if(!_FAT_disc_writeSectors(cache->disc,cacheEntries[oldUsed].sector,cacheEntries[oldUsed].count,cacheEntries[oldUsed].cache)) return NULL;
-		cacheEntries[oldUsed].dirty = false;
+		if(runEnd > cache->endOfPartition) runEnd = cache->endOfPartition;
+		runCount = runEnd - page;
+
+		if(runCount <= sectorsPerPage) {
+			if(_FAT_cache_getPage(cache,page)==NULL) return false;
+		} else {
+			unsigned int i, pages;
+
+			// The pages about to be replaced are the least recently used ones.
+			// Write them back now, while the staging buffer is free
+			for(i = cache->lruTail, pages = 0; i!=CACHE_NONE && pages < (runCount + sectorsPerPage - 1)/sectorsPerPage; i = cache->cacheEntries[i].lruPrev, pages++) {
+				if(cache->cacheEntries[i].dirty && !_FAT_cache_writeBack(cache,i)) return false;
+			}
+
+			if(!_FAT_disc_readSectors(cache->disc,page,runCount,cache->readAheadBuffer)) return false;
+
+			for(offset = 0; offset < runCount; offset += sectorsPerPage) {
+				unsigned int count = _FAT_cache_pageCount(cache,page + offset);
+				unsigned int i = _FAT_cache_evict(cache);
+				if(i==CACHE_NONE) return false;
+
+				memcpy(cache->cacheEntries[i].cache,cache->readAheadBuffer + offset*cache->bytesPerSector,count*cache->bytesPerSector);
+				_FAT_cache_install(cache,i,page + offset,count);
+			}
+		}
+		page = runEnd;
 	}
+	return true;
+}
 
-	sector = (sector/sectorsPerPage)*sectorsPerPage; // align base sector to page size
-	sec_t next_page = sector + sectorsPerPage;
-	if(next_page > cache->endOfPartition)	next_page = cache->endOfPartition;
+bool _FAT_cache_startPrefetch(CACHE *cache,sec_t sector,sec_t numSectors)
+{
+	unsigned int sectorsPerPage = cache->sectorsPerPage;
+	sec_t page = (sector/sectorsPerPage)*sectorsPerPage;
+	sec_t end = sector + numSectors;
+	sec_t runEnd;
+	unsigned int i, pages;
+
+	_FAT_cache_finishPrefetch(cache);
+
+	if(cache->readAheadBuffer==NULL) return _FAT_cache_prefetch(cache,sector,numSectors);
 
-	if(!_FAT_disc_readSectors(cache->disc,sector,next_page-sector,cacheEntries[oldUsed].cache)) return NULL;
+	if(end > cache->endOfPartition) end = cache->endOfPartition;
 
-	cacheEntries[oldUsed].sector = sector;
-	cacheEntries[oldUsed].count = next_page-sector;
-	cacheEntries[oldUsed].last_access = accessTime();
+	// Skip the pages already in the cache, then gather the missing ones
+	while(page < end && _FAT_cache_findPage(cache,page)!=CACHE_NONE) {
+		page += sectorsPerPage;
+	}
+	runEnd = page;
+	while(runEnd < end && runEnd - page + sectorsPerPage <= cache->readAheadSectors
+	   && _FAT_cache_findPage(cache,runEnd)==CACHE_NONE) {
+		runEnd += sectorsPerPage;
+	}
+	if(runEnd == page) return true;
+	if(runEnd > cache->endOfPartition) runEnd = cache->endOfPartition;
 
-	return &(cacheEntries[oldUsed]);
+	// The pages about to be replaced are the least recently used ones.
+	// Write them back now, while the staging buffer is free
+	for(i = cache->lruTail, pages = 0; i!=CACHE_NONE && pages < (runEnd - page + sectorsPerPage - 1)/sectorsPerPage; i = cache->cacheEntries[i].lruPrev, pages++) {
+		if(cache->cacheEntries[i].dirty && !_FAT_cache_writeBack(cache,i)) return false;
+	}
+
+	if(!_FAT_disc_startReadSectors(cache->disc,page,runEnd - page,cache->readAheadBuffer)) return false;
+	cache->prefetchSector = page;
+	cache->prefetchCount = runEnd - page;
+	return true;
 }
 
 bool _FAT_cache_readSectors(CACHE *cache,sec_t sector,sec_t numSectors,void *buffer)
@@ -163,6 +491,13 @@ bool _FAT_cache_readSectors(CACHE *cache,sec_t sector,sec_t numSectors,void *buf
 	uint8_t *dest = (uint8_t *)buffer;
 
 	while(numSectors>0) {
+		// Bring in missing pages many at a time, in batches that fit the cache
+		if(sector % cache->readAheadSectors == 0 || dest == buffer) {
+			sec_t batch = cache->readAheadSectors - sector % cache->readAheadSectors;
+			if(batch > numSectors) batch = numSectors;
+			if(!_FAT_cache_prefetch(cache,sector,batch)) return false;
+		}
+
 		entry = _FAT_cache_getPage(cache,sector);
 		if(entry==NULL) return false;
 
@@ -294,21 +629,179 @@ bool _FAT_cache_writeSectors (CACHE* cache, sec_t sector, sec_t numSectors, cons
 	return true;
 }
 
+bool _FAT_cache_readSectorsDirect (CACHE* cache, sec_t sector, sec_t numSectors, void* buffer)
+{
+	unsigned int sectorsPerPage = cache->sectorsPerPage;
+	sec_t end = sector + numSectors;
+	uint8_t *dest = (uint8_t *)buffer;
+
+	_FAT_cache_finishPrefetch(cache);
+
+	while(sector < end) {
+		sec_t page = (sector/sectorsPerPage)*sectorsPerPage;
+		sec_t runEnd;
+		unsigned int i = _FAT_cache_findPage(cache,page);
+
+		if(i!=CACHE_NONE) {
+			// The page may be newer than the disc
+			runEnd = page + cache->cacheEntries[i].count;
+			if(runEnd > end) runEnd = end;
+			memcpy(dest,cache->cacheEntries[i].cache + (sector - page)*cache->bytesPerSector,(runEnd - sector)*cache->bytesPerSector);
+		} else {
+			// Read consecutive pages that are not in the cache in one go
+			runEnd = page + sectorsPerPage;
+			while(runEnd < end && _FAT_cache_findPage(cache,runEnd)==CACHE_NONE) {
+				runEnd += sectorsPerPage;
+			}
+			if(runEnd > end) runEnd = end;
+			if(!_FAT_disc_readSectors(cache->disc,sector,runEnd - sector,dest)) return false;
+		}
+
+		dest += (runEnd - sector)*cache->bytesPerSector;
+		sector = runEnd;
+	}
+	return true;
+}
+
+bool _FAT_cache_writeSectorsDirect (CACHE* cache, sec_t sector, sec_t numSectors, const void* buffer)
+{
+	unsigned int sectorsPerPage = cache->sectorsPerPage;
+	sec_t end = sector + numSectors;
+	const uint8_t *src = (const uint8_t *)buffer;
+	unsigned int i;
+	sec_t page;
+
+	_FAT_cache_finishPrefetch(cache);
+
+	if(!_FAT_disc_writeSectors(cache->disc,sector,numSectors,buffer)) return false;
+
+	// Pages that were clean match the disc again; dirty ones stay dirty for
+	// their other sectors
+	page = (sector/sectorsPerPage)*sectorsPerPage;
+	if((end - page)/sectorsPerPage > cache->numberOfPages) {
+		// Fewer entries than pages in the range: look at every entry
+		for(i = 0; i < cache->numberOfPages; i++) {
+			CACHE_ENTRY* entry = &cache->cacheEntries[i];
+			if(entry->sector != CACHE_FREE && entry->sector < end && entry->sector + entry->count > sector) {
+				sec_t first = entry->sector > sector ? entry->sector : sector;
+				sec_t last = entry->sector + entry->count < end ? entry->sector + entry->count : end;
+				memcpy(entry->cache + (first - entry->sector)*cache->bytesPerSector,src + (first - sector)*cache->bytesPerSector,(last - first)*cache->bytesPerSector);
+			}
+		}
+	} else {
+		for(; page < end; page += sectorsPerPage) {
+			i = _FAT_cache_findPage(cache,page);
+			if(i!=CACHE_NONE) {
+				CACHE_ENTRY* entry = &cache->cacheEntries[i];
+				sec_t first = page > sector ? page : sector;
+				sec_t last = page + entry->count < end ? page + entry->count : end;
+				memcpy(entry->cache + (first - page)*cache->bytesPerSector,src + (first - sector)*cache->bytesPerSector,(last - first)*cache->bytesPerSector);
+			}
+		}
+	}
+	return true;
+}
+
+typedef struct {
+	sec_t        sector;
+	unsigned int entry;
+} CACHE_DIRTY_PAGE;
+
+static int _FAT_cache_compareDirtyPages (const void* a, const void* b) {
+	sec_t sectorA = ((const CACHE_DIRTY_PAGE*) a)->sector;
+	sec_t sectorB = ((const CACHE_DIRTY_PAGE*) b)->sector;
+	return (sectorA > sectorB) - (sectorA < sectorB);
+}
+
 /*
 Flushes all dirty pages to disc, clearing the dirty flag.
+The pages are written in order of their sectors, and consecutive ones are
+written together, so that the card sees few, long, ascending writes.
 */
 bool _FAT_cache_flush (CACHE* cache) {
-	unsigned int i;
+	CACHE_DIRTY_PAGE* dirtyPages;
+	unsigned int i, count = 0;
+
+	_FAT_cache_finishPrefetch (cache);
+
+	dirtyPages = (CACHE_DIRTY_PAGE*) _FAT_mem_allocate (sizeof(CACHE_DIRTY_PAGE) * cache->numberOfPages);
+	if (dirtyPages == NULL) {
+		// Write the pages in the order of the entries instead
+		for (i = 0; i < cache->numberOfPages; i++) {
+			if (cache->cacheEntries[i].dirty && !_FAT_cache_writeBack (cache, i)) {
+				return false;
+			}
+		}
+		return true;
+	}
 
 	for (i = 0; i < cache->numberOfPages; i++) {
 		if (cache->cacheEntries[i].dirty) {
-			if (!_FAT_disc_writeSectors (cache->disc, cache->cacheEntries[i].sector, cache->cacheEntries[i].count, cache->cacheEntries[i].cache)) {
+			dirtyPages[count].sector = cache->cacheEntries[i].sector;
+			dirtyPages[count].entry = i;
+			count++;
+		}
+	}
+	qsort (dirtyPages, count, sizeof(CACHE_DIRTY_PAGE), _FAT_cache_compareDirtyPages);
+
+	for (i = 0; i < count; i++) {
+		// Pages written with an earlier one are clean already
+		if (cache->cacheEntries[dirtyPages[i].entry].dirty
+		 && !_FAT_cache_writeBack (cache, dirtyPages[i].entry)) {
+			_FAT_mem_free (dirtyPages);
+			return false;
+		}
+	}
+
+	_FAT_mem_free (dirtyPages);
+	return true;
+}
+
+/*
+Writes back an entry if it is dirty, and with discard, also drops it, making
+it the first to be replaced
+*/
+static bool _FAT_cache_syncEntry (CACHE* cache, unsigned int i, bool discard) {
+	CACHE_ENTRY* entry = &cache->cacheEntries[i];
+
+	if (entry->dirty && !_FAT_cache_writeBack (cache, i)) {
+		return false;
+	}
+	if (discard) {
+		_FAT_cache_hashRemove (cache, i);
+		entry->sector = CACHE_FREE;
+		entry->count = 0;
+		_FAT_cache_lruRemove (cache, i);
+		_FAT_cache_lruPushBack (cache, i);
+	}
+	return true;
+}
+
+bool _FAT_cache_syncRange (CACHE* cache, sec_t sector, sec_t numSectors, bool discard) {
+	unsigned int i;
+	sec_t page = (sector / cache->sectorsPerPage) * cache->sectorsPerPage;
+	sec_t end = sector + numSectors;
+
+	_FAT_cache_finishPrefetch (cache);
+
+	if ((end - page) / cache->sectorsPerPage > cache->numberOfPages) {
+		// Fewer entries than pages in the range: look at every entry
+		for (i = 0; i < cache->numberOfPages; i++) {
+			CACHE_ENTRY* entry = &cache->cacheEntries[i];
+			if (entry->sector != CACHE_FREE && entry->sector < end && entry->sector + entry->count > sector) {
+				if (!_FAT_cache_syncEntry (cache, i, discard)) {
+					return false;
+				}
+			}
+		}
+	} else {
+		for (; page < end; page += cache->sectorsPerPage) {
+			i = _FAT_cache_findPage (cache, page);
+			if (i != CACHE_NONE && !_FAT_cache_syncEntry (cache, i, discard)) {
 				return false;
 			}
 		}
-		cache->cacheEntries[i].dirty = false;
 	}
-
 	return true;
 }
 
@@ -317,8 +810,8 @@ void _FAT_cache_invalidate (CACHE* cache) {
 	_FAT_cache_flush(cache);
 	for (i = 0; i < cache->numberOfPages; i++) {
 		cache->cacheEntries[i].sector = CACHE_FREE;
-		cache->cacheEntries[i].last_access = 0;
 		cache->cacheEntries[i].count = 0;
 		cache->cacheEntries[i].dirty = false;
 	}
+	_FAT_cache_resetIndex(cache);
 }
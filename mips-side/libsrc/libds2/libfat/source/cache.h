@@ -42,9 +42,11 @@
 typedef struct {
 	sec_t        sector;
 	unsigned int count;
-	unsigned int last_access;
 	bool         dirty;
 	uint8_t*     cache;
+	unsigned int hashNext;   // Next entry in the same hash bucket
+	unsigned int lruPrev;    // Entry used more recently than this one
+	unsigned int lruNext;    // Entry used less recently than this one
 } CACHE_ENTRY;
 
 typedef struct {
@@ -54,6 +56,14 @@ typedef struct {
 	unsigned int          sectorsPerPage;
 	unsigned int          bytesPerSector;
 	CACHE_ENTRY*          cacheEntries;
+	unsigned int*         hashBuckets;  // First entry of each bucket, by page number
+	unsigned int          hashShift;    // 32 - log2 of the number of buckets
+	unsigned int          lruHead;      // Most recently used entry
+	unsigned int          lruTail;      // Least recently used entry, replaced first
+	sec_t                 readAheadSectors; // Most sectors read into pages at once
+	uint8_t*              readAheadBuffer;  // Holds them, and pages written back together, if more than a page
+	sec_t                 prefetchSector;   // First sector being read into readAheadBuffer in the background
+	sec_t                 prefetchCount;    // Number of sectors being read in the background, or 0
 } CACHE;
 
 /*
@@ -94,6 +104,19 @@ Read several sectors from the cache
 */
 bool _FAT_cache_readSectors (CACHE* cache, sec_t sector, sec_t numSectors, void* buffer);
 
+/*
+Make sure the given sectors are in the cache, reading each run of missing pages
+from the disc in one multi-sector transfer
+*/
+bool _FAT_cache_prefetch (CACHE* cache, sec_t sector, sec_t numSectors);
+
+/*
+Start reading the first run of the given sectors that is not in the cache
+from the disc in the background, in one multi-sector transfer. The pages
+enter the cache when they are next needed, or before the disc is used again
+*/
+bool _FAT_cache_startPrefetch (CACHE* cache, sec_t sector, sec_t numSectors);
+
 /*
 Read a full sector from the cache
 */
@@ -110,11 +133,30 @@ static inline bool _FAT_cache_writeSector (CACHE* cache, const void* buffer, sec
 
 bool _FAT_cache_writeSectors (CACHE* cache, sec_t sector, sec_t numSectors, const void* buffer);
 
+/*
+Read several sectors straight into a buffer, copying the pages that are in
+the cache from it and reading the rest from the disc without caching them
+*/
+bool _FAT_cache_readSectorsDirect (CACHE* cache, sec_t sector, sec_t numSectors, void* buffer);
+
+/*
+Write several sectors straight to the disc, then update the pages of them
+that are in the cache so that the cache stays coherent
+*/
+bool _FAT_cache_writeSectorsDirect (CACHE* cache, sec_t sector, sec_t numSectors, const void* buffer);
+
 /*
 Write any dirty sectors back to disc and clear out the contents of the cache
 */
 bool _FAT_cache_flush (CACHE* cache);
 
+/*
+Write back the dirty pages overlapping the given sectors, so that the disc
+holds their latest contents, and with discard, also drop them from the cache,
+for when the sectors are about to be written without going through it
+*/
+bool _FAT_cache_syncRange (CACHE* cache, sec_t sector, sec_t numSectors, bool discard);
+
 /*
 Clear out the contents of the cache without writing any dirty sectors first
 */
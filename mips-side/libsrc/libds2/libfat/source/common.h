@@ -44,7 +44,9 @@ typedef struct _DIR_ITER {
 #include <disc_io.h>
 
 // Platform specific options
-#define DEFAULT_CACHE_PAGES 16
+#define DEFAULT_CACHE_PAGES 64
 #define DEFAULT_SECTORS_PAGE 8
+#define READ_AHEAD_MAX_SECTORS 128
+#define DIR_INDEX_COUNT 4
 
 #endif // _COMMON_H
@@ -41,6 +41,7 @@
 #include "file_allocation_table.h"
 #include "bit_ops.h"
 #include "filetime.h"
+#include "mem_allocate.h"
 
 // Directory entry codes
 #define DIR_ENTRY_LAST 0x00
@@ -528,13 +529,356 @@ bool _FAT_directory_entryFromPosition (PARTITION* partition, DIR_ENTRY* entry) {
 
 
 
+/*
+Directory name indexes
+
+Looking up a name in a directory used to read every entry before it, and
+creating a file read the whole directory again for every alias tried. The
+partition now keeps hash indexes for the few directories used last, each
+mapping the hashes of the names and aliases in the directory to the
+positions of their entries. A lookup reads only the entries whose hashes
+match, then compares names as the full scan would.
+
+An index is filled in by the lookups themselves. A name not in the index
+is looked for by scanning on from where the index stops, adding every entry
+read, until the name is found, as the scan without an index did. So a
+lookup never reads further into a directory than that scan would, and an
+index is complete once a lookup has reached the end of its directory.
+Adding an entry adds it to the index, and removing one takes it out, so an
+index stays valid while its directory changes. The least recently used
+index, and its memory, goes to another directory when all are in use.
+Without memory for an index, lookups scan the directory.
+*/
+#define DIR_INDEX_NONE 0xFFFFFFFF
+
+typedef struct {
+	uint32_t           hash;			// Hash of the lowercase name or alias
+	uint32_t           next;			// Next node in the same bucket, or DIR_INDEX_NONE
+	DIR_ENTRY_POSITION dataStart;
+	DIR_ENTRY_POSITION dataEnd;			// cluster is CLUSTER_ERROR if the entry was removed
+} DIR_INDEX_NODE;
+
+typedef struct _DIR_INDEX {
+	uint32_t           dirCluster;
+	uint32_t           lastUsed;		// Value of dirIndexClock when last used
+	bool               inUse;
+	bool               complete;		// true once every entry of the directory is in the index
+	DIR_ENTRY_POSITION scanEnd;			// End of the last entry added by scanning
+	uint32_t           nodeCount;
+	uint32_t           nodeCapacity;
+	uint32_t           bucketCount;		// A power of 2, or 0 before the buckets are allocated
+	uint32_t*          buckets;
+	DIR_INDEX_NODE*    nodes;
+} DIR_INDEX;
+
+/*
+Hashes a multibyte name as _FAT_directory_mbsncasecmp compares it
+*/
+static uint32_t _FAT_directory_nameHash (const char* name, size_t len) {
+	uint32_t hash = 2166136261u;
+	mbstate_t ps = {0};
+	wchar_t wc;
+	size_t bytes;
+
+	while (len > 0) {
+		bytes = mbrtowc (&wc, name, len, &ps);
+		if ((int)bytes <= 0) {
+			break;
+		}
+		hash = (hash ^ (uint32_t)towlower (wc)) * 16777619u;
+		name += bytes;
+		len -= bytes;
+	}
+
+	return hash;
+}
+
+/*
+Hashes an alias as strncasecmp compares it
+*/
+static uint32_t _FAT_directory_aliasHash (const char* alias, size_t len) {
+	uint32_t hash = 2166136261u;
+
+	while (len > 0 && *alias != '\0') {
+		hash = (hash ^ (uint32_t)tolower ((unsigned char)*alias)) * 16777619u;
+		alias++;
+		len--;
+	}
+
+	return hash;
+}
+
+/*
+Returns true if the name, len bytes long, is the file name or the alias of
+the entry
+*/
+static bool _FAT_directory_entryMatches (DIR_ENTRY* entry, const char* name, size_t len) {
+	char alias[MAX_ALIAS_LENGTH];
+
+	// Check if the filename matches
+	if ((len == strnlen(entry->filename, MAX_FILENAME_LENGTH))
+		&& (_FAT_directory_mbsncasecmp(name, entry->filename, len) == 0)) {
+		return true;
+	}
+
+	// Check if the alias matches
+	_FAT_directory_entryGetAlias (entry->entryData, alias);
+	return (len == strnlen(alias, MAX_ALIAS_LENGTH))
+		&& (strncasecmp(name, alias, len) == 0);
+}
+
+static void _FAT_directory_clearIndex (DIR_INDEX* index) {
+	_FAT_mem_free (index->buckets);
+	_FAT_mem_free (index->nodes);
+	index->buckets = NULL;
+	index->nodes = NULL;
+	index->nodeCount = 0;
+	index->nodeCapacity = 0;
+	index->bucketCount = 0;
+	index->inUse = false;
+}
+
+void _FAT_directory_destroyIndexes (PARTITION* partition) {
+	int i;
+
+	if (partition->dirIndexes == NULL) {
+		return;
+	}
+	for (i = 0; i < DIR_INDEX_COUNT; i++) {
+		_FAT_directory_clearIndex (&partition->dirIndexes[i]);
+	}
+	_FAT_mem_free (partition->dirIndexes);
+	partition->dirIndexes = NULL;
+}
+
+/*
+Grows the buckets of an index to suit its number of nodes and puts every
+node back in its bucket. Returns false if there is no memory for it.
+*/
+static bool _FAT_directory_rehashIndex (DIR_INDEX* index) {
+	uint32_t bucketCount = 16;
+	uint32_t* buckets;
+	uint32_t i, bucket;
+
+	while (bucketCount < index->nodeCount) {
+		bucketCount *= 2;
+	}
+	if (bucketCount > index->bucketCount) {
+		buckets = (uint32_t*) _FAT_mem_reallocate (index->buckets, bucketCount * sizeof(uint32_t));
+		if (buckets == NULL) {
+			return false;
+		}
+		index->buckets = buckets;
+		index->bucketCount = bucketCount;
+	}
+
+	for (i = 0; i < index->bucketCount; i++) {
+		index->buckets[i] = DIR_INDEX_NONE;
+	}
+	for (i = 0; i < index->nodeCount; i++) {
+		bucket = index->nodes[i].hash & (index->bucketCount - 1);
+		index->nodes[i].next = index->buckets[bucket];
+		index->buckets[bucket] = i;
+	}
+
+	return true;
+}
+
+static bool _FAT_directory_addIndexNode (DIR_INDEX* index, uint32_t hash, const DIR_ENTRY* entry) {
+	DIR_INDEX_NODE* node;
+	uint32_t bucket;
+
+	if (index->nodeCount == index->nodeCapacity) {
+		uint32_t capacity = index->nodeCapacity ? index->nodeCapacity * 2 : 64;
+		DIR_INDEX_NODE* nodes = (DIR_INDEX_NODE*) _FAT_mem_reallocate (index->nodes, capacity * sizeof(DIR_INDEX_NODE));
+		if (nodes == NULL) {
+			return false;
+		}
+		index->nodes = nodes;
+		index->nodeCapacity = capacity;
+	}
+
+	node = &index->nodes[index->nodeCount++];
+	node->hash = hash;
+	node->dataStart = entry->dataStart;
+	node->dataEnd = entry->dataEnd;
+
+	// Keep chains short as the directory grows
+	if (index->nodeCount > index->bucketCount * 2) {
+		return _FAT_directory_rehashIndex (index);
+	}
+	bucket = hash & (index->bucketCount - 1);
+	node->next = index->buckets[bucket];
+	index->buckets[bucket] = index->nodeCount - 1;
+	return true;
+}
+
+/*
+Adds the name of an entry, and its alias if that hashes differently, to an index
+*/
+static bool _FAT_directory_addIndexEntry (DIR_INDEX* index, const DIR_ENTRY* entry) {
+	char alias[MAX_ALIAS_LENGTH];
+	uint32_t nameHash, aliasHash;
+
+	nameHash = _FAT_directory_nameHash (entry->filename, strnlen (entry->filename, MAX_FILENAME_LENGTH));
+	if (!_FAT_directory_addIndexNode (index, nameHash, entry)) {
+		return false;
+	}
+
+	_FAT_directory_entryGetAlias (entry->entryData, alias);
+	aliasHash = _FAT_directory_aliasHash (alias, MAX_ALIAS_LENGTH);
+	if (alias[0] != '\0' && aliasHash != nameHash) {
+		return _FAT_directory_addIndexNode (index, aliasHash, entry);
+	}
+	return true;
+}
+
+/*
+Returns the index of a directory if there is one already
+*/
+static DIR_INDEX* _FAT_directory_findIndex (PARTITION* partition, uint32_t dirCluster) {
+	int i;
+
+	if (partition->dirIndexes == NULL) {
+		return NULL;
+	}
+	if (dirCluster == CLUSTER_ROOT) {
+		dirCluster = partition->rootDirCluster;
+	}
+	for (i = 0; i < DIR_INDEX_COUNT; i++) {
+		if (partition->dirIndexes[i].inUse && partition->dirIndexes[i].dirCluster == dirCluster) {
+			return &partition->dirIndexes[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+Returns the index of a directory, starting an empty one in place of the
+least recently used one if needed. Returns NULL if there is no memory for it.
+*/
+static DIR_INDEX* _FAT_directory_getIndex (PARTITION* partition, uint32_t dirCluster) {
+	DIR_INDEX* index;
+	int i;
+
+	if (dirCluster == CLUSTER_ROOT) {
+		dirCluster = partition->rootDirCluster;
+	}
+
+	index = _FAT_directory_findIndex (partition, dirCluster);
+	if (index == NULL) {
+		if (partition->dirIndexes == NULL) {
+			partition->dirIndexes = (DIR_INDEX*) _FAT_mem_allocate (DIR_INDEX_COUNT * sizeof(DIR_INDEX));
+			if (partition->dirIndexes == NULL) {
+				return NULL;
+			}
+			memset (partition->dirIndexes, 0, DIR_INDEX_COUNT * sizeof(DIR_INDEX));
+		}
+
+		index = &partition->dirIndexes[0];
+		for (i = 1; i < DIR_INDEX_COUNT; i++) {
+			if (partition->dirIndexes[i].lastUsed < index->lastUsed) {
+				index = &partition->dirIndexes[i];
+			}
+		}
+
+		// Keep the memory of the old index for the new one
+		index->nodeCount = 0;
+		if (!_FAT_directory_rehashIndex (index)) {
+			_FAT_directory_clearIndex (index);
+			return NULL;
+		}
+		index->dirCluster = dirCluster;
+		index->inUse = true;
+		index->complete = false;
+		// Start before the beginning of the directory
+		index->scanEnd.cluster = dirCluster;
+		index->scanEnd.sector = 0;
+		index->scanEnd.offset = -1;
+	}
+
+	index->lastUsed = ++partition->dirIndexClock;
+	return index;
+}
+
+/*
+Looks up a name, len bytes long, in the index of a directory, then in the
+entries after those in the index, adding them to it. If it is found, fills
+in entry as _FAT_directory_getNextEntry would and returns true. If
+wantDirectory is set, only directories match.
+*/
+static bool _FAT_directory_indexLookup (PARTITION* partition, DIR_INDEX* index, DIR_ENTRY* entry,
+	const char* name, size_t len, bool wantDirectory)
+{
+	uint32_t hashes[2];
+	uint32_t best = DIR_INDEX_NONE;
+	uint32_t node;
+	int i;
+
+	hashes[0] = _FAT_directory_nameHash (name, len);
+	hashes[1] = _FAT_directory_aliasHash (name, len);
+
+	for (i = 0; i < 2; i++) {
+		if (i == 1 && hashes[1] == hashes[0]) {
+			break;
+		}
+		// Prefer the match that comes first in the index, as a scan would
+		for (node = index->buckets[hashes[i] & (index->bucketCount - 1)]; node != DIR_INDEX_NONE; node = index->nodes[node].next) {
+			if (node >= best || index->nodes[node].hash != hashes[i]
+			 || index->nodes[node].dataEnd.cluster == CLUSTER_ERROR) {
+				continue;
+			}
+			entry->dataStart = index->nodes[node].dataStart;
+			entry->dataEnd = index->nodes[node].dataEnd;
+			if (_FAT_directory_entryFromPosition (partition, entry)
+			 && _FAT_directory_entryMatches (entry, name, len)
+			 && (!wantDirectory || (entry->entryData[DIR_ENTRY_attributes] & ATTRIB_DIR))) {
+				best = node;
+			}
+		}
+	}
+
+	if (best != DIR_INDEX_NONE) {
+		entry->dataStart = index->nodes[best].dataStart;
+		entry->dataEnd = index->nodes[best].dataEnd;
+		return _FAT_directory_entryFromPosition (partition, entry);
+	}
+
+	if (index->complete) {
+		return false;
+	}
+
+	// Scan on from the end of the index, stopping at the name as a full scan would
+	entry->dataEnd = index->scanEnd;
+	while (_FAT_directory_getNextEntry (partition, entry)) {
+		if (index != NULL) {
+			if (_FAT_directory_addIndexEntry (index, entry)) {
+				index->scanEnd = entry->dataEnd;
+			} else {
+				// Out of memory, so finish this scan without the index
+				_FAT_directory_clearIndex (index);
+				index = NULL;
+			}
+		}
+		if (_FAT_directory_entryMatches (entry, name, len)
+		 && (!wantDirectory || (entry->entryData[DIR_ENTRY_attributes] & ATTRIB_DIR))) {
+			return true;
+		}
+	}
+
+	if (index != NULL) {
+		index->complete = true;
+	}
+	return false;
+}
+
 bool _FAT_directory_entryFromPath (PARTITION* partition, DIR_ENTRY* entry, const char* path, const char* pathEnd) {
 	size_t dirnameLength;
 	const char* pathPosition;
 	const char* nextPathPosition;
 	uint32_t dirCluster;
 	bool foundFile;
-	char alias[MAX_ALIAS_LENGTH];
+	DIR_INDEX* index;
 	bool found, notFound;
 
 	pathPosition = path;
@@ -585,23 +929,17 @@ bool _FAT_directory_entryFromPath (PARTITION* partition, DIR_ENTRY* entry, const
 		  || (strncmp("..", pathPosition, dirnameLength) == 0))) {
 			foundFile = true;
 			_FAT_directory_getRootEntry(partition, entry);
+		} else if ((index = _FAT_directory_getIndex (partition, dirCluster)) != NULL) {
+			// Look for the directory within the path, using its name index
+			foundFile = _FAT_directory_indexLookup (partition, index, entry,
+				pathPosition, dirnameLength, nextPathPosition != NULL);
 		} else {
 			// Look for the directory within the path
 			foundFile = _FAT_directory_getFirstEntry (partition, entry, dirCluster);
 
 			while (foundFile && !found && !notFound) {			// It hasn't already found the file
-				// Check if the filename matches
-				if ((dirnameLength == strnlen(entry->filename, MAX_FILENAME_LENGTH))
-					&& (_FAT_directory_mbsncasecmp(pathPosition, entry->filename, dirnameLength) == 0)) {
-						found = true;
-				}
-
-				// Check if the alias matches
-				_FAT_directory_entryGetAlias (entry->entryData, alias);
-				if ((dirnameLength == strnlen(alias, MAX_ALIAS_LENGTH))
-					&& (strncasecmp(pathPosition, alias, dirnameLength) == 0)) {
-						found = true;
-				}
+				// Check if the filename or alias matches
+				found = _FAT_directory_entryMatches (entry, pathPosition, dirnameLength);
 
 				if (found && !(entry->entryData[DIR_ENTRY_attributes] & ATTRIB_DIR) && (nextPathPosition != NULL)) {
 					// Make sure that we aren't trying to follow a file instead of a directory in the path
@@ -653,6 +991,38 @@ bool _FAT_directory_entryFromPath (PARTITION* partition, DIR_ENTRY* entry, const
 	}
 }
 
+/*
+Takes a removed entry out of the directory indexes and, if the entry was a
+directory, drops the index of its contents
+*/
+static void _FAT_directory_removeFromIndexes (PARTITION* partition, DIR_ENTRY* entry) {
+	DIR_INDEX* index;
+	uint32_t node;
+	int i;
+
+	if (partition->dirIndexes == NULL) {
+		return;
+	}
+
+	for (i = 0; i < DIR_INDEX_COUNT; i++) {
+		index = &partition->dirIndexes[i];
+		for (node = 0; node < index->nodeCount; node++) {
+			if (index->nodes[node].dataEnd.cluster == entry->dataEnd.cluster
+			 && index->nodes[node].dataEnd.sector == entry->dataEnd.sector
+			 && index->nodes[node].dataEnd.offset == entry->dataEnd.offset) {
+				index->nodes[node].dataEnd.cluster = CLUSTER_ERROR;
+			}
+		}
+	}
+
+	if (_FAT_directory_isDirectory (entry)) {
+		index = _FAT_directory_findIndex (partition, _FAT_directory_entryGetCluster (partition, entry->entryData));
+		if (index != NULL) {
+			_FAT_directory_clearIndex (index);
+		}
+	}
+}
+
 bool _FAT_directory_removeEntry (PARTITION* partition, DIR_ENTRY* entry) {
 	DIR_ENTRY_POSITION entryStart = entry->dataStart;
 	DIR_ENTRY_POSITION entryEnd = entry->dataEnd;
@@ -677,6 +1047,8 @@ bool _FAT_directory_removeEntry (PARTITION* partition, DIR_ENTRY* entry) {
 		return false;
 	}
 
+	_FAT_directory_removeFromIndexes (partition, entry);
+
 	return true;
 }
 
@@ -756,8 +1128,8 @@ static bool _FAT_directory_findEntryGap (PARTITION* partition, DIR_ENTRY* entry,
 
 static bool _FAT_directory_entryExists (PARTITION* partition, const char* name, uint32_t dirCluster) {
 	DIR_ENTRY tempEntry;
+	DIR_INDEX* index;
 	bool foundFile;
-	char alias[MAX_ALIAS_LENGTH];
 	size_t dirnameLength;
 
 	dirnameLength = strnlen(name, MAX_FILENAME_LENGTH);
@@ -766,20 +1138,18 @@ static bool _FAT_directory_entryExists (PARTITION* partition, const char* name,
 		return false;
 	}
 
+	index = _FAT_directory_getIndex (partition, dirCluster);
+	if (index != NULL) {
+		return _FAT_directory_indexLookup (partition, index, &tempEntry, name, dirnameLength, false);
+	}
+
 	// Make sure the entry doesn't already exist
 	foundFile = _FAT_directory_getFirstEntry (partition, &tempEntry, dirCluster);
 
 	while (foundFile) {			// It hasn't already found the file
-		// Check if the filename matches
-		if ((dirnameLength == strnlen(tempEntry.filename, MAX_FILENAME_LENGTH))
-			&& (_FAT_directory_mbsncasecmp(name, tempEntry.filename, dirnameLength) == 0)) {
-				return true;
-		}
-
-		// Check if the alias matches
-		_FAT_directory_entryGetAlias (tempEntry.entryData, alias);
-		if ((strncasecmp(name, alias, MAX_ALIAS_LENGTH) == 0)) {
-				return true;
+		// Check if the filename or alias matches
+		if (_FAT_directory_entryMatches (&tempEntry, name, dirnameLength)) {
+			return true;
 		}
 		foundFile = _FAT_directory_getNextEntry (partition, &tempEntry);
 	}
@@ -911,6 +1281,7 @@ bool _FAT_directory_addEntry (PARTITION* partition, DIR_ENTRY* entry, uint32_t d
 	char alias [MAX_ALIAS_LENGTH];
 	int aliasLen;
 	int lfnLen;
+	DIR_INDEX* index;
 
 	// Remove trailing spaces
 	for (i = strlen (entry->filename) - 1; (i >= 0) && (entry->filename[i] == ' '); --i) {
@@ -1076,6 +1447,12 @@ bool _FAT_directory_addEntry (PARTITION* partition, DIR_ENTRY* entry, uint32_t d
 		}
 	}
 
+	// Keep the directory's name index, if it has one, in step
+	index = _FAT_directory_findIndex (partition, dirCluster);
+	if (index != NULL && !_FAT_directory_addIndexEntry (index, entry)) {
+		_FAT_directory_clearIndex (index);
+	}
+
 	return true;
 }
 
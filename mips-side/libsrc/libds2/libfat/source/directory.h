@@ -175,6 +175,11 @@ Fill in a stat struct based on a file entry
 */
 void _FAT_directory_entryStat (PARTITION* partition, DIR_ENTRY* entry, struct stat *st);
 
+/*
+Free the name indexes of the directories of a partition
+*/
+void _FAT_directory_destroyIndexes (PARTITION* partition);
+
 /*
 Get volume label
 */
@@ -71,6 +71,47 @@ static inline bool _FAT_disc_writeSectors (const DISC_INTERFACE* disc, sec_t sec
 	return disc->writeSectors (sector, numSectors, buffer);
 }
 
+/*
+Start reading numSectors sectors from a disc into buffer, like
+_FAT_disc_readSectors, possibly returning before the data has arrived.
+The buffer must not be accessed until _FAT_disc_isBusy returns false.
+Discs without FEATURE_MEDIUM_ASYNC read the sectors before returning.
+*/
+static inline bool _FAT_disc_startReadSectors (const DISC_INTERFACE* disc, sec_t sector, sec_t numSectors, void* buffer) {
+	if (disc->features & FEATURE_MEDIUM_ASYNC) {
+		return disc->startReadSectors (sector, numSectors, buffer);
+	}
+	return disc->readSectors (sector, numSectors, buffer);
+}
+
+/*
+Start writing numSectors sectors to a disc from buffer, like
+_FAT_disc_writeSectors, possibly returning before the data has been written.
+The buffer must not be modified until _FAT_disc_isBusy returns false.
+Discs without FEATURE_MEDIUM_ASYNC write the sectors before returning.
+*/
+static inline bool _FAT_disc_startWriteSectors (const DISC_INTERFACE* disc, sec_t sector, sec_t numSectors, const void* buffer) {
+	if (disc->features & FEATURE_MEDIUM_ASYNC) {
+		return disc->startWriteSectors (sector, numSectors, buffer);
+	}
+	return disc->writeSectors (sector, numSectors, buffer);
+}
+
+/*
+Return true while a started transfer is still moving data
+*/
+static inline bool _FAT_disc_isBusy (const DISC_INTERFACE* disc) {
+	return (disc->features & FEATURE_MEDIUM_ASYNC) && disc->isBusy();
+}
+
+/*
+Wait for the last started transfer to finish
+Return true if it succeeded, false otherwise
+*/
+static inline bool _FAT_disc_waitTransfer (const DISC_INTERFACE* disc) {
+	return !(disc->features & FEATURE_MEDIUM_ASYNC) || disc->waitTransfer();
+}
+
 /*
 Reset the card back to a ready state
 */
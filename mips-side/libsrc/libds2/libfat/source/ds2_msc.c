@@ -36,6 +36,42 @@ static inline bool _MMC_WriteSectors(uint32_t sector, uint32_t numSectors, const
 	return (flag==MMC_NO_ERROR);
 }
 
+/* Whether the last started transfer finishes in the background */
+static bool _MMC_Background;
+/* Whether the last started transfer succeeded, if it finished when started */
+static bool _MMC_Succeeded = true;
+
+static inline bool _MMC_StartedTransfer(int flag)
+{
+	_MMC_Background = (flag == MMC_TRANSFER_PENDING);
+	_MMC_Succeeded = (flag == MMC_NO_ERROR);
+	return _MMC_Background || _MMC_Succeeded;
+}
+
+/* start reading blocks from MMC/SD card, finishing in the background */
+static inline bool _MMC_StartReadSectors(uint32_t sector, uint32_t numSectors, void* buffer)
+{
+	return _MMC_StartedTransfer(MMC_StartReadMultiBlock(sector, numSectors, (unsigned char*)buffer));
+}
+
+/* start writing blocks to MMC/SD card, finishing in the background */
+static inline bool _MMC_StartWriteSectors(uint32_t sector, uint32_t numSectors, const void* buffer)
+{
+	return _MMC_StartedTransfer(MMC_StartWriteMultiBlock(sector, numSectors, (unsigned char*)buffer));
+}
+
+static inline bool _MMC_IsBusy(void)
+{
+	return _MMC_Background && MMC_TransferStatus() == MMC_TRANSFER_PENDING;
+}
+
+static inline bool _MMC_WaitTransfer(void)
+{
+	if (_MMC_Background)
+		return MMC_WaitTransfer() == MMC_NO_ERROR;
+	return _MMC_Succeeded;
+}
+
 static inline bool _MMC_ClearStatus(void)
 {
 	return true;
@@ -53,11 +89,15 @@ static inline bool _MMC_IsInserted(void)
 
 const DISC_INTERFACE __io_scds2 = {
 	DEVICE_TYPE_SCDS2_MICROSD,
-	FEATURE_MEDIUM_CANREAD | FEATURE_MEDIUM_CANWRITE,
+	FEATURE_MEDIUM_CANREAD | FEATURE_MEDIUM_CANWRITE | FEATURE_MEDIUM_ASYNC,
 	(FN_MEDIUM_STARTUP)&_MMC_StartUp,
 	(FN_MEDIUM_ISINSERTED)&_MMC_IsInserted,
 	(FN_MEDIUM_READSECTORS)&_MMC_ReadSectors,
 	(FN_MEDIUM_WRITESECTORS)&_MMC_WriteSectors,
 	(FN_MEDIUM_CLEARSTATUS)&_MMC_ClearStatus,
-	(FN_MEDIUM_SHUTDOWN)&_MMC_ShutDown
+	(FN_MEDIUM_SHUTDOWN)&_MMC_ShutDown,
+	(FN_MEDIUM_STARTREADSECTORS)&_MMC_StartReadSectors,
+	(FN_MEDIUM_STARTWRITESECTORS)&_MMC_StartWriteSectors,
+	(FN_MEDIUM_ISBUSY)&_MMC_IsBusy,
+	(FN_MEDIUM_WAITTRANSFER)&_MMC_WaitTransfer
 };
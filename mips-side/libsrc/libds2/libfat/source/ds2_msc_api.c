@@ -35,6 +35,9 @@ static OS_EVENT *pSemMMC = NULL;	/* semaphore that access card */
 ********************************************************************************************************************/
 static void mmc_enter(void)
 {
+#if MMC_DMA_ENABLE
+	_mmc_wait_transfer();	/* finish the transfer started in the background */
+#endif
 #if MMC_UCOSII_EN
 	unsigned char ret;
 	OSSemPend(pSemMMC, 0, &ret);	/* wait for semaphore that accessed Card */
@@ -323,6 +326,28 @@ int MMC_WriteBlock(unsigned int blockaddr, unsigned char * sendbuf)
 	return retval;
 }
 
+/******************************************************************
+ *
+ * Tell an SD card how many blocks the next multiple block write
+ * will replace, so that it can erase them ahead of the data
+ * (ACMD23). This is only a hint, so failures are ignored.
+ *
+ ******************************************************************/
+static void mmc_pre_erase(unsigned int blocknum)
+{
+	struct mmc_request request;
+	struct mmc_response_r1 r1;
+
+	if (!mmcinfo.sd || blocknum < 2)
+		return;
+
+	mmc_simple_cmd(&request, MMC_APP_CMD, mmcinfo.rca, RESPONSE_R1);
+	if (mmc_unpack_r1(&request, &r1, 0))
+		return;
+	mmc_simple_cmd(&request, SET_WR_BLK_ERASE_COUNT, blocknum, RESPONSE_R1);
+	mmc_unpack_r1(&request, &r1, 0);
+}
+
 /******************************************************************
  *
  * Write multiple blocks to SD/MMC card
@@ -365,6 +390,8 @@ int MMC_WriteMultiBlock(unsigned int blockaddr, unsigned int blocknum, unsigned
 		return retval;
 	}
 
+	mmc_pre_erase(blocknum);
+
 	if (sd2_0) {
 		mmc_send_cmd(&request, MMC_WRITE_MULTIPLE_BLOCK, blockaddr,
 			     blocknum, MMC_BLOCKSIZE, RESPONSE_R1,
@@ -392,6 +419,111 @@ int MMC_WriteMultiBlock(unsigned int blockaddr, unsigned int blocknum, unsigned
 	return retval;
 }
 
+#if MMC_DMA_ENABLE
+/******************************************************************
+ *
+ * Start a multiple block command whose data moves by DMA
+ *
+ ******************************************************************/
+static int mmc_start_multi_block(int cmd, unsigned int blockaddr, unsigned int blocknum, unsigned char * buf)
+{
+	struct mmc_request request;
+	struct mmc_response_r1 r1;
+	int retval;
+
+	mmc_enter();		/* request semaphore acessed SD/MMC to OS */
+	if (_mmc_chkcard() != 1) {
+		mmc_exit();
+		return MMC_NO_RESPONSE;	/* card is not inserted entirely */
+	}
+
+	if ((blockaddr + blocknum) > mmcinfo.block_num) {
+		mmc_exit();
+		return MMC_ERROR_OUT_OF_RANGE;	/* operate over the card range */
+	}
+
+	if (cmd == MMC_WRITE_MULTIPLE_BLOCK && _mmc_chkcardwp() == 1) {
+		mmc_exit();
+		return MMC_ERROR_WP_VIOLATION;	/* card is write protected */
+	}
+
+	mmc_simple_cmd(&request, MMC_SEND_STATUS, mmcinfo.rca,
+		       RESPONSE_R1);
+	retval = mmc_unpack_r1(&request, &r1, 0);
+	if (retval && (retval != MMC_ERROR_STATE_MISMATCH)) {
+		mmc_exit();
+		return retval;
+	}
+
+	mmc_simple_cmd(&request, MMC_SET_BLOCKLEN, MMC_BLOCKSIZE,
+		       RESPONSE_R1);
+	if ((retval = mmc_unpack_r1(&request, &r1, 0))) {
+		mmc_exit();
+		return retval;
+	}
+
+	if (cmd == MMC_WRITE_MULTIPLE_BLOCK)
+		mmc_pre_erase(blocknum);
+
+	/* STOP_TRANSMISSION is sent from an interrupt after the data */
+	mmc_start_cmd(&request, cmd, sd2_0 ? blockaddr : blockaddr * MMC_BLOCKSIZE,
+		      blocknum, MMC_BLOCKSIZE, RESPONSE_R1, buf);
+	retval = mmc_unpack_r1(&request, &r1, 0);
+
+	mmc_exit();
+	return retval ? retval : MMC_TRANSFER_PENDING;
+}
+#endif
+
+/******************************************************************
+ *
+ * Start reading multiple blocks from SD/MMC card. Returns
+ * MMC_TRANSFER_PENDING if the data is moving in the background.
+ * Buffers that can't be used by DMA are read before returning.
+ *
+ ******************************************************************/
+int MMC_StartReadMultiBlock(unsigned int blockaddr, unsigned int blocknum, unsigned char * recbuf)
+{
+#if MMC_DMA_ENABLE
+	if (_mmc_dma_capable(recbuf, blocknum * MMC_BLOCKSIZE))
+		return mmc_start_multi_block(MMC_READ_MULTIPLE_BLOCK, blockaddr, blocknum, recbuf);
+#endif
+	return MMC_ReadMultiBlock(blockaddr, blocknum, recbuf);
+}
+
+/******************************************************************
+ *
+ * Start writing multiple blocks to SD/MMC card. Returns
+ * MMC_TRANSFER_PENDING if the data is moving in the background.
+ * Buffers that can't be used by DMA are written before returning.
+ *
+ ******************************************************************/
+int MMC_StartWriteMultiBlock(unsigned int blockaddr, unsigned int blocknum, unsigned char * sendbuf)
+{
+#if MMC_DMA_ENABLE
+	if (_mmc_dma_capable(sendbuf, blocknum * MMC_BLOCKSIZE))
+		return mmc_start_multi_block(MMC_WRITE_MULTIPLE_BLOCK, blockaddr, blocknum, sendbuf);
+#endif
+	return MMC_WriteMultiBlock(blockaddr, blocknum, sendbuf);
+}
+
+int MMC_TransferStatus(void)
+{
+#if MMC_DMA_ENABLE
+	return _mmc_transfer_status();
+#else
+	return MMC_NO_ERROR;
+#endif
+}
+
+int MMC_WaitTransfer(void)
+{
+#if MMC_DMA_ENABLE
+	return _mmc_wait_transfer();
+#else
+	return MMC_NO_ERROR;
+#endif
+}
 
 #ifndef USE_MIDWARE
 /******************************************************************
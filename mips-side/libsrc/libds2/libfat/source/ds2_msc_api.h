@@ -3,6 +3,7 @@
 
 /* Error codes */
 enum mmc_result_t {
+	MMC_TRANSFER_PENDING   = -2,
 	MMC_NO_RESPONSE        = -1,
 	MMC_NO_ERROR           = 0,
 	MMC_ERROR_OUT_OF_RANGE,
@@ -49,6 +50,18 @@ extern int MMC_WriteBlock(unsigned int blockaddr, unsigned char *recbuf);
 /* write multi blocks to MMC/SD card */
 extern int MMC_WriteMultiBlock(unsigned int blockaddr, unsigned int blocknum, unsigned char *recbuf);
 
+/* start reading multi blocks from MMC/SD card; MMC_TRANSFER_PENDING if it finishes in the background */
+extern int MMC_StartReadMultiBlock(unsigned int blockaddr, unsigned int blocknum, unsigned char *recbuf);
+
+/* start writing multi blocks to MMC/SD card; MMC_TRANSFER_PENDING if it finishes in the background */
+extern int MMC_StartWriteMultiBlock(unsigned int blockaddr, unsigned int blocknum, unsigned char *sendbuf);
+
+/* get the result of the last transfer finishing in the background, or MMC_TRANSFER_PENDING */
+extern int MMC_TransferStatus(void);
+
+/* wait for the last transfer finishing in the background and get its result */
+extern int MMC_WaitTransfer(void);
+
 /* detect MMC/SD card */
 extern int MMC_DetectStatus(void);
 
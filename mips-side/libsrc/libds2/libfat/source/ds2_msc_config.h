@@ -32,7 +32,7 @@ Known problems or limitations with current version
 
 #define MMC_UCOSII_EN		0		/* Enable UCOS */
 
-#define MMC_DMA_ENABLE		0       /*Enable DMA*/
+#define MMC_DMA_ENABLE		1       /*Enable DMA*/
 
 #define MMC_BLOCKSIZE 		512		/* MMC/SD Block Size */
 
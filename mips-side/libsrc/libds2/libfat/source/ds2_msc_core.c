@@ -448,5 +448,27 @@ void mmc_send_cmd(struct mmc_request *request, int cmd, unsigned int arg,
 	request->buffer = buffer;
 	request->cnt = nob * block_len;
 //printf("mmc_send_cmd: command = %d \r\n",cmd);
-	_mmc_exec_cmd(request);
+	int retval = _mmc_exec_cmd(request);
+	if (retval != MMC_NO_ERROR)
+		request->result = retval;
 }
+
+#if MMC_DMA_ENABLE
+void mmc_start_cmd(struct mmc_request *request, int cmd, unsigned int arg,
+		  unsigned short nob, unsigned short block_len, enum mmc_rsp_t rtype,
+		  unsigned char * buffer)
+{
+	int retval;
+
+	request->cmd = cmd;
+	request->arg = arg;
+	request->rtype = rtype;
+	request->nob = nob;
+	request->block_len = block_len;
+	request->buffer = buffer;
+	request->cnt = nob * block_len;
+	retval = _mmc_start_cmd(request);
+	if (retval != MMC_NO_ERROR)
+		request->result = retval;
+}
+#endif
@@ -76,6 +76,8 @@ int    mmc_unpack_r3( struct mmc_request *request, struct mmc_response_r3 *r3 );
 
 void   mmc_send_cmd( struct mmc_request *request, int cmd, unsigned int arg, 
 		     unsigned short nob, unsigned short block_len, enum mmc_rsp_t rtype, unsigned char *buffer);
+void   mmc_start_cmd( struct mmc_request *request, int cmd, unsigned int arg, 
+		     unsigned short nob, unsigned short block_len, enum mmc_rsp_t rtype, unsigned char *buffer);
 unsigned int    mmc_tran_speed( unsigned char ts );
 void   _mmc_set_clock(int sd, unsigned int rate);
 int   _mmc_hardware_init(void);
@@ -94,4 +96,20 @@ int mmc_select_card(void);
 
 int _mmc_exec_cmd(struct mmc_request *request);
 
+/* Like _mmc_exec_cmd, but returns once the command is sent if the data can
+ * move by DMA. The data, and STOP_TRANSMISSION after multiple blocks, then
+ * finish from interrupts. */
+int _mmc_start_cmd(struct mmc_request *request);
+
+/* Returns whether data at 'buffer' can move by DMA. */
+int _mmc_dma_capable(const void *buffer, unsigned int size);
+
+/* Returns MMC_TRANSFER_PENDING while data is moving by DMA, then the result
+ * of the transfer. */
+int _mmc_transfer_status(void);
+
+/* Waits for data moving by DMA, if any, and returns the result of the
+ * transfer. */
+int _mmc_wait_transfer(void);
+
 #endif  /* __MMC_CORE__ */
@@ -49,18 +49,15 @@
 
 #if MMC_UCOSII_EN
 #include "ucos_ii.h"
-static OS_EVENT *mmc_dma_rtx_sem;
 static OS_EVENT *mmc_msc_irq_sem;
 #endif
 
 #if MMC_DMA_ENABLE
-#define MMC_DMA_CHANNEL 0
-#define MMC_LOW_LEVEL_DMA  0
-
-#if !MMC_LOW_LEVEL_DMA
+#include <ds2/pm.h>
 #include "dma.h"
-#include "cache.h"
-#endif
+#include "intc.h"
+
+#define MMC_CACHE_LINE_SIZE 32  /* Data cache line size of the JZ4740 */
 #endif
 
 #define PHYSADDR(x) ((x) & 0x1fffffff)
@@ -262,124 +259,6 @@ static void _mmc_get_response(struct mmc_request *request)
 }
 
 
-#if (MMC_DMA_ENABLE && MMC_UCOSII_EN)
-void _mmc_rtx_handler(unsigned int arg)
-{
-	if (__dmac_channel_address_error_detected(arg)) {
-		MMC_DBG("%s: DMAC address error.\n", __FUNCTION__);
-		__dmac_channel_clear_address_error(arg);
-	}
-	if (__dmac_channel_transmit_end_detected(arg)) {
-        dma_stop(arg);
-		OSSemPost(mmc_dma_rtx_sem);
-	}
-}
-#endif
-
-
-#if MMC_DMA_ENABLE
-static int _mmc_receive_data_dma(struct mmc_request *req)
-{
-	int ch;
-	unsigned int size = req->block_len * req->nob;
-
-#if MMC_LOW_LEVEL_DMA
-    REG_DMAC_DCKE = DMAC_DCKE_CH0_ON;
-	/* flush dcache */
-	dcache_writeback_range(req->buffer, size);
-	/* setup dma channel */
-	REG_DMAC_DSAR(ch) = PHYSADDR(MSC_RXFIFO);	/* DMA source addr */
-	REG_DMAC_DTAR(ch) = PHYSADDR((unsigned long) req->buffer);	/* DMA dest addr */
-	REG_DMAC_DTCR(ch) = (size + 3) / 4;	/* DMA transfer count */
-	REG_DMAC_DRSR(ch) = DMAC_DRSR_RS_MSCIN;	/* DMA request type */
-	REG_DMAC_DCMD(ch) = DMAC_DCMD_DAI | DMAC_DCMD_SWDH_32 | DMAC_DCMD_DWDH_32 |
-	    DMAC_DCMD_DS_32BIT;
-	REG_DMAC_DCCSR(ch) = DMAC_DCCSR_EN | DMAC_DCCSR_NDES;
-
-    while (!__dmac_channel_transmit_end_detected(ch));
-    /* clear status and disable channel */
-	REG_DMAC_DCCSR(ch) = 0;
-
-    return 0;
-
-#else
-    dcache_writeback_range(req->buffer, size);
-#if MMC_UCOSII_EN
-    dma_request(ch, _mmc_rtx_handler, ch,
-        DMAC_DCMD_DAI | DMAC_DCMD_SWDH_32 | DMAC_DCMD_DWDH_32 | DMAC_DCMD_DS_32BIT,
-        DMAC_DRSR_RS_MSCIN);
-    dma_start(ch, MSC_RXFIFO, (unsigned int)req->buffer, size);
-
-    unsigned char err = 0;
-
-    OSSemPend(mmc_dma_rtx_sem, 0, &err);
-    if(!err)    return MMC_NO_ERROR;
-    else        return MMC_NO_RESPONSE;
-#else
-    ch = dma_request(NULL, 0, DMAC_DRSR_RS_MSCIN,
-        DMAC_DCMD_DAI | DMAC_DCMD_SWDH_32 | DMAC_DCMD_DWDH_32 | DMAC_DCMD_DS_32BIT);
-
-    dma_start(ch, (void*) MSC_RXFIFO, req->buffer, size);
-    dma_join(ch);
-    dma_free(ch);
-
-    return MMC_NO_ERROR;
-#endif    
-#endif
-}
-
-static int _mmc_transmit_data_dma(struct mmc_request *req)
-{
-	int ch;
-	unsigned int size = req->block_len * req->nob;
-	
-#if MMC_LOW_LEVEL_DMA
-    REG_DMAC_DCKE = DMAC_DCKE_CH0_ON;
-	/* flush dcache */
-	dcache_writeback_range(req->buffer, size);
-	/* setup dma channel */
-	REG_DMAC_DSAR(ch) = PHYSADDR((unsigned long) req->buffer);	/* DMA source addr */
-	REG_DMAC_DTAR(ch) = PHYSADDR(MSC_TXFIFO);	/* DMA dest addr */
-	REG_DMAC_DTCR(ch) = (size + 3) / 4;	/* DMA transfer count */
-	REG_DMAC_DRSR(ch) = DMAC_DRSR_RS_MSCOUT;	/* DMA request type */
-
-	REG_DMAC_DCMD(ch) = DMAC_DCMD_SAI | DMAC_DCMD_SWDH_32 | DMAC_DCMD_DWDH_32 |
-	    DMAC_DCMD_DS_32BIT;
-	REG_DMAC_DCCSR(ch) = DMAC_DCCSR_EN | DMAC_DCCSR_NDES;
-	/* wait for dma completion */
-
-	while (!__dmac_channel_transmit_end_detected(ch));
-	/* clear status and disable channel */
-	REG_DMAC_DCCSR(ch) = 0;
-
-    return 0;
-#else
-    dcache_writeback_range(req->buffer, size);
- #if MMC_UCOSII_EN
-    dma_request(ch, _mmc_rtx_handler, ch,
-        DMAC_DCMD_SAI | DMAC_DCMD_SWDH_32 | DMAC_DCMD_DWDH_32 | DMAC_DCMD_DS_32BIT,
-        DMAC_DRSR_RS_MSCOUT);
-    dma_start(ch, (unsigned int)req->buffer, MSC_TXFIFO, size);
-
-    unsigned char err = 0;
-
-    OSSemPend(mmc_dma_rtx_sem, 0, &err);
-    if(!err)    return MMC_NO_ERROR;
-    else        return MMC_NO_RESPONSE;
- #else
-    ch = dma_request(NULL, 0, DMAC_DRSR_RS_MSCOUT,
-        DMAC_DCMD_SAI | DMAC_DCMD_SWDH_32 | DMAC_DCMD_DWDH_32 | DMAC_DCMD_DS_32BIT);
-
-    dma_start(ch, req->buffer, (void*) MSC_TXFIFO, size);
-    dma_join(ch);
-    dma_free(ch);
-
-    return MMC_NO_ERROR;
- #endif    
-#endif
-}
-#endif/* MMC_DMA_ENABLE */
-
 static int _mmc_receive_data(struct mmc_request *req)
 {
 	unsigned int nob = req->nob;
@@ -487,16 +366,196 @@ static int _mmc_transmit_data(struct mmc_request *req)
 	return MMC_NO_ERROR;
 }
 
+#if MMC_DMA_ENABLE
+/* Data moved by DMA finishes from interrupts, through these steps. */
+enum mmc_transfer_step {
+	MMC_STEP_IDLE,       /* No transfer is in flight */
+	MMC_STEP_DATA,       /* DMA is moving the data */
+	MMC_STEP_DATA_DONE,  /* Waiting for the controller to finish the data */
+	MMC_STEP_STOP,       /* Waiting for the response to STOP_TRANSMISSION */
+	MMC_STEP_PROG_DONE,  /* Waiting for the card to finish programming */
+};
+
+static volatile enum mmc_transfer_step mmc_step;
+static volatile int mmc_transfer_result;
+static int mmc_dma_channel = -1;
+static int mmc_transfer_write;  /* The transfer writes to the card */
+static int mmc_transfer_stop;   /* STOP_TRANSMISSION follows the data */
+static struct mmc_request mmc_stop_request;
+
+static void _mmc_transfer_end(int result)
+{
+	__intc_mask_irq(IRQ_MSC);
+	REG_MSC_IMASK = 0xffff;
+	if (mmc_transfer_result == MMC_NO_ERROR)
+		mmc_transfer_result = result;
+	mmc_step = MMC_STEP_IDLE;
+}
+
+/* Waits for one event of the controller by interrupt */
+static void _mmc_transfer_await(enum mmc_transfer_step step, unsigned int imask)
+{
+	mmc_step = step;
+	REG_MSC_IMASK = 0xffff & ~imask;
+	__intc_unmask_irq(IRQ_MSC);
+}
+
+/* Sends STOP_TRANSMISSION, without waiting for its response */
+static void _mmc_transfer_send_stop(void)
+{
+	mmc_stop_request.cmd = MMC_STOP_TRANSMISSION;
+	mmc_stop_request.arg = 0;
+	mmc_stop_request.rtype = RESPONSE_R1B;
+	mmc_stop_request.result = MMC_NO_RESPONSE;
+
+	REG_MSC_IREG = 0xffff;
+	REG_MSC_CMD = MMC_STOP_TRANSMISSION;
+	REG_MSC_ARG = 0;
+	REG_MSC_CMDAT = MSC_CMDAT_BUSY | MSC_CMDAT_RESPONSE_R1
+		| (use_4bit ? MSC_CMDAT_BUS_WIDTH_4BIT : 0);
+	_mmc_start_op();
+	_mmc_transfer_await(MMC_STEP_STOP, MSC_IMASK_END_CMD_RES);
+}
+
+void _mmc_irq_handler(unsigned int arg)
+{
+	unsigned int ireg = REG_MSC_IREG;
+	struct mmc_response_r1 r1;
+	int retval;
+
+	switch (mmc_step) {
+	case MMC_STEP_DATA_DONE:
+		if (!(ireg & MSC_IREG_DATA_TRAN_DONE))
+			return;
+		REG_MSC_IREG = MSC_IREG_DATA_TRAN_DONE;
+		if (mmc_transfer_stop)
+			_mmc_transfer_send_stop();
+		else if (mmc_transfer_write)
+			_mmc_transfer_await(MMC_STEP_PROG_DONE, MSC_IMASK_PRG_DONE);
+		else
+			_mmc_transfer_end(MMC_NO_ERROR);
+		break;
+
+	case MMC_STEP_STOP:
+		if (!(ireg & MSC_IREG_END_CMD_RES))
+			return;
+		REG_MSC_IREG = MSC_IREG_END_CMD_RES;
+		retval = _mmc_check_status(&mmc_stop_request);
+		if (retval == MMC_NO_ERROR) {
+			_mmc_get_response(&mmc_stop_request);
+			retval = mmc_unpack_r1(&mmc_stop_request, &r1, 0);
+		}
+		if (retval != MMC_NO_ERROR)
+			_mmc_transfer_end(retval);
+		else
+			_mmc_transfer_await(MMC_STEP_PROG_DONE, MSC_IMASK_PRG_DONE);
+		break;
+
+	case MMC_STEP_PROG_DONE:
+		if (!(ireg & MSC_IREG_PRG_DONE))
+			return;
+		REG_MSC_IREG = MSC_IREG_PRG_DONE;
+		_mmc_transfer_end(MMC_NO_ERROR);
+		break;
+
+	default:
+		/* Not ours to handle */
+		__intc_mask_irq(IRQ_MSC);
+		break;
+	}
+}
+
+static void _mmc_dma_handler(unsigned int arg)
+{
+	if (__dmac_channel_address_error_detected(mmc_dma_channel))
+		mmc_transfer_result = MMC_ERROR_DRIVER_FAILURE;
+
+	dma_free(mmc_dma_channel);
+	mmc_dma_channel = -1;
+
+	/* The controller may still be shifting the last words of the data. */
+	_mmc_transfer_await(MMC_STEP_DATA_DONE, MSC_IMASK_DATA_TRAN_DONE);
+}
+
+int _mmc_dma_capable(const void *buffer, unsigned int size)
+{
+	/* Buffers must own their cache lines, because the ones for data being
+	 * read are invalidated. */
+	return ((unsigned int) buffer & (MMC_CACHE_LINE_SIZE - 1)) == 0
+	    && (size & (MMC_CACHE_LINE_SIZE - 1)) == 0;
+}
+
+/* Starts moving the data of a command by DMA */
+static void _mmc_transfer_start(struct mmc_request *req, int write, int stop)
+{
+	unsigned int size = req->block_len * req->nob;
+
+	mmc_transfer_write = write;
+	mmc_transfer_stop = stop;
+	mmc_transfer_result = MMC_NO_ERROR;
+	mmc_step = MMC_STEP_DATA;
+
+	if (write) {
+		dcache_writeback_range(req->buffer, size);
+		mmc_dma_channel = dma_request(_mmc_dma_handler, 0, DMAC_DRSR_RS_MSCOUT,
+			DMAC_DCMD_SAI | DMAC_DCMD_SWDH_32 | DMAC_DCMD_DWDH_32 | DMAC_DCMD_DS_32BIT);
+	} else {
+		/* Nothing must be written back over the data after it's read. */
+		dcache_writeback_invalidate_range(req->buffer, size);
+		mmc_dma_channel = dma_request(_mmc_dma_handler, 0, DMAC_DRSR_RS_MSCIN,
+			DMAC_DCMD_DAI | DMAC_DCMD_SWDH_32 | DMAC_DCMD_DWDH_32 | DMAC_DCMD_DS_32BIT);
+	}
+
+	if (mmc_dma_channel < 0) {
+		/* No channel is free. Move the data by the CPU instead. */
+		int retval = write ? _mmc_transmit_data(req) : _mmc_receive_data(req);
+		if (retval != MMC_NO_ERROR)
+			mmc_transfer_result = retval;
+		_mmc_transfer_await(MMC_STEP_DATA_DONE, MSC_IMASK_DATA_TRAN_DONE);
+		return;
+	}
+
+	if (write)
+		dma_start(mmc_dma_channel, req->buffer, (void*) MSC_TXFIFO, size);
+	else
+		dma_start(mmc_dma_channel, (void*) MSC_RXFIFO, req->buffer, size);
+}
+
+int _mmc_transfer_status(void)
+{
+	return mmc_step != MMC_STEP_IDLE ? MMC_TRANSFER_PENDING : mmc_transfer_result;
+}
+
+int _mmc_wait_transfer(void)
+{
+	/* This is the only place where the card driver waits, and it can be in
+	 * the middle of a command, or of a libfat call that holds sectors and
+	 * file positions. The audio callback must not enter libfat from here. */
+	_block_deferred_calls();
+	DS2_StartAwait();
+	while (mmc_step != MMC_STEP_IDLE)
+		DS2_AwaitInterrupt();
+	DS2_StopAwait();
+	_unblock_deferred_calls();
+	return mmc_transfer_result;
+}
+#endif/* MMC_DMA_ENABLE */
+
 /********************************************************************************************************************
 ** Name:	  int _mmc_exec_cmd()
 ** Function:      send command to the card, and get a response
 ** Input:	  struct mmc_request *req	: MMC/SD request
 ** Output:	  0:  right		>0:  error code
 ********************************************************************************************************************/
-int _mmc_exec_cmd(struct mmc_request *request)
+static int _mmc_exec(struct mmc_request *request, int async)
 {
 	unsigned int cmdat = 0, events = 0;
 	int retval, timeout = 0x3fffff;
+#if MMC_DMA_ENABLE
+	/* The SCR is read into the response, which is too small for DMA */
+	int dma = request->cmd != SEND_SCR
+	       && _mmc_dma_capable(request->buffer, request->block_len * request->nob);
+#endif
 
     MMC_DBG("MMC: cmd %d\n", request->cmd);
 
@@ -572,7 +631,7 @@ int _mmc_exec_cmd(struct mmc_request *request)
 	case MMC_READ_MULTIPLE_BLOCK:
 	case SEND_SCR:
 #if MMC_DMA_ENABLE
-		cmdat |= MSC_CMDAT_DATA_EN | MSC_CMDAT_READ | MSC_CMDAT_DMA_EN;
+		cmdat |= MSC_CMDAT_DATA_EN | MSC_CMDAT_READ | (dma ? MSC_CMDAT_DMA_EN : 0);
 #else
 		cmdat |= MSC_CMDAT_DATA_EN | MSC_CMDAT_READ;
 #endif
@@ -582,7 +641,7 @@ int _mmc_exec_cmd(struct mmc_request *request)
 	case 6:
 		if (num_6 < 2) {
 #if MMC_DMA_ENABLE
-			cmdat |= MSC_CMDAT_DATA_EN | MSC_CMDAT_READ | MSC_CMDAT_DMA_EN;
+			cmdat |= MSC_CMDAT_DATA_EN | MSC_CMDAT_READ | (dma ? MSC_CMDAT_DMA_EN : 0);
 #else
 			cmdat |= MSC_CMDAT_DATA_EN | MSC_CMDAT_READ;
 #endif
@@ -599,7 +658,7 @@ int _mmc_exec_cmd(struct mmc_request *request)
 	case MMC_GEN_CMD:
 	case MMC_LOCK_UNLOCK:
 #if MMC_DMA_ENABLE
-		cmdat |= MSC_CMDAT_DATA_EN | MSC_CMDAT_WRITE | MSC_CMDAT_DMA_EN;
+		cmdat |= MSC_CMDAT_DATA_EN | MSC_CMDAT_WRITE | (dma ? MSC_CMDAT_DMA_EN : 0);
 #else
 		cmdat |= MSC_CMDAT_DATA_EN | MSC_CMDAT_WRITE;
 #endif
@@ -714,26 +773,30 @@ int _mmc_exec_cmd(struct mmc_request *request)
 				    (unsigned char *) ((unsigned int) request->response + 5);
 			}
 #if MMC_DMA_ENABLE
-            if((unsigned int) request -> buffer & 0x3)
-                _mmc_receive_data(request);
-            else
-    			_mmc_receive_data_dma(request);
-#else
-			_mmc_receive_data(request);
+			if (!dma)
 #endif
+			_mmc_receive_data(request);
 		}
 
 		if (events & MMC_EVENT_TX_DATA_DONE) {
 #if MMC_DMA_ENABLE
-            if((unsigned int) request -> buffer & 0x3)
-    			_mmc_transmit_data(request);
-            else
-    			_mmc_transmit_data_dma(request);
-#else
-			_mmc_transmit_data(request);
+			if (!dma)
 #endif
+			_mmc_transmit_data(request);
 		}
 
+#if MMC_DMA_ENABLE
+		if (dma) {
+			/* The data, and STOP_TRANSMISSION after the data of an
+			 * asynchronous multiple block command, finish from
+			 * interrupts. */
+			_mmc_transfer_start(request, events & MMC_EVENT_TX_DATA_DONE,
+				async && (request->cmd == MMC_READ_MULTIPLE_BLOCK
+				       || request->cmd == MMC_WRITE_MULTIPLE_BLOCK));
+			return async ? MMC_NO_ERROR : _mmc_wait_transfer();
+		}
+#endif
+
 #if MMC_UCOSII_EN
 		__intc_unmask_irq(IRQ_MSC);
 		OSSemPend(mmc_msc_irq_sem, 100, &err);
@@ -760,6 +823,18 @@ int _mmc_exec_cmd(struct mmc_request *request)
 	return MMC_NO_ERROR;	/* return successfully */
 }
 
+int _mmc_exec_cmd(struct mmc_request *request)
+{
+	return _mmc_exec(request, 0);
+}
+
+#if MMC_DMA_ENABLE
+int _mmc_start_cmd(struct mmc_request *request)
+{
+	return _mmc_exec(request, 1);
+}
+#endif
+
 /*******************************************************************************************************************
 ** Name:	  int mmc_chkcardwp()
 ** Function:      check weather card is write protect
@@ -824,6 +899,7 @@ void _mmc_set_clock(int sd, unsigned int rate)
 //	printf("MMC: clock= %u Hz is_sd=%d\n", rate, sd);
 }
 
+#if !MMC_DMA_ENABLE
 void _mmc_irq_handler(unsigned int arg)
 {
 	__intc_mask_irq(IRQ_MSC);
@@ -831,6 +907,7 @@ void _mmc_irq_handler(unsigned int arg)
 	OSSemPost(mmc_msc_irq_sem);
 #endif
 }
+#endif
 
 
 /*******************************************************************************************************************
@@ -866,17 +943,9 @@ int _mmc_hardware_init(void)
 #endif
 
 #if MMC_DMA_ENABLE
-#if MMC_LOW_LEVEL_DMA
-    __cpm_start_dmac();
-    __dmac_enable_module();
-#elif MMC_UCOSII_EN
-	mmc_dma_rtx_sem = OSSemCreate(0);
-    if(mmc_dma_rtx_sem == NULL)
-    {
-        MMC_DBG("MMC: mmc_dma_rtx_sem error\n");
-        return MMC_NO_RESPONSE;
-    }
-#endif
+	/* The controller interrupts only while a transfer awaits it */
+	irq_request(IRQ_MSC, _mmc_irq_handler, 0);
+	__intc_mask_irq(IRQ_MSC);
 #endif
 
     return MMC_NO_ERROR;
@@ -39,11 +39,13 @@
 #include <unistd.h>
 
 #include "fatfile.h"
+#include "fat.h"
 #include "cache.h"
 #include "file_allocation_table.h"
 #include "bit_ops.h"
 #include "filetime.h"
 #include "lock.h"
+#include "mem_allocate.h"
 
 bool _FAT_findEntry(const char *path, DIR_ENTRY *dirEntry) {
 	// Check Partition
@@ -283,6 +285,17 @@ int _FAT_open (void* restrict fileStruct, const char* restrict path, int flags,
 	file->rwPosition.sector =  0;
 	file->rwPosition.byte = 0;
 
+	// A read from the start of the file is sequential
+	file->readAheadPosition = 0;
+	file->readAheadSectors = 0;
+	file->readAheadEnd = 0;
+
+	// The extent map is built on the first seek that needs it
+	file->extents = NULL;
+	file->extentCount = 0;
+	file->extentCapacity = 0;
+	file->extentHint = 0;
+
 	if (flags & O_APPEND) {
 		file->append = true;
 
@@ -375,6 +388,229 @@ int _FAT_syncToDisc (FILE_STRUCT* file) {
 }
 
 
+/*
+The extent map of a file lists its clusters as runs of consecutive clusters,
+in file order, so that finding the cluster at any offset in the file takes a
+search through a few runs instead of a walk down the FAT. The map is built
+the first time it is needed, and from then on the functions below keep it in
+step with the cluster chain as the file grows and shrinks. Files that have no
+map, because it was never needed or because there was no memory for it, use
+the FAT directly.
+*/
+static void _FAT_file_freeExtents (FILE_STRUCT* file) {
+	_FAT_mem_free (file->extents);
+	file->extents = NULL;
+	file->extentCount = 0;
+	file->extentCapacity = 0;
+	file->extentHint = 0;
+}
+
+/*
+Adds a cluster to the end of the extent map of a file.
+Returns false if there is no memory to grow the map.
+*/
+static bool _FAT_file_addExtentCluster (FILE_STRUCT* file, uint32_t cluster) {
+	FILE_EXTENT* extent;
+	uint32_t index = 0;
+
+	if (file->extentCount > 0) {
+		extent = &file->extents[file->extentCount - 1];
+		if (extent->firstCluster + extent->length == cluster) {
+			extent->length++;
+			return true;
+		}
+		index = extent->index + extent->length;
+	}
+
+	if (file->extentCount == file->extentCapacity) {
+		uint32_t capacity = file->extentCapacity ? file->extentCapacity * 2 : 4;
+		FILE_EXTENT* extents = (FILE_EXTENT*) _FAT_mem_reallocate (file->extents, capacity * sizeof(FILE_EXTENT));
+		if (extents == NULL) {
+			return false;
+		}
+		file->extents = extents;
+		file->extentCapacity = capacity;
+	}
+
+	extent = &file->extents[file->extentCount++];
+	extent->firstCluster = cluster;
+	extent->index = index;
+	extent->length = 1;
+	return true;
+}
+
+/*
+Builds the extent map of a file by walking its cluster chain once.
+Returns false if there is no memory for the map.
+*/
+static bool _FAT_file_mapExtents (FILE_STRUCT* file) {
+	PARTITION* partition = file->partition;
+	uint32_t cluster = file->startCluster;
+
+	while (_FAT_fat_isValidCluster (partition, cluster)) {
+		if (!_FAT_file_addExtentCluster (file, cluster)) {
+			_FAT_file_freeExtents (file);
+			return false;
+		}
+		cluster = _FAT_fat_nextCluster (partition, cluster);
+	}
+	// An empty map still needs an allocation to tell it apart from no map
+	if (file->extents == NULL) {
+		file->extents = (FILE_EXTENT*) _FAT_mem_allocate (4 * sizeof(FILE_EXTENT));
+		if (file->extents == NULL) {
+			return false;
+		}
+		file->extentCapacity = 4;
+	}
+	file->extentHint = 0;
+	return true;
+}
+
+/*
+Returns the cluster at a position in a file, counted in clusters, or
+CLUSTER_EOF if the file's cluster chain is shorter than that.
+*/
+static uint32_t _FAT_file_clusterAt (FILE_STRUCT* file, uint32_t index) {
+	FILE_EXTENT* extent;
+	uint32_t low, high;
+
+	if (file->extents == NULL && !_FAT_file_mapExtents (file)) {
+		// No memory for the map, so walk the chain
+		PARTITION* partition = file->partition;
+		uint32_t cluster = file->startCluster;
+		while (index > 0 && _FAT_fat_isValidCluster (partition, cluster)) {
+			cluster = _FAT_fat_nextCluster (partition, cluster);
+			index--;
+		}
+		return _FAT_fat_isValidCluster (partition, cluster) ? cluster : CLUSTER_EOF;
+	}
+
+	if (file->extentCount == 0) {
+		return CLUSTER_EOF;
+	}
+
+	// Seeks tend to land near the last one
+	extent = &file->extents[file->extentHint];
+	if (index < extent->index || index >= extent->index + extent->length) {
+		// Find the last extent starting at or before the index
+		low = 0;
+		high = file->extentCount - 1;
+		while (low < high) {
+			uint32_t middle = (low + high + 1) / 2;
+			if (file->extents[middle].index <= index) {
+				low = middle;
+			} else {
+				high = middle - 1;
+			}
+		}
+		extent = &file->extents[low];
+		if (index >= extent->index + extent->length) {
+			return CLUSTER_EOF;
+		}
+		file->extentHint = low;
+	}
+
+	return extent->firstCluster + (index - extent->index);
+}
+
+/*
+Returns the cluster after a cluster of a file, like _FAT_fat_nextCluster,
+but from the extent map when it covers that cluster.
+*/
+static uint32_t _FAT_file_nextCluster (FILE_STRUCT* file, uint32_t cluster) {
+	FILE_EXTENT* extent;
+	uint32_t i;
+
+	if (file->extents != NULL) {
+		// Sequential access stays in the last extent used or moves to the next
+		for (i = file->extentHint; i < file->extentCount && i <= file->extentHint + 1; i++) {
+			extent = &file->extents[i];
+			if (cluster >= extent->firstCluster && cluster < extent->firstCluster + extent->length) {
+				file->extentHint = i;
+				if (cluster + 1 < extent->firstCluster + extent->length) {
+					return cluster + 1;
+				}
+				if (i + 1 < file->extentCount) {
+					return file->extents[i + 1].firstCluster;
+				}
+				break;
+			}
+		}
+	}
+
+	return _FAT_fat_nextCluster (file->partition, cluster);
+}
+
+/*
+Links a free cluster after a cluster of a file, like _FAT_fat_linkFreeCluster,
+and adds it to the extent map if it is new at the end of the file.
+*/
+static uint32_t _FAT_file_linkFreeCluster (FILE_STRUCT* file, uint32_t cluster) {
+	uint32_t newCluster = _FAT_fat_linkFreeCluster (file->partition, cluster);
+	FILE_EXTENT* extent;
+	bool atEnd;
+
+	if (file->extents != NULL && _FAT_fat_isValidCluster (file->partition, newCluster)) {
+		if (file->extentCount == 0) {
+			atEnd = (cluster == CLUSTER_FREE);
+		} else {
+			extent = &file->extents[file->extentCount - 1];
+			atEnd = (cluster == extent->firstCluster + extent->length - 1);
+		}
+		if (atEnd && !_FAT_file_addExtentCluster (file, newCluster)) {
+			_FAT_file_freeExtents (file);
+		}
+	}
+
+	return newCluster;
+}
+
+/*
+Returns the last cluster of a file, like _FAT_fat_lastCluster.
+*/
+static uint32_t _FAT_file_lastCluster (FILE_STRUCT* file) {
+	FILE_EXTENT* extent;
+
+	if (file->extents != NULL && file->extentCount > 0) {
+		extent = &file->extents[file->extentCount - 1];
+		return extent->firstCluster + extent->length - 1;
+	}
+
+	return _FAT_fat_lastCluster (file->partition, file->startCluster);
+}
+
+/*
+Drops the clusters past the first numClusters clusters of a file from its
+extent map, after the cluster chain has been trimmed to that length.
+*/
+static void _FAT_file_trimExtents (FILE_STRUCT* file, uint32_t numClusters) {
+	FILE_EXTENT* extent;
+
+	if (file->extents == NULL) {
+		return;
+	}
+
+	while (file->extentCount > 0) {
+		extent = &file->extents[file->extentCount - 1];
+		if (extent->index < numClusters) {
+			if (extent->index + extent->length > numClusters) {
+				extent->length = numClusters - extent->index;
+			}
+			break;
+		}
+		file->extentCount--;
+	}
+
+	if (file->extentHint >= file->extentCount) {
+		file->extentHint = file->extentCount ? file->extentCount - 1 : 0;
+	}
+}
+
+/*
+The file whose data is moving in the background, if any
+*/
+static FILE_STRUCT* _FAT_transferFile;
+
 int _FAT_close (int fd) {
 	FILE_STRUCT* file = (FILE_STRUCT*)  fd;
 	int ret = 0;
@@ -394,8 +630,15 @@ int _FAT_close (int fd) {
 		}
 	}
 
+	// Don't leave data moving into or out of a closed file
+	if (_FAT_transferFile == file && fatWaitTransfer () != 0) {
+		ret = -1;
+	}
+
 	file->inUse = false;
 
+	_FAT_file_freeExtents (file);
+
 	// Remove this file from the double-linked list of open files
 	file->partition->openFileCount -= 1;
 	if (file->nextOpenFile) {
@@ -412,6 +655,58 @@ int _FAT_close (int fd) {
 	return ret;
 }
 
+/*
+Starts reading sectors ahead of a position in a file into the cache, stopping
+at the end of the file or where its clusters stop being contiguous, so that
+they come from the disc in one transfer while the application works on what
+it has read, and the next sequential read finds them in the cache. Returns
+the number of sectors covered, starting at the position.
+*/
+static uint32_t _FAT_read_ahead (FILE_STRUCT* file, FILE_POSITION position, uint32_t numSectors) {
+	PARTITION* partition = file->partition;
+	uint32_t fileSectors, startSector, available, cluster, nextCluster;
+
+	// Don't read past the end of the file
+	fileSectors = (file->filesize - file->currentPosition + position.byte
+		+ partition->bytesPerSector - 1) / partition->bytesPerSector;
+	if (numSectors > fileSectors) {
+		numSectors = fileSectors;
+	}
+	// A transfer started by fatStartRead or fatStartWrite reports to its
+	// caller; don't start another one over it
+	if (numSectors == 0 || _FAT_transferFile != NULL) {
+		return 0;
+	}
+
+	cluster = position.cluster;
+	if (position.sector >= partition->sectorsPerCluster) {
+		cluster = _FAT_file_nextCluster (file, cluster);
+		if (!_FAT_fat_isValidCluster (partition, cluster)) {
+			return 0;
+		}
+		position.sector = 0;
+	}
+
+	startSector = _FAT_fat_clusterToSector (partition, cluster) + position.sector;
+	available = partition->sectorsPerCluster - position.sector;
+
+	while (available < numSectors) {
+		nextCluster = _FAT_file_nextCluster (file, cluster);
+		if (nextCluster != cluster + 1) {
+			break;
+		}
+		cluster = nextCluster;
+		available += partition->sectorsPerCluster;
+	}
+	if (numSectors > available) {
+		numSectors = available;
+	}
+
+	// A failed read ahead is not an error; the read itself will report it
+	_FAT_cache_startPrefetch (partition->cache, startSector, numSectors);
+	return numSectors;
+}
+
 ssize_t _FAT_read (int fd, char *ptr, size_t len) {
 	FILE_STRUCT* file = (FILE_STRUCT*)  fd;
 	PARTITION* partition;
@@ -421,6 +716,7 @@ ssize_t _FAT_read (int fd, char *ptr, size_t len) {
 	unsigned int tempVar;
 	size_t remain;
 	bool flagNoError = true;
+	bool direct = false;
 
 	// Short circuit cases where len is 0 (or less)
 	if (len <= 0) {
@@ -504,7 +800,7 @@ ssize_t _FAT_read (int fd, char *ptr, size_t len) {
 	// Move onto next cluster
 	// It should get to here without reading anything if a cluster is due to be allocated
 	if ((position.sector >= partition->sectorsPerCluster) && flagNoError) {
-		tempNextCluster = _FAT_fat_nextCluster(partition, position.cluster);
+		tempNextCluster = _FAT_file_nextCluster(file, position.cluster);
 		if ((remain == 0) && (tempNextCluster == CLUSTER_EOF)) {
 			position.sector = partition->sectorsPerCluster;
 		} else if (!_FAT_fat_isValidCluster(partition, tempNextCluster)) {
@@ -524,7 +820,7 @@ ssize_t _FAT_read (int fd, char *ptr, size_t len) {
 
 		do {
 			chunkEnd = nextChunkStart;
-			nextChunkStart = _FAT_fat_nextCluster (partition, chunkEnd);
+			nextChunkStart = _FAT_file_nextCluster (file, chunkEnd);
 			chunkSize += partition->bytesPerCluster;
 		} while ((nextChunkStart == chunkEnd + 1) &&
 #ifdef LIMIT_SECTORS
@@ -532,7 +828,9 @@ ssize_t _FAT_read (int fd, char *ptr, size_t len) {
 #endif
 			(chunkSize + partition->bytesPerCluster <= remain));
 
-		if (!_FAT_cache_readSectors (cache, _FAT_fat_clusterToSector (partition, position.cluster),
+		// Whole clusters go straight to the caller's buffer, not through the cache
+		direct = true;
+		if (!_FAT_cache_readSectorsDirect (cache, _FAT_fat_clusterToSector (partition, position.cluster),
 				chunkSize / partition->bytesPerSector, ptr))
 		{
 			flagNoError = false;
@@ -582,9 +880,37 @@ ssize_t _FAT_read (int fd, char *ptr, size_t len) {
 	// Length read is the wanted length minus the stuff not read
 	len = len - remain;
 
+	// Grow the read ahead window while reads are sequential, up to what the
+	// cache can read at once, and stop reading ahead after a seek. Reads of
+	// whole clusters bypass the cache, so reading ahead into it would only
+	// add a copy
+	if (direct) {
+		file->readAheadSectors = 0;
+	} else if (file->currentPosition == file->readAheadPosition) {
+		if (file->readAheadSectors == 0) {
+			file->readAheadSectors = cache->sectorsPerPage;
+		} else if (file->readAheadSectors < cache->readAheadSectors) {
+			file->readAheadSectors *= 2;
+		}
+		if (file->readAheadSectors > cache->readAheadSectors) {
+			file->readAheadSectors = cache->readAheadSectors;
+		}
+	} else {
+		file->readAheadSectors = 0;
+	}
+
 	// Update file information
 	file->rwPosition = position;
 	file->currentPosition += len;
+	file->readAheadPosition = file->currentPosition;
+
+	// Refill once half of the window has been read, so that the missing part
+	// is still read in one large transfer
+	if (flagNoError && file->readAheadSectors > 0
+	 && file->currentPosition + file->readAheadSectors / 2 * partition->bytesPerSector >= file->readAheadEnd) {
+		file->readAheadEnd = file->currentPosition - position.byte
+			+ _FAT_read_ahead (file, position, file->readAheadSectors) * partition->bytesPerSector;
+	}
 
 	_FAT_unlock(&partition->lock);
 	return len;
@@ -595,8 +921,9 @@ ssize_t _FAT_read (int fd, char *ptr, size_t len) {
 // this solves the over-allocation problems when file size is aligned to cluster size
 // return true on succes, false on error
 static bool _FAT_check_position_for_next_cluster(
-		FILE_POSITION *position, PARTITION* partition, size_t remain, bool *flagNoError)
+		FILE_STRUCT* file, FILE_POSITION *position, size_t remain, bool *flagNoError)
 {
+	PARTITION* partition = file->partition;
 	uint32_t tempNextCluster;
 	// do nothing if no more data to write
 	if (remain == 0) return true;
@@ -608,10 +935,10 @@ static bool _FAT_check_position_for_next_cluster(
 	}
 	if (position->sector == partition->sectorsPerCluster) {
 		// need to advance to next cluster
-		tempNextCluster = _FAT_fat_nextCluster(partition, position->cluster);
+		tempNextCluster = _FAT_file_nextCluster(file, position->cluster);
 		if ((tempNextCluster == CLUSTER_EOF) || (tempNextCluster == CLUSTER_FREE)) {
 			// Ran out of clusters so get a new one
-			tempNextCluster = _FAT_fat_linkFreeCluster(partition, position->cluster);
+			tempNextCluster = _FAT_file_linkFreeCluster(file, position->cluster);
 		}
 		if (!_FAT_fat_isValidCluster(partition, tempNextCluster)) {
 			// Couldn't get a cluster, so abort
@@ -644,13 +971,13 @@ static bool _FAT_file_extend (FILE_STRUCT* file) {
 	position.sector = (file->filesize % partition->bytesPerCluster) / partition->bytesPerSector;
 	// It is assumed that there is always a startCluster
 	// This will be true when _FAT_file_extend is called from _FAT_write_r
-	position.cluster = _FAT_fat_lastCluster (partition, file->startCluster);
+	position.cluster = _FAT_file_lastCluster (file);
 
 	remain = file->currentPosition - file->filesize;
 
 	if ((remain > 0) && (file->filesize > 0) && (position.sector == 0) && (position.byte  == 0)) {
 		// Get a new cluster on the edge of a cluster boundary
-		tempNextCluster = _FAT_fat_linkFreeCluster(partition, position.cluster);
+		tempNextCluster = _FAT_file_linkFreeCluster(file, position.cluster);
 		if (!_FAT_fat_isValidCluster(partition, tempNextCluster)) {
 			// Couldn't get a cluster, so abort
 			_FAT_file_error (file, ENOSPC);
@@ -679,7 +1006,7 @@ static bool _FAT_file_extend (FILE_STRUCT* file) {
 			if (position.sector >= partition->sectorsPerCluster) {
 				position.sector = 0;
 				// Ran out of clusters so get a new one
-				tempNextCluster = _FAT_fat_linkFreeCluster(partition, position.cluster);
+				tempNextCluster = _FAT_file_linkFreeCluster(file, position.cluster);
 				if (!_FAT_fat_isValidCluster(partition, tempNextCluster)) {
 					// Couldn't get a cluster, so abort
 					_FAT_file_error (file, ENOSPC);
@@ -695,7 +1022,7 @@ static bool _FAT_file_extend (FILE_STRUCT* file) {
 			position.sector ++;
 		}
 
-		if (!_FAT_check_position_for_next_cluster(&position, partition, remain, NULL)) {
+		if (!_FAT_check_position_for_next_cluster(file, &position, remain, NULL)) {
 			// error already marked
 			_FAT_file_error(file, errno);
 			return false;
@@ -749,7 +1076,7 @@ ssize_t _FAT_write (int fd, const char *ptr, size_t len) {
 
 	// Get a new cluster for the start of the file if required
 	if (file->startCluster == CLUSTER_FREE) {
-		tempNextCluster = _FAT_fat_linkFreeCluster (partition, CLUSTER_FREE);
+		tempNextCluster = _FAT_file_linkFreeCluster (file, CLUSTER_FREE);
 		if (!_FAT_fat_isValidCluster(partition, tempNextCluster)) {
 			// Couldn't get a cluster, so abort immediately
 			_FAT_unlock(&partition->lock);
@@ -790,7 +1117,7 @@ ssize_t _FAT_write (int fd, const char *ptr, size_t len) {
 	}
 
 	// Move onto next cluster if needed
-	_FAT_check_position_for_next_cluster(&position, partition, remain, &flagNoError);
+	_FAT_check_position_for_next_cluster(file, &position, remain, &flagNoError);
 	if (!flagNoError) {
 		_FAT_file_error (file, errno);
 	}
@@ -842,7 +1169,7 @@ ssize_t _FAT_write (int fd, const char *ptr, size_t len) {
 	// Write whole clusters
 	while ((remain >= partition->bytesPerCluster) && flagNoError) {
 		// allocate next cluster
-		_FAT_check_position_for_next_cluster(&position, partition, remain, &flagNoError);
+		_FAT_check_position_for_next_cluster(file, &position, remain, &flagNoError);
 		if (!flagNoError) {
 			_FAT_file_error (file, errno);
 			break;
@@ -863,7 +1190,7 @@ ssize_t _FAT_write (int fd, const char *ptr, size_t len) {
 			// pretend to use up all sectors in next_position
 			next_position.sector = partition->sectorsPerCluster;
 			// get or allocate next cluster
-			_FAT_check_position_for_next_cluster(&next_position, partition,
+			_FAT_check_position_for_next_cluster(file, &next_position,
 					remain - chunkSize, &flagNoError);
 			if (!flagNoError) {
 				_FAT_file_error (file, errno);
@@ -875,7 +1202,8 @@ ssize_t _FAT_write (int fd, const char *ptr, size_t len) {
 			chunkSize += partition->bytesPerCluster;
 		}
 
-		if ( !_FAT_cache_writeSectors (cache,
+		// Whole clusters go straight from the caller's buffer, not through the cache
+		if ( !_FAT_cache_writeSectorsDirect (cache,
 				_FAT_fat_clusterToSector(partition, position.cluster), chunkSize / partition->bytesPerSector, ptr))
 		{
 			flagNoError = false;
@@ -897,7 +1225,7 @@ ssize_t _FAT_write (int fd, const char *ptr, size_t len) {
 	}
 
 	// allocate next cluster if needed
-	_FAT_check_position_for_next_cluster(&position, partition, remain, &flagNoError);
+	_FAT_check_position_for_next_cluster(file, &position, remain, &flagNoError);
 
 	if (!flagNoError) {
 		_FAT_file_error (file, errno);
@@ -954,11 +1282,193 @@ ssize_t _FAT_write (int fd, const char *ptr, size_t len) {
 }
 
 
+/*
+Finds the sectors from a position in a file that can move in one transfer:
+whole sectors, up to len bytes, in clusters that follow each other on the
+disc. Stores the first sector in *sector and moves the position past the
+sectors. Returns the number of sectors, or 0 if the position is not at the
+start of a sector or the clusters of the file end there.
+*/
+static uint32_t _FAT_file_sectorRun (FILE_STRUCT* file, FILE_POSITION* position, size_t len, sec_t* sector) {
+	PARTITION* partition = file->partition;
+	uint32_t maxSectors = len / partition->bytesPerSector;
+	uint32_t numSectors, endSector, cluster, nextCluster;
+
+	// The card transfers at most 65535 sectors per command
+	if (maxSectors > 0xFFFF) {
+		maxSectors = 0xFFFF;
+	}
+	if (position->byte != 0 || maxSectors == 0) {
+		return 0;
+	}
+
+	if (position->sector >= partition->sectorsPerCluster) {
+		nextCluster = _FAT_file_nextCluster (file, position->cluster);
+		if (!_FAT_fat_isValidCluster (partition, nextCluster)) {
+			return 0;
+		}
+		position->cluster = nextCluster;
+		position->sector = 0;
+	}
+
+	*sector = _FAT_fat_clusterToSector (partition, position->cluster) + position->sector;
+	numSectors = partition->sectorsPerCluster - position->sector;
+	cluster = position->cluster;
+
+	while (numSectors < maxSectors) {
+		nextCluster = _FAT_file_nextCluster (file, cluster);
+		if (nextCluster != cluster + 1) {
+			break;
+		}
+		cluster = nextCluster;
+		numSectors += partition->sectorsPerCluster;
+	}
+	if (numSectors > maxSectors) {
+		numSectors = maxSectors;
+	}
+
+	// A position at the end of a cluster stays in that cluster
+	endSector = position->sector + numSectors;
+	position->cluster += (endSector - 1) / partition->sectorsPerCluster;
+	position->sector = (endSector - 1) % partition->sectorsPerCluster + 1;
+	return numSectors;
+}
+
+ssize_t fatStartRead (int fd, void* buffer, size_t len) {
+	FILE_STRUCT* file = (FILE_STRUCT*) fd;
+	PARTITION* partition;
+	FILE_POSITION position;
+	uint32_t numSectors;
+	sec_t sector;
+
+	if ((file == NULL) || !file->inUse || !file->read) {
+		_FAT_file_error (file, EBADF);
+		return -1;
+	}
+
+	// One transfer moves at a time
+	if (fatWaitTransfer () != 0) {
+		return -1;
+	}
+
+	partition = file->partition;
+	_FAT_lock(&partition->lock);
+
+	if (file->currentPosition >= file->filesize || file->startCluster == CLUSTER_FREE) {
+		_FAT_unlock(&partition->lock);
+		return 0;
+	}
+	if (len > file->filesize - file->currentPosition) {
+		len = file->filesize - file->currentPosition;
+	}
+
+	position = file->rwPosition;
+	numSectors = _FAT_file_sectorRun (file, &position, len, &sector);
+	if (numSectors == 0) {
+		// Read up to the next sector boundary through the cache
+		_FAT_unlock(&partition->lock);
+		if (len > partition->bytesPerSector - position.byte) {
+			len = partition->bytesPerSector - position.byte;
+		}
+		return _FAT_read (fd, buffer, len);
+	}
+
+	// The cache may hold sectors newer than those on the disc
+	if (!_FAT_cache_syncRange (partition->cache, sector, numSectors, false)
+	 || !_FAT_disc_startReadSectors (partition->disc, sector, numSectors, buffer)) {
+		_FAT_unlock(&partition->lock);
+		_FAT_file_error (file, EIO);
+		return -1;
+	}
+	_FAT_transferFile = file;
+
+	file->rwPosition = position;
+	file->currentPosition += numSectors * partition->bytesPerSector;
+
+	_FAT_unlock(&partition->lock);
+	return numSectors * partition->bytesPerSector;
+}
+
+ssize_t fatStartWrite (int fd, const void* buffer, size_t len) {
+	FILE_STRUCT* file = (FILE_STRUCT*) fd;
+	PARTITION* partition;
+	FILE_POSITION position;
+	uint32_t numSectors = 0;
+	sec_t sector;
+
+	if ((file == NULL) || !file->inUse || !file->write) {
+		_FAT_file_error (file, EBADF);
+		return -1;
+	}
+
+	// One transfer moves at a time
+	if (fatWaitTransfer () != 0) {
+		return -1;
+	}
+
+	partition = file->partition;
+	_FAT_lock(&partition->lock);
+
+	// Only clusters that the file already has are written in the background;
+	// anything that changes the allocation goes through _FAT_write
+	position = file->rwPosition;
+	if (!file->append && file->startCluster != CLUSTER_FREE
+	 && file->currentPosition <= file->filesize) {
+		numSectors = _FAT_file_sectorRun (file, &position, len, &sector);
+	}
+	if (numSectors == 0) {
+		// Write up to the next sector boundary, or the part beyond the
+		// clusters of the file, through the cache
+		_FAT_unlock(&partition->lock);
+		if (!file->append && position.byte != 0 && len > partition->bytesPerSector - position.byte) {
+			len = partition->bytesPerSector - position.byte;
+		}
+		return _FAT_write (fd, buffer, len);
+	}
+
+	// The cache must not keep older copies of the sectors
+	if (!_FAT_cache_syncRange (partition->cache, sector, numSectors, true)
+	 || !_FAT_disc_startWriteSectors (partition->disc, sector, numSectors, buffer)) {
+		_FAT_unlock(&partition->lock);
+		_FAT_file_error (file, EIO);
+		return -1;
+	}
+	_FAT_transferFile = file;
+
+	file->rwPosition = position;
+	file->currentPosition += numSectors * partition->bytesPerSector;
+	if (file->currentPosition > file->filesize) {
+		file->filesize = file->currentPosition;
+	}
+	file->modified = true;
+
+	_FAT_unlock(&partition->lock);
+	return numSectors * partition->bytesPerSector;
+}
+
+bool fatTransferBusy (void) {
+	return _FAT_transferFile != NULL && _FAT_disc_isBusy (_FAT_transferFile->partition->disc);
+}
+
+int fatWaitTransfer (void) {
+	FILE_STRUCT* file = _FAT_transferFile;
+
+	if (file == NULL) {
+		return 0;
+	}
+	_FAT_transferFile = NULL;
+
+	if (!_FAT_disc_waitTransfer (file->partition->disc)) {
+		_FAT_file_error (file, EIO);
+		return -1;
+	}
+	return 0;
+}
+
 off_t _FAT_seek (int fd, off_t pos, int dir) {
 	FILE_STRUCT* file = (FILE_STRUCT*)  fd;
 	PARTITION* partition;
-	uint32_t cluster, nextCluster;
-	int clusCount;
+	uint32_t cluster, clusCount;
 	off_t newPosition;
 	uint32_t position;
 
@@ -1009,35 +1519,23 @@ off_t _FAT_seek (int fd, off_t pos, int dir) {
 		// Calculate where the correct cluster is
 		// how many clusters from start of file
 		clusCount = position / partition->bytesPerCluster;
-		cluster = file->startCluster;
-		if (position >= file->currentPosition) {
-			// start from current cluster
-			int currentCount = file->currentPosition / partition->bytesPerCluster;
-			if (file->rwPosition.sector == partition->sectorsPerCluster) {
-				currentCount--;
-			}
-			clusCount -= currentCount;
-			cluster = file->rwPosition.cluster;
-		}
+
 		// Calculate the sector and byte of the current position,
 		// and store them
 		file->rwPosition.sector = (position % partition->bytesPerCluster) / partition->bytesPerSector;
 		file->rwPosition.byte = position % partition->bytesPerSector;
 
-		nextCluster = _FAT_fat_nextCluster (partition, cluster);
-		while ((clusCount > 0) && (nextCluster != CLUSTER_FREE) && (nextCluster != CLUSTER_EOF)) {
-			clusCount--;
-			cluster = nextCluster;
-			nextCluster = _FAT_fat_nextCluster (partition, cluster);
-		}
+		cluster = _FAT_file_clusterAt (file, clusCount);
 
 		// Check if ran out of clusters and it needs to allocate a new one
-		if (clusCount > 0) {
-			if ((clusCount == 1) && (file->filesize == position) && (file->rwPosition.sector == 0)) {
+		if (!_FAT_fat_isValidCluster (partition, cluster)) {
+			if ((clusCount > 0) && (file->filesize == position) && (file->rwPosition.sector == 0)) {
 				// Set flag to allocate a new cluster
+				cluster = _FAT_file_clusterAt (file, clusCount - 1);
 				file->rwPosition.sector = partition->sectorsPerCluster;
 				file->rwPosition.byte = 0;
-			} else {
+			}
+			if (!_FAT_fat_isValidCluster (partition, cluster)) {
 				_FAT_unlock(&partition->lock);
 				_FAT_file_error (file, EINVAL);
 				return -1;
@@ -1130,7 +1628,7 @@ int _FAT_ftruncate (int fd, off_t len) {
 		uint32_t savedOffset;
 		// Get a new cluster for the start of the file if required
 		if (file->startCluster == CLUSTER_FREE) {
-			uint32_t tempNextCluster = _FAT_fat_linkFreeCluster (partition, CLUSTER_FREE);
+			uint32_t tempNextCluster = _FAT_file_linkFreeCluster (file, CLUSTER_FREE);
 			if (!_FAT_fat_isValidCluster(partition, tempNextCluster)) {
 				// Couldn't get a cluster, so abort immediately
 				_FAT_unlock(&partition->lock);
@@ -1165,6 +1663,7 @@ int _FAT_ftruncate (int fd, off_t len) {
 			// Cutting the file down to nothing, clear all clusters used
 			_FAT_fat_clearLinks (partition, file->startCluster);
 			file->startCluster = CLUSTER_FREE;
+			_FAT_file_freeExtents (file);
 
 			file->appendPosition.cluster = CLUSTER_FREE;
 			file->appendPosition.sector = 0;
@@ -1179,6 +1678,7 @@ int _FAT_ftruncate (int fd, off_t len) {
 			// then set a flag to allocate a cluster as needed
 			chainLength = ((newSize-1) / partition->bytesPerCluster) + 1;
 			lastCluster = _FAT_fat_trimChain (partition, file->startCluster, chainLength);
+			_FAT_file_trimExtents (file, chainLength);
 
 			if (file->append) {
 				file->appendPosition.byte = newSize % partition->bytesPerSector;
@@ -48,12 +48,26 @@ typedef struct {
 
 struct _FILE_STRUCT;
 
+// A run of clusters of a file that follow each other on the disc
+typedef struct {
+	uint32_t             firstCluster;
+	uint32_t             index;				// Position of the first cluster in the file, in clusters
+	uint32_t             length;			// Number of clusters
+} FILE_EXTENT;
+
 struct _FILE_STRUCT {
 	uint32_t             filesize;
 	uint32_t             startCluster;
 	uint32_t             currentPosition;
 	FILE_POSITION        rwPosition;
 	FILE_POSITION        appendPosition;
+	uint32_t             readAheadPosition;	// Where the next read starts if reading is sequential
+	uint32_t             readAheadSectors;	// How far ahead of sequential reads to read, in sectors
+	uint32_t             readAheadEnd;		// Where the data last read ahead ends
+	FILE_EXTENT*         extents;			// The clusters of the file as runs, or NULL until needed
+	uint32_t             extentCount;
+	uint32_t             extentCapacity;
+	uint32_t             extentHint;		// The run looked at last
 	DIR_ENTRY_POSITION   dirEntryStart;		// Points to the start of the LFN entries of a file, or the alias for no LFN
 	DIR_ENTRY_POSITION   dirEntryEnd;		// Always points to the file's alias entry
 	PARTITION*           partition;
@@ -31,8 +31,12 @@
 #include "file_allocation_table.h"
 #include "partition.h"
 #include "mem_allocate.h"
+#include "bit_ops.h"
 #include <string.h>
 
+// Number of FAT sectors read at a time to build the free cluster map
+#define FREE_MAP_READ_SECTORS 64
+
 /*
 Gets the cluster linked from input cluster
 */
@@ -115,6 +119,135 @@ uint32_t _FAT_fat_nextCluster(PARTITION* partition, uint32_t cluster)
 	return nextCluster;
 }
 
+/*
+The free cluster map holds one bit per cluster, set if the cluster is free,
+so that finding a free cluster is a scan through memory instead of through
+the FAT, and the number of free clusters is always known. It is built from
+the FAT the first time a cluster is allocated or counted, and kept up to
+date by every write to the FAT. Without memory for it, both fall back to
+reading the FAT.
+*/
+static inline void _FAT_fat_setClusterFree (PARTITION* partition, uint32_t cluster, bool isFree) {
+	uint32_t* word = &partition->fat.freeClusterMap[(cluster - CLUSTER_FIRST) / 32];
+	uint32_t bit = 1u << ((cluster - CLUSTER_FIRST) % 32);
+
+	if (isFree && !(*word & bit)) {
+		*word |= bit;
+		partition->fat.numberFreeCluster++;
+	} else if (!isFree && (*word & bit)) {
+		*word &= ~bit;
+		partition->fat.numberFreeCluster--;
+	}
+}
+
+/*
+Reads the whole FAT to build the free cluster map, several sectors at a time
+straight from the disc. Returns false if there is no memory for the map or
+the FAT could not be read.
+*/
+static bool _FAT_fat_buildFreeClusterMap (PARTITION* partition) {
+	uint32_t clusterCount = partition->fat.lastCluster - CLUSTER_FIRST + 1;
+	uint32_t entriesPerSector, cluster, entry, value;
+	sec_t sector, numSectors;
+	uint8_t* buffer;
+	uint32_t* map;
+
+	if (partition->fat.freeClusterMap != NULL) {
+		return true;
+	}
+
+	map = (uint32_t*) _FAT_mem_allocate (((clusterCount + 31) / 32) * sizeof(uint32_t));
+	if (map == NULL) {
+		return false;
+	}
+	memset (map, 0, ((clusterCount + 31) / 32) * sizeof(uint32_t));
+	partition->fat.freeClusterMap = map;
+	partition->fat.numberFreeCluster = 0;
+
+	if (partition->filesysType == FS_FAT12) {
+		// FAT12 entries straddle sectors, but there are few of them
+		for (cluster = CLUSTER_FIRST; cluster <= partition->fat.lastCluster; cluster++) {
+			if (_FAT_fat_nextCluster (partition, cluster) == CLUSTER_FREE) {
+				_FAT_fat_setClusterFree (partition, cluster, true);
+			}
+		}
+		return true;
+	}
+
+	buffer = (uint8_t*) _FAT_mem_align (FREE_MAP_READ_SECTORS * partition->bytesPerSector);
+	// Sectors of the FAT changed in the cache must reach the disc first
+	if (buffer == NULL || !_FAT_cache_syncRange (partition->cache, partition->fat.fatStart, partition->fat.sectorsPerFat, false)) {
+		_FAT_mem_free (buffer);
+		_FAT_fat_destroyFreeClusterMap (partition);
+		return false;
+	}
+
+	entriesPerSector = partition->bytesPerSector / (partition->filesysType == FS_FAT16 ? 2 : 4);
+	cluster = 0;
+	for (sector = 0; cluster <= partition->fat.lastCluster; sector += numSectors) {
+		numSectors = partition->fat.sectorsPerFat - sector;
+		if (numSectors > FREE_MAP_READ_SECTORS) {
+			numSectors = FREE_MAP_READ_SECTORS;
+		}
+		if (numSectors == 0
+		 || !_FAT_disc_readSectors (partition->disc, partition->fat.fatStart + sector, numSectors, buffer)) {
+			_FAT_mem_free (buffer);
+			_FAT_fat_destroyFreeClusterMap (partition);
+			return false;
+		}
+
+		for (entry = 0; entry < numSectors * entriesPerSector && cluster <= partition->fat.lastCluster; entry++, cluster++) {
+			if (partition->filesysType == FS_FAT16) {
+				value = u8array_to_u16 (buffer, entry * 2);
+			} else {
+				value = u8array_to_u32 (buffer, entry * 4) & 0x0FFFFFFF;
+			}
+			if (cluster >= CLUSTER_FIRST && value == CLUSTER_FREE) {
+				_FAT_fat_setClusterFree (partition, cluster, true);
+			}
+		}
+	}
+
+	_FAT_mem_free (buffer);
+	return true;
+}
+
+/*
+Returns the first free cluster in the free cluster map at or after a
+cluster, wrapping around to the start of the FAT, or CLUSTER_ERROR if
+there is none.
+*/
+static uint32_t _FAT_fat_findFreeCluster (PARTITION* partition, uint32_t cluster) {
+	uint32_t words = (partition->fat.lastCluster - CLUSTER_FIRST) / 32 + 1;
+	uint32_t bit = cluster - CLUSTER_FIRST;
+	uint32_t word = bit / 32;
+	uint32_t bits = partition->fat.freeClusterMap[word] & (0xFFFFFFFFu << (bit % 32));
+	uint32_t i;
+
+	if (partition->fat.numberFreeCluster == 0) {
+		return CLUSTER_ERROR;
+	}
+
+	// Look at one more word than there are, to see the start of the first one again
+	for (i = 0; i <= words; i++) {
+		if (bits != 0) {
+			cluster = word * 32 + __builtin_ctz (bits) + CLUSTER_FIRST;
+			if (cluster <= partition->fat.lastCluster) {
+				return cluster;
+			}
+		}
+		word = (word + 1 < words) ? word + 1 : 0;
+		bits = partition->fat.freeClusterMap[word];
+	}
+
+	return CLUSTER_ERROR;
+}
+
+void _FAT_fat_destroyFreeClusterMap (PARTITION* partition) {
+	_FAT_mem_free (partition->fat.freeClusterMap);
+	partition->fat.freeClusterMap = NULL;
+}
+
 /*
 writes value into the correct offset within a partition's FAT, based
 on the cluster number.
@@ -123,6 +256,7 @@ static bool _FAT_fat_writeFatEntry (PARTITION* partition, uint32_t cluster, uint
 	sec_t sector;
 	int offset;
 	uint32_t oldValue;
+	bool isFree = (value == CLUSTER_FREE);
 
 	if ((cluster < CLUSTER_FIRST) || (cluster > partition->fat.lastCluster /* This will catch CLUSTER_ERROR */))
 	{
@@ -195,6 +329,10 @@ static bool _FAT_fat_writeFatEntry (PARTITION* partition, uint32_t cluster, uint
 			break;
 	}
 
+	if (partition->fat.freeClusterMap != NULL) {
+		_FAT_fat_setClusterFree (partition, cluster, isFree);
+	}
+
 	return true;
 }
 
@@ -229,25 +367,36 @@ uint32_t _FAT_fat_linkFreeCluster(PARTITION* partition, uint32_t cluster) {
 		firstFree = CLUSTER_FIRST;
 	}
 
-	// Search until a free cluster is found
-	while (_FAT_fat_nextCluster(partition, firstFree) != CLUSTER_FREE) {
-		firstFree++;
+	if (_FAT_fat_buildFreeClusterMap (partition)) {
 		if (firstFree > lastCluster) {
-			if (loopedAroundFAT) {
-				// If couldn't get a free cluster then return an error
-				partition->fat.firstFree = firstFree;
-				return CLUSTER_ERROR;
-			} else {
-				// Try looping back to the beginning of the FAT
-				// This was suggested by loopy
-				firstFree = CLUSTER_FIRST;
-				loopedAroundFAT = true;
+			firstFree = CLUSTER_FIRST;
+		}
+		firstFree = _FAT_fat_findFreeCluster (partition, firstFree);
+		if (firstFree == CLUSTER_ERROR) {
+			return CLUSTER_ERROR;
+		}
+	} else {
+		// Search until a free cluster is found
+		while (_FAT_fat_nextCluster(partition, firstFree) != CLUSTER_FREE) {
+			firstFree++;
+			if (firstFree > lastCluster) {
+				if (loopedAroundFAT) {
+					// If couldn't get a free cluster then return an error
+					partition->fat.firstFree = firstFree;
+					return CLUSTER_ERROR;
+				} else {
+					// Try looping back to the beginning of the FAT
+					// This was suggested by loopy
+					firstFree = CLUSTER_FIRST;
+					loopedAroundFAT = true;
+				}
 			}
 		}
+		// The free cluster map counts its own clusters as they are written
+		if(partition->fat.numberFreeCluster)
+			partition->fat.numberFreeCluster--;
 	}
 	partition->fat.firstFree = firstFree;
-	if(partition->fat.numberFreeCluster)
-		partition->fat.numberFreeCluster--;
 	partition->fat.numberLastAllocCluster = firstFree;
 
 	if ((cluster >= CLUSTER_FIRST) && (cluster <= lastCluster))
@@ -317,7 +466,7 @@ bool _FAT_fat_clearLinks (PARTITION* partition, uint32_t cluster) {
 		// Erase the link
 		_FAT_fat_writeFatEntry (partition, cluster, CLUSTER_FREE);
 
-		if(partition->fat.numberFreeCluster < (partition->numberOfSectors/partition->sectorsPerCluster))
+		if(partition->fat.freeClusterMap == NULL && partition->fat.numberFreeCluster < (partition->numberOfSectors/partition->sectorsPerCluster))
 			partition->fat.numberFreeCluster++;
 		// Move onto next cluster
 		cluster = nextCluster;
@@ -382,6 +531,10 @@ unsigned int _FAT_fat_freeClusterCount (PARTITION* partition) {
 	unsigned int count = 0;
 	uint32_t curCluster;
 
+	if (_FAT_fat_buildFreeClusterMap (partition)) {
+		return partition->fat.numberFreeCluster;
+	}
+
 	for (curCluster = CLUSTER_FIRST; curCluster <= partition->fat.lastCluster; curCluster++) {
 		if (_FAT_fat_nextCluster(partition, curCluster) == CLUSTER_FREE) {
 			count++;
@@ -37,8 +37,14 @@ static inline void* _FAT_mem_allocate (size_t size) {
 	return malloc (size);
 }
 
+// Sector buffers start on a data cache line (32 bytes on the JZ4740), so
+// that the card driver can move them by DMA instead of reading them itself
 static inline void* _FAT_mem_align (size_t size) {
-	return malloc (size);
+	return memalign (32, size);
+}
+
+static inline void* _FAT_mem_reallocate (void* mem, size_t size) {
+	return realloc (mem, size);
 }
 
 static inline void _FAT_mem_free (void* mem) {
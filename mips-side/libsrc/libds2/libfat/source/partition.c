@@ -261,6 +261,7 @@ PARTITION* _FAT_partition_constructor_buf (const DISC_INTERFACE* disc, uint32_t
 	partition->fat.firstFree = CLUSTER_FIRST;
 	partition->fat.numberFreeCluster = 0;
 	partition->fat.numberLastAllocCluster = 0;
+	partition->fat.freeClusterMap = NULL;
 
 	if (clusterCount < CLUSTERS_PER_FAT12) {
 		partition->filesysType = FS_FAT12;	// FAT12 volume
@@ -295,6 +296,10 @@ PARTITION* _FAT_partition_constructor_buf (const DISC_INTERFACE* disc, uint32_t
 	partition->openFileCount = 0;
 	partition->firstOpenFile = NULL;
 
+	// Directory name indexes are built as directories are searched
+	partition->dirIndexes = NULL;
+	partition->dirIndexClock = 0;
+
 	_FAT_partition_readFSinfo(partition);
 
 	return partition;
@@ -329,6 +334,10 @@ void _FAT_partition_destructor (PARTITION* partition) {
 	// Free memory used by the cache, writing it to disc at the same time
 	_FAT_cache_destructor (partition->cache);
 
+	_FAT_fat_destroyFreeClusterMap (partition);
+
+	_FAT_directory_destroyIndexes (partition);
+
 	// Unlock the partition and destroy the lock
 	_FAT_unlock(&partition->lock);
 	_FAT_lock_deinit(&partition->lock);
@@ -381,13 +390,18 @@ void _FAT_partition_readFSinfo(PARTITION * partition)
 
 	if(memcmp(sectorBuffer+FSIB_SIG1, FS_INFO_SIG1, 4) != 0 ||
 		memcmp(sectorBuffer+FSIB_SIG2, FS_INFO_SIG2, 4) != 0 ||
-		u8array_to_u32(sectorBuffer, FSIB_numberOfFreeCluster) == 0)
+		u8array_to_u32(sectorBuffer, FSIB_numberOfFreeCluster) == 0 ||
+		u8array_to_u32(sectorBuffer, FSIB_numberOfFreeCluster) > partition->fat.lastCluster - CLUSTER_FIRST + 1)
 	{
-		//sector does not yet exist, create one!
+		//sector does not yet exist or holds an unknown count, create one!
 		_FAT_partition_createFSinfo(partition);
 	} else {
 		partition->fat.numberFreeCluster = u8array_to_u32(sectorBuffer, FSIB_numberOfFreeCluster);
 		partition->fat.numberLastAllocCluster = u8array_to_u32(sectorBuffer, FSIB_numberLastAllocCluster);
+		// Start looking for free clusters where the last allocation left off
+		if (partition->fat.numberLastAllocCluster >= CLUSTER_FIRST && partition->fat.numberLastAllocCluster <= partition->fat.lastCluster) {
+			partition->fat.firstFree = partition->fat.numberLastAllocCluster;
+		}
 	}
 	_FAT_mem_free(sectorBuffer);
 }
@@ -47,6 +47,7 @@ typedef struct {
 	uint32_t firstFree;
 	uint32_t numberFreeCluster;
 	uint32_t numberLastAllocCluster;
+	uint32_t* freeClusterMap;		// One bit per cluster, set if it is free, or NULL until needed
 } FAT;
 
 typedef struct {
@@ -71,6 +72,8 @@ typedef struct {
 	mutex_t               lock;					// A lock for partition operations
 	bool                  readOnly;				// If this is set, then do not try writing to the disc
 	char                  label[12];			// Volume label
+	struct _DIR_INDEX*    dirIndexes;			// Name indexes of recently used directories, or NULL
+	uint32_t              dirIndexClock;		// Counts directory lookups, to find the least recently used index
 } PARTITION;
 
 extern PARTITION* single_partition;
@@ -0,0 +1,158 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Reports the host time that libfat takes to find pages in its sector cache
+ * as the cache grows, on a FAT32 image in memory.
+ *
+ * For each cache size, a file that takes up 3/4 of the cache is written and
+ * read once, so that its pages are all in the cache. The benchmark then
+ * times random 512-byte reads of the file through _FAT_read, which are all
+ * cache hits, and random lookups of its sectors in the cache alone. For
+ * comparison, it also times finding the same pages by scanning every entry,
+ * as the cache did before it had a hash table.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+
+#include <fat.h>
+
+#include "cache.h"
+#include "fat_host.h"
+#include "fatfile.h"
+#include "file_allocation_table.h"
+#include "partition.h"
+
+/* 96 MiB, in clusters of 1 KiB, is enough clusters for FAT32. */
+#define DISC_SECTORS (96 * 2048)
+#define SECTORS_PER_CLUSTER 2
+#define SECTOR_SIZE 512
+#define SECTORS_PER_PAGE 8
+
+#define TIMED_READS 200000
+
+static uint8_t data[4096 * SECTORS_PER_PAGE * SECTOR_SIZE];
+
+static double elapsed_ns(const struct timespec* start, const struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* Finds a page as the cache used to: by looking at every entry. */
+static const CACHE_ENTRY* scan_for_page(const CACHE* cache, sec_t sector)
+{
+	unsigned int i;
+
+	sector -= sector % cache->sectorsPerPage;
+	for (i = 0; i < cache->numberOfPages; i++)
+		if (cache->cacheEntries[i].sector == sector)
+			return &cache->cacheEntries[i];
+	return NULL;
+}
+
+int main(void)
+{
+	static const unsigned int pages[] = { 16, 64, 256, 1024, 4096 };
+	FILE_STRUCT* file = fat_host_alloc_file(sizeof(FILE_STRUCT));
+	size_t p;
+
+	ramdisc_create(DISC_SECTORS);
+	srand(1);
+	for (p = 0; p < sizeof(data); p++)
+		data[p] = rand();
+
+	printf("%6s %9s | %10s %11s %11s | %8s\n",
+		"pages", "file KiB", "ns/read", "ns/lookup", "ns/scan", "reads");
+
+	for (p = 0; p < sizeof(pages) / sizeof(pages[0]); p++) {
+		size_t size = pages[p] * 3 / 4 * SECTORS_PER_PAGE * SECTOR_SIZE, i;
+		sec_t first_sector;
+		struct timespec start, end;
+		double read_ns, lookup_ns, scan_ns;
+		unsigned long found = 0;
+		CACHE* cache;
+		char sector[SECTOR_SIZE];
+		int fd;
+
+		ramdisc_format_fat32(SECTORS_PER_CLUSTER);
+		if (!fatMount("fat", &__io_scds2, 0, pages[p], SECTORS_PER_PAGE)) {
+			fprintf(stderr, "%u pages: can't mount\n", pages[p]);
+			return 1;
+		}
+		cache = single_partition->cache;
+
+		fd = _FAT_open(file, "fat:/bench.bin", O_RDWR | O_CREAT, 0);
+		if (fd == -1 || _FAT_write(fd, (const char*) data, size) != (ssize_t) size) {
+			fprintf(stderr, "%u pages: can't write the file\n", pages[p]);
+			return 1;
+		}
+		first_sector = _FAT_fat_clusterToSector(single_partition, file->startCluster);
+
+		/* Bring the whole file into the cache, and check it. */
+		_FAT_seek(fd, 0, SEEK_SET);
+		for (i = 0; i < size; i += SECTOR_SIZE) {
+			if (_FAT_read(fd, sector, SECTOR_SIZE) != SECTOR_SIZE
+			 || memcmp(sector, data + i, SECTOR_SIZE) != 0) {
+				fprintf(stderr, "%u pages: wrong data at %zu\n", pages[p], i);
+				return 1;
+			}
+		}
+
+		ramdisc_reset_stats();
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < TIMED_READS; i++) {
+			_FAT_seek(fd, (rand() % (size / SECTOR_SIZE)) * SECTOR_SIZE, SEEK_SET);
+			_FAT_read(fd, sector, SECTOR_SIZE);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		read_ns = elapsed_ns(&start, &end) / TIMED_READS;
+
+		/* The file is contiguous on a fresh disc. */
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < TIMED_READS; i++)
+			_FAT_cache_readPartialSector(cache, sector, first_sector + rand() % (size / SECTOR_SIZE), 0, 4);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		lookup_ns = elapsed_ns(&start, &end) / TIMED_READS;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < TIMED_READS; i++)
+			found += scan_for_page(cache, first_sector + rand() % (size / SECTOR_SIZE)) != NULL;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		scan_ns = elapsed_ns(&start, &end) / TIMED_READS;
+
+		printf("%6u %9zu | %10.0f %11.1f %11.1f | %8lu\n",
+			pages[p], size / 1024, read_ns, lookup_ns, scan_ns, ramdisc_stats.reads);
+
+		if (found != TIMED_READS) {
+			fprintf(stderr, "%u pages: the file is not all in the cache\n", pages[p]);
+			return 1;
+		}
+		_FAT_close(fd);
+		fatUnmount("fat");
+	}
+
+	return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Reports the host time and the File Allocation Table sectors that libfat
+ * reads for random seeks in a fragmented file, on a FAT32 image in memory.
+ *
+ * The file is written in chunks between the chunks of another file, so that
+ * each chunk is an extent of its own, and the sector cache is too small to
+ * hold the part of the FAT that describes it. The benchmark times random
+ * seeks followed by 512-byte reads through _FAT_seek and _FAT_read, which
+ * find the cluster in the extent map of the file. For comparison, it times
+ * finding the same clusters by following the cluster chain from the start of
+ * the file, as a seek backwards did before files had extent maps.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+
+#include <fat.h>
+
+#include "cache.h"
+#include "fat_host.h"
+#include "fatfile.h"
+#include "file_allocation_table.h"
+#include "partition.h"
+
+/* 96 MiB, in clusters of 1 KiB, is enough clusters for FAT32. */
+#define DISC_SECTORS (96 * 2048)
+#define SECTORS_PER_CLUSTER 2
+#define SECTOR_SIZE 512
+#define CLUSTER_SIZE (SECTORS_PER_CLUSTER * SECTOR_SIZE)
+
+#define CACHE_PAGES 16
+#define SECTORS_PER_PAGE 8
+
+#define FILE_SIZE (32 * 1024 * 1024)
+#define CHUNK_SIZE (16 * 1024)
+
+#define TIMED_SEEKS 100000
+#define TIMED_WALKS 1000
+
+static uint8_t data[FILE_SIZE];
+
+static double elapsed_ns(const struct timespec* start, const struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* Finds a cluster of a file as seeks used to: by following its chain. */
+static uint32_t walk_to_cluster(PARTITION* partition, uint32_t cluster, uint32_t index)
+{
+	while (index-- > 0)
+		cluster = _FAT_fat_nextCluster(partition, cluster);
+	return cluster;
+}
+
+int main(void)
+{
+	FILE_STRUCT* file = fat_host_alloc_file(sizeof(FILE_STRUCT));
+	FILE_STRUCT* other = fat_host_alloc_file(sizeof(FILE_STRUCT));
+	struct timespec start, end;
+	double seek_ns, walk_ns;
+	unsigned long seek_fat_sectors, walk_fat_sectors;
+	char sector[SECTOR_SIZE];
+	size_t i;
+	int fd, other_fd;
+
+	ramdisc_create(DISC_SECTORS);
+	ramdisc_format_fat32(SECTORS_PER_CLUSTER);
+	srand(1);
+	for (i = 0; i < FILE_SIZE; i++)
+		data[i] = rand();
+
+	if (!fatMount("fat", &__io_scds2, 0, CACHE_PAGES, SECTORS_PER_PAGE)) {
+		fprintf(stderr, "can't mount the image\n");
+		return 1;
+	}
+	fd = _FAT_open(file, "fat:/bench.bin", O_RDWR | O_CREAT, 0);
+	other_fd = _FAT_open(other, "fat:/other.bin", O_RDWR | O_CREAT, 0);
+	if (fd == -1 || other_fd == -1) {
+		fprintf(stderr, "can't make the files\n");
+		return 1;
+	}
+	for (i = 0; i < FILE_SIZE; i += CHUNK_SIZE) {
+		if (_FAT_write(fd, (const char*) data + i, CHUNK_SIZE) != CHUNK_SIZE
+		 || _FAT_write(other_fd, (const char*) data + i, CHUNK_SIZE) != CHUNK_SIZE) {
+			fprintf(stderr, "can't write the files\n");
+			return 1;
+		}
+	}
+	_FAT_close(other_fd);
+
+	/* The first seek maps the file. Don't count that. */
+	_FAT_seek(fd, 0, SEEK_SET);
+	_FAT_read(fd, sector, SECTOR_SIZE);
+
+	ramdisc_reset_stats();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < TIMED_SEEKS; i++) {
+		size_t pos = (rand() % (FILE_SIZE / SECTOR_SIZE)) * SECTOR_SIZE;
+		_FAT_seek(fd, pos, SEEK_SET);
+		if (_FAT_read(fd, sector, SECTOR_SIZE) != SECTOR_SIZE
+		 || memcmp(sector, data + pos, SECTOR_SIZE) != 0) {
+			fprintf(stderr, "wrong data at %zu\n", pos);
+			return 1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seek_ns = elapsed_ns(&start, &end) / TIMED_SEEKS;
+	seek_fat_sectors = ramdisc_stats.fat_sectors_read;
+
+	ramdisc_reset_stats();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < TIMED_WALKS; i++) {
+		size_t pos = (rand() % (FILE_SIZE / SECTOR_SIZE)) * SECTOR_SIZE;
+		uint32_t cluster = walk_to_cluster(single_partition, file->startCluster, pos / CLUSTER_SIZE);
+		sec_t sector_no = _FAT_fat_clusterToSector(single_partition, cluster) + pos % CLUSTER_SIZE / SECTOR_SIZE;
+		if (!_FAT_cache_readPartialSector(single_partition->cache, sector, sector_no, 0, SECTOR_SIZE)
+		 || memcmp(sector, data + pos, SECTOR_SIZE) != 0) {
+			fprintf(stderr, "wrong data at %zu after walking the chain\n", pos);
+			return 1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	walk_ns = elapsed_ns(&start, &end) / TIMED_WALKS;
+	walk_fat_sectors = ramdisc_stats.fat_sectors_read;
+
+	printf("%u KiB file in %lu extents, %u-page cache\n",
+		FILE_SIZE / 1024, (unsigned long) file->extentCount, CACHE_PAGES);
+	printf("%12s | %10s %16s\n", "", "ns/seek", "FAT sectors/seek");
+	printf("%12s | %10.0f %16.2f\n", "extent map", seek_ns, (double) seek_fat_sectors / TIMED_SEEKS);
+	printf("%12s | %10.0f %16.2f\n", "chain walk", walk_ns, (double) walk_fat_sectors / TIMED_WALKS);
+
+	_FAT_close(fd);
+	fatUnmount("fat");
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Reports how many voices the mixer mixes per millisecond of host time, for
+ * each interpolation, with all voices playing looped 16-bit and 8-bit sources
+ * at various frequencies into 16-bit stereo output at 32768 Hz.
+ *
+ * A voice mixed here is one voice over one DS2_MixVoices call of 512 output
+ * samples, which is 15.6 ms of sound.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <ds2/ds.h>
+
+#include "globals.h"
+#include "mixer.h"
+
+#define SOURCE_LENGTH 8192
+#define OUTPUT_SAMPLES 512
+#define TIMED_CALLS 2000
+
+static int16_t source_16[SOURCE_LENGTH];
+static uint8_t source_8[SOURCE_LENGTH];
+static int16_t output[OUTPUT_SAMPLES * 2];
+
+static double elapsed_ns(const struct timespec* start, const struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main(void)
+{
+	static const char* const names[] = { "none", "linear", "cubic" };
+	int interpolation;
+	size_t i;
+
+	srand(1);
+	for (i = 0; i < SOURCE_LENGTH; i++) {
+		source_16[i] = rand();
+		source_8[i] = rand();
+	}
+
+	_ds2_ds.snd_freq = 32768;
+	_ds2_ds.snd_16bit = true;
+	_ds2_ds.snd_stereo = true;
+
+	printf("%-7s %12s %14s\n", "interp", "ns per call", "voices per ms");
+	for (interpolation = DS2_INTERPOLATION_NONE; interpolation <= DS2_INTERPOLATION_CUBIC; interpolation++) {
+		struct timespec start, end;
+		double ns;
+
+		_mixer_init();
+		for (i = 0; i < DS2_MIXER_VOICES; i++) {
+			DS2_PlayVoice(i, (i & 1) ? (const void*) source_8 : (const void*) source_16,
+				SOURCE_LENGTH, !(i & 1), 8000 + i * 2719, i * 100);
+			DS2_SetVoiceVolume(i, 100, i * 127 / (DS2_MIXER_VOICES - 1));
+			DS2_SetVoiceInterpolation(i, interpolation);
+		}
+		/* Let the mixer compute the steps before timing it. */
+		DS2_MixVoices(output, OUTPUT_SAMPLES, NULL);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < TIMED_CALLS; i++)
+			DS2_MixVoices(output, OUTPUT_SAMPLES, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns = elapsed_ns(&start, &end) / TIMED_CALLS;
+
+		for (i = 0; i < DS2_MIXER_VOICES; i++) {
+			if (!DS2_IsVoicePlaying(i)) {
+				fprintf(stderr, "%s: voice %zu stopped\n", names[interpolation], i);
+				return 1;
+			}
+		}
+
+		printf("%-7s %12.0f %14.1f\n", names[interpolation], ns,
+			DS2_MIXER_VOICES * 1e6 / ns);
+	}
+
+	return 0;
+}
@@ -0,0 +1,283 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Compares video encoding 1, whose reverse palette is a table of 32768
+ * bytes indexed directly by the pixel, with a smaller reverse palette in two
+ * levels: a directory of 1024 bytes indexed by the upper 10 bits of the
+ * pixel, giving a block of 32 bytes indexed by the lower 5 bits.
+ *
+ * For each test frame, both encoders must produce the same bytes. The
+ * benchmark then reports the host time to make the reverse palette and
+ * encode the frame, and the data cache misses that the reverse palette
+ * lookups and the pixel loads of each encoder take in a model of the
+ * JZ4740's data cache, starting cold at each frame.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dcache_model.h"
+#include "globals.h"
+#include "video.h"
+#include "video_encoding_1.h"
+
+#define FRAME_PIXELS (DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT)
+
+#define TIMED_FRAMES 500
+
+/* Simulated addresses given to the cache model. */
+#define SIM_PIXELS      UINT32_C(0x80100000)
+#define SIM_REV_PALETTE UINT32_C(0x80200000)
+
+uint16_t _video_main_palettes[MAIN_BUFFER_MAX][256];
+uint8_t _video_main_rev_palettes[MAIN_BUFFER_MAX][REV_PALETTE_SIZE];
+
+/* The reverse palette in two levels, for buffer 0: the directory, then block
+ * 0, which stands for colors not in the palette, then up to 252 blocks. */
+#define DIRECTORY_SIZE 1024
+#define BLOCK_SIZE     32
+
+static uint8_t two_level[DIRECTORY_SIZE + (252 + 1) * BLOCK_SIZE];
+
+static uint16_t frame[FRAME_PIXELS] __attribute__((aligned (4)));
+static uint8_t two_level_out[FRAME_PIXELS + 4], direct_out[FRAME_PIXELS + 4];
+
+/* Fills the palette of buffer 0 with the colors of the frame, in ascending
+ * order, like _make_palette. Returns the number of colors, or 0 if there are
+ * more than 252. */
+static size_t make_palette(void)
+{
+	static bool seen[32768];
+	size_t i, count = 0;
+
+	memset(seen, 0, sizeof(seen));
+	for (i = 0; i < FRAME_PIXELS; i++)
+		seen[frame[i] & 0x7FFF] = true;
+	for (i = 0; i < 32768; i++) {
+		if (seen[i]) {
+			if (count == 252)
+				return 0;
+			_video_main_palettes[0][count++] = i;
+		}
+	}
+	return count;
+}
+
+static void make_two_level(size_t count)
+{
+	unsigned int blocks = 0;
+	size_t i;
+
+	memset(two_level, 0, DIRECTORY_SIZE + BLOCK_SIZE);
+	for (i = 0; i < count; i++) {
+		uint_fast16_t pixel = _video_main_palettes[0][i];
+
+		if (two_level[pixel >> 5] == 0) {
+			two_level[pixel >> 5] = ++blocks;
+			memset(&two_level[DIRECTORY_SIZE + blocks * BLOCK_SIZE], 0, BLOCK_SIZE);
+		}
+		two_level[DIRECTORY_SIZE + two_level[pixel >> 5] * BLOCK_SIZE + (pixel & 31)] = i;
+	}
+}
+
+static inline uint8_t two_level_lookup(uint_fast16_t pixel)
+{
+	return two_level[DIRECTORY_SIZE + two_level[pixel >> 5] * BLOCK_SIZE + (pixel & 31)];
+}
+
+/* The encoding 1 loop with the reverse palette in two levels. */
+static size_t two_level_video_encoding_1(const uint16_t* src, uint8_t* dst, size_t pixel_count)
+{
+	size_t i;
+
+	if (pixel_count > 504)
+		pixel_count = 504;
+	for (i = 0; i < pixel_count; i++)
+		dst[i] = two_level_lookup(src[i] & UINT16_C(0x7FFF));
+	return pixel_count;
+}
+
+static void two_level_encode(void)
+{
+	size_t offset = 0;
+
+	while (offset < FRAME_PIXELS)
+		offset += two_level_video_encoding_1(frame + offset, two_level_out + offset, FRAME_PIXELS - offset);
+}
+
+static void direct_encode(void)
+{
+	size_t offset = 0;
+
+	while (offset < FRAME_PIXELS) {
+		size_t n = _video_encoding_1(frame + offset, 0, offset, FRAME_PIXELS - offset);
+		memcpy(direct_out + offset, &_ds2_ds.vid_next_data, n);
+		offset += n;
+	}
+}
+
+/* Replays the loads of two_level_encode in the cache model. */
+static void two_level_trace(struct dcache_model* cache)
+{
+	size_t i;
+
+	for (i = 0; i < FRAME_PIXELS; i++) {
+		uint_fast16_t pixel = frame[i] & 0x7FFF;
+
+		dcache_access(cache, SIM_PIXELS + i * 2);
+		dcache_access(cache, SIM_REV_PALETTE + (pixel >> 5));
+		dcache_access(cache, SIM_REV_PALETTE + DIRECTORY_SIZE
+			+ two_level[pixel >> 5] * BLOCK_SIZE + (pixel & 31));
+	}
+}
+
+/* Replays the loads of direct_encode in the cache model. Pixels are loaded
+ * two at a time. */
+static void direct_trace(struct dcache_model* cache)
+{
+	size_t i;
+
+	for (i = 0; i < FRAME_PIXELS; i++) {
+		if (i % 2 == 0)
+			dcache_access(cache, SIM_PIXELS + i * 2);
+		dcache_access(cache, SIM_REV_PALETTE + (frame[i] & 0x7FFF));
+	}
+}
+
+static uint16_t color(unsigned int n)
+{
+	/* 131 is odd, so the first 32768 values of n give different colors. */
+	return (n * 131) & 0x7FFF;
+}
+
+/* Fills the frame for the given test. The upper bit of each pixel is random,
+ * because the encoder must ignore it. Returns the name of the test, or NULL
+ * if there is no such test. */
+static const char* make_frame(unsigned int test)
+{
+	size_t x, y;
+
+	for (y = 0; y < DS_SCREEN_HEIGHT; y++) {
+		for (x = 0; x < DS_SCREEN_WIDTH; x++) {
+			uint16_t pixel;
+
+			switch (test) {
+			case 0:
+				pixel = color(7);
+				break;
+			case 1:
+				pixel = color((x + y) % 2);
+				break;
+			case 2:
+				pixel = color((y * 4 + x / 64) % 252);
+				break;
+			case 3:
+				pixel = color((x / 16 + y / 16 * 16) % 252);
+				if ((x ^ y) & 8)
+					pixel = color(251 - (x + y) % 4);
+				break;
+			case 4:
+				pixel = color(rand() % 252);
+				break;
+			default:
+				return NULL;
+			}
+			frame[y * DS_SCREEN_WIDTH + x] = pixel | ((rand() & 1) << 15);
+		}
+	}
+
+	switch (test) {
+	case 0: return "solid";
+	case 1: return "dither";
+	case 2: return "bands";
+	case 3: return "tiles";
+	default: return "noise";
+	}
+}
+
+static double elapsed_ns(const struct timespec* start, const struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main(void)
+{
+	static struct dcache_model cache;
+	unsigned int test;
+	const char* name;
+
+	srand(1);
+	printf("%-6s %7s | %10s %12s | %14s %16s\n",
+		"frame", "colors", "direct ns", "2-level ns", "direct misses", "2-level misses");
+
+	for (test = 0; (name = make_frame(test)) != NULL; test++) {
+		struct timespec start, end;
+		double direct_ns, two_level_ns;
+		unsigned long direct_misses, two_level_misses;
+		size_t count = make_palette(), i;
+
+		if (count == 0) {
+			fprintf(stderr, "%s: too many colors\n", name);
+			return 1;
+		}
+
+		_make_rev_palette(0, count);
+		make_two_level(count);
+		direct_encode();
+		two_level_encode();
+		if (memcmp(direct_out, two_level_out, FRAME_PIXELS) != 0) {
+			fprintf(stderr, "%s: encoders disagree\n", name);
+			return 1;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < TIMED_FRAMES; i++) {
+			_make_rev_palette(0, count);
+			direct_encode();
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		direct_ns = elapsed_ns(&start, &end) / TIMED_FRAMES;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < TIMED_FRAMES; i++) {
+			make_two_level(count);
+			two_level_encode();
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		two_level_ns = elapsed_ns(&start, &end) / TIMED_FRAMES;
+
+		dcache_reset(&cache);
+		direct_trace(&cache);
+		direct_misses = cache.misses;
+		dcache_reset(&cache);
+		two_level_trace(&cache);
+		two_level_misses = cache.misses;
+
+		printf("%-6s %7zu | %10.0f %12.0f | %14lu %16lu\n",
+			name, count, direct_ns, two_level_ns, direct_misses, two_level_misses);
+	}
+
+	return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dcache_model.h"
+
+void dcache_reset(struct dcache_model* cache)
+{
+	dcache_invalidate(cache);
+	cache->accesses = 0;
+	cache->misses = 0;
+}
+
+void dcache_invalidate(struct dcache_model* cache)
+{
+	size_t set, way;
+
+	for (set = 0; set < DCACHE_SETS; set++)
+		for (way = 0; way < DCACHE_WAYS; way++)
+			cache->lines[set][way] = UINT32_MAX;
+}
+
+void dcache_access(struct dcache_model* cache, uint32_t address)
+{
+	uint32_t line = address / DCACHE_LINE_SIZE;
+	uint32_t* ways = cache->lines[line % DCACHE_SETS];
+	size_t way;
+
+	cache->accesses++;
+	for (way = 0; way < DCACHE_WAYS - 1; way++) {
+		if (ways[way] == line)
+			break;
+	}
+	if (ways[way] != line)
+		cache->misses++;
+
+	/* Move the line to the front. On a miss, the last way is replaced. */
+	for (; way > 0; way--)
+		ways[way] = ways[way - 1];
+	ways[0] = line;
+}
@@ -0,0 +1,56 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TESTS_DCACHE_MODEL_H__
+#define __TESTS_DCACHE_MODEL_H__
+
+#include <stdint.h>
+
+/*
+ * A model of the JZ4740's data cache: 16 KiB, 4-way set associative, with
+ * 32-byte lines. Replacement is modeled as LRU within a set.
+ *
+ * Benchmarks feed it the addresses that a kernel loads, in order, to count
+ * the misses that the kernel would take on the DSTwo. The addresses are
+ * simulated ones chosen by the benchmark, not host addresses.
+ */
+
+#define DCACHE_SIZE      16384
+#define DCACHE_LINE_SIZE 32
+#define DCACHE_WAYS      4
+#define DCACHE_SETS      (DCACHE_SIZE / DCACHE_LINE_SIZE / DCACHE_WAYS)
+
+struct dcache_model {
+	/* For each set, the line addresses held by each way, from the most
+	 * recently used to the least recently used. UINT32_MAX if empty. */
+	uint32_t lines[DCACHE_SETS][DCACHE_WAYS];
+	unsigned long accesses;
+	unsigned long misses;
+};
+
+/* Empties the cache and zeroes the counters. */
+extern void dcache_reset(struct dcache_model* cache);
+
+/* Empties the cache, keeping the counters. */
+extern void dcache_invalidate(struct dcache_model* cache);
+
+/* Records an access to the given simulated address. */
+extern void dcache_access(struct dcache_model* cache, uint32_t address);
+
+#endif /* !__TESTS_DCACHE_MODEL_H__ */
@@ -0,0 +1,346 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "fat_host.h"
+
+/* This file uses the build machine's heap itself. */
+#undef malloc
+#undef memalign
+#undef realloc
+#undef free
+
+#define SECTOR_SIZE 512
+
+#define RESERVED_SECTORS 32
+
+uint8_t* ramdisc;
+sec_t ramdisc_sectors;
+
+struct ramdisc_stats ramdisc_stats;
+
+/* Where the first File Allocation Table is, for counting reads of it. */
+static sec_t fat_start, fat_sectors;
+
+/* The transfer started in the background, if 'pending' is true. */
+static bool pending, pending_write;
+static sec_t pending_sector, pending_count;
+static void* pending_buffer;
+
+void ramdisc_create(sec_t sectors)
+{
+	free(ramdisc);
+	ramdisc = calloc(sectors, SECTOR_SIZE);
+	if (ramdisc == NULL) {
+		fprintf(stderr, "no memory for a disc of %lu sectors\n", (unsigned long) sectors);
+		exit(1);
+	}
+	ramdisc_sectors = sectors;
+	fat_start = fat_sectors = 0;
+	pending = false;
+}
+
+static void put_16(uint8_t* p, uint16_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+}
+
+static void put_32(uint8_t* p, uint32_t value)
+{
+	put_16(p, value);
+	put_16(p + 2, value >> 16);
+}
+
+void ramdisc_format_fat32(unsigned int sectors_per_cluster)
+{
+	uint8_t* boot = ramdisc;
+	uint32_t clusters = (ramdisc_sectors - RESERVED_SECTORS) / sectors_per_cluster;
+	/* This counts the FATs' own sectors as clusters, so it's a bit large. */
+	uint32_t sectors_per_fat = ((clusters + 2) * 4 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	unsigned int fat;
+
+	clusters = (ramdisc_sectors - RESERVED_SECTORS - 2 * sectors_per_fat) / sectors_per_cluster;
+	if (clusters < 65525) {
+		fprintf(stderr, "%lu sectors make %lu clusters, too few for FAT32\n",
+			(unsigned long) ramdisc_sectors, (unsigned long) clusters);
+		exit(1);
+	}
+
+	memset(ramdisc, 0, (size_t) ramdisc_sectors * SECTOR_SIZE);
+
+	memcpy(boot, "\xEB\x58\x90" "MSWIN4.1", 11);
+	put_16(boot + 0x0B, SECTOR_SIZE);
+	boot[0x0D] = sectors_per_cluster;
+	put_16(boot + 0x0E, RESERVED_SECTORS);
+	boot[0x10] = 2;                       /* FATs */
+	boot[0x15] = 0xF8;                    /* fixed disc */
+	put_32(boot + 0x20, ramdisc_sectors);
+	put_32(boot + 0x24, sectors_per_fat);
+	put_32(boot + 0x2C, 2);               /* root directory cluster */
+	put_16(boot + 0x30, 1);               /* FSInfo sector, left for libfat to make */
+	boot[0x40] = 0x80;
+	boot[0x42] = 0x29;
+	memcpy(boot + 0x47, "NO NAME    FAT32   ", 19);
+	boot[0x1FE] = 0x55;
+	boot[0x1FF] = 0xAA;
+
+	for (fat = 0; fat < 2; fat++) {
+		uint8_t* entries = ramdisc + (RESERVED_SECTORS + fat * sectors_per_fat) * SECTOR_SIZE;
+		put_32(entries, UINT32_C(0x0FFFFFF8));
+		put_32(entries + 4, UINT32_C(0x0FFFFFFF));
+		put_32(entries + 8, UINT32_C(0x0FFFFFFF)); /* the root directory */
+	}
+
+	fat_start = RESERVED_SECTORS;
+	fat_sectors = sectors_per_fat;
+}
+
+void ramdisc_reset_stats(void)
+{
+	memset(&ramdisc_stats, 0, sizeof(ramdisc_stats));
+}
+
+static void check_range(sec_t sector, sec_t count)
+{
+	if (count == 0 || sector >= ramdisc_sectors || count > ramdisc_sectors - sector) {
+		fprintf(stderr, "transfer of %lu sectors at %lu is outside the disc\n",
+			(unsigned long) count, (unsigned long) sector);
+		abort();
+	}
+}
+
+static void count_read(sec_t sector, sec_t count)
+{
+	sec_t first = sector > fat_start ? sector : fat_start,
+	      end = sector + count < fat_start + fat_sectors ? sector + count : fat_start + fat_sectors;
+
+	ramdisc_stats.reads++;
+	ramdisc_stats.sectors_read += count;
+	if (end > first)
+		ramdisc_stats.fat_sectors_read += end - first;
+}
+
+static void count_write(sec_t count)
+{
+	ramdisc_stats.writes++;
+	ramdisc_stats.sectors_written += count;
+}
+
+/* Moves the data of the transfer started in the background, if any. */
+static void finish_pending(void)
+{
+	if (!pending)
+		return;
+	pending = false;
+	if (pending_write)
+		memcpy(ramdisc + (size_t) pending_sector * SECTOR_SIZE, pending_buffer, (size_t) pending_count * SECTOR_SIZE);
+	else
+		memcpy(pending_buffer, ramdisc + (size_t) pending_sector * SECTOR_SIZE, (size_t) pending_count * SECTOR_SIZE);
+}
+
+static bool ramdisc_startup(void)
+{
+	return true;
+}
+
+static bool ramdisc_is_inserted(void)
+{
+	return true;
+}
+
+static bool ramdisc_read_sectors(sec_t sector, sec_t count, void* buffer)
+{
+	finish_pending();
+	check_range(sector, count);
+	count_read(sector, count);
+	memcpy(buffer, ramdisc + (size_t) sector * SECTOR_SIZE, (size_t) count * SECTOR_SIZE);
+	return true;
+}
+
+static bool ramdisc_write_sectors(sec_t sector, sec_t count, const void* buffer)
+{
+	finish_pending();
+	check_range(sector, count);
+	count_write(count);
+	memcpy(ramdisc + (size_t) sector * SECTOR_SIZE, buffer, (size_t) count * SECTOR_SIZE);
+	return true;
+}
+
+static bool ramdisc_clear_status(void)
+{
+	return true;
+}
+
+static bool ramdisc_shutdown(void)
+{
+	finish_pending();
+	return true;
+}
+
+/* Returns true if the card driver would move this buffer by DMA. */
+static bool dma_capable(const void* buffer, sec_t count)
+{
+	return ((uintptr_t) buffer & 31) == 0 && ((size_t) count * SECTOR_SIZE & 31) == 0;
+}
+
+static bool ramdisc_start_read_sectors(sec_t sector, sec_t count, void* buffer)
+{
+	if (!dma_capable(buffer, count)) {
+		ramdisc_stats.unaligned_starts++;
+		return ramdisc_read_sectors(sector, count, buffer);
+	}
+	finish_pending();
+	check_range(sector, count);
+	count_read(sector, count);
+	ramdisc_stats.started_reads++;
+	/* Anything that reads the buffer too early gets this. */
+	memset(buffer, 0xA5, (size_t) count * SECTOR_SIZE);
+	pending = true;
+	pending_write = false;
+	pending_sector = sector;
+	pending_count = count;
+	pending_buffer = buffer;
+	return true;
+}
+
+static bool ramdisc_start_write_sectors(sec_t sector, sec_t count, const void* buffer)
+{
+	if (!dma_capable(buffer, count)) {
+		ramdisc_stats.unaligned_starts++;
+		return ramdisc_write_sectors(sector, count, buffer);
+	}
+	finish_pending();
+	check_range(sector, count);
+	count_write(count);
+	ramdisc_stats.started_writes++;
+	pending = true;
+	pending_write = true;
+	pending_sector = sector;
+	pending_count = count;
+	pending_buffer = (void*) buffer;
+	return true;
+}
+
+/* A transfer is busy when asked once, then done, like a short one on the
+ * card. */
+static bool ramdisc_is_busy(void)
+{
+	bool busy = pending;
+	finish_pending();
+	return busy;
+}
+
+static bool ramdisc_wait_transfer(void)
+{
+	finish_pending();
+	return true;
+}
+
+const DISC_INTERFACE __io_scds2 = {
+	0x32534453, /* 'SDS2' */
+	FEATURE_MEDIUM_CANREAD | FEATURE_MEDIUM_CANWRITE | FEATURE_MEDIUM_ASYNC,
+	ramdisc_startup,
+	ramdisc_is_inserted,
+	ramdisc_read_sectors,
+	ramdisc_write_sectors,
+	ramdisc_clear_status,
+	ramdisc_shutdown,
+	ramdisc_start_read_sectors,
+	ramdisc_start_write_sectors,
+	ramdisc_is_busy,
+	ramdisc_wait_transfer
+};
+
+/* Each allocation is preceded by the address that the build machine's heap
+ * gave and the size that was asked for. */
+struct heap_header {
+	void* block;
+	size_t size;
+};
+
+static void* heap_allocate(size_t alignment, size_t misalignment, size_t size)
+{
+	uint8_t* block = malloc(sizeof(struct heap_header) + alignment + misalignment + size);
+	uintptr_t p;
+	struct heap_header* header;
+
+	if (block == NULL)
+		return NULL;
+	p = ((uintptr_t) block + sizeof(struct heap_header) + alignment - 1) & ~(uintptr_t) (alignment - 1);
+	p += misalignment;
+	header = (struct heap_header*) p - 1;
+	header->block = block;
+	header->size = size;
+	return (void*) p;
+}
+
+void* fat_host_malloc(size_t size)
+{
+	return heap_allocate(32, 8, size);
+}
+
+void* fat_host_memalign(size_t alignment, size_t size)
+{
+	if (alignment < 8)
+		alignment = 8;
+	return heap_allocate(alignment, 0, size);
+}
+
+void* fat_host_realloc(void* p, size_t size)
+{
+	void* q = heap_allocate(32, 8, size);
+
+	if (q != NULL && p != NULL) {
+		size_t old_size = ((struct heap_header*) p - 1)->size;
+		memcpy(q, p, old_size < size ? old_size : size);
+		fat_host_free(p);
+	}
+	return q;
+}
+
+void fat_host_free(void* p)
+{
+	if (p != NULL)
+		free(((struct heap_header*) p - 1)->block);
+}
+
+void* fat_host_alloc_file(size_t size)
+{
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	void* p;
+
+#ifdef MAP_32BIT
+	flags |= MAP_32BIT;
+#endif
+	p = mmap((void*) (uintptr_t) 0x10000000, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (p == MAP_FAILED || (uintptr_t) p + size > (uintptr_t) 0x80000000) {
+		fprintf(stderr, "can't map a file structure in the low 2 GiB\n");
+		exit(1);
+	}
+	memset(p, 0, size);
+	return p;
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TESTS_FAT_HOST_H__
+#define __TESTS_FAT_HOST_H__
+
+/*
+ * A disc in the memory of the build machine, standing in for the microSD
+ * card under libfat. It counts the commands that libfat sends it, and it
+ * takes background transfers like the card driver does: a started read
+ * only fills its buffer once it is waited for or another command comes, and
+ * only buffers that DMA could use are moved in the background.
+ *
+ * It is __io_scds2, so that libfat's disc.c links against it.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+#include <disc_io.h>
+
+struct ramdisc_stats {
+	/* Read and write commands, whether synchronous or started. */
+	unsigned long reads;
+	unsigned long writes;
+	unsigned long sectors_read;
+	unsigned long sectors_written;
+	/* Read and write commands that were started in the background. */
+	unsigned long started_reads;
+	unsigned long started_writes;
+	/* Read and write commands that were asked to start in the background on
+	 * buffers that the card driver can't move by DMA, because they don't
+	 * start and end on a 32-byte cache line. The driver moves those before
+	 * returning, and so does this disc. */
+	unsigned long unaligned_starts;
+	/* Reads of sectors of the first File Allocation Table. */
+	unsigned long fat_sectors_read;
+};
+
+/* The contents of the disc. */
+extern uint8_t* ramdisc;
+extern sec_t ramdisc_sectors;
+
+extern struct ramdisc_stats ramdisc_stats;
+
+/* Makes a disc of the given number of 512-byte sectors, all zero. Exits the
+ * program if there is not enough memory. */
+extern void ramdisc_create(sec_t sectors);
+
+/* Formats the disc as one FAT32 volume without a partition table, with the
+ * given number of sectors per cluster and an empty root directory. There must
+ * be enough sectors for FAT32, which is at least 65525 clusters. */
+extern void ramdisc_format_fat32(unsigned int sectors_per_cluster);
+
+/* Sets all counters in ramdisc_stats to 0. */
+extern void ramdisc_reset_stats(void);
+
+/* The heap of the DSTwo only aligns allocations to 8 bytes unless memalign
+ * is asked for more, whereas the build machine's aligns them to 16 and often
+ * to more. libfat gets these instead, whose allocations from malloc and
+ * realloc are 8 bytes past a 32-byte boundary, so that buffers that the card
+ * driver could not move by DMA show up as such in ramdisc_stats. */
+extern void* fat_host_malloc(size_t size);
+extern void* fat_host_memalign(size_t alignment, size_t size);
+extern void* fat_host_realloc(void* p, size_t size);
+extern void fat_host_free(void* p);
+
+#define malloc(size)               fat_host_malloc(size)
+#define memalign(alignment, size)  fat_host_memalign(alignment, size)
+#define realloc(p, size)           fat_host_realloc(p, size)
+#define free(p)                    fat_host_free(p)
+
+/* Allocates memory for a FILE_STRUCT. libfat passes files around as int
+ * descriptors holding their address, so they must be in the low 2 GiB of
+ * the address space of the build machine. Exits the program on failure. */
+extern void* fat_host_alloc_file(size_t size);
+
+#endif /* !__TESTS_FAT_HOST_H__ */
@@ -0,0 +1,127 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Checks that _audio_encoding_0 sends the samples between two positions of
+ * the audio ring in order, and that every reply is exactly 512 bytes long,
+ * for each sample size, for rings of even and odd sizes, from every start
+ * position and for every number of samples that fits in a reply.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "audio_encoding_0.h"
+#include "card_protocol.h"
+#include "globals.h"
+
+/* The reply as the Nintendo DS would receive it. */
+static uint8_t reply[1024];
+static size_t reply_len;
+
+static void reply_bytes(const void* data, size_t len)
+{
+	if (reply_len + len <= sizeof(reply))
+		memcpy(&reply[reply_len], data, len);
+	reply_len += len;
+}
+
+void _send_reply_4(uint32_t word)
+{
+	reply_bytes(&word, 4);
+}
+
+void _send_reply(const void* data, size_t len)
+{
+	reply_bytes(data, len);
+}
+
+void _send_reply_2(const uint16_t* data, size_t count)
+{
+	reply_bytes(data, count * 2);
+}
+
+void _send_reply_zero(size_t len)
+{
+	static const uint8_t zero[1024];
+	reply_bytes(zero, len);
+}
+
+static uint8_t ring[4096 + 2] __attribute__((aligned (4)));
+
+/* Checks every start position and sample count for one ring. Returns 0 on
+ * success or 1 on failure. */
+static int check_ring(size_t size_shift, size_t samples)
+{
+	size_t size = samples << size_shift;
+	size_t max_samples = 508 >> size_shift;
+	size_t send, count, i;
+
+	_ds2_ds.snd_buffer = ring;
+	_ds2_ds.snd_size_shift = size_shift;
+	_ds2_ds.snd_samples = samples;
+	for (i = 0; i < size; i++)
+		ring[i] = i * 7 + 1;
+
+	for (send = 0; send < samples; send++) {
+		/* The ring holds at most samples - 1 samples. */
+		for (count = 1; count < samples && count <= max_samples + 1; count++) {
+			size_t write = (send + count) % samples;
+			size_t expected = count < max_samples ? count : max_samples;
+			size_t result, bytes = expected << size_shift;
+			uint32_t header;
+
+			reply_len = 0;
+			result = _audio_encoding_0(send, write);
+			memcpy(&header, reply, 4);
+
+			if (result != expected || reply_len != 512
+			 || header != (DATA_KIND_AUDIO | DATA_ENCODING(0) | DATA_BYTE_COUNT(bytes))) {
+				fprintf(stderr, "shift %zu, ring of %zu samples, send %zu, %zu samples: "
+					"%zu samples in a reply of %zu bytes\n",
+					size_shift, samples, send, count, result, reply_len);
+				return 1;
+			}
+			for (i = 0; i < bytes; i++) {
+				if (reply[4 + i] != ring[((send << size_shift) + i) % size]) {
+					fprintf(stderr, "shift %zu, ring of %zu samples, send %zu, %zu samples: "
+						"wrong byte %zu\n", size_shift, samples, send, count, i);
+					return 1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+int main(void)
+{
+	static const size_t ring_samples[] = { 2, 3, 17, 254, 255, 509, 600, 1023, 1024 };
+	size_t shift, i;
+
+	for (shift = 0; shift <= 2; shift++)
+		for (i = 0; i < sizeof(ring_samples) / sizeof(ring_samples[0]); i++)
+			if (check_ring(shift, ring_samples[i]) != 0)
+				return 1;
+
+	printf("all replies are 512 bytes and in order\n");
+	return 0;
+}
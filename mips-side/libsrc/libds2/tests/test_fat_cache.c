@@ -0,0 +1,198 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Checks the libfat sector cache against a plain copy of the disc, with
+ * random reads, writes, partial writes, prefetches, including ones in the
+ * background, reads and writes that go around the cache, write-backs and
+ * invalidations, for caches from 2 to 5000
+ * pages, so that the hash table and the LRU list are checked both when
+ * everything fits and when pages are replaced all the time.
+ *
+ * After each cache is destroyed, the disc must hold everything written.
+ *
+ * Before that, it checks that a flush writes adjacent dirty pages together.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "fat_host.h"
+
+#define DISC_SECTORS 100000
+#define SECTOR_SIZE 512
+
+#define ROUNDS 50000
+
+/* What the disc would hold if the cache wrote everything through. */
+static uint8_t reference[DISC_SECTORS * SECTOR_SIZE];
+
+static uint8_t buffer[300 * SECTOR_SIZE];
+
+static void fill_random(uint8_t* data, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		data[i] = rand();
+}
+
+/* Does one random operation on the cache. Returns false if the cache failed
+ * or gave data that does not match the reference. */
+static bool random_operation(CACHE* cache)
+{
+	sec_t count = (rand() % 50 == 0) ? 1 + rand() % 300 : 1 + rand() % 8;
+	sec_t sector = rand() % (DISC_SECTORS - count);
+	uint8_t* expected = &reference[sector * SECTOR_SIZE];
+	size_t len = count * SECTOR_SIZE;
+
+	switch (rand() % 9) {
+	case 0:
+		fill_random(buffer, len);
+		memcpy(expected, buffer, len);
+		return _FAT_cache_writeSectors(cache, sector, count, buffer);
+
+	case 1:
+	{
+		uint32_t value = rand();
+		unsigned int offset = rand() % (SECTOR_SIZE - 4);
+		memcpy(expected + offset, &value, 4);
+		return _FAT_cache_writeLittleEndianValue(cache, value, sector, offset, 4);
+	}
+
+	case 2:
+	{
+		unsigned int offset = rand() % SECTOR_SIZE, size = 1 + rand() % (SECTOR_SIZE - offset);
+		return _FAT_cache_readPartialSector(cache, buffer, sector, offset, size)
+		    && memcmp(buffer, expected + offset, size) == 0;
+	}
+
+	case 3:
+		if (!_FAT_cache_prefetch(cache, sector, count * 8))
+			return false;
+		break;
+
+	case 4:
+		/* The next operation finds the pages on their way in. */
+		if (!_FAT_cache_startPrefetch(cache, sector, count * 8))
+			return false;
+		return true;
+
+	case 5:
+		/* Cached pages in the range are newer than the disc, if dirty. */
+		return _FAT_cache_readSectorsDirect(cache, sector, count, buffer)
+		    && memcmp(buffer, expected, len) == 0;
+
+	case 6:
+		/* Cached pages in the range must take the new data too. */
+		fill_random(buffer, len);
+		memcpy(expected, buffer, len);
+		if (!_FAT_cache_writeSectorsDirect(cache, sector, count, buffer))
+			return false;
+		break;
+
+	case 7:
+		/* After a write-back, the disc must hold the latest data. */
+		if (!_FAT_cache_syncRange(cache, sector, count, rand() & 1))
+			return false;
+		if (memcmp(&ramdisc[sector * SECTOR_SIZE], expected, len) != 0)
+			return false;
+		break;
+	}
+
+	return _FAT_cache_readSectors(cache, sector, count, buffer)
+	    && memcmp(buffer, expected, len) == 0;
+}
+
+/* Dirties 40 adjacent pages of a cache of 64, from the last to the first,
+ * then flushes them. They must reach the disc in as few writes as the
+ * cache's staging buffer allows, not one write per page. */
+static bool check_coalesced_flush(void)
+{
+	CACHE* cache = _FAT_cache_constructor(64, 8, &__io_scds2, DISC_SECTORS, SECTOR_SIZE);
+	sec_t first = 8000, count = 40 * 8, page, most_writes;
+	bool ok;
+
+	if (cache == NULL)
+		return false;
+	for (page = count; page > 0; page -= 8) {
+		fill_random(buffer, 8 * SECTOR_SIZE);
+		memcpy(&reference[(first + page - 8) * SECTOR_SIZE], buffer, 8 * SECTOR_SIZE);
+		if (!_FAT_cache_writeSectors(cache, first + page - 8, 8, buffer))
+			return false;
+	}
+
+	ramdisc_reset_stats();
+	most_writes = (count + cache->readAheadSectors - 1) / cache->readAheadSectors;
+	ok = _FAT_cache_flush(cache)
+	  && memcmp(&ramdisc[first * SECTOR_SIZE], &reference[first * SECTOR_SIZE], count * SECTOR_SIZE) == 0;
+	printf("flushing 40 adjacent dirty pages: %lu writes\n", ramdisc_stats.writes);
+	if (ramdisc_stats.writes > most_writes) {
+		fprintf(stderr, "the flush should take at most %lu writes\n", (unsigned long) most_writes);
+		ok = false;
+	}
+	_FAT_cache_destructor(cache);
+	return ok;
+}
+
+int main(void)
+{
+	static const unsigned int pages[] = { 2, 16, 100, 1000, 5000 };
+	size_t p;
+
+	ramdisc_create(DISC_SECTORS);
+	srand(1);
+	fill_random(ramdisc, sizeof(reference));
+	memcpy(reference, ramdisc, sizeof(reference));
+
+	if (!check_coalesced_flush())
+		return 1;
+
+	for (p = 0; p < sizeof(pages) / sizeof(pages[0]); p++) {
+		CACHE* cache = _FAT_cache_constructor(pages[p], 8, &__io_scds2, DISC_SECTORS, SECTOR_SIZE);
+		unsigned long round;
+
+		if (cache == NULL) {
+			fprintf(stderr, "%u pages: no cache\n", pages[p]);
+			return 1;
+		}
+		for (round = 0; round < ROUNDS; round++) {
+			if (!random_operation(cache)) {
+				fprintf(stderr, "%u pages, round %lu: wrong data or failure\n", pages[p], round);
+				return 1;
+			}
+			if (round % 12500 == 12499)
+				_FAT_cache_invalidate(cache);
+		}
+		_FAT_cache_destructor(cache);
+
+		if (memcmp(ramdisc, reference, sizeof(reference)) != 0) {
+			fprintf(stderr, "%u pages: the disc misses some writes\n", pages[p]);
+			return 1;
+		}
+	}
+
+	printf("%zu cache sizes match the reference\n", sizeof(pages) / sizeof(pages[0]));
+	return 0;
+}
@@ -0,0 +1,660 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Checks reads, writes, seeks and truncations of files through libfat on a
+ * FAT32 image in memory, against a copy of what the files should hold, and
+ * counts the commands that they send to the disc and what they leave in the
+ * cache. Then checks the names in a large folder, against a model of what it
+ * should hold, as files and folders are created, removed and renamed in it.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <fat.h>
+
+#include "cache.h"
+#include "directory.h"
+#include "fat_host.h"
+#include "fatdir.h"
+#include "fatfile.h"
+#include "partition.h"
+
+/* 96 MiB, in clusters of 1 KiB, is enough clusters for FAT32. */
+#define DISC_SECTORS (96 * 2048)
+#define SECTORS_PER_CLUSTER 2
+#define SECTOR_SIZE 512
+
+#define CACHE_PAGES 64
+#define SECTORS_PER_PAGE 8
+
+#define FILE_SIZE (2 * 1024 * 1024)
+
+/* The largest size of the fragmented file in check_fragmented_seeks. */
+#define FRAGMENTED_MAX (8 * 1024 * 1024)
+
+#define CHUNK_SIZE (16 * 1024)
+
+/* Names that check_directory_operations may use in its large folder. */
+#define DIR_SLOTS 400
+
+#define DIR_ROUNDS 4000
+
+/* Folders besides the large one that check_directory_operations looks in,
+ * so that their name indexes take the place of the large folder's. */
+#define DEEP_PATH  "fat:/d0/d1/d2/d3/d4/d5"
+#define SIDE_DIRS  5
+
+enum slot_state {
+	SLOT_ABSENT,
+	SLOT_FILE,
+	SLOT_DIR
+};
+
+static FILE_STRUCT* file;
+static FILE_STRUCT* other;
+
+/* What the file should hold. */
+static uint8_t expected[FILE_SIZE];
+
+static uint8_t buffer[FILE_SIZE];
+
+/* What the fragmented file should hold. */
+static uint8_t fragmented[FRAGMENTED_MAX];
+
+/* What each name in the large folder should be, and what each file there
+ * should hold. */
+static enum slot_state slot_states[DIR_SLOTS];
+static uint32_t slot_values[DIR_SLOTS];
+
+/* Writes a file of FILE_SIZE random bytes. Returns false on failure. */
+static bool make_file(const char* path)
+{
+	int fd = _FAT_open(file, path, O_WRONLY | O_CREAT | O_TRUNC, 0);
+	size_t i;
+
+	if (fd == -1)
+		return false;
+	for (i = 0; i < FILE_SIZE; i++)
+		expected[i] = rand();
+	if (_FAT_write(fd, (const char*) expected, FILE_SIZE) != FILE_SIZE)
+		return false;
+	return _FAT_close(fd) == 0;
+}
+
+/* Reads the file in small pieces from start to end, as a player streams a
+ * movie. The pieces must be read ahead in the background, in transfers of
+ * many sectors, each sector once. */
+static bool check_sequential_reads(const char* path)
+{
+	int fd = _FAT_open(file, path, O_RDONLY, 0);
+	size_t pos = 0;
+	ssize_t n;
+
+	if (fd == -1)
+		return false;
+	ramdisc_reset_stats();
+	while ((n = _FAT_read(fd, (char*) buffer, 700)) > 0) {
+		if (memcmp(buffer, expected + pos, n) != 0) {
+			fprintf(stderr, "sequential reads: wrong data at %zu\n", pos);
+			return false;
+		}
+		pos += n;
+	}
+	if (n != 0 || pos != FILE_SIZE || _FAT_close(fd) != 0) {
+		fprintf(stderr, "sequential reads: stopped at %zu\n", pos);
+		return false;
+	}
+
+	printf("sequential reads: %lu commands, %lu in the background, for %lu sectors\n",
+		ramdisc_stats.reads, ramdisc_stats.started_reads, ramdisc_stats.sectors_read);
+	if (ramdisc_stats.unaligned_starts != 0) {
+		fprintf(stderr, "sequential reads: %lu reads ahead into buffers that DMA can't use\n",
+			ramdisc_stats.unaligned_starts);
+		return false;
+	}
+	if (ramdisc_stats.started_reads == 0
+	 || ramdisc_stats.sectors_read - ramdisc_stats.fat_sectors_read > FILE_SIZE / SECTOR_SIZE + SECTORS_PER_PAGE) {
+		fprintf(stderr, "sequential reads: no reading ahead, or sectors read twice\n");
+		return false;
+	}
+	return true;
+}
+
+/* Reads and writes random runs of the file, which reads ahead during the
+ * runs of small reads, so that writes come while pages are on their way. */
+static bool check_mixed_access(const char* path)
+{
+	int fd = _FAT_open(file, path, O_RDWR, 0);
+	unsigned int round;
+
+	if (fd == -1)
+		return false;
+	for (round = 0; round < 2000; round++) {
+		size_t pos = rand() % FILE_SIZE, len = 1 + rand() % 3000, i;
+
+		if (pos + len > FILE_SIZE)
+			len = FILE_SIZE - pos;
+		if (_FAT_seek(fd, pos, SEEK_SET) != (off_t) pos)
+			return false;
+
+		if (rand() % 4 == 0) {
+			for (i = 0; i < len; i++)
+				buffer[i] = expected[pos + i] = rand();
+			if (_FAT_write(fd, (const char*) buffer, len) != (ssize_t) len)
+				return false;
+		} else {
+			/* A run of small sequential reads. */
+			while (len > 0) {
+				size_t piece = len < 300 ? len : 300;
+				if (_FAT_read(fd, (char*) buffer, piece) != (ssize_t) piece
+				 || memcmp(buffer, expected + pos, piece) != 0) {
+					fprintf(stderr, "mixed access, round %u: wrong data at %zu\n", round, pos);
+					return false;
+				}
+				pos += piece;
+				len -= piece;
+			}
+		}
+	}
+	if (_FAT_close(fd) != 0)
+		return false;
+
+	/* Everything must be on the disc after an unmount and a mount. */
+	fatUnmount("fat");
+	if (!fatMount("fat", &__io_scds2, 0, CACHE_PAGES, SECTORS_PER_PAGE))
+		return false;
+	fd = _FAT_open(file, path, O_RDONLY, 0);
+	if (fd == -1 || _FAT_read(fd, (char*) buffer, FILE_SIZE) != FILE_SIZE
+	 || memcmp(buffer, expected, FILE_SIZE) != 0 || _FAT_close(fd) != 0) {
+		fprintf(stderr, "mixed access: the file is wrong after mounting again\n");
+		return false;
+	}
+	printf("mixed access: the file matches\n");
+	return true;
+}
+
+/* Remembers which page each entry of the cache holds. */
+static void get_cached_pages(sec_t* pages)
+{
+	const CACHE* cache = single_partition->cache;
+	unsigned int i;
+
+	for (i = 0; i < cache->numberOfPages; i++)
+		pages[i] = cache->cacheEntries[i].sector;
+}
+
+/* Reads and writes whole clusters of the file in one call each. They must go
+ * around the cache, so that nothing in it is replaced, yet see and update
+ * what it holds. */
+static bool check_direct_access(const char* path)
+{
+	sec_t before[CACHE_PAGES], after[CACHE_PAGES];
+	int fd = _FAT_open(file, path, O_RDWR, 0);
+	size_t i;
+
+	if (fd == -1)
+		return false;
+
+	/* A dirty page in the middle of the first read, newer than the disc. */
+	for (i = 5000; i < 5100; i++)
+		expected[i] = rand();
+	if (_FAT_seek(fd, 5000, SEEK_SET) != 5000
+	 || _FAT_write(fd, (const char*) &expected[5000], 100) != 100)
+		return false;
+
+	get_cached_pages(before);
+	ramdisc_reset_stats();
+	if (_FAT_seek(fd, 0, SEEK_SET) != 0
+	 || _FAT_read(fd, (char*) buffer, FILE_SIZE / 2) != FILE_SIZE / 2
+	 || memcmp(buffer, expected, FILE_SIZE / 2) != 0) {
+		fprintf(stderr, "direct access: wrong data read\n");
+		return false;
+	}
+	get_cached_pages(after);
+	printf("direct read of %u sectors: %lu commands, %lu sectors\n", FILE_SIZE / 2 / SECTOR_SIZE,
+		ramdisc_stats.reads, ramdisc_stats.sectors_read - ramdisc_stats.fat_sectors_read);
+	if (memcmp(before, after, sizeof(before)) != 0
+	 || ramdisc_stats.sectors_read - ramdisc_stats.fat_sectors_read > FILE_SIZE / 2 / SECTOR_SIZE) {
+		fprintf(stderr, "direct access: the read went through the cache\n");
+		return false;
+	}
+
+	for (i = FILE_SIZE / 2; i < FILE_SIZE; i++)
+		expected[i] = rand();
+	ramdisc_reset_stats();
+	if (_FAT_write(fd, (const char*) &expected[FILE_SIZE / 2], FILE_SIZE / 2) != FILE_SIZE / 2)
+		return false;
+	get_cached_pages(after);
+	printf("direct write of %u sectors: %lu commands, %lu sectors\n", FILE_SIZE / 2 / SECTOR_SIZE,
+		ramdisc_stats.writes, ramdisc_stats.sectors_written);
+	if (memcmp(before, after, sizeof(before)) != 0
+	 || ramdisc_stats.sectors_written != FILE_SIZE / 2 / SECTOR_SIZE) {
+		fprintf(stderr, "direct access: the write went through the cache\n");
+		return false;
+	}
+	if (_FAT_close(fd) != 0)
+		return false;
+
+	fatUnmount("fat");
+	if (!fatMount("fat", &__io_scds2, 0, CACHE_PAGES, SECTORS_PER_PAGE))
+		return false;
+	fd = _FAT_open(file, path, O_RDONLY, 0);
+	if (fd == -1 || _FAT_read(fd, (char*) buffer, FILE_SIZE) != FILE_SIZE
+	 || memcmp(buffer, expected, FILE_SIZE) != 0 || _FAT_close(fd) != 0) {
+		fprintf(stderr, "direct access: the file is wrong after mounting again\n");
+		return false;
+	}
+	return true;
+}
+
+/* Appends 'len' random bytes to the fragmented file in chunks, between
+ * chunks of the other file, so that each chunk is an extent of its own.
+ * Returns the new size of the fragmented file, or 0 on failure. */
+static size_t append_fragmented(int fd, int other_fd, size_t size, size_t len)
+{
+	static uint8_t chunk[CHUNK_SIZE];
+	size_t i;
+
+	if (_FAT_seek(fd, 0, SEEK_END) != (off_t) size)
+		return 0;
+	while (len > 0) {
+		size_t n = len < CHUNK_SIZE ? len : CHUNK_SIZE;
+		for (i = 0; i < n; i++)
+			fragmented[size + i] = rand();
+		for (i = 0; i < CHUNK_SIZE; i++)
+			chunk[i] = rand();
+		if (_FAT_write(fd, (const char*) &fragmented[size], n) != (ssize_t) n
+		 || _FAT_write(other_fd, (const char*) chunk, CHUNK_SIZE) != CHUNK_SIZE)
+			return 0;
+		size += n;
+		len -= n;
+	}
+	return size;
+}
+
+/* Seeks to random places in the fragmented file, from the start, the current
+ * position and the end, and reads there. */
+static bool check_random_seeks(int fd, size_t size, const char* stage)
+{
+	unsigned int round;
+
+	for (round = 0; round < 3000; round++) {
+		size_t pos = rand() % (size + 1), len = 1 + rand() % 3000, cur;
+		off_t result;
+		ssize_t n;
+
+		switch (rand() % 3) {
+		case 0:
+			result = _FAT_seek(fd, pos, SEEK_SET);
+			break;
+		case 1:
+			cur = _FAT_seek(fd, 0, SEEK_CUR);
+			result = _FAT_seek(fd, (off_t) pos - (off_t) cur, SEEK_CUR);
+			break;
+		default:
+			result = _FAT_seek(fd, (off_t) pos - (off_t) size, SEEK_END);
+			break;
+		}
+		if (result != (off_t) pos) {
+			fprintf(stderr, "%s, round %u: seek to %zu gave %ld\n", stage, round, pos, (long) result);
+			return false;
+		}
+
+		if (len > size - pos)
+			len = size - pos;
+		n = _FAT_read(fd, (char*) buffer, len);
+		if (n != (ssize_t) len || memcmp(buffer, &fragmented[pos], len) != 0) {
+			fprintf(stderr, "%s, round %u: wrong data at %zu\n", stage, round, pos);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Seeks in a file made of many extents as it grows and shrinks, so that its
+ * extent map must follow every change to its cluster chain. */
+static bool check_fragmented_seeks(void)
+{
+	int fd = _FAT_open(file, "fat:/save.bin", O_RDWR | O_CREAT | O_TRUNC, 0),
+	    other_fd = _FAT_open(other, "fat:/other.bin", O_RDWR | O_CREAT | O_TRUNC, 0);
+	size_t size = 0;
+
+	if (fd == -1 || other_fd == -1)
+		return false;
+
+	if ((size = append_fragmented(fd, other_fd, size, 4 * 1024 * 1024)) == 0
+	 || !check_random_seeks(fd, size, "fragmented file"))
+		return false;
+
+	/* Growing appends to the map. */
+	if ((size = append_fragmented(fd, other_fd, size, 1024 * 1024 + 700)) == 0
+	 || !check_random_seeks(fd, size, "after growing"))
+		return false;
+
+	/* Shrinking trims it, in the middle of a cluster, then on a boundary. */
+	size = 3 * 1024 * 1024 + 123;
+	if (_FAT_ftruncate(fd, size) != 0 || !check_random_seeks(fd, size, "after truncating"))
+		return false;
+	if ((size = append_fragmented(fd, other_fd, size, 2 * 1024 * 1024)) == 0
+	 || !check_random_seeks(fd, size, "after growing again"))
+		return false;
+	size = 2 * 1024 * 1024;
+	if (_FAT_ftruncate(fd, size) != 0 || !check_random_seeks(fd, size, "after truncating to a cluster"))
+		return false;
+	if ((size = append_fragmented(fd, other_fd, size, 512 * 1024)) == 0
+	 || !check_random_seeks(fd, size, "after growing from a cluster"))
+		return false;
+
+	if (_FAT_close(fd) != 0 || _FAT_close(other_fd) != 0)
+		return false;
+
+	/* The chain on the disc must match the map that was used. */
+	fatUnmount("fat");
+	if (!fatMount("fat", &__io_scds2, 0, CACHE_PAGES, SECTORS_PER_PAGE))
+		return false;
+	fd = _FAT_open(file, "fat:/save.bin", O_RDONLY, 0);
+	if (fd == -1 || !check_random_seeks(fd, size, "after mounting again") || _FAT_close(fd) != 0)
+		return false;
+
+	printf("fragmented seeks: the file matches through every change\n");
+	return true;
+}
+
+/* Makes the path to a name in the large folder. Every name has the same
+ * first 6 letters and the same extension, so every alias has a numeric tail.
+ * If 'upper' is true, the name is in upper case, which must find the same
+ * file. */
+static void slot_path(char* path, size_t slot, bool upper)
+{
+	char* c;
+
+	sprintf(path, "fat:/big/Collide name %zu.data", slot);
+	if (upper)
+		for (c = path + strlen("fat:/big/"); *c != '\0'; c++)
+			*c = toupper((unsigned char) *c);
+}
+
+/* Writes a file holding one value. Returns false on failure. */
+static bool write_value(const char* path, uint32_t value)
+{
+	int fd = _FAT_open(file, path, O_WRONLY | O_CREAT | O_EXCL, 0);
+
+	if (fd == -1)
+		return false;
+	if (_FAT_write(fd, (const char*) &value, sizeof(value)) != sizeof(value)) {
+		_FAT_close(fd);
+		return false;
+	}
+	return _FAT_close(fd) == 0;
+}
+
+/* Returns true if the file holds the given value. */
+static bool read_value(const char* path, uint32_t value)
+{
+	int fd = _FAT_open(file, path, O_RDONLY, 0);
+	uint32_t read = ~value;
+
+	if (fd == -1)
+		return false;
+	if (_FAT_read(fd, (char*) &read, sizeof(read)) != sizeof(read)) {
+		_FAT_close(fd);
+		return false;
+	}
+	return _FAT_close(fd) == 0 && read == value;
+}
+
+/* Returns true if the path names what 'state' says. */
+static bool path_is(const char* path, enum slot_state state)
+{
+	struct stat st;
+
+	if (_FAT_stat(path, &st) != 0)
+		return state == SLOT_ABSENT;
+	return state == (S_ISDIR(st.st_mode) ? SLOT_DIR : SLOT_FILE);
+}
+
+/* Looks up the deep path and the side folders, one after the other. Each
+ * side folder has a file of the same name, holding the number of the
+ * folder. */
+static bool check_other_folders(unsigned int round)
+{
+	char path[64];
+	unsigned int i;
+
+	if (!read_value(DEEP_PATH "/deep.bin", 0xDEE9))
+		return false;
+	for (i = 0; i < SIDE_DIRS; i++) {
+		sprintf(path, "fat:/side%u/file.bin", (i + round) % SIDE_DIRS);
+		if (!read_value(path, (i + round) % SIDE_DIRS))
+			return false;
+	}
+	return true;
+}
+
+/* Makes the alias of a directory entry, as in a path. */
+static void entry_alias(const DIR_ENTRY* entry, char* alias)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < 8 && entry->entryData[i] != ' '; i++)
+		alias[n++] = entry->entryData[i];
+	if (entry->entryData[8] != ' ') {
+		alias[n++] = '.';
+		for (i = 8; i < 11 && entry->entryData[i] != ' '; i++)
+			alias[n++] = entry->entryData[i];
+	}
+	alias[n] = '\0';
+}
+
+/* Reads the large folder as it is on the disc, and checks that it holds
+ * every name in the model and nothing else, that every alias is different,
+ * and that every alias finds the same thing as its name. */
+static bool check_large_folder(void)
+{
+	static char aliases[DIR_SLOTS][13];
+	size_t count = 0, expected_count = 0, slot, i;
+	DIR_ENTRY entry;
+	bool found;
+	char path[64], name[MAX_FILENAME_LENGTH];
+
+	if (!_FAT_directory_entryFromPath(single_partition, &entry, "/big", NULL))
+		return false;
+	found = _FAT_directory_getFirstEntry(single_partition, &entry,
+		_FAT_directory_entryGetCluster(single_partition, entry.entryData));
+	for (; found; found = _FAT_directory_getNextEntry(single_partition, &entry)) {
+		if (_FAT_directory_isDot(&entry))
+			continue;
+		/* Renaming to a name in upper case keeps it in upper case. */
+		for (i = 0; i < MAX_FILENAME_LENGTH; i++)
+			name[i] = tolower((unsigned char) entry.filename[i]);
+		if (sscanf(name, "collide name %zu.data", &slot) != 1 || slot >= DIR_SLOTS
+		 || count == DIR_SLOTS) {
+			fprintf(stderr, "large folder: unexpected name %s\n", entry.filename);
+			return false;
+		}
+		entry_alias(&entry, aliases[count]);
+		for (i = 0; i < count; i++) {
+			if (strcmp(aliases[i], aliases[count]) == 0) {
+				fprintf(stderr, "large folder: alias %s is used twice\n", aliases[i]);
+				return false;
+			}
+		}
+		if (slot_states[slot] != (_FAT_directory_isDirectory(&entry) ? SLOT_DIR : SLOT_FILE)) {
+			fprintf(stderr, "large folder: %s should not be there\n", entry.filename);
+			return false;
+		}
+		sprintf(path, "fat:/big/%s", aliases[count]);
+		if (slot_states[slot] == SLOT_FILE ? !read_value(path, slot_values[slot]) : !path_is(path, SLOT_DIR)) {
+			fprintf(stderr, "large folder: alias %s does not find %s\n", aliases[count], entry.filename);
+			return false;
+		}
+		count++;
+	}
+
+	for (slot = 0; slot < DIR_SLOTS; slot++) {
+		if (slot_states[slot] == SLOT_ABSENT)
+			continue;
+		expected_count++;
+		slot_path(path, slot, false);
+		if (slot_states[slot] == SLOT_FILE ? !read_value(path, slot_values[slot]) : !path_is(path, SLOT_DIR)) {
+			fprintf(stderr, "large folder: %s is missing\n", path);
+			return false;
+		}
+	}
+	if (count != expected_count) {
+		fprintf(stderr, "large folder: %zu names, expected %zu\n", count, expected_count);
+		return false;
+	}
+	return true;
+}
+
+/* Creates, removes and renames files and folders in a large folder whose
+ * aliases all collide, and looks names up in it in either case, while
+ * looking in a deep path and in more folders than there are name indexes. */
+static bool check_directory_operations(void)
+{
+	char path[64], new_path[64];
+	unsigned int round, i;
+
+	if (_FAT_mkdir("fat:/big", 0) != 0)
+		return false;
+	strcpy(path, DEEP_PATH);
+	for (i = strlen("fat:/d0"); i <= strlen(path); i += 3) {
+		path[i] = '\0';
+		if (_FAT_mkdir(path, 0) != 0)
+			return false;
+		path[i] = '/';
+	}
+	if (!write_value(DEEP_PATH "/deep.bin", 0xDEE9))
+		return false;
+	for (i = 0; i < SIDE_DIRS; i++) {
+		sprintf(path, "fat:/side%u", i);
+		if (_FAT_mkdir(path, 0) != 0)
+			return false;
+		sprintf(path, "fat:/side%u/file.bin", i);
+		if (!write_value(path, i))
+			return false;
+	}
+
+	for (i = 0; i < DIR_SLOTS * 3 / 4; i++) {
+		slot_path(path, i, false);
+		slot_values[i] = rand();
+		slot_states[i] = SLOT_FILE;
+		if (!write_value(path, slot_values[i]))
+			return false;
+	}
+
+	for (round = 0; round < DIR_ROUNDS; round++) {
+		size_t slot = rand() % DIR_SLOTS, to = rand() % DIR_SLOTS;
+		enum slot_state state = slot_states[slot];
+		uint32_t value;
+		bool ok;
+
+		slot_path(path, slot, rand() & 1);
+		switch (rand() % 8) {
+		case 0:
+		case 1:
+			/* An existing name, in either case, can't be made again. */
+			value = rand();
+			ok = write_value(path, value) == (state == SLOT_ABSENT);
+			if (state == SLOT_ABSENT) {
+				slot_states[slot] = SLOT_FILE;
+				slot_values[slot] = value;
+			}
+			break;
+		case 2:
+			ok = (_FAT_mkdir(path, 0) == 0) == (state == SLOT_ABSENT);
+			if (state == SLOT_ABSENT)
+				slot_states[slot] = SLOT_DIR;
+			break;
+		case 3:
+			/* The folders are empty, so they can be removed too. */
+			ok = (_FAT_unlink(path) == 0) == (state != SLOT_ABSENT);
+			slot_states[slot] = SLOT_ABSENT;
+			break;
+		case 4:
+			slot_path(new_path, to, rand() & 1);
+			ok = (_FAT_rename(path, new_path) == 0) == (state != SLOT_ABSENT && slot_states[to] == SLOT_ABSENT);
+			if (state != SLOT_ABSENT && slot_states[to] == SLOT_ABSENT) {
+				slot_states[to] = state;
+				slot_values[to] = slot_values[slot];
+				slot_states[slot] = SLOT_ABSENT;
+			}
+			break;
+		default:
+			ok = state == SLOT_FILE ? read_value(path, slot_values[slot]) : path_is(path, state);
+			break;
+		}
+
+		if (!ok || !check_other_folders(round)) {
+			fprintf(stderr, "directory operations, round %u: wrong result for %s\n", round, path);
+			return false;
+		}
+	}
+
+	if (!check_large_folder())
+		return false;
+
+	/* The folder on the disc must match the indexes that were used. */
+	fatUnmount("fat");
+	if (!fatMount("fat", &__io_scds2, 0, CACHE_PAGES, SECTORS_PER_PAGE))
+		return false;
+	if (!check_large_folder() || !check_other_folders(0))
+		return false;
+
+	printf("directory operations: %u rounds match after mounting again\n", DIR_ROUNDS);
+	return true;
+}
+
+int main(void)
+{
+	file = fat_host_alloc_file(sizeof(FILE_STRUCT));
+	other = fat_host_alloc_file(sizeof(FILE_STRUCT));
+	srand(1);
+
+	ramdisc_create(DISC_SECTORS);
+	ramdisc_format_fat32(SECTORS_PER_CLUSTER);
+	if (!fatMount("fat", &__io_scds2, 0, CACHE_PAGES, SECTORS_PER_PAGE)) {
+		fprintf(stderr, "can't mount the image\n");
+		return 1;
+	}
+
+	if (!make_file("fat:/stream.bin")) {
+		fprintf(stderr, "can't write the file\n");
+		return 1;
+	}
+	if (!check_sequential_reads("fat:/stream.bin")
+	 || !check_mixed_access("fat:/stream.bin")
+	 || !check_direct_access("fat:/stream.bin")
+	 || !check_fragmented_seeks()
+	 || !check_directory_operations())
+		return 1;
+
+	fatUnmount("fat");
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Checks the mixer's interpolation against the same interpolation done in
+ * double precision, for one voice, with full-scale sources that make the
+ * fixed-point products as large as they can be.
+ *
+ * The reference uses the same position, step and quantized fraction as the
+ * mixer, so only the fixed-point arithmetic is checked: an overflow shows up
+ * as an error of thousands, while rounding stays within a few units.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ds2/ds.h>
+
+#include "globals.h"
+#include "mixer.h"
+
+#define SOURCE_LENGTH 1000
+#define OUTPUT_SAMPLES 4096
+
+static int16_t source_16[SOURCE_LENGTH];
+static uint8_t source_8[SOURCE_LENGTH];
+static int16_t output[OUTPUT_SAMPLES * 2];
+
+/* Gets a source value as the mixer does for a voice looping from 0. */
+static double source_value(bool is_16bit, int32_t index)
+{
+	if (index < 0)
+		index = 0;
+	index %= SOURCE_LENGTH;
+	return is_16bit ? source_16[index] : ((int32_t) source_8[index] - 128) * 256;
+}
+
+static double reference(bool is_16bit, enum DS2_Interpolation interpolation, uint32_t pos, uint32_t frac)
+{
+	double p0 = source_value(is_16bit, (int32_t) pos - 1),
+	       p1 = source_value(is_16bit, pos),
+	       p2 = source_value(is_16bit, pos + 1),
+	       p3 = source_value(is_16bit, pos + 2), t;
+
+	switch (interpolation) {
+	case DS2_INTERPOLATION_NONE:
+		return p1;
+	case DS2_INTERPOLATION_LINEAR:
+		t = (frac >> 17) / 32768.0;
+		return p1 + (p2 - p1) * t;
+	default:
+		t = (frac >> 21) / 2048.0;
+		return p1 + 0.5 * t * ((p2 - p0) + t * ((2 * p0 - 5 * p1 + 4 * p2 - p3)
+		                                      + t * (3 * (p1 - p2) + p3 - p0)));
+	}
+}
+
+/* Scales a reference value as the mixer does, saturating like its output. */
+static double scale(double value, double gain)
+{
+	value = value * gain / 8192;
+	return value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : value;
+}
+
+/* Mixes one voice and compares it with the reference. Returns the largest
+ * error, in output units. */
+static double check(bool is_16bit, enum DS2_Interpolation interpolation, uint32_t frequency, uint32_t rate, bool stereo)
+{
+	uint64_t step = ((uint64_t) frequency << 32) / rate, position = 0;
+	double gain_left = stereo ? 63 * 127 : 64 * 127, gain_right = 64 * 127;
+	double max_error = 0;
+	size_t i;
+
+	_ds2_ds.snd_freq = rate;
+	_ds2_ds.snd_16bit = true;
+	_ds2_ds.snd_stereo = stereo;
+	_mixer_init();
+	DS2_PlayVoice(0, is_16bit ? (const void*) source_16 : (const void*) source_8,
+		SOURCE_LENGTH, is_16bit, frequency, 0);
+	DS2_SetVoiceInterpolation(0, interpolation);
+	DS2_MixVoices(output, OUTPUT_SAMPLES, NULL);
+
+	for (i = 0; i < OUTPUT_SAMPLES; i++) {
+		uint32_t pos = (position >> 32) % SOURCE_LENGTH, frac = (uint32_t) position;
+		double value = reference(is_16bit, interpolation, pos, frac), error;
+
+		if (stereo) {
+			error = fabs(output[2 * i] - scale(value, gain_left));
+			if (error > max_error)
+				max_error = error;
+			error = fabs(output[2 * i + 1] - scale(value, gain_right));
+		} else {
+			error = fabs(output[i] - scale(value, gain_left));
+		}
+		if (error > max_error)
+			max_error = error;
+		position += step;
+	}
+	return max_error;
+}
+
+int main(void)
+{
+	static const uint32_t frequencies[] = { 7919, 22050, 32768, 44100, 96000 };
+	static const char* const names[] = { "none", "linear", "cubic" };
+	/* Rounding in the mixer, plus truncation by each shift. */
+	static const double tolerances[] = { 1, 2, 4 };
+	size_t i, f, source;
+	int interpolation;
+	bool stereo;
+
+	srand(1);
+	for (source = 0; source < 2; source++) {
+		/* Full-scale square waves first, then noise. */
+		for (i = 0; i < SOURCE_LENGTH; i++) {
+			bool high = source == 0 ? (i & 1) : (rand() & 1);
+			source_16[i] = high ? INT16_MAX : INT16_MIN;
+			source_8[i] = high ? UINT8_MAX : 0;
+			if (source == 1 && (rand() & 1)) {
+				source_16[i] = rand();
+				source_8[i] = rand();
+			}
+		}
+
+		for (interpolation = DS2_INTERPOLATION_NONE; interpolation <= DS2_INTERPOLATION_CUBIC; interpolation++)
+		for (f = 0; f < sizeof(frequencies) / sizeof(frequencies[0]); f++)
+		for (i = 0; i < 2; i++)
+		for (stereo = false; ; stereo = true) {
+			double error = check(i == 0, interpolation, frequencies[f], 32768, stereo);
+			if (error > tolerances[interpolation]) {
+				fprintf(stderr, "%s interpolation, %s source at %u Hz, %s: error of %.1f\n",
+					names[interpolation], i == 0 ? "16-bit" : "8-bit",
+					frequencies[f], stereo ? "stereo" : "mono", error);
+				return 1;
+			}
+			if (stereo)
+				break;
+		}
+	}
+
+	printf("all interpolations within rounding\n");
+	return 0;
+}
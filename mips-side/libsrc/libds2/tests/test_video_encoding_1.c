@@ -0,0 +1,150 @@
+/*
+ * This file is part of the C standard library for the Supercard DSTwo.
+ *
+ * Copyright 2017 Nebuleon Fumika <nebuleon.fumika@gmail.com>
+ *
+ * It is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with it.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Checks that _video_encoding_1, which packs palette entries two pixels at
+ * a time, is bit-exact with a plain lookup of every pixel, and that it fills
+ * in the packet header correctly.
+ *
+ * Each round makes a random palette of 1 to 252 colors in a random buffer,
+ * an image made of runs and noise over those colors with random upper bits,
+ * and sends it in packets starting at random even offsets.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "card_protocol.h"
+#include "globals.h"
+#include "video.h"
+#include "video_encoding_1.h"
+
+#define FRAME_PIXELS (DS_SCREEN_WIDTH * DS_SCREEN_HEIGHT)
+
+#define ROUNDS 1000
+
+uint16_t _video_main_palettes[MAIN_BUFFER_MAX][256];
+uint8_t _video_main_rev_palettes[MAIN_BUFFER_MAX][REV_PALETTE_SIZE];
+
+/* Spare pixels after the frame, because the encoder reads two pairs at a
+ * time and may read one pair past the last pixel. */
+static uint16_t frame[FRAME_PIXELS + 4] __attribute__((aligned (4)));
+
+/* Fills the palette of the given buffer with 'count' different colors, in
+ * ascending order like _make_palette. */
+static void make_palette(uint_fast8_t buffer, size_t count)
+{
+	static bool used[32768];
+	size_t i, n = 0;
+
+	memset(used, 0, sizeof(used));
+	while (n < count) {
+		uint16_t pixel = rand() & 0x7FFF;
+		if (!used[pixel]) {
+			used[pixel] = true;
+			n++;
+		}
+	}
+	n = 0;
+	for (i = 0; i < 32768; i++)
+		if (used[i])
+			_video_main_palettes[buffer][n++] = i;
+}
+
+static void make_frame(uint_fast8_t buffer, size_t count)
+{
+	size_t i = 0;
+
+	while (i < FRAME_PIXELS + 4) {
+		/* Runs of one color, of two alternating colors, or noise. */
+		size_t length = 1 + rand() % 64, kind = rand() % 3, j;
+		uint16_t a = _video_main_palettes[buffer][rand() % count],
+		         b = _video_main_palettes[buffer][rand() % count];
+
+		for (j = 0; j < length && i < FRAME_PIXELS + 4; j++, i++) {
+			uint16_t pixel = (kind == 0) ? a
+			               : (kind == 1) ? ((j & 1) ? b : a)
+			               : _video_main_palettes[buffer][rand() % count];
+			frame[i] = pixel | ((rand() & 1) << 15);
+		}
+	}
+}
+
+/* The palette entry for each color in the current round, or -1. */
+static int16_t reference[32768];
+
+static void make_reference(uint_fast8_t buffer, size_t count)
+{
+	size_t i;
+
+	memset(reference, 0xFF, sizeof(reference));
+	for (i = 0; i < count; i++)
+		reference[_video_main_palettes[buffer][i]] = i;
+}
+
+int main(void)
+{
+	unsigned int round;
+
+	srand(1);
+	for (round = 0; round < ROUNDS; round++) {
+		uint_fast8_t buffer = rand() % MAIN_BUFFER_MAX;
+		size_t count = 1 + rand() % 252, offset;
+
+		/* Leave the other buffers' reverse palettes stale, as they may be
+		 * on the DSTwo. */
+		make_palette(buffer, count);
+		make_frame(buffer, count);
+		_make_rev_palette(buffer, count);
+		make_reference(buffer, count);
+
+		offset = (rand() % (FRAME_PIXELS / 2)) * 2;
+		while (offset < FRAME_PIXELS) {
+			size_t n = _video_encoding_1(frame + offset, buffer, offset, FRAME_PIXELS - offset), i;
+			const uint8_t* data = (const uint8_t*) &_ds2_ds.vid_next_data;
+			bool end = offset + n == FRAME_PIXELS;
+
+			if (n != (FRAME_PIXELS - offset < 504 ? FRAME_PIXELS - offset : 504)
+			 || _ds2_ds.vid_header_1 != (DATA_KIND_VIDEO | DATA_ENCODING(1) | DATA_BYTE_COUNT(n))
+			 || _ds2_ds.vid_header_2 != (VIDEO_BUFFER(buffer) | VIDEO_PIXEL_OFFSET(offset)
+			                           | VIDEO_ENGINE_MAIN | (end ? VIDEO_END_FRAME : 0))
+			 || _ds2_ds.vid_next_ptr != &_ds2_ds.vid_next_data
+			 || _ds2_ds.vid_fixup) {
+				fprintf(stderr, "round %u, offset %zu: bad packet header\n", round, offset);
+				return 1;
+			}
+			for (i = 0; i < n; i++) {
+				int expected = reference[frame[offset + i] & 0x7FFF];
+				if (data[i] != expected) {
+					fprintf(stderr, "round %u, pixel %zu: got entry %u, expected %d\n",
+						round, offset + i, data[i], expected);
+					return 1;
+				}
+			}
+			offset += n;
+		}
+	}
+
+	printf("%u rounds bit-exact\n", ROUNDS);
+	return 0;
+}